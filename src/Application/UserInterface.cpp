@@ -3,24 +3,19 @@
 void GUI::init(Renderer2D& inRenderer2D)
 {
 	renderer2D = &inRenderer2D;
-
-	renderer2D->loadTexture(ATLAS_TEST);
-	width[ATLAS_TEST] = (float)renderer2D->width;
-	height[ATLAS_TEST] = (float)renderer2D->height;
 }
 
 void GUI::buildMainMenu()
 {
-	float xCentre = (((float)Window::instance()->width) - width[ATLAS_TEST]) / 2;
-	float yCentre = (((float)Window::instance()->height) - height[ATLAS_TEST]) / 2;
+	//The menu is laid out around the full sheet the buttons were drawn on, four buttons high.
+	vec2s buttonSize = renderer2D->atlas.getSprite(SPRITE_START_BUTTON).size;
 
-	vec2s spriteOffset = { .x = 1, .y = 1 };
-	vec2s buttonSize = { width[ATLAS_TEST], 128.f };
-	vec2s subSpriteSize = { width[ATLAS_TEST], 128.f };
+	float xCentre = (((float)Window::instance()->width) - buttonSize.x) / 2;
+	float yCentre = (((float)Window::instance()->height) - buttonSize.y * 4.f) / 2;
 
-	renderer2D->addQuad({ xCentre, yCentre - 40.f, 0.5f }, buttonSize, subSpriteSize, { 0, 3 }, spriteOffset, ATLAS_TEST);
-	addButton({ xCentre, yCentre + 100.f, 0.5f }, buttonSize, subSpriteSize, { 0, 2 }, spriteOffset, ATLAS_TEST, START_BUTTON);
-	addButton({ xCentre, yCentre + 240.f, 0.5f }, buttonSize, subSpriteSize, { 0, 1 }, spriteOffset, ATLAS_TEST, EXIT_BUTTON);
+	renderer2D->addSprite({ xCentre, yCentre - 40.f, 0.5f }, renderer2D->atlas.getSprite(SPRITE_MENU_TITLE).size, SPRITE_MENU_TITLE);
+	addButton({ xCentre, yCentre + 100.f, 0.5f }, buttonSize, SPRITE_START_BUTTON, START_BUTTON);
+	addButton({ xCentre, yCentre + 240.f, 0.5f }, buttonSize, SPRITE_EXIT_BUTTON, EXIT_BUTTON);
 }
 
 void GUI::buildGameUI()
@@ -33,9 +28,9 @@ void GUI::buildUI()
 	buildGameUI();
 }
 
-void GUI::addButton(vec3s position, vec2s size, vec2s spriteSize, vec2s rowAndColumn, vec2s offset, TextureAtlas atlas, UI uiElement)
+void GUI::addButton(vec3s position, vec2s size, SpriteID sprite, UI uiElement)
 {
-	renderer2D->addQuad(position, size, spriteSize, rowAndColumn, offset, atlas);
+	renderer2D->addSprite(position, size, sprite);
 	sUIRectangles[uiElement].x = position.x;
 	sUIRectangles[uiElement].y = position.y;
 	sUIRectangles[uiElement].width = size.x;
@@ -0,0 +1,409 @@
+#include "JobScheduler.hpp"
+
+#include "Assert.hpp"
+#include "Log.hpp"
+#include "Memory.hpp"
+#include "Numerics.hpp"
+
+#if defined(VOID_JOB_BENCHMARK)
+#include "Time.hpp"
+
+#include <math.h>
+#endif //VOID_JOB_BENCHMARK
+
+namespace
+{
+    //Worker index of the calling thread, UINT32_MAX for threads the scheduler didn't start.
+    thread_local uint32_t threadWorkerIndex = UINT32_MAX;
+
+    //Deques that have been spun on this many times give the core away.
+    static constexpr uint32_t JOB_DEQUE_SPINS = 64;
+}
+
+JobScheduler* JobScheduler::instance()
+{
+    static JobScheduler jobScheduler;
+    return &jobScheduler;
+}
+
+void JobScheduler::init(Allocator* inAllocator, int32_t workerCount)
+{
+    VOID_ASSERTM(initialised == false, "The job scheduler is already initialised.");
+
+    allocator = inAllocator;
+
+    JobSystemWithBarrier::Init(JOB_SCHEDULER_MAX_BARRIERS);
+    jobs.Init(JOB_SCHEDULER_MAX_JOBS, JOB_SCHEDULER_MAX_JOBS);
+
+    if (workerCount < 0)
+    {
+        workerCount = int32_t(std::thread::hardware_concurrency()) - 1;
+    }
+
+    //At least one thread so a job queued with nobody waiting on it still runs.
+    startWorkers(min(uint32_t(max(workerCount, 1)), JOB_SCHEDULER_MAX_WORKERS));
+
+    initialised = true;
+
+#if defined(VOID_JOB_BENCHMARK)
+    benchmark();
+#endif //VOID_JOB_BENCHMARK
+}
+
+void JobScheduler::shutdown()
+{
+    stopWorkers();
+    initialised = false;
+}
+
+JPH::JobHandle JobScheduler::createJob(const char* name, JobPriority priority, const JobFunction& function, JobCounter* counter, uint32_t dependencyCount)
+{
+    if (counter == nullptr)
+    {
+        return createPriorityJob(name, JPH::Color::sGrey, priority, function, dependencyCount);
+    }
+
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+    return createPriorityJob(name, JPH::Color::sGrey, priority, [function, counter]()
+    {
+        function();
+        counter->pending.fetch_sub(1, std::memory_order_release);
+    }, dependencyCount);
+}
+
+void JobScheduler::wait(JobCounter& counter)
+{
+    const uint32_t workerIndex = currentWorker();
+    while (counter.pending.load(std::memory_order_acquire) > 0)
+    {
+        PriorityJob* job = findJob(workerIndex);
+        if (job == nullptr)
+        {
+            //The last jobs are running on other threads.
+            std::this_thread::yield();
+            continue;
+        }
+
+        job->Execute();
+        job->Release();
+    }
+}
+
+int JobScheduler::GetMaxConcurrency() const
+{
+    return int(workerCount);
+}
+
+JPH::JobHandle JobScheduler::CreateJob(const char* inName, JPH::ColorArg inColor, const JobFunction& inJobFunction, JPH::uint32 inNumDependencies)
+{
+    return createPriorityJob(inName, inColor, JOB_PRIORITY_HIGH, inJobFunction, inNumDependencies);
+}
+
+void JobScheduler::QueueJob(Job* inJob)
+{
+    queue(static_cast<PriorityJob*>(inJob));
+    if (workerCount > 1)
+    {
+        wakeUp.Release();
+    }
+}
+
+void JobScheduler::QueueJobs(Job** inJobs, JPH::uint inNumJobs)
+{
+    for (JPH::uint i = 0; i < inNumJobs; ++i)
+    {
+        queue(static_cast<PriorityJob*>(inJobs[i]));
+    }
+
+    if (workerCount > 1 && inNumJobs > 0)
+    {
+        wakeUp.Release(min(uint32_t(inNumJobs), workerCount - 1));
+    }
+}
+
+void JobScheduler::FreeJob(Job* inJob)
+{
+    jobs.DestructObject(static_cast<PriorityJob*>(inJob));
+}
+
+void JobScheduler::JobDeque::pushBottom(PriorityJob* job)
+{
+    lock();
+    VOID_ASSERTM(bottom - top < JOB_SCHEDULER_MAX_JOBS, "Job deque is full.");
+    jobs[bottom % JOB_SCHEDULER_MAX_JOBS] = job;
+    ++bottom;
+    unlock();
+}
+
+JobScheduler::PriorityJob* JobScheduler::JobDeque::popBottom()
+{
+    PriorityJob* job = nullptr;
+
+    lock();
+    if (bottom != top)
+    {
+        --bottom;
+        job = jobs[bottom % JOB_SCHEDULER_MAX_JOBS];
+    }
+    unlock();
+
+    return job;
+}
+
+JobScheduler::PriorityJob* JobScheduler::JobDeque::stealTop()
+{
+    PriorityJob* job = nullptr;
+
+    lock();
+    if (bottom != top)
+    {
+        job = jobs[top % JOB_SCHEDULER_MAX_JOBS];
+        ++top;
+    }
+    unlock();
+
+    return job;
+}
+
+void JobScheduler::JobDeque::lock()
+{
+    uint32_t spins = 0;
+    while (locked.exchange(true, std::memory_order_acquire))
+    {
+        while (locked.load(std::memory_order_relaxed))
+        {
+            if (++spins >= JOB_DEQUE_SPINS)
+            {
+                std::this_thread::yield();
+                spins = 0;
+            }
+        }
+    }
+}
+
+void JobScheduler::JobDeque::unlock()
+{
+    locked.store(false, std::memory_order_release);
+}
+
+void JobScheduler::startWorkers(uint32_t threadCount)
+{
+    workerCount = threadCount + 1;
+    quit = false;
+    queuedJobs = 0;
+
+    const uint32_t dequeCount = workerCount * JOB_PRIORITY_COUNT;
+    deques = (JobDeque*)void_allocaa(sizeof(JobDeque) * dequeCount, allocator, alignof(JobDeque));
+    dequeStorage = (PriorityJob**)void_alloca(sizeof(PriorityJob*) * JOB_SCHEDULER_MAX_JOBS * dequeCount, allocator);
+    for (uint32_t i = 0; i < dequeCount; ++i)
+    {
+        new (&deques[i]) JobDeque;
+        deques[i].jobs = dequeStorage + i * JOB_SCHEDULER_MAX_JOBS;
+    }
+
+    threadWorkerIndex = 0;
+    for (uint32_t i = 1; i < workerCount; ++i)
+    {
+        threads[i - 1] = std::thread([this, i]() { workerMain(i); });
+    }
+}
+
+void JobScheduler::stopWorkers()
+{
+    if (deques == nullptr)
+    {
+        return;
+    }
+
+    quit = true;
+    if (workerCount > 1)
+    {
+        wakeUp.Release(workerCount - 1);
+    }
+    for (uint32_t i = 1; i < workerCount; ++i)
+    {
+        threads[i - 1].join();
+    }
+
+    //Anything still queued holds a reference, running it lets the job be freed.
+    for (PriorityJob* job = findJob(0); job != nullptr; job = findJob(0))
+    {
+        job->Execute();
+        job->Release();
+    }
+
+    for (uint32_t i = 0; i < workerCount * JOB_PRIORITY_COUNT; ++i)
+    {
+        deques[i].~JobDeque();
+    }
+
+    void_free(deques, allocator);
+    void_free(dequeStorage, allocator);
+    deques = nullptr;
+    dequeStorage = nullptr;
+    workerCount = 0;
+}
+
+void JobScheduler::workerMain(uint32_t workerIndex)
+{
+    threadWorkerIndex = workerIndex;
+
+    while (quit.load(std::memory_order_relaxed) == false)
+    {
+        PriorityJob* job = findJob(workerIndex);
+        if (job == nullptr)
+        {
+            wakeUp.Acquire();
+            continue;
+        }
+
+        job->Execute();
+        job->Release();
+    }
+}
+
+JPH::JobHandle JobScheduler::createPriorityJob(const char* name, JPH::ColorArg colour, JobPriority priority, const JobFunction& function, uint32_t dependencyCount)
+{
+    uint32_t index;
+    for (;;)
+    {
+        index = jobs.ConstructObject(name, colour, this, function, dependencyCount, priority);
+        if (index != JPH::FixedSizeFreeList<PriorityJob>::cInvalidObjectIndex)
+        {
+            break;
+        }
+
+        //Jobs a barrier already ran stay in the deques until they're popped, running them frees their slots.
+        //Otherwise the other threads hold the rest and will release them shortly.
+        PriorityJob* queued = findJob(currentWorker());
+        if (queued)
+        {
+            queued->Execute();
+            queued->Release();
+            continue;
+        }
+
+        std::this_thread::yield();
+    }
+
+    PriorityJob* job = &jobs.Get(index);
+
+    //The handle keeps the job alive, it may be finished before this returns.
+    JPH::JobHandle handle(job);
+    if (dependencyCount == 0)
+    {
+        QueueJob(job);
+    }
+
+    return handle;
+}
+
+void JobScheduler::queue(PriorityJob* job)
+{
+    //The deque holds a reference until the job has run.
+    job->AddRef();
+
+    deques[currentWorker() * JOB_PRIORITY_COUNT + job->priority].pushBottom(job);
+    queuedJobs.fetch_add(1, std::memory_order_release);
+}
+
+JobScheduler::PriorityJob* JobScheduler::findJob(uint32_t workerIndex)
+{
+    if (queuedJobs.load(std::memory_order_acquire) == 0)
+    {
+        return nullptr;
+    }
+
+    for (uint32_t priority = 0; priority < JOB_PRIORITY_COUNT; ++priority)
+    {
+        PriorityJob* job = deques[workerIndex * JOB_PRIORITY_COUNT + priority].popBottom();
+
+        for (uint32_t i = 1; i < workerCount && job == nullptr; ++i)
+        {
+            const uint32_t victim = (workerIndex + i) % workerCount;
+            job = deques[victim * JOB_PRIORITY_COUNT + priority].stealTop();
+        }
+
+        if (job)
+        {
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+uint32_t JobScheduler::currentWorker() const
+{
+    return threadWorkerIndex < workerCount ? threadWorkerIndex : 0;
+}
+
+#if defined(VOID_JOB_BENCHMARK)
+void JobScheduler::benchmark()
+{
+    static constexpr uint32_t BENCHMARK_JOBS = 4096;
+    static constexpr uint32_t BENCHMARK_ITERATIONS = 2000;
+    static constexpr uint32_t BENCHMARK_RUNS = 5;
+
+    const uint32_t threadCount = workerCount - 1;
+    double singleMS = 0.0;
+
+    vprint("Job scheduler benchmark, %u jobs of %u iterations, best of %u runs.\n", BENCHMARK_JOBS, BENCHMARK_ITERATIONS, BENCHMARK_RUNS);
+
+    //Threads beyond the calling one, 0 has the calling thread do everything while it waits.
+    for (uint32_t threads = 0;; threads = threads == 0 ? 1 : min(threads * 2, threadCount))
+    {
+        stopWorkers();
+        startWorkers(threads);
+
+        double bestMS = 1e30;
+        double bestEmptyMS = 1e30;
+        for (uint32_t run = 0; run < BENCHMARK_RUNS; ++run)
+        {
+            std::atomic<uint32_t> sink{ 0 };
+
+            JobCounter counter;
+            int64_t start = timeNow();
+            for (uint32_t i = 0; i < BENCHMARK_JOBS; ++i)
+            {
+                createJob("BenchmarkJob", JOB_PRIORITY_NORMAL, [&sink, i]()
+                {
+                    float value = float(i);
+                    for (uint32_t iteration = 0; iteration < BENCHMARK_ITERATIONS; ++iteration)
+                    {
+                        value = sqrtf(value * value + 1.f);
+                    }
+                    sink.fetch_add(uint32_t(value), std::memory_order_relaxed);
+                }, &counter);
+            }
+            wait(counter);
+            bestMS = min(bestMS, timeDeltaMilliseconds(start, timeNow()));
+
+            //Nothing to do in the job, so this is the cost of creating, queueing, stealing and freeing one.
+            start = timeNow();
+            for (uint32_t i = 0; i < BENCHMARK_JOBS; ++i)
+            {
+                createJob("BenchmarkEmptyJob", JOB_PRIORITY_NORMAL, []() {}, &counter);
+            }
+            wait(counter);
+            bestEmptyMS = min(bestEmptyMS, timeDeltaMilliseconds(start, timeNow()));
+        }
+
+        if (threads == 0)
+        {
+            singleMS = bestMS;
+        }
+
+        vprint("    %2u workers: %8.3fms, %5.2fx, %.3fus per empty job.\n", threads + 1, bestMS, singleMS / bestMS, bestEmptyMS * 1000.0 / BENCHMARK_JOBS);
+
+        if (threads == threadCount)
+        {
+            break;
+        }
+    }
+
+    stopWorkers();
+    startWorkers(threadCount);
+}
+#endif //VOID_JOB_BENCHMARK
@@ -0,0 +1,127 @@
+#ifndef JOB_SCHEDULER_HDR
+#define JOB_SCHEDULER_HDR
+
+#include "Platform.hpp"
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/JobSystemWithBarrier.h>
+#include <Jolt/Core/FixedSizeFreeList.h>
+#include <Jolt/Core/Semaphore.h>
+
+#include <atomic>
+#include <thread>
+
+struct Allocator;
+
+//Define this to time the same batch of jobs with one worker up to all of them when the scheduler starts and log the speed up.
+//#define VOID_JOB_BENCHMARK
+
+//Jobs alive at once, Jolt alone may have cMaxPhysicsJobs of them. Every deque can hold all of them so a push never fails.
+static constexpr uint32_t JOB_SCHEDULER_MAX_JOBS = 4096;
+static constexpr uint32_t JOB_SCHEDULER_MAX_BARRIERS = 32;
+static constexpr uint32_t JOB_SCHEDULER_MAX_WORKERS = 63;
+
+enum JobPriority : uint8_t
+{
+    //Work the frame is waiting on, the physics step and anything on its critical path.
+    JOB_PRIORITY_HIGH,
+    JOB_PRIORITY_NORMAL,
+    //Background work such as asset decoding, only run when nothing else is queued.
+    JOB_PRIORITY_LOW,
+    JOB_PRIORITY_COUNT
+};
+
+//Jobs still to finish. A job created with a counter increments it straight away and decrements it once it has run.
+struct JobCounter
+{
+    std::atomic<uint32_t> pending{ 0 };
+};
+
+//Engine wide work-stealing scheduler, it is also Jolt's job system so physics and everything else share one set of threads.
+//Every thread has a deque per priority, it pushes and pops its own jobs at the bottom and idle threads steal from the top of the
+//others. The thread that initialises it is worker 0 and runs jobs whenever it waits on a counter or a barrier.
+struct JobScheduler final : public JPH::JobSystemWithBarrier
+{
+    static JobScheduler* instance();
+
+    //Worker threads besides the calling one, -1 leaves a core for everything else.
+    void init(Allocator* inAllocator, int32_t workerCount = -1);
+    void shutdown();
+
+    //Engine jobs, the function runs once the dependency count is removed. The counter is optional.
+    JPH::JobHandle createJob(const char* name, JobPriority priority, const JobFunction& function, JobCounter* counter = nullptr, uint32_t dependencyCount = 0);
+    //Runs any queued jobs on the calling thread until the counter reaches zero.
+    void wait(JobCounter& counter);
+
+#if defined(VOID_JOB_BENCHMARK)
+    void benchmark();
+#endif //VOID_JOB_BENCHMARK
+
+    //JPH::JobSystem, the jobs Jolt creates are high priority because the frame waits on the step.
+    int GetMaxConcurrency() const override;
+    JPH::JobHandle CreateJob(const char* inName, JPH::ColorArg inColor, const JobFunction& inJobFunction, JPH::uint32 inNumDependencies = 0) override;
+
+protected:
+    void QueueJob(Job* inJob) override;
+    void QueueJobs(Job** inJobs, JPH::uint inNumJobs) override;
+    void FreeJob(Job* inJob) override;
+
+private:
+    struct PriorityJob : public Job
+    {
+        PriorityJob(const char* inName, JPH::ColorArg inColor, JobSystem* inJobSystem, const JobFunction& inJobFunction, JPH::uint32 inNumDependencies, JobPriority inPriority)
+            : Job(inName, inColor, inJobSystem, inJobFunction, inNumDependencies), priority(inPriority)
+        {
+        }
+
+        JobPriority priority;
+    };
+
+    //Ring of queued jobs behind a spin lock, the critical sections are a few instructions so the lock is rarely contended.
+    struct alignas(64) JobDeque
+    {
+        void pushBottom(PriorityJob* job);
+        PriorityJob* popBottom();
+        PriorityJob* stealTop();
+
+        void lock();
+        void unlock();
+
+        PriorityJob** jobs = nullptr;
+        uint32_t top = 0;
+        uint32_t bottom = 0;
+        std::atomic<bool> locked{ false };
+    };
+
+    void startWorkers(uint32_t workerCount);
+    void stopWorkers();
+    void workerMain(uint32_t workerIndex);
+
+    JPH::JobHandle createPriorityJob(const char* name, JPH::ColorArg colour, JobPriority priority, const JobFunction& function, uint32_t dependencyCount);
+    void queue(PriorityJob* job);
+    //Own deque first, then the others starting with the next worker, one priority at a time.
+    PriorityJob* findJob(uint32_t workerIndex);
+    //Deque of the calling thread, threads the scheduler doesn't know use worker 0's.
+    uint32_t currentWorker() const;
+
+    JPH::FixedSizeFreeList<PriorityJob> jobs;
+
+    //Indexed by worker then priority.
+    JobDeque* deques = nullptr;
+    PriorityJob** dequeStorage = nullptr;
+
+    std::thread threads[JOB_SCHEDULER_MAX_WORKERS];
+    //Workers including the one that initialised the scheduler.
+    uint32_t workerCount = 0;
+
+    //Jobs in all deques, lets an idle worker go back to sleep without looking through every deque.
+    std::atomic<uint32_t> queuedJobs{ 0 };
+    //Released once per queued job, sleeping workers acquire it.
+    JPH::Semaphore wakeUp;
+    std::atomic<bool> quit{ false };
+
+    Allocator* allocator = nullptr;
+    bool initialised = false;
+};
+
+#endif // !JOB_SCHEDULER_HDR
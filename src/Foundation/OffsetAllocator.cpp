@@ -0,0 +1,107 @@
+#include "OffsetAllocator.hpp"
+
+void OffsetAllocator::init(Allocator* allocator, uint32_t newSize)
+{
+    size = newSize;
+    usedSize = 0;
+
+    freeRanges.init(allocator, 16);
+    freeRanges.push({ 0, size });
+}
+
+void OffsetAllocator::shutdown()
+{
+    freeRanges.shutdown();
+
+    size = 0;
+    usedSize = 0;
+}
+
+uint32_t OffsetAllocator::allocate(uint32_t allocationSize, uint32_t alignment)
+{
+    VOID_ASSERTM(allocationSize > 0 && alignment > 0, "Offset allocations need a size and an alignment.");
+
+    for (uint32_t i = 0; i < freeRanges.size; ++i)
+    {
+        Range& range = freeRanges[i];
+
+        const uint32_t alignedOffset = ((range.offset + alignment - 1) / alignment) * alignment;
+        const uint32_t padding = alignedOffset - range.offset;
+        if (padding + allocationSize > range.size)
+        {
+            continue;
+        }
+
+        const uint32_t remainingOffset = alignedOffset + allocationSize;
+        const uint32_t remainingSize = range.size - padding - allocationSize;
+
+        //The alignment padding stays free in front of the allocation.
+        if (padding > 0)
+        {
+            range.size = padding;
+            if (remainingSize > 0)
+            {
+                freeRanges.push({});
+                for (uint32_t j = freeRanges.size - 1; j > i + 1; --j)
+                {
+                    freeRanges[j] = freeRanges[j - 1];
+                }
+                freeRanges[i + 1] = { remainingOffset, remainingSize };
+            }
+        }
+        else if (remainingSize > 0)
+        {
+            range = { remainingOffset, remainingSize };
+        }
+        else
+        {
+            freeRanges.erase(i);
+        }
+
+        usedSize += allocationSize;
+        return alignedOffset;
+    }
+
+    return INVALID_OFFSET;
+}
+
+void OffsetAllocator::free(uint32_t offset, uint32_t allocationSize)
+{
+    VOID_ASSERTM(offset + allocationSize <= size, "Freeing a range outside of the allocator, offset %u size %u.", offset, allocationSize);
+
+    //Find the first free range after the freed one.
+    uint32_t next = 0;
+    while (next < freeRanges.size && freeRanges[next].offset < offset)
+    {
+        ++next;
+    }
+
+    const bool mergePrevious = next > 0 && freeRanges[next - 1].offset + freeRanges[next - 1].size == offset;
+    const bool mergeNext = next < freeRanges.size && offset + allocationSize == freeRanges[next].offset;
+
+    if (mergePrevious && mergeNext)
+    {
+        freeRanges[next - 1].size += allocationSize + freeRanges[next].size;
+        freeRanges.erase(next);
+    }
+    else if (mergePrevious)
+    {
+        freeRanges[next - 1].size += allocationSize;
+    }
+    else if (mergeNext)
+    {
+        freeRanges[next].offset = offset;
+        freeRanges[next].size += allocationSize;
+    }
+    else
+    {
+        freeRanges.push({});
+        for (uint32_t j = freeRanges.size - 1; j > next; --j)
+        {
+            freeRanges[j] = freeRanges[j - 1];
+        }
+        freeRanges[next] = { offset, allocationSize };
+    }
+
+    usedSize -= allocationSize;
+}
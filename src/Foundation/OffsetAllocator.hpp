@@ -0,0 +1,32 @@
+#ifndef OFFSET_ALLOCATOR_HDR
+#define OFFSET_ALLOCATOR_HDR
+
+#include "Array.hpp"
+
+static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+//Hands out ranges of a fixed size resource (for example a GPU buffer) as offsets, it never touches the memory itself.
+//Free ranges are kept sorted by offset and merged with their neighbours when freed.
+struct OffsetAllocator
+{
+    void init(Allocator* allocator, uint32_t newSize);
+    void shutdown();
+
+    //Alignment does not need to be a power of two, so a range can be aligned to a vertex stride.
+    //Returns INVALID_OFFSET when there is no free range big enough.
+    uint32_t allocate(uint32_t allocationSize, uint32_t alignment = 1);
+    void free(uint32_t offset, uint32_t allocationSize);
+
+    struct Range
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    Array<Range> freeRanges;
+
+    uint32_t size = 0;
+    uint32_t usedSize = 0;
+};
+
+#endif // !OFFSET_ALLOCATOR_HDR
@@ -9,6 +9,13 @@
 #include "Graphics/LoadGLTF.hpp"
 #include "Graphics/ShaderData.hpp"
 #include "Graphics/Skybox.hpp"
+#include "Graphics/FrustumCulling.hpp"
+#include "Graphics/ClusterCulling.hpp"
+#include "Graphics/FrameGraph.hpp"
+#include "Graphics/LightCulling.hpp"
+#include "Graphics/DepthPyramid.hpp"
+
+#include "Game/TransformExtractor.hpp"
 
 #include "cglm/struct/mat3.h"
 #include "cglm/struct/mat4.h"
@@ -36,41 +43,303 @@ namespace
     PipelineHandle mainPipeline;
     PipelineHandle debugPipeline;
 
-    DescriptorSetLayoutHandle mainDescriptorSetLayout;
-
     BufferHandle positionalBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle visibleIndexBuffer[FRAMES_IN_FLIGHT];
     BufferHandle debugGlobalBuffer;
 
-    void uploadMaterial(MaterialData& meshData, const MeshDraw& meshDraw)
+    InstanceCuller instanceCuller;
+    GPUCuller gpuCuller;
+    ClusterCuller clusterCuller;
+    LightCuller lightCuller;
+    DepthPyramid depthPyramid;
+
+    TransformExtractor transformExtractor;
+    //The positional buffers stay mapped so the extraction jobs can store into them directly.
+    EntityData* mappedPositions[FRAMES_IN_FLIGHT];
+
+#if defined(VOID_LIGHT_BENCHMARK)
+    static constexpr uint32_t LIGHT_BENCHMARK_COUNT = 1000;
+    static constexpr uint32_t LIGHT_BENCHMARK_FRAMES = 600;
+    uint32_t lightBenchmarkFrame = 0;
+    double lightBenchmarkUpdateMS = 0.0;
+#endif //VOID_LIGHT_BENCHMARK
+
+    static constexpr uint16_t INVALID_SCENE_TEXTURE_INDEX = UINT16_MAX;
+
+    //Everything the frame graph passes need that changes per frame.
+    struct FramePassData
+    {
+        Game* game;
+        PushConstants pushConstants;
+        Frustum frustum;
+        mat4s globalModel;
+        //The transient depth is recreated on resize, so the pyramid pass looks its texture up every frame.
+        uint32_t depthResource;
+    };
+
+    FrameGraph frameGraph;
+    FramePassData framePassData;
+
+    //The late occlusion phase only runs on top of the GPU culler.
+    bool occlusionActive(const Game& game)
+    {
+        return game.gpuCulling && game.occlusionCulling;
+    }
+
+    void instanceCullingPass(CommandBuffer& commandBuffer, void* userData)
     {
-        meshData.textures[0] = meshDraw.diffuseTextureIndex;
-        meshData.textures[1] = meshDraw.roughnessTextureIndex;
-        meshData.textures[2] = meshDraw.normalTextureIndex;
-        meshData.textures[3] = meshDraw.occlusionTextureIndex;
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        GPUDevice& gpu = *data.game->gpu;
+        if (data.game->gpuCulling)
+        {
+            gpuCuller.cull(commandBuffer, data.frustum, positionalBuffer[gpu.currentFrame], visibleIndexBuffer[gpu.currentFrame], gpu.currentFrame, 
+                           data.game->occlusionCulling ? CULLING_PHASE_EARLY : CULLING_PHASE_ALL);
+        }
+    }
 
-        meshData.emissiveFactor =
+    void instanceCullingLatePass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        GPUDevice& gpu = *data.game->gpu;
+        if (occlusionActive(*data.game))
         {
-            meshDraw.emissiveFactor.x,
-            meshDraw.emissiveFactor.y,
-            meshDraw.emissiveFactor.z
-        };
-
-        meshData.emissiveTextureIndex = meshDraw.emisiveTextureIndex;
-
-        meshData.baseColourFactor = meshDraw.baseColourFactor;
-        meshData.metallicRoughnessOcclusionFactor = meshDraw.metallicRoughnessOcclusionFactor;
-        meshData.alphaCutoff = meshDraw.alphaCutoff;
-        meshData.iorFactor = meshDraw.iorFactor;
-        meshData.specularValue = meshDraw.specularValue;
-        meshData.flags = meshDraw.flags;
-
-        // NOTE: for left-handed systems (as defined in cglm) need to invert positive and negative Z.
-        mat4s model = meshDraw.model;
-        meshData.model = model;
-        meshData.modelInv = glms_mat4_inv(glms_mat4_transpose(model));
+            CullingOcclusion occlusion{};
+            depthPyramid.fillOcclusion(gpu, data.game->gameCamera.internal3DCamera, data.globalModel, gpu.currentFrame, occlusion);
+            gpuCuller.cull(commandBuffer, data.frustum, positionalBuffer[gpu.currentFrame], visibleIndexBuffer[gpu.currentFrame], gpu.currentFrame, 
+                           CULLING_PHASE_LATE, &occlusion);
+        }
     }
 
-    static constexpr uint16_t INVALID_SCENE_TEXTURE_INDEX = UINT16_MAX;
+    void lightCullingPass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        const Camera& camera = data.game->gameCamera.internal3DCamera;
+        lightCuller.cull(commandBuffer, camera.view, camera.projection, camera.farPlane, data.game->gpu->currentFrame);
+    }
+
+    void clusterCullingPass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        GPUDevice& gpu = *data.game->gpu;
+        if (data.game->gpuCulling)
+        {
+            clusterCuller.cull(commandBuffer, gpuCuller, data.frustum, positionalBuffer[gpu.currentFrame], visibleIndexBuffer[gpu.currentFrame], 
+                               data.game->scene.geometry, gpu.currentFrame);
+        }
+    }
+
+    void clusterCullingLatePass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        if (occlusionActive(*data.game))
+        {
+            clusterCullingPass(commandBuffer, userData);
+        }
+    }
+
+    void depthPyramidPass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        if (occlusionActive(*data.game))
+        {
+            depthPyramid.build(commandBuffer, frameGraph.getTexture(data.depthResource), data.game->gpu->currentFrame);
+        }
+    }
+
+    void scenePass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        GPUDevice& gpu = *data.game->gpu;
+        PushConstants& pushConstants = data.pushConstants;
+
+        commandBuffer.setScissor(nullptr);
+        commandBuffer.setViewport(nullptr);
+
+        commandBuffer.bindPipeline(mainPipeline);
+
+        commandBuffer.bindlessDescriptorSet(0);
+
+        //Every model lives in the shared geometry buffer, so each pipeline draws everything visible with one indirect call.
+        pushConstants.vertexDataAddress = gpu.accessBuffer(data.game->scene.geometry.vertexBuffer)->bufferAddress;
+        pushConstants.drawCommandAddress = gpu.accessBuffer(gpuCuller.drawCommandBuffer[gpu.currentFrame])->bufferAddress;
+
+        vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        commandBuffer.bindIndexBuffer(data.game->scene.geometry.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+        gpuCuller.drawMeshes(commandBuffer, gpu.currentFrame, data.game->gpuCulling);
+
+        //LOD 0 of clustered meshes is drawn from the culled cluster index lists.
+        pushConstants.drawCommandAddress = gpu.accessBuffer(clusterCuller.drawCommandBuffer[gpu.currentFrame])->bufferAddress;
+        vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        clusterCuller.draw(commandBuffer, gpu.currentFrame, data.game->gpuCulling);
+
+        pushConstants.drawCommandAddress = gpu.accessBuffer(gpuCuller.drawCommandBuffer[gpu.currentFrame])->bufferAddress;
+        commandBuffer.bindIndexBuffer(data.game->scene.geometry.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    }
+
+    //Draws the instances that became visible, the counts and commands now hold the late phase.
+    void sceneLatePass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        if (occlusionActive(*data.game))
+        {
+            scenePass(commandBuffer, userData);
+        }
+    }
+
+    void debugPass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        if (data.game->debugRenderer == false)
+        {
+            return;
+        }
+
+        commandBuffer.bindPipeline(debugPipeline);
+
+        //Every entity has a sphere collider, so the debug spheres reuse the visible ranges of the scene models.
+        VOID_ASSERTM(data.game->scene.debugModels[DebugModels::SPHERE].meshDraws.size == 1, "Collider geometry have have one draw call.\n");
+
+        vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, 
+                           sizeof(data.pushConstants), &data.pushConstants);
+
+        gpuCuller.drawDebugSpheres(commandBuffer, data.game->gpu->currentFrame, data.game->gpuCulling);
+    }
+
+    //Each phase draws the spheres of the instances it drew.
+    void debugLatePass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        if (occlusionActive(*data.game))
+        {
+            debugPass(commandBuffer, userData);
+        }
+    }
+
+    void skyboxPass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        drawSkybox(*data.game->gpu, commandBuffer, data.pushConstants);
+    }
+
+    void userInterfacePass(CommandBuffer& commandBuffer, void* userData)
+    {
+        FramePassData& data = *static_cast<FramePassData*>(userData);
+        data.game->renderer2D.drawQuad(commandBuffer);
+    }
+
+    //The culling passes are never culled by the graph while the scene reads their results, the CPU culler leaves them empty.
+    //With occlusion culling the culling and scene passes run twice. The early half draws what was visible last frame, the depth pyramid
+    //is built from that depth and the late half draws what the pyramid doesn't hide. The late passes leave everything untouched when it's off.
+    void buildFrameGraph(Game& game)
+    {
+        framePassData.game = &game;
+
+        frameGraph.init(*game.gpu, &MemoryService::instance()->systemAllocator);
+
+        const uint32_t swapchain = frameGraph.importSwapchain();
+        frameGraph.setOutput(swapchain);
+        const uint32_t depth = frameGraph.createTexture("Depth", VK_FORMAT_D32_SFLOAT, 0, 0);
+        framePassData.depthResource = depth;
+
+        const uint32_t cullingCounts = frameGraph.importBuffer("Culling Counts");
+        const uint32_t drawCommands = frameGraph.importBuffer("Draw Commands");
+        const uint32_t visibleIndices = frameGraph.importBuffer("Visible Indices");
+        const uint32_t clusterCounts = frameGraph.importBuffer("Cluster Counts");
+        const uint32_t clusterIndices = frameGraph.importBuffer("Cluster Indices");
+        const uint32_t clusterDrawCommands = frameGraph.importBuffer("Cluster Draw Commands");
+        const uint32_t lightGrid = frameGraph.importBuffer("Light Grid");
+        const uint32_t lightIndices = frameGraph.importBuffer("Light Indices");
+        const uint32_t instanceVisibility = frameGraph.importBuffer("Instance Visibility");
+        const uint32_t depthPyramidLevels = frameGraph.importBuffer("Depth Pyramid");
+
+        //The counters are cleared with a transfer before the dispatches.
+        const uint32_t instanceCulling = frameGraph.addPass("Instance Culling", FRAME_GRAPH_COMPUTE, instanceCullingPass, &framePassData);
+        frameGraph.use(instanceCulling, cullingCounts, FRAME_GRAPH_TRANSFER_WRITE | FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(instanceCulling, drawCommands, FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(instanceCulling, visibleIndices, FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(instanceCulling, instanceVisibility, FRAME_GRAPH_STORAGE_READ);
+
+        const uint32_t clusterCulling = frameGraph.addPass("Cluster Culling", FRAME_GRAPH_COMPUTE, clusterCullingPass, &framePassData);
+        frameGraph.use(clusterCulling, cullingCounts, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(clusterCulling, visibleIndices, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(clusterCulling, clusterCounts, FRAME_GRAPH_TRANSFER_WRITE | FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(clusterCulling, clusterIndices, FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(clusterCulling, clusterDrawCommands, FRAME_GRAPH_STORAGE_WRITE);
+
+        const uint32_t lightCulling = frameGraph.addPass("Light Culling", FRAME_GRAPH_COMPUTE, lightCullingPass, &framePassData);
+        frameGraph.use(lightCulling, lightGrid, FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(lightCulling, lightIndices, FRAME_GRAPH_STORAGE_WRITE);
+
+        //The draw commands are also read in the shaders for their material.
+        const uint32_t scene = frameGraph.addPass("Scene", FRAME_GRAPH_GRAPHICS, scenePass, &framePassData);
+        frameGraph.use(scene, swapchain, FRAME_GRAPH_COLOUR_ATTACHMENT);
+        frameGraph.use(scene, depth, FRAME_GRAPH_DEPTH_ATTACHMENT);
+        frameGraph.use(scene, cullingCounts, FRAME_GRAPH_INDIRECT_READ);
+        frameGraph.use(scene, drawCommands, FRAME_GRAPH_INDIRECT_READ | FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(scene, visibleIndices, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(scene, clusterCounts, FRAME_GRAPH_INDIRECT_READ);
+        frameGraph.use(scene, clusterIndices, FRAME_GRAPH_INDEX_READ);
+        frameGraph.use(scene, clusterDrawCommands, FRAME_GRAPH_INDIRECT_READ | FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(scene, lightGrid, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(scene, lightIndices, FRAME_GRAPH_STORAGE_READ);
+
+        const uint32_t debug = frameGraph.addPass("Debug", FRAME_GRAPH_GRAPHICS, debugPass, &framePassData);
+        frameGraph.use(debug, swapchain, FRAME_GRAPH_COLOUR_ATTACHMENT);
+        frameGraph.use(debug, depth, FRAME_GRAPH_DEPTH_ATTACHMENT);
+        frameGraph.use(debug, cullingCounts, FRAME_GRAPH_INDIRECT_READ);
+        frameGraph.use(debug, drawCommands, FRAME_GRAPH_INDIRECT_READ | FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(debug, visibleIndices, FRAME_GRAPH_STORAGE_READ);
+
+        const uint32_t pyramid = frameGraph.addPass("Depth Pyramid", FRAME_GRAPH_COMPUTE, depthPyramidPass, &framePassData);
+        frameGraph.use(pyramid, depth, FRAME_GRAPH_SAMPLED);
+        frameGraph.use(pyramid, depthPyramidLevels, FRAME_GRAPH_STORAGE_WRITE);
+
+        const uint32_t instanceCullingLate = frameGraph.addPass("Instance Culling Late", FRAME_GRAPH_COMPUTE, instanceCullingLatePass, &framePassData);
+        frameGraph.use(instanceCullingLate, cullingCounts, FRAME_GRAPH_TRANSFER_WRITE | FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(instanceCullingLate, drawCommands, FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(instanceCullingLate, visibleIndices, FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(instanceCullingLate, instanceVisibility, FRAME_GRAPH_STORAGE_READ | FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(instanceCullingLate, depthPyramidLevels, FRAME_GRAPH_STORAGE_READ);
+
+        const uint32_t clusterCullingLate = frameGraph.addPass("Cluster Culling Late", FRAME_GRAPH_COMPUTE, clusterCullingLatePass, &framePassData);
+        frameGraph.use(clusterCullingLate, cullingCounts, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(clusterCullingLate, visibleIndices, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(clusterCullingLate, clusterCounts, FRAME_GRAPH_TRANSFER_WRITE | FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(clusterCullingLate, clusterIndices, FRAME_GRAPH_STORAGE_WRITE);
+        frameGraph.use(clusterCullingLate, clusterDrawCommands, FRAME_GRAPH_STORAGE_WRITE);
+
+        const uint32_t sceneLate = frameGraph.addPass("Scene Late", FRAME_GRAPH_GRAPHICS, sceneLatePass, &framePassData);
+        frameGraph.use(sceneLate, swapchain, FRAME_GRAPH_COLOUR_ATTACHMENT);
+        frameGraph.use(sceneLate, depth, FRAME_GRAPH_DEPTH_ATTACHMENT);
+        frameGraph.use(sceneLate, cullingCounts, FRAME_GRAPH_INDIRECT_READ);
+        frameGraph.use(sceneLate, drawCommands, FRAME_GRAPH_INDIRECT_READ | FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(sceneLate, visibleIndices, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(sceneLate, clusterCounts, FRAME_GRAPH_INDIRECT_READ);
+        frameGraph.use(sceneLate, clusterIndices, FRAME_GRAPH_INDEX_READ);
+        frameGraph.use(sceneLate, clusterDrawCommands, FRAME_GRAPH_INDIRECT_READ | FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(sceneLate, lightGrid, FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(sceneLate, lightIndices, FRAME_GRAPH_STORAGE_READ);
+
+        const uint32_t debugLate = frameGraph.addPass("Debug Late", FRAME_GRAPH_GRAPHICS, debugLatePass, &framePassData);
+        frameGraph.use(debugLate, swapchain, FRAME_GRAPH_COLOUR_ATTACHMENT);
+        frameGraph.use(debugLate, depth, FRAME_GRAPH_DEPTH_ATTACHMENT);
+        frameGraph.use(debugLate, cullingCounts, FRAME_GRAPH_INDIRECT_READ);
+        frameGraph.use(debugLate, drawCommands, FRAME_GRAPH_INDIRECT_READ | FRAME_GRAPH_STORAGE_READ);
+        frameGraph.use(debugLate, visibleIndices, FRAME_GRAPH_STORAGE_READ);
+
+        const uint32_t skybox = frameGraph.addPass("Skybox", FRAME_GRAPH_GRAPHICS, skyboxPass, &framePassData);
+        frameGraph.use(skybox, swapchain, FRAME_GRAPH_COLOUR_ATTACHMENT);
+        frameGraph.use(skybox, depth, FRAME_GRAPH_DEPTH_ATTACHMENT);
+
+        const uint32_t userInterface = frameGraph.addPass("2D", FRAME_GRAPH_GRAPHICS, userInterfacePass, &framePassData);
+        frameGraph.use(userInterface, swapchain, FRAME_GRAPH_COLOUR_ATTACHMENT);
+        frameGraph.use(userInterface, depth, FRAME_GRAPH_DEPTH_ATTACHMENT);
+
+        frameGraph.compile();
+    }
 }
 
 void Game::init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService& inImgui)
@@ -94,18 +363,8 @@ void Game::init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService& inIm
         .addStage(fragShaderCode.data, uint32_t(fragShaderCode.size), VK_SHADER_STAGE_FRAGMENT_BIT)
         .setSPVInput(true);
 
-    //Descriptor set layout.
-    DescriptorSetLayoutCreation mainCreation{};
-    mainCreation.addBinding({ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .binding = 0, .count = 1, .stage = VK_SHADER_STAGE_ALL_GRAPHICS, .name = "MaterialConstant" })
-        .setSetIndex(1);
-    mainCreation.bindless = false;
-
-    //Setting it into pipeline.
-    //This descriptor set layout will be ran every draw calls
-    mainDescriptorSetLayout = gpu->createDescriptorSetLayout(mainCreation);
-    //This descriptor set layout will be ran every frame
-    pipelineCreation.addDescriptorSetLayout(gpu->bindlessDescriptorSetLayoutHandle)
-                    .addDescriptorSetLayout(mainDescriptorSetLayout);
+    //Materials are read through the bindless material buffer, so only the bindless set is needed.
+    pipelineCreation.addDescriptorSetLayout(gpu->bindlessDescriptorSetLayoutHandle);
 
     mainPipeline = gpu->createPipeline(pipelineCreation);
 
@@ -125,13 +384,10 @@ void Game::init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService& inIm
 
     debugPipeline = gpu->createPipeline(debugPipelineCreation, /*debugRendering=*/ true);
 
-    // Register allocation hook. In this example we'll just let Jolt use malloc / free but you can override these if you want (see Memory.h).
-    // This needs to be done before any other Jolt function is called.
-    JPH::RegisterDefaultAllocator();
-
+    //Jolt's allocation hooks are registered in main before the job scheduler starts.
     Physics::instance();
 
-    scene.initScene(&MemoryService::instance()->systemAllocator, *gpu, mainDescriptorSetLayout);
+    scene.initScene(&MemoryService::instance()->systemAllocator, *gpu);
     scene.buildScene();
     //scene.buildDebugScene();
 
@@ -140,14 +396,69 @@ void Game::init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService& inIm
     // Instead insert all new objects in batches instead of 1 at a time to keep the broad phase efficient.
     Physics::instance().physicsSystem.OptimizeBroadPhase();
 
+    //Culling spheres are bucketed per model, so the instance order no longer has to match the model order.
+    Array<uint32_t> cullingModels;
+    cullingModels.init(&MemoryService::instance()->systemAllocator, scene.entities.size, scene.entities.size);
+    Array<vec4s> cullingSpheres;
+    cullingSpheres.init(&MemoryService::instance()->systemAllocator, scene.entities.size, scene.entities.size);
+
+    for (uint32_t entityIndex = 0; entityIndex < scene.entities.size; ++entityIndex)
+    {
+        cullingModels[entityIndex] = scene.entities[entityIndex].modelType;
+        cullingSpheres[entityIndex] = glms_vec4(entityTranslation(scene.entityData[entityIndex]), scene.entities[entityIndex].boundingRadius);
+    }
+
+    instanceCuller.init(&MemoryService::instance()->systemAllocator, scene.models.size);
+    for (uint32_t model = 0; model < scene.models.size; ++model)
+    {
+        instanceCuller.setLods(model, scene.models[model].lodError, scene.models[model].lodCount);
+    }
+    instanceCuller.build(cullingModels.data, cullingSpheres.data, scene.entities.size);
+    gpuCuller.init(*gpu, instanceCuller, scene.models, scene.debugModels[DebugModels::SPHERE], cullingModels.data, cullingSpheres.data);
+    clusterCuller.init(*gpu, instanceCuller, scene.models, scene.geometry);
+    lightCuller.init(*gpu);
+    depthPyramid.init(*gpu);
+
+#if defined(VOID_LIGHT_BENCHMARK)
+    //Point lights with every tenth one a spot, scattered over the level and orbiting it in the loop.
+    for (uint32_t i = 0; i < LIGHT_BENCHMARK_COUNT; ++i)
+    {
+        const vec3s position{ getRandomValue(-150.f, 150.f), getRandomValue(1.f, 20.f), getRandomValue(-150.f, 150.f) };
+        const vec3s colour{ getRandomValue(0.2f, 1.f), getRandomValue(0.2f, 1.f), getRandomValue(0.2f, 1.f) };
+        if (i % 10 == 0)
+        {
+            lightCuller.addSpotLight(position, vec3s{ 0.f, -1.f, 0.f }, colour, 20000.f, 30.f, GLM_PIf / 12.f, GLM_PIf / 6.f);
+        }
+        else
+        {
+            lightCuller.addPointLight(position, colour, 2000.f, getRandomValue(5.f, 15.f));
+        }
+    }
+#endif //VOID_LIGHT_BENCHMARK
+
+    cullingSpheres.shutdown();
+    cullingModels.shutdown();
+
+#if defined(VOID_CULLING_BENCHMARK)
+    benchmarkInstanceCulling();
+#endif //VOID_CULLING_BENCHMARK
+
     BufferCreation bufferCreation{};
     for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
     {
         bufferCreation.reset()
             .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(EntityData) * scene.entityData.size)
             .setName("othername")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME)
             .setData(scene.entityData.data);
         positionalBuffer[i] = gpu->createBindlessBuffer(bufferCreation);
+        mappedPositions[i] = (EntityData*)gpu->mapBuffer(MapBufferParameters{ positionalBuffer[i] });
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * instanceCuller.visibleIndices.size)
+            .setName("visibleIndices")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        visibleIndexBuffer[i] = gpu->createBindlessBuffer(bufferCreation);
     }
 
     bufferCreation.reset()
@@ -155,6 +466,11 @@ void Game::init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService& inIm
         .setName("debugGlobalBuffer");
     debugGlobalBuffer = gpu->createBindlessBuffer(bufferCreation);
 
+    transformExtractor.init(&MemoryService::instance()->systemAllocator, &Physics::instance().physicsSystem, Physics::instance().jobSystem,
+                            scene.entities.data, scene.entities.size, scene.entities[0].entityIndex, static_cast<Player*>(scene.entities[0].entityData)->character->GetBodyID());
+
+    buildFrameGraph(*this);
+
     beginFrameTick = timeNow();
 
     gameCamera.internal3DCamera.initPerspective(0.01f, 5000.f, 60.f, (float)Window::instance()->width / (float)Window::instance()->height);
@@ -164,16 +480,24 @@ void Game::init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService& inIm
     renderer2D.init(*gpu);
     userInterface.init(renderer2D);
     userInterface.buildGameUI();
-    renderer2D.loadBuffer();
+
+#if defined(VOID_2D_BENCHMARK)
+    renderer2D.benchmark();
+#endif //VOID_2D_BENCHMARK
 
     modelScale = 1.0f;
 
     debugRenderer = true;
+    gpuCulling = gpu->drawIndirectCountSupported;
+#if defined(VOID_VALIDATE_GPU_CULLING)
+    //The CPU culler only tests the frustum, so the counts only match without occlusion.
+    occlusionCulling = false;
+#endif //VOID_VALIDATE_GPU_CULLING
     element = 0;
     recreatePositionBuffer = false;
 }
 
-void Game::loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuProfiler)
+void Game::loop(InputHandler& inputHandler, GPUProfiler& gpuProfiler)
 {
     while (Window::instance()->exitRequested == false)
     {
@@ -191,7 +515,8 @@ void Game::loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuPro
         //New Frame
         if (Window::instance()->minimised == false)
         {
-            playerPosition = convertToVec3(static_cast<Player*>(scene.entities[0].entityData)->character->GetPosition());
+            //The interpolated position, so the camera moves as smoothly as the player it follows.
+            playerPosition = entityTranslation(scene.entityData[scene.entities[0].entityIndex]);
 
             //This is only false when we can't recreate the swapchain because of 0 height due to VK_ERROR_OUT_OF_DATE_KHR constantly being hit.
             //We still need to acquire an image to re-check if can now correctly fetch a swapchain image. 
@@ -210,12 +535,27 @@ void Game::loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuPro
                 gameCamera.internal3DCamera.setAspectRatio(Window::instance()->width * 1.f / Window::instance()->height);
             }
 
+            //Steps begun last frame when pipelined, nothing below may touch the bodies until they are done.
+            uint32_t physicsSteps = Physics::instance().finishUpdate();
+
             static_cast<Player*>(scene.entities[0].entityData)->handleEvents(inputHandler, convertToVec3JPH(gameCamera.internal3DCamera.direction));
 
             if (inputHandler.isKeyJustReleased(Keys::KEY_1))
             {
                 debugRenderer = !debugRenderer;
             }
+            else if (inputHandler.isKeyJustReleased(Keys::KEY_2))
+            {
+                gpuCulling = !gpuCulling && gpu->drawIndirectCountSupported;
+            }
+            else if (inputHandler.isKeyJustReleased(Keys::KEY_3))
+            {
+                occlusionCulling = !occlusionCulling;
+            }
+            else if (inputHandler.isKeyJustReleased(Keys::KEY_4))
+            {
+                pipelinedPhysics = !pipelinedPhysics;
+            }
             else if (inputHandler.isKeyJustReleased(Keys::KEY_SPACE))
             {
                 audioSystem->playSoundEffect(sfx::Lazer);
@@ -251,7 +591,12 @@ void Game::loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuPro
             float deltaTime = static_cast<float>(timeDeltaSeconds(beginFrameTick, currentTick));
             beginFrameTick = currentTick;
 
-            Physics::instance().updatePhysics(deltaTime);
+            //Fixed steps, the transforms below are blended between the last two by the time left over.
+            if (pipelinedPhysics == false)
+            {
+                Physics::instance().beginUpdate(deltaTime);
+                physicsSteps += Physics::instance().finishUpdate();
+            }
 
             static_cast<Player*>(scene.entities[0].entityData)->update(deltaTime, *audioSystem);
 
@@ -259,22 +604,30 @@ void Game::loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuPro
             gameCamera.updatePlayerCamera(&inputHandler, (float)Window::instance()->width, (float)Window::instance()->height, playerPosition, { 0.f, 0.f, 0.f, 0.f }, deltaTime);
             Window::instance()->centerMouse(inputHandler.isMouseDragging(MouseButtons::MOUSE_BUTTON_RIGHT));
             
-            deleteEntity();
+            handleContactEvents();
 
-            CommandBuffer* gpuCommands = gpu->getCommandBuffer(VK_QUEUE_GRAPHICS_BIT, true);
-            gpuCommands->pushMarker("Frame");
+            //Sleeping and static bodies are not active, so the thousands of rocks are never visited.
+            if (physicsSteps > 0)
+            {
+                transformExtractor.capture(physicsSteps);
+            }
 
-            gpu->beginRenderingTransition(gpuCommands);
-            gpuCommands->beginRendering();
+            //The snapshots are all the frame reads from here, so the next steps simulate while it is recorded.
+            if (pipelinedPhysics)
+            {
+                Physics::instance().beginUpdate(deltaTime);
+            }
 
-            gpuCommands->setScissor(nullptr);
-            gpuCommands->setViewport(nullptr);
+            CommandBuffer* gpuCommands = gpu->getCommandBuffer(VK_QUEUE_GRAPHICS_BIT, true);
+            gpuCommands->pushMarker("Frame");
 
-            PushConstants pushConstants{};
+            PushConstants& pushConstants = framePassData.pushConstants;
+            pushConstants = PushConstants{};
             Buffer* globalSceneBuffer = gpu->accessBuffer(debugGlobalBuffer);
             pushConstants.sceneAddress = globalSceneBuffer->bufferAddress;
             pushConstants.vertexDataAddress = 0;
             pushConstants.modelPositionAddress = 0;
+            pushConstants.visibleIndexAddress = 0;
 
             UniformData globalSceneData{};
             globalSceneData.globalModel = globalModel;
@@ -285,108 +638,82 @@ void Game::loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuPro
             globalSceneData.light = vec4s{ lightPosition.x, lightPosition.y, lightPosition.z, 1.f };
             //globalSceneData.light = vec4s{ gameCamera.internal3DCamera.position.x, gameCamera.internal3DCamera.position.y, gameCamera.internal3DCamera.position.z, 1.f };
 
-            //Scene
-            gpuCommands->bindPipeline(mainPipeline);
-
-            gpuCommands->bindlessDescriptorSet(0);
-
             Buffer* positionBuff = gpu->accessBuffer(positionalBuffer[gpu->currentFrame]);
             pushConstants.modelPositionAddress = positionBuff->bufferAddress;
 
-            vmaCopyMemoryToAllocation(gpu->VMAAllocator, &globalSceneData, globalSceneBuffer->vmaAllocation, 0, sizeof(UniformData));
-
-            for (uint32_t entityIndex = 0; entityIndex < scene.entities.size; ++entityIndex)
+#if defined(VOID_LIGHT_BENCHMARK)
+            const int64_t lightUpdateStart = timeNow();
+            const float orbitSin = sinf(deltaTime * 0.2f);
+            const float orbitCos = cosf(deltaTime * 0.2f);
+            for (uint32_t i = 0; i < lightCuller.lights.size; ++i)
             {
-                const Entity& entity = scene.entities[entityIndex];
-                uint32_t entityIdx = scene.entities[entityIndex].entityIndex;
-
-                if (entity.isDeleted) 
-                {
-                    continue;
-                }
-
-                if (entity.entityType != PLAYER)
-                {
-                    if (entity.bodyID.IsInvalid() == false && entity.isDynamic)
-                    {
-                        JPH::RMat44 newPos = Physics::instance().bodyInterface->GetWorldTransform(entity.bodyID);
-                        mat4s modelPosition = convertToMat4(newPos);
-                        scene.entityData[entityIdx].position = modelPosition;
-                    }
-                }
-                else
-                {
-                    JPH::RMat44 newPos = Physics::instance().bodyInterface->GetWorldTransform(static_cast<Player*>(scene.entities[0].entityData)->character->GetBodyID());
-                    mat4s modelPosition = convertToMat4(newPos);
-                    scene.entityData[entityIdx].position = modelPosition;
-                }
+                vec3s& position = lightCuller.lights[i].position;
+                position = vec3s{ position.x * orbitCos - position.z * orbitSin, position.y, position.x * orbitSin + position.z * orbitCos };
             }
+#endif //VOID_LIGHT_BENCHMARK
 
-            vmaCopyMemoryToAllocation(gpu->VMAAllocator, scene.entityData.data, positionBuff->vmaAllocation, 0, sizeof(EntityData) * scene.entityData.size);
+            lightCuller.update(*gpu, gpu->currentFrame);
+            lightCuller.fillSceneData(*gpu, globalSceneData, gpu->currentFrame);
 
-            uint32_t instanceCountOffset = 0;
-            for (int32_t modelIndexType = scene.models.size - 1; modelIndexType >= 0; --modelIndexType)
-            {
-                for (uint32_t meshIndex = 0; meshIndex < scene.models[modelIndexType].meshDraws.size; ++meshIndex)
-                {
-                    MeshDraw meshDraw = scene.models[modelIndexType].meshDraws[meshIndex];
+#if defined(VOID_LIGHT_BENCHMARK)
+            lightBenchmarkUpdateMS += lightBenchmarkFrame < LIGHT_BENCHMARK_FRAMES ? timeDeltaMilliseconds(lightUpdateStart, timeNow()) : 0.0;
+#endif //VOID_LIGHT_BENCHMARK
 
-                    MapBufferParameters materialMap = { meshDraw.materialBuffer, 0, 0 };
-                    MaterialData* materialBufferData = reinterpret_cast<MaterialData*>(gpu->mapBuffer(materialMap));
+            vmaCopyMemoryToAllocation(gpu->VMAAllocator, &globalSceneData, globalSceneBuffer->vmaAllocation, 0, sizeof(UniformData));
 
-                    uploadMaterial(*materialBufferData, meshDraw);
-                    gpu->unmapBuffer(materialMap);
+            pushConstants.materialAddress = gpu->accessBuffer(scene.materialBuffer)->bufferAddress;
 
-                    Buffer* vertexDataBuf = gpu->accessBuffer(meshDraw.vertexBuffer);
-                    pushConstants.vertexDataAddress = vertexDataBuf->bufferAddress;
+            updateTransforms();
+            scene.updateEntityData(*gpu, positionalBuffer[gpu->currentFrame], gpu->currentFrame);
 
-                    vkCmdPushConstants(gpuCommands->vkCommandBuffer, gpuCommands->currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+            //The culling planes are in entity space so the global model is folded into the view projection.
+            Frustum& frustum = framePassData.frustum;
+            framePassData.globalModel = globalModel;
+            const mat4s viewProjection = glms_mat4_mul(gameCamera.internal3DCamera.projection, gameCamera.internal3DCamera.view);
+            frustum.extract(glms_mat4_mul(viewProjection, globalModel), gameCamera.internal3DCamera.farPlane);
+            frustum.setLodView(glms_vec3_scale(gameCamera.internal3DCamera.position, 1.f / modelScale), gameCamera.internal3DCamera.projection, (float)Window::instance()->height);
 
-                    gpuCommands->bindIndexBuffer(meshDraw.indexBuffer, meshDraw.indexOffset, meshDraw.componentType);
-                    gpuCommands->bindDescriptorSet(&meshDraw.descriptorSet, 1, nullptr, 0, 1);
+            //Same entity space view as the LODs. Levels are swapped before anything is recorded with them and the uploads go
+            //into the frame ahead of the rendering.
+            scene.updateTextureStreaming(*gpu, gpuCommands, glms_vec3_scale(gameCamera.internal3DCamera.position, 1.f / modelScale),
+                                         gameCamera.internal3DCamera.projection.m11 * (float)Window::instance()->height * 0.5f);
 
-                    gpuCommands->drawIndexed(meshDraw.count, scene.models[modelIndexType].instanceCount, 0, 0, instanceCountOffset);
-                }
+            Buffer* visibleIndexBuff = gpu->accessBuffer(visibleIndexBuffer[gpu->currentFrame]);
+            pushConstants.visibleIndexAddress = visibleIndexBuff->bufferAddress;
 
-                instanceCountOffset += scene.models[modelIndexType].instanceCount;
+#if defined(VOID_VALIDATE_GPU_CULLING)
+            if (gpuCulling)
+            {
+                instanceCuller.cull(frustum);
+                gpuCuller.validate(*gpu, instanceCuller, gpu->currentFrame);
             }
+#endif //VOID_VALIDATE_GPU_CULLING
 
-            if (debugRenderer)
+            //The GPU culling is recorded by the culling passes of the frame graph.
+            if (gpuCulling == false)
             {
-                //Debug
-                gpuCommands->bindPipeline(debugPipeline);
-
-                pushConstants.modelPositionAddress = positionBuff->bufferAddress;
-                pushConstants.sceneAddress = globalSceneBuffer->bufferAddress;
-
-                instanceCountOffset = 0;
-                for (int32_t modelIndexType = scene.debugModels.size - 1; modelIndexType >= 0; --modelIndexType)
-                {
-                    VOID_ASSERTM(scene.debugModels[modelIndexType].meshDraws.size == 1, "Collider geometry have have one draw call.\n");
-
-                    MeshDraw meshDraw = scene.debugModels[modelIndexType].meshDraws[0];
-
-                    Buffer* vertexDataBuf = gpu->accessBuffer(meshDraw.vertexBuffer);
-                    pushConstants.vertexDataAddress = vertexDataBuf->bufferAddress;
-
-                    vkCmdPushConstants(gpuCommands->vkCommandBuffer, gpuCommands->currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
-
-                    gpuCommands->bindIndexBuffer(meshDraw.indexBuffer, meshDraw.indexOffset, meshDraw.componentType);
-
-                    gpuCommands->drawIndexed(meshDraw.count, scene.debugModels[modelIndexType].instanceCount, 0, 0, instanceCountOffset);
-
-                    instanceCountOffset += scene.debugModels[modelIndexType].instanceCount;
-                }
+                instanceCuller.cull(frustum);
+                vmaCopyMemoryToAllocation(gpu->VMAAllocator, instanceCuller.visibleIndices.data, visibleIndexBuff->vmaAllocation, 0, sizeof(uint32_t) * instanceCuller.visibleIndices.size);
+                gpuCuller.writeDrawCommands(*gpu, instanceCuller, gpu->currentFrame);
+                clusterCuller.cull(*gpu, instanceCuller, frustum, scene.entityData.data, gpu->currentFrame);
             }
 
-            drawSkybox(*gpu, *gpuCommands, pushConstants);
-            renderer2D.drawQuad(*gpuCommands);
+            //Both culling phases, scene, debug, skybox and 2D, the graph places the barriers between them and hands the swapchain to present.
+            frameGraph.execute(*gpuCommands);
 
             //imgui->render(*gpuCommands);
 
             gpuCommands->popMarker();
 
-            //gpuProfiler.update(gpu);
+            gpuProfiler.update(*gpu);
+
+#if defined(VOID_LIGHT_BENCHMARK)
+            if (++lightBenchmarkFrame == LIGHT_BENCHMARK_FRAMES)
+            {
+                vprint("%u lights: %3.4fms average CPU update and upload, GPU passes:\n", lightCuller.lights.size, lightBenchmarkUpdateMS / LIGHT_BENCHMARK_FRAMES);
+                gpuProfiler.logStatistics();
+            }
+#endif //VOID_LIGHT_BENCHMARK
 
             gpu->queueCommandBuffer(gpuCommands);
             gpu->present();
@@ -404,40 +731,90 @@ void Game::shutdown()
 {
     vkDeviceWaitIdle(gpu->vulkanDevice);
 
+    //A pipelined update may still be running on the workers.
+    Physics::instance().finishUpdate();
+
+    frameGraph.shutdown();
+
     shutdownSkybox(*gpu);
     renderer2D.shutdown();
 
+    transformExtractor.shutdown();
+
     for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
     {
+        gpu->unmapBuffer(MapBufferParameters{ positionalBuffer[i] });
         gpu->destroyBuffer(positionalBuffer[i]);
+        gpu->destroyBuffer(visibleIndexBuffer[i]);
     }
 
+    depthPyramid.shutdown(*gpu);
+    lightCuller.shutdown(*gpu);
+    clusterCuller.shutdown(*gpu);
+    gpuCuller.shutdown(*gpu);
+    instanceCuller.shutdown();
+
     gpu->destroyBuffer(debugGlobalBuffer);
 
     scene.shutdownScene(*gpu);
     Physics::instance().shutdownPhysics();
 
-    gpu->destroyDescriptorSetLayout(mainDescriptorSetLayout);
     gpu->destroyPipeline(mainPipeline);
     gpu->destroyPipeline(debugPipeline);
 }
 
-void Game::deleteEntity() 
+void Game::updateTransforms()
 {
-    if (Physics::instance().contactListener.toDeleteQueue.size > 0)
+    //This frame's buffer is written by the interpolation itself, only the other frames need the dirty ranges.
+    const Array<uint32_t>& moved = transformExtractor.interpolate(Physics::instance().interpolationAlpha, scene.entityData.data, mappedPositions[gpu->currentFrame]);
+    for (uint32_t i = 0; i < moved.size; ++i)
     {
-        for (uint32_t i = 0; i < Physics::instance().contactListener.toDeleteQueue.size;)
-        {
-            uint32_t index = Physics::instance().contactListener.toDeleteQueue[i];
-            scene.entities[index].isDeleted = true;
-            scene.entityData[index].position = glms_mat4_identity();
-            scene.entityData[index].position.m30 = FLT_MAX;
-            scene.entityData[index].position.m31 = FLT_MAX;
-            scene.entityData[index].position.m32 = FLT_MAX;
+        instanceCuller.setCentre(moved[i], entityTranslation(scene.entityData[moved[i]]));
+        scene.markEntityDirty(moved[i], gpu->currentFrame);
+    }
+}
 
-            Physics::instance().bodyInterface->DeactivateBody(scene.entities[index].bodyID);
+void Game::handleContactEvents()
+{
+    ContactEventQueue& events = Physics::instance().contactListener.events;
+    if (events.dropped() > 0)
+    {
+        vprint("%u contact events didn't fit in the queue and were dropped.\n", events.dropped());
+    }
 
-            Physics::instance().contactListener.toDeleteQueue.pop();
+    for (uint32_t i = 0; i < events.size(); ++i)
+    {
+        const ContactEvent& event = events[i];
+        switch (event.type)
+        {
+        case CONTACT_EVENT_PLAYER_CRASH:
+            static_cast<Player*>(scene.entities[event.entityIndex].entityData)->crashNoise();
+            break;
+        case CONTACT_EVENT_ROCK_HIT:
+            deleteEntity(event.entityIndex);
+            break;
         }
     }
+
+    events.clear();
+}
+
+void Game::deleteEntity(uint32_t index)
+{
+    //A rock touching several bodies in one update is queued once for each.
+    if (scene.entities[index].isDeleted)
+    {
+        return;
+    }
+
+    scene.entities[index].isDeleted = true;
+    mat4s farAway = glms_mat4_identity();
+    farAway.m30 = FLT_MAX;
+    farAway.m31 = FLT_MAX;
+    farAway.m32 = FLT_MAX;
+    packEntityTransform(scene.entityData[index], farAway);
+    scene.markEntityDirty(index);
+    instanceCuller.disable(index);
+
+    Physics::instance().bodyInterface->DeactivateBody(scene.entities[index].bodyID);
 }
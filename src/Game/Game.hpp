@@ -15,10 +15,14 @@
 struct Game
 {
     void init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService& inImgui);
-    void loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuProfiler);
+    void loop(InputHandler& inputHandler, GPUProfiler& gpuProfiler);
     void shutdown();
 
-    void deleteEntity();
+    //Acts on what the physics jobs reported in the last update, the rocks that were hit are deleted.
+    void handleContactEvents();
+    void deleteEntity(uint32_t index);
+    //Blends every moving entity between its last two captured steps and queues it for upload.
+    void updateTransforms();
 
     GPUDevice* gpu;
     AudioSystem* audioSystem;
@@ -40,6 +44,12 @@ struct Game
 
     bool recreatePositionBuffer = false;
     bool debugRenderer = true;
+    //Culls and builds the draw commands in compute, falls back to the CPU culler when indirect count draws are unsupported.
+    bool gpuCulling = false;
+    //Draws last frame's visible instances first and culls the rest against a depth pyramid of them, needs GPU culling.
+    bool occlusionCulling = true;
+    //Steps the physics on the workers while the frame is recorded, rendering the last update's transforms a frame late.
+    bool pipelinedPhysics = true;
 };
 
 #endif // !GAME_HDR
@@ -12,7 +12,6 @@ void MainMenu::init(GPUDevice& inGPU, AudioSystem& inAudioSystem, ImguiService&
     renderer2D.init(*gpu);
     userInterface.init(renderer2D);
     userInterface.buildMainMenu();
-    renderer2D.loadBuffer();
 }
 
 void MainMenu::loop(InputHandler& inputHandler, [[maybe_unused]] GPUProfiler& gpuProfiler)
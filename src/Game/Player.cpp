@@ -14,9 +14,9 @@ void Player::init(EntityData& entityData, const JPH::ShapeRefC& shapeRef, const
     playerSettings.mFriction = 0.5f;
     playerSettings.mSupportingVolume = JPH::Plane(JPH::Vec3::sAxisY(), -cCharacterRadiusStanding);
 
-    entityData.colour = { 1.f, 1.f, 1.f, 1.f };
-    entityData.position = glms_mat4_identity();
-    entityData.debugModel = convertToMat4(modelShape);
+    entityData.colour = packColour({ 1.f, 1.f, 1.f, 1.f });
+    packEntityTransform(entityData, glms_mat4_identity());
+    entityData.debugScale = modelShape.GetAxisX().Length();
 
     //TODO - change for your allocator, check object life.
     character = new JPH::Character{ &playerSettings, JPH::RVec3Arg::sZero(), JPH::QuatArg::sIdentity(), 0, &Physics::instance().physicsSystem };
@@ -2,26 +2,243 @@
 
 #include "Foundation/Memory.hpp"
 #include "Foundation/File.hpp"
+#include "Foundation/Numerics.hpp"
 #include "Physics/Physics.hpp"
 
 #include "Player.hpp"
 
-void Scene::initScene(HeapAllocator *inAllocator, GPUDevice & gpu, DescriptorSetLayoutHandle descriptorSetLayout)
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    void fillMaterial(MaterialData& materialData, const MeshDraw& meshDraw)
+    {
+        materialData.textures[0] = meshDraw.diffuseTextureIndex;
+        materialData.textures[1] = meshDraw.roughnessTextureIndex;
+        materialData.textures[2] = meshDraw.normalTextureIndex;
+        materialData.textures[3] = meshDraw.occlusionTextureIndex;
+
+        materialData.emissiveFactor =
+        {
+            meshDraw.emissiveFactor.x,
+            meshDraw.emissiveFactor.y,
+            meshDraw.emissiveFactor.z
+        };
+
+        materialData.emissiveTextureIndex = meshDraw.emisiveTextureIndex;
+
+        materialData.baseColourFactor = meshDraw.baseColourFactor;
+        materialData.metallicRoughnessOcclusionFactor = meshDraw.metallicRoughnessOcclusionFactor;
+        materialData.alphaCutoff = meshDraw.alphaCutoff;
+        materialData.iorFactor = meshDraw.iorFactor;
+        materialData.specularValue = meshDraw.specularValue;
+        materialData.flags = meshDraw.flags;
+
+        // NOTE: for left-handed systems (as defined in cglm) need to invert positive and negative Z.
+        mat4s model = meshDraw.model;
+        materialData.model = model;
+        materialData.modelInv = glms_mat4_inv(glms_mat4_transpose(model));
+    }
+
+    int compareEntityIndices(const void* a, const void* b)
+    {
+        const uint32_t left = *(const uint32_t*)a;
+        const uint32_t right = *(const uint32_t*)b;
+        return (left > right) - (left < right);
+    }
+}
+
+void Scene::initScene(HeapAllocator *inAllocator, GPUDevice & gpu)
 {
     allocator = inAllocator;
 
     entities.init(allocator, totalEntities, totalEntities);
 
     entityData.init(allocator, totalEntities, totalEntities);
+    entityDirtyFrames.init(allocator, totalEntities, totalEntities);
+    memset(entityDirtyFrames.data, 0, entityDirtyFrames.sizeInBytes());
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        entityDirtyIndices[i].init(allocator, 64);
+    }
     bodiesToBeAdded.init(allocator, totalEntities);
     models.init(allocator, 3, 3);
     debugModels.init(allocator, 1, 1);
 
-    models[EntityModels::ROCK_MODEL].loadModel("Assets/Models/out/rock.glb", gpu, descriptorSetLayout);
-    models[EntityModels::DUCK_MODEL].loadModel("Assets/Models/out/metalDuck.glb", gpu, descriptorSetLayout);
-    models[EntityModels::SPEC_SPHERE_MODEL].loadModel("Assets/Models/out/specularSpheres2.glb", gpu, descriptorSetLayout);
+    geometry.init(gpu, GEOMETRY_VERTEX_BYTES, GEOMETRY_INDEX_COUNT);
+
+    //Indexed by EntityModels.
+    const char* modelPaths[] = { "Assets/Models/out/rock.glb", "Assets/Models/out/metalDuck.glb", "Assets/Models/out/specularSpheres2.glb" };
+    VOID_ASSERTM(ArraySize(modelPaths) == models.size, "Every model needs a path.");
+
+    //The images of every model decode together as low priority jobs on the job scheduler, physics shares its workers but takes precedence.
+    //Parsing, uploads and the mesh work stay on this thread because the heap allocator and the GPU device are not thread safe.
+    textureStreamer.init(allocator, gpu);
+
+    ImageDecodeQueue decodeQueue;
+    decodeQueue.init(allocator, JobScheduler::instance(), &textureStreamer);
+
+    cgltf_data* modelData[ArraySize(modelPaths)];
+    for (uint32_t modelIndex = 0; modelIndex < models.size; ++modelIndex)
+    {
+        modelData[modelIndex] = models[modelIndex].queueImages(modelPaths[modelIndex], gpu, decodeQueue);
+    }
+
+    decodeQueue.uploadAll(gpu);
+    decodeQueue.shutdown();
+
+    for (uint32_t modelIndex = 0; modelIndex < models.size; ++modelIndex)
+    {
+        models[modelIndex].loadModel(modelPaths[modelIndex], modelData[modelIndex], gpu, geometry);
+    }
+
+    debugModels[DebugModels::SPHERE].loadCollider("Assets/Models/Debug/debugSphere.glb", gpu, geometry);
+
+    initMaterials(gpu);
+}
+
+void Scene::initMaterials(GPUDevice& gpu)
+{
+    uint32_t materialCount = 0;
+    for (uint32_t modelIndex = 0; modelIndex < models.size; ++modelIndex)
+    {
+        materialCount += models[modelIndex].meshDraws.size;
+    }
+
+    materials.init(allocator, materialCount, materialCount);
+
+    uint32_t materialIndex = 0;
+    for (uint32_t modelIndex = 0; modelIndex < models.size; ++modelIndex)
+    {
+        for (uint32_t meshIndex = 0; meshIndex < models[modelIndex].meshDraws.size; ++meshIndex)
+        {
+            MeshDraw& meshDraw = models[modelIndex].meshDraws[meshIndex];
+            meshDraw.materialIndex = materialIndex;
+            fillMaterial(materials[materialIndex], meshDraw);
+
+            ++materialIndex;
+        }
+    }
+
+    //Nothing changes a material after load, so a single copy is read by every frame.
+    BufferCreation bufferCreation{};
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(MaterialData) * materials.size)
+        .setName("materials")
+        .setCategory(GPU_MEMORY_CATEGORY_OTHER)
+        .setData(materials.data);
+    materialBuffer = gpu.createBindlessBuffer(bufferCreation);
+}
+
+void Scene::markEntityDirty(uint32_t entityIndex, uint32_t writtenFrame)
+{
+    VOID_ASSERTM(entityIndex < entityData.size, "Entity index %u is out of range.", entityIndex);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        const uint8_t frameBit = uint8_t(1u << i);
+        if (i == writtenFrame || entityDataStale[i] || (entityDirtyFrames[entityIndex] & frameBit))
+        {
+            continue;
+        }
+
+        //Past half of the entities the ranges would cover most of the buffer anyway.
+        if (entityDirtyIndices[i].size >= entityData.size / 2)
+        {
+            entityDataStale[i] = true;
+            continue;
+        }
+
+        entityDirtyFrames[entityIndex] |= frameBit;
+        entityDirtyIndices[i].push(entityIndex);
+    }
+}
+
+void Scene::updateEntityData(GPUDevice& gpu, BufferHandle positionalBuffer, uint32_t currentFrame)
+{
+    Array<uint32_t>& dirty = entityDirtyIndices[currentFrame];
+    Buffer* buffer = gpu.accessBuffer(positionalBuffer);
+    const uint8_t frameBit = uint8_t(1u << currentFrame);
+
+    if (entityDataStale[currentFrame])
+    {
+        vmaCopyMemoryToAllocation(gpu.VMAAllocator, entityData.data, buffer->vmaAllocation, 0, sizeof(EntityData) * entityData.size);
+    }
+    else if (dirty.size > 0)
+    {
+        qsort(dirty.data, dirty.size, sizeof(uint32_t), compareEntityIndices);
+
+        uint32_t first = dirty[0];
+        uint32_t end = first + 1;
+        for (uint32_t i = 1; i <= dirty.size; ++i)
+        {
+            if (i < dirty.size && dirty[i] == end)
+            {
+                ++end;
+                continue;
+            }
+
+            vmaCopyMemoryToAllocation(gpu.VMAAllocator, entityData.data + first, buffer->vmaAllocation, sizeof(EntityData) * first, sizeof(EntityData) * (end - first));
+
+            if (i < dirty.size)
+            {
+                first = dirty[i];
+                end = first + 1;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < dirty.size; ++i)
+    {
+        entityDirtyFrames[dirty[i]] &= uint8_t(~frameBit);
+    }
+    dirty.clear();
+    entityDataStale[currentFrame] = false;
+}
+
+void Scene::updateTextureStreaming(GPUDevice& gpu, CommandBuffer* commandBuffer, const vec3s& eye, float projectionScale)
+{
+    //Projected diameter of the nearest instance of each model.
+    float modelPixels[MODEL_COUNT]{};
+    for (uint32_t entityIndex = 0; entityIndex < entities.size; ++entityIndex)
+    {
+        const Entity& entity = entities[entityIndex];
+        if (entity.isDeleted || entity.modelType >= MODEL_COUNT)
+        {
+            continue;
+        }
+
+        const float distance = glms_vec3_distance(eye, entityTranslation(entityData[entity.entityIndex]));
+        const float pixels = 2.f * entity.boundingRadius * projectionScale / max(distance, entity.boundingRadius);
+
+        modelPixels[entity.modelType] = max(modelPixels[entity.modelType], pixels);
+    }
+
+    for (uint32_t modelIndex = 0; modelIndex < models.size; ++modelIndex)
+    {
+        if (modelPixels[modelIndex] == 0.f)
+        {
+            continue;
+        }
+
+        for (uint32_t meshIndex = 0; meshIndex < models[modelIndex].meshDraws.size; ++meshIndex)
+        {
+            const MeshDraw& meshDraw = models[modelIndex].meshDraws[meshIndex];
+            const uint16_t textureIndices[] = { meshDraw.diffuseTextureIndex, meshDraw.roughnessTextureIndex, meshDraw.normalTextureIndex,
+                                                meshDraw.occlusionTextureIndex, meshDraw.emisiveTextureIndex };
+
+            for (uint32_t i = 0; i < ArraySize(textureIndices); ++i)
+            {
+                if (textureIndices[i] != UINT16_MAX)
+                {
+                    textureStreamer.requestScreenSize({ textureIndices[i] }, modelPixels[modelIndex]);
+                }
+            }
+        }
+    }
 
-    debugModels[DebugModels::SPHERE].loadCollider("Assets/Models/Debug/debugSphere.glb", gpu);
+    textureStreamer.update(gpu, commandBuffer);
 }
 
 void Scene::buildScene()
@@ -223,9 +440,11 @@ void Scene::buildRigidBodyEntity(EntityModels modelType, DebugModels debugModelT
     }
 
     entities[currentLastEntity].isDeleted = false;
-    entityData[currentLastEntity].position = convertToMat4(shapePosition);
-    entityData[currentLastEntity].colour = colour;
-    entityData[currentLastEntity].debugModel = convertToMat4(shapeModel);
+    entities[currentLastEntity].boundingRadius = getBoundingRadius(shapeSetting);
+    packEntityTransform(entityData[currentLastEntity], shapePosition);
+    entityData[currentLastEntity].colour = packColour(colour);
+    //The collision shapes are only ever scaled.
+    entityData[currentLastEntity].debugScale = shapeModel.GetAxisX().Length();
 
     entities[currentLastEntity].entityIndex = currentLastEntity;
     entities[currentLastEntity].modelType = modelType;
@@ -239,9 +458,9 @@ void Scene::buildNoneSoildEntity(EntityModels modelType, EntityType entityType,
 {
     vec3s scaledVector = glms_vec3_scale(axis, sinf(angle * 0.5f));
 
-    entityData[currentLastEntity].position = glms_mat4_mul(glms_rotate_make(cosf(angle * 0.5f), scaledVector), glms_translate_make(position));
-    entityData[currentLastEntity].colour = { 1.f, 0.f, 1.f, 1.f };
-    entityData[currentLastEntity].debugModel = glms_mat4_identity();
+    packEntityTransform(entityData[currentLastEntity], glms_mat4_mul(glms_rotate_make(cosf(angle * 0.5f), scaledVector), glms_translate_make(position)));
+    entityData[currentLastEntity].colour = packColour({ 1.f, 0.f, 1.f, 1.f });
+    entityData[currentLastEntity].debugScale = 1.f;
 
     entities[currentLastEntity].entityIndex = currentLastEntity;
     entities[currentLastEntity].entityType = entityType;
@@ -273,20 +492,32 @@ void Scene::shutdownScene(GPUDevice& gpu)
     //    }
     //}
 
+    gpu.destroyBuffer(materialBuffer);
+    materials.shutdown();
+
+    textureStreamer.shutdown(gpu);
+
     for (uint32_t i = 0; i < models.size; ++i)
     {
-        models[i].shutdownModel(gpu);
+        models[i].shutdownModel(gpu, geometry);
     }
     models.shutdown();
 
     for (uint32_t i = 0; i < debugModels.size; ++i)
     {
-        debugModels[i].shutdownModel(gpu);
+        debugModels[i].shutdownModel(gpu, geometry);
     }
     debugModels.shutdown();
 
+    geometry.shutdown(gpu);
+
     entities.shutdown();
     entityData.shutdown();
+    entityDirtyFrames.shutdown();
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        entityDirtyIndices[i].shutdown();
+    }
     bodiesToBeAdded.shutdown();
 }
 
@@ -302,4 +533,17 @@ JPH::RMat44 Scene::getCollsionShape(JPH::EShapeSubType shapeType, const JPH::Bod
     default:
         VOID_ERROR("Shape type not supported.\n");
     }
+}
+
+float Scene::getBoundingRadius(const JPH::BodyCreationSettings& shapeSetting)
+{
+    const JPH::Shape* shape = shapeSetting.GetShape();
+    if (shape->GetSubType() == JPH::EShapeSubType::Sphere)
+    {
+        return ((JPH::SphereShape*)shape)->GetRadius();
+    }
+
+    //Any other shape gets a sphere around its local bounds.
+    const JPH::AABox bounds = shape->GetLocalBounds();
+    return bounds.GetCenter().Length() + bounds.GetExtent().Length();
 }
\ No newline at end of file
@@ -18,9 +18,13 @@
 
 struct HeapAllocator;
 
+//Sizes of the shared geometry buffer every model is loaded into.
+static constexpr uint32_t GEOMETRY_VERTEX_BYTES = void_mega(64);
+static constexpr uint32_t GEOMETRY_INDEX_COUNT = void_mega(16);
+
 struct Scene
 {
-    void initScene(HeapAllocator* inAllocator, GPUDevice& gpu, DescriptorSetLayoutHandle descriptorSetLayout);
+    void initScene(HeapAllocator* inAllocator, GPUDevice& gpu);
     void buildScene();
     void buildDebugScene();
     void buildRigidBodyEntity(EntityModels modelType, DebugModels debugModelType, EntityType entityType, const vec3s& position, vec3s axis,
@@ -28,7 +32,20 @@ struct Scene
     void buildNoneSoildEntity(EntityModels modelType, EntityType entityType, vec3s& position, vec3s axis, float angle);
     void shutdownScene(GPUDevice& gpu);
 
+    //Every model mesh gets one entry in a single bindless material buffer, indexed by MeshDraw::materialIndex.
+    void initMaterials(GPUDevice& gpu);
+
+    //Queues a changed transform for every frame's positional buffer, except the one of a frame it was already written to.
+    void markEntityDirty(uint32_t entityIndex, uint32_t writtenFrame = UINT32_MAX);
+    //Writes the dirty entities of this frame's positional buffer in contiguous ranges, or all of them when it is stale.
+    void updateEntityData(GPUDevice& gpu, BufferHandle positionalBuffer, uint32_t currentFrame);
+
+    //Asks the streamer for the texture detail of every model at the size its nearest instance covers on screen, then lets it stream.
+    //The eye is in entity space and the projection scale is the pixels per unit at distance 1. Uploads are recorded into the command buffer.
+    void updateTextureStreaming(GPUDevice& gpu, CommandBuffer* commandBuffer, const vec3s& eye, float projectionScale);
+
     JPH::RMat44 getCollsionShape(JPH::EShapeSubType shapeType, const JPH::BodyCreationSettings& shapeSetting);
+    float getBoundingRadius(const JPH::BodyCreationSettings& shapeSetting);
 
     JPH::BodyCreationSettings sphereSettings;
     JPH::BodyCreationSettings sphereSettings2;
@@ -42,6 +59,19 @@ struct Scene
     Array<Model> debugModels;
     Array<JPH::BodyID> bodiesToBeAdded;
 
+    GeometryBuffer geometry;
+    TextureStreamer textureStreamer;
+
+    Array<MaterialData> materials;
+    BufferHandle materialBuffer;
+
+    //Entities changed since each frame's positional buffer was last written, unsorted.
+    Array<uint32_t> entityDirtyIndices[FRAMES_IN_FLIGHT];
+    //A bit per frame in flight, set while the entity is in that frame's dirty list.
+    Array<uint8_t> entityDirtyFrames;
+    //Set once a frame's dirty list reaches half the entities, its next upload copies the whole array.
+    bool entityDataStale[FRAMES_IN_FLIGHT]{};
+
     HeapAllocator* allocator;
 };
 #endif // !SCENE_HDR
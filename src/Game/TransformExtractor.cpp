@@ -0,0 +1,219 @@
+#include "TransformExtractor.hpp"
+
+#include "Utils.hpp"
+
+#include "Foundation/Numerics.hpp"
+
+#include <Jolt/Physics/Body/BodyLock.h>
+
+namespace
+{
+    //Splits count items into batches on the job system and waits for them, small counts are done on this thread.
+    template<typename Function>
+    void forEachBatch(JPH::JobSystem* jobSystem, JPH::JobSystem::Barrier* barrier, uint32_t count, const char* name, const Function& function)
+    {
+        if (count <= TRANSFORM_EXTRACTION_BATCH || jobSystem->GetMaxConcurrency() <= 1)
+        {
+            function(0u, count);
+            return;
+        }
+
+        for (uint32_t first = 0; first < count; first += TRANSFORM_EXTRACTION_BATCH)
+        {
+            const uint32_t end = min(first + TRANSFORM_EXTRACTION_BATCH, count);
+            JPH::JobHandle job = jobSystem->CreateJob(name, JPH::Color::sCyan, [function, first, end]()
+            {
+                function(first, end);
+            });
+            barrier->AddJob(job);
+        }
+
+        //This thread takes batches too while it waits.
+        jobSystem->WaitForJobs(barrier);
+    }
+}
+
+void TransformExtractor::init(Allocator* inAllocator, JPH::PhysicsSystem* inPhysicsSystem, JPH::JobSystem* inJobSystem, const Entity* inEntities, uint32_t entityCount,
+                              uint32_t inPlayerEntity, JPH::BodyID inCharacterID)
+{
+    physicsSystem = inPhysicsSystem;
+    jobSystem = inJobSystem;
+    entities = inEntities;
+    playerEntity = inPlayerEntity;
+    characterID = inCharacterID;
+
+    previous.init(inAllocator, entityCount, entityCount);
+    current.init(inAllocator, entityCount, entityCount);
+    capturedStep.init(inAllocator, entityCount, entityCount);
+    bodyEntities.init(inAllocator, 64);
+    interpolating.init(inAllocator, 64);
+    nextInterpolating.init(inAllocator, 64);
+    written.init(inAllocator, 64);
+
+    barrier = jobSystem->CreateBarrier();
+
+    const JPH::BodyLockInterfaceNoLock& locks = physicsSystem->GetBodyLockInterfaceNoLock();
+    for (uint32_t entityIndex = 0; entityIndex < entityCount; ++entityIndex)
+    {
+        current[entityIndex] = TransformSnapshot{ JPH::Vec3::sZero(), JPH::Quat::sIdentity() };
+        capturedStep[entityIndex] = 0;
+
+        const JPH::BodyID bodyID = entityIndex == playerEntity ? characterID : entities[entityIndex].bodyID;
+        if (bodyID.IsInvalid() == false)
+        {
+            JPH::BodyLockRead lock(locks, bodyID);
+            if (lock.Succeeded())
+            {
+                current[entityIndex] = TransformSnapshot{ lock.GetBody().GetPosition(), lock.GetBody().GetRotation() };
+            }
+        }
+
+        previous[entityIndex] = current[entityIndex];
+    }
+}
+
+void TransformExtractor::shutdown()
+{
+    jobSystem->DestroyBarrier(barrier);
+    barrier = nullptr;
+
+    previous.shutdown();
+    current.shutdown();
+    capturedStep.shutdown();
+    bodyEntities.shutdown();
+    interpolating.shutdown();
+    nextInterpolating.shutdown();
+    written.shutdown();
+}
+
+void TransformExtractor::capture(uint32_t steps)
+{
+    ++step;
+    capturedSteps = steps;
+
+    //Not thread safe in general, but nothing changes the list while the simulation isn't stepping.
+    const uint32_t activeCount = physicsSystem->GetNumActiveBodies(JPH::EBodyType::RigidBody);
+    activeBodies = physicsSystem->GetActiveBodiesUnsafe(JPH::EBodyType::RigidBody);
+
+    //Sized before the jobs start so none of them grows it.
+    bodyEntities.setSize(activeCount);
+    forEachBatch(jobSystem, barrier, activeCount, "CaptureTransforms", [this](uint32_t first, uint32_t end) { captureRange(first, end); });
+
+    nextInterpolating.clear();
+    for (uint32_t i = 0; i < activeCount; ++i)
+    {
+        if (bodyEntities[i] != UINT32_MAX)
+        {
+            nextInterpolating.push(bodyEntities[i]);
+        }
+    }
+
+    //The character body has no entity in its user data.
+    if (playerEntity != UINT32_MAX && entities[playerEntity].isDeleted == false)
+    {
+        JPH::BodyLockRead lock(physicsSystem->GetBodyLockInterfaceNoLock(), characterID);
+        if (lock.Succeeded() && lock.GetBody().IsActive())
+        {
+            captureBody(lock.GetBody(), playerEntity);
+            nextInterpolating.push(playerEntity);
+        }
+    }
+
+    //Active in the last capture but not this one, the body stopped at its current pose so it is blended there once more.
+    for (uint32_t i = 0; i < interpolating.size; ++i)
+    {
+        const uint32_t entityIndex = interpolating[i];
+        if (capturedStep[entityIndex] == step - 1)
+        {
+            previous[entityIndex] = current[entityIndex];
+            nextInterpolating.push(entityIndex);
+        }
+    }
+
+    const Array<uint32_t> swap = interpolating;
+    interpolating = nextInterpolating;
+    nextInterpolating = swap;
+}
+
+const Array<uint32_t>& TransformExtractor::interpolate(float alpha, EntityData* entityData, EntityData* mappedEntityData)
+{
+    //The rendered time is alpha into the last step, which is this far along all the steps between the two poses.
+    const float blend = (float(capturedSteps - 1) + alpha) / float(capturedSteps);
+    forEachBatch(jobSystem, barrier, interpolating.size, "InterpolateTransforms", [this, blend, entityData, mappedEntityData](uint32_t first, uint32_t end)
+    {
+        interpolateRange(first, end, blend, entityData, mappedEntityData);
+    });
+
+    //Deleted entities keep the transform they were given when they were removed.
+    written.clear();
+    for (uint32_t i = 0; i < interpolating.size; ++i)
+    {
+        if (entities[interpolating[i]].isDeleted == false)
+        {
+            written.push(interpolating[i]);
+        }
+    }
+
+    return written;
+}
+
+void TransformExtractor::captureRange(uint32_t first, uint32_t end)
+{
+    const JPH::BodyLockInterfaceNoLock& locks = physicsSystem->GetBodyLockInterfaceNoLock();
+
+    for (uint32_t i = first; i < end; ++i)
+    {
+        bodyEntities[i] = UINT32_MAX;
+
+        JPH::BodyLockRead lock(locks, activeBodies[i]);
+        if (lock.Succeeded() == false)
+        {
+            continue;
+        }
+
+        const JPH::Body& body = lock.GetBody();
+        const Entity* entity = (const Entity*)body.GetUserData();
+        if (entity == nullptr || entity->isDeleted || entity->isDynamic == false || entity->entityIndex == playerEntity)
+        {
+            continue;
+        }
+
+        captureBody(body, entity->entityIndex);
+        bodyEntities[i] = entity->entityIndex;
+    }
+}
+
+void TransformExtractor::captureBody(const JPH::Body& body, uint32_t entityIndex)
+{
+    previous[entityIndex] = current[entityIndex];
+    current[entityIndex] = TransformSnapshot{ body.GetPosition(), body.GetRotation() };
+    capturedStep[entityIndex] = step;
+}
+
+void TransformExtractor::interpolateRange(uint32_t first, uint32_t end, float blend, EntityData* entityData, EntityData* mappedEntityData)
+{
+    for (uint32_t i = first; i < end; ++i)
+    {
+        const uint32_t entityIndex = interpolating[i];
+        if (entities[entityIndex].isDeleted)
+        {
+            continue;
+        }
+
+        const TransformSnapshot& from = previous[entityIndex];
+        const TransformSnapshot& to = current[entityIndex];
+        const JPH::Vec3 position = from.position + (to.position - from.position) * blend;
+        const JPH::Quat rotation = from.rotation.SLERP(to.rotation, blend);
+
+        //Each row of the GPU layout is a column of the transposed matrix, so it goes out in one store per destination.
+        const JPH::Mat44 rows = JPH::Mat44::sRotationTranslation(rotation, position).Transposed();
+        EntityData& cpu = entityData[entityIndex];
+        EntityData& mapped = mappedEntityData[entityIndex];
+        for (int row = 0; row < 3; ++row)
+        {
+            const JPH::Vec4 values = rows.GetColumn4(row);
+            values.StoreFloat4((JPH::Float4*)&cpu.rows[row]);
+            values.StoreFloat4((JPH::Float4*)&mapped.rows[row]);
+        }
+    }
+}
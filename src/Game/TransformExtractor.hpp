@@ -0,0 +1,72 @@
+#ifndef TRANSFORM_EXTRACTOR_HDR
+#define TRANSFORM_EXTRACTOR_HDR
+
+#include "Foundation/Array.hpp"
+
+#include "Graphics/ShaderData.hpp"
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/JobSystem.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+
+struct Entity;
+
+//Bodies or entities one job handles, below this many everything is done on the calling thread.
+static constexpr uint32_t TRANSFORM_EXTRACTION_BATCH = 256;
+
+//Pose of a body after a physics step.
+struct TransformSnapshot
+{
+    JPH::Vec3 position;
+    JPH::Quat rotation;
+};
+
+//Keeps the poses of the last two physics steps for every entity and blends them into the entity data on the physics job system.
+//The bodies are read through the non-locking interface so capture has to run between PhysicsSystem::Update calls.
+struct TransformExtractor
+{
+    //Both snapshots start at the pose every body has now. The player is moved by its character, so that body stands in for its entity.
+    void init(Allocator* inAllocator, JPH::PhysicsSystem* inPhysicsSystem, JPH::JobSystem* inJobSystem, const Entity* inEntities, uint32_t entityCount,
+              uint32_t inPlayerEntity, JPH::BodyID inCharacterID);
+    void shutdown();
+
+    //Called after an update that took steps, the current pose of every active body becomes its previous one and the new pose is read.
+    //A catch up update takes all its steps at once, so the two poses are that many steps apart.
+    void capture(uint32_t steps);
+    //Every entity that moved in the last update is blended from its previous to its current pose, to alpha of a step before the
+    //current one. alpha is the fraction of a step simulated time is behind. The transforms are stored in both the CPU copy and the mapped positional buffer of this frame, which
+    //must already hold the rest of the entity data. Returns the indices of the entities written.
+    const Array<uint32_t>& interpolate(float alpha, EntityData* entityData, EntityData* mappedEntityData);
+
+    //Helpers
+    void captureRange(uint32_t first, uint32_t end);
+    void interpolateRange(uint32_t first, uint32_t end, float blend, EntityData* entityData, EntityData* mappedEntityData);
+    void captureBody(const JPH::Body& body, uint32_t entityIndex);
+
+    Array<TransformSnapshot> previous;
+    Array<TransformSnapshot> current;
+    //Capture an entity was last active in, the ones that fell asleep are blended to their final pose for one more step.
+    Array<uint32_t> capturedStep;
+    uint32_t step = 0;
+    //Steps between the previous and current poses of the last capture.
+    uint32_t capturedSteps = 1;
+
+    //Entity index of each active body, UINT32_MAX for the ones that aren't captured. Each job only touches its own range.
+    Array<uint32_t> bodyEntities;
+    //Entities blended every frame until the next capture.
+    Array<uint32_t> interpolating;
+    Array<uint32_t> nextInterpolating;
+    Array<uint32_t> written;
+
+    const JPH::BodyID* activeBodies = nullptr;
+    const Entity* entities = nullptr;
+
+    uint32_t playerEntity = UINT32_MAX;
+    JPH::BodyID characterID;
+
+    JPH::PhysicsSystem* physicsSystem = nullptr;
+    JPH::JobSystem* jobSystem = nullptr;
+    JPH::JobSystem::Barrier* barrier = nullptr;
+};
+
+#endif // !TRANSFORM_EXTRACTOR_HDR
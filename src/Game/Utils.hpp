@@ -6,6 +6,8 @@
 #include "cglm/struct/quat.h"
 #include "cglm/struct/affine.h"
 
+#include "Graphics/ShaderData.hpp"
+
 #include <Jolt/Jolt.h>
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
 
@@ -44,6 +46,8 @@ struct Entity
     EntityType entityType = COUNT_TYPE;
     void* entityData;
     JPH::BodyID bodyID;
+    //Radius of the bounding sphere taken from the collision shape, used for culling.
+    float boundingRadius = 0.f;
 
     bool isDynamic;
     bool isDeleted = false;
@@ -80,6 +84,16 @@ static mat4s convertToMat4(const JPH::RMat44& jphMat)
     return positionMatrix;
 }
 
+//Writes the rows straight from the Jolt matrix, the transpose puts each row in a SIMD register.
+static void packEntityTransform(EntityData& entity, const JPH::RMat44& jphMat)
+{
+    const JPH::Mat44 rows = jphMat.Transposed();
+    for (int row = 0; row < 3; ++row)
+    {
+        rows.GetColumn4(row).StoreFloat4((JPH::Float4*)&entity.rows[row]);
+    }
+}
+
 static vec3s convertToVec3(const JPH::Vec3& jphVec3)
 {
     vec3s vector;
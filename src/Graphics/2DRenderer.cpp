@@ -2,9 +2,13 @@
 
 #include "Application/Window.hpp"
 
+#include "Foundation/Colour.hpp"
+#include "Foundation/Time.hpp"
+
 #include <meshoptimizer.h>
 #include "cglm/struct/cam.h"
-#include "vender/stb_image.h"
+
+#include <string.h>
 
 namespace
 {
@@ -14,45 +18,63 @@ namespace
         VkDeviceAddress sceneAddress;
     };
 
-    struct QuadPositionData
-    {
-        mat4s transform;
-        vec4s colour = vec4s{ 1.f, 1.f, 1.f, 1.f };
-        vec2s texCoords[4] =
-        {
-            vec2s{ 0.f, 0.f },
-            vec2s{ 1.f, 0.f },
-            vec2s{ 1.f, 1.f },
-            vec2s{ 0.f, 1.f }
-        };
-
-        uint32_t textureID = UINT16_MAX;
-        float padd[3];
-    };
+    static constexpr uint32_t INVALID_TEXTURE_ID = UINT16_MAX;
 
-    struct QuadData
+    //Layer in the high half and texture in the low half, the float bits are flipped so they sort as unsigned integers.
+    uint32_t sortKey(const QuadData2D& quad)
     {
-        //per-instance.
-        mat4s transform;
-        uint32_t textureID;
-        vec4s colour;
-
-        //per-index.
-        vec2s sprintSize;
-        vec2s rowAndColumn;
-        vec2s offset = { 1, 1 }; //offset-per-sprite
-    };
+        uint32_t layerBits;
+        memcpy(&layerBits, &quad.layer, sizeof(float));
+        layerBits ^= (layerBits & 0x80000000) ? 0xFFFFFFFF : 0x80000000;
 
-    static uint32_t sTextureAlasHandles[128] = { UINT32_MAX };
+        return (layerBits & 0xFFFF0000) | (quad.textureID & 0xFFFF);
+    }
 
-    Array<QuadPositionData> quadData;
+    //LSD radix sort of the quad indices by key, 8 bits a pass. Passes where every key has the same byte are skipped,
+    //which is most of them when only a few layers and atlases are used.
+    void radixSort(uint32_t* keys, uint32_t* indices, uint32_t* tempKeys, uint32_t* tempIndices, uint32_t count)
+    {
+        for (uint32_t shift = 0; shift < 32; shift += 8)
+        {
+            uint32_t histogram[256]{};
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                ++histogram[(keys[i] >> shift) & 0xFF];
+            }
+
+            if (histogram[(keys[0] >> shift) & 0xFF] == count)
+            {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (uint32_t bucket = 0; bucket < 256; ++bucket)
+            {
+                const uint32_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const uint32_t slot = histogram[(keys[i] >> shift) & 0xFF]++;
+                tempKeys[slot] = keys[i];
+                tempIndices[slot] = indices[i];
+            }
+
+            memcpy(keys, tempKeys, sizeof(uint32_t) * count);
+            memcpy(indices, tempIndices, sizeof(uint32_t) * count);
+        }
+    }
 }
 
 void Renderer2D::init(GPUDevice& inGPU)
 {
     gpu = &inGPU;
 
-    quadData.init(&MemoryService::instance()->systemAllocator, 16);
+    quads.init(&MemoryService::instance()->systemAllocator, 16);
+
+    atlas.init(*gpu);
 
     //Debug renderer
     PipelineCreation pipelineCreation2D{};
@@ -75,96 +97,88 @@ void Renderer2D::init(GPUDevice& inGPU)
     pipeline2D = gpu->createPipeline(pipelineCreation2D);
 
     camera2D.initOrthographic(-1.f, 1.f, (float)Window::instance()->width, (float)Window::instance()->height, 0.5f);
-}
-
-void Renderer2D::loadTexture(TextureAtlas atlas)
-{
-    TextureHandle textureResource;
-
-    int comp;
-    uint8_t mipLevels = 1;
-
-    stbi_set_flip_vertically_on_load(1);
-    uint8_t* imageData = stbi_load(sAtlasPaths[atlas], &width, &height, &comp, 4);
-    if (imageData == nullptr)
-    {
-        textureResource = INVALID_TEXTURE;
-        VOID_ERROR("Error loading texture %s", sAtlasPaths[atlas]);
-    }
 
-    TextureCreation creation;
-    creation.setData(imageData)
-        .setFormatType(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
-        .setFlags(mipLevels, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-        .setSize(static_cast<uint16_t>(width), static_cast<uint16_t>(height), 1)
-        .setName(sAtlasPaths[atlas]);
+    //Each frame in flight writes its own part of the ring. newFrame waits on frameTimelineValues[currentFrame] first,
+    //so the GPU is done with that part before it is written again.
+    BufferCreation bufferCreation{};
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(QuadData2D) * RENDERER_2D_MAX_SPRITES * FRAMES_IN_FLIGHT)
+        .setName("quadRing")
+        .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+    ringBufferHandle = gpu->createBindlessBuffer(bufferCreation);
 
-    sTextureAlasHandles[atlas] = gpu->createTexture(creation).index;
+    MapBufferParameters ringMap{ ringBufferHandle, 0, 0 };
+    ringData = static_cast<QuadData2D*>(gpu->mapBuffer(ringMap));
 
-    VOID_ASSERT(sTextureAlasHandles[atlas] != INVALID_TEXTURE.index);
+    scene2d.ortho = glms_ortho(0, (float)Window::instance()->width, 0, (float)Window::instance()->height, 0.f, 100.f);
 
-    free(imageData);
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(SceneData2D))
+        .setName("sceneData2D")
+        .setData(&scene2d);
+    sceneBDAHandle = gpu->createBindlessBuffer(bufferCreation);
 }
 
 void Renderer2D::addQuad(vec3s position, vec2s scale)
 {
-    const mat4s translationMatrix = glms_translate_make(position);
-    const mat4s scaleMatrix = glms_scale_make({ scale.x, scale.y, 1.f });
-    const mat4s transform = glms_mat4_mul(translationMatrix, scaleMatrix);
+    addQuad(position, scale, vec4s{ 0.f, 0.f, 1.f, 1.f }, Colour::white, INVALID_TEXTURE_ID);
+}
 
-    QuadPositionData data{};
-    data.transform = transform;
+void Renderer2D::addSprite(vec3s position, vec2s scale, SpriteID sprite)
+{
+    const Sprite& atlasSprite = atlas.getSprite(sprite);
+    addQuad(position, scale, atlasSprite.uvRect, Colour::white, atlasSprite.textureID);
+}
 
-    quadData.push(data);
-    instanceCount++;
+void Renderer2D::addQuad(vec3s position, vec2s scale, vec4s uvRect, uint32_t colour, uint32_t textureID)
+{
+    quads.push(QuadData2D{ vec2s{ position.x, position.y }, scale, uvRect, colour, textureID, position.z, 0.f });
 }
 
-void Renderer2D::addQuad(vec3s position, vec2s scale, vec2s spriteSize, vec2s rowAndColumn, vec2s offset, TextureAtlas atlas)
+void Renderer2D::clear()
 {
-    const mat4s translationMatrix = glms_translate_make(position);
-    const mat4s scaleMatrix = glms_scale_make({ scale.x, scale.y, 1.f });
-    const mat4s transform = glms_mat4_mul(translationMatrix, scaleMatrix);
-
-    vec2s min{};
-    min.x = ((rowAndColumn.x * spriteSize.x) / width);
-    min.y = ((rowAndColumn.y * spriteSize.y) / height);
-
-    vec2s max{};
-    max.x = ((rowAndColumn.x + offset.x) * spriteSize.x) / width;
-    max.y = ((rowAndColumn.y + offset.y) * spriteSize.y) / height;
-
-    QuadPositionData data{};
-    data.textureID = sTextureAlasHandles[atlas];
-    data.transform = transform;
-    data.texCoords[0] = vec2s{ min.x, max.y };
-    data.texCoords[1] = vec2s{ max.x, max.y };
-    data.texCoords[2] = vec2s{ max.x, min.y };
-    data.texCoords[3] = vec2s{ min.x, min.y };
-
-    quadData.push(data);
-    instanceCount++;
+    quads.setSize(0);
 }
 
-void Renderer2D::loadBuffer() 
+uint32_t Renderer2D::stream(uint32_t currentFrame)
 {
-    BufferCreation bufferCreation{};
-    bufferCreation.reset()
-        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(QuadPositionData) * quadData.size)
-        .setName("quadPosition")
-        .setData(quadData.data);
-    positionalBDAHandle = gpu->createBindlessBuffer(bufferCreation);
+    const uint32_t count = min(quads.size, RENDERER_2D_MAX_SPRITES);
+    if (count == 0)
+    {
+        return 0;
+    }
 
-    scene2d.ortho = glms_ortho(0, (float)Window::instance()->width, 0, (float)Window::instance()->height, 0.f, 100.f);
+    StackAllocator* scratchAllocator = &MemoryService::instance()->scratchAllocator;
+    size_t sortMarker = scratchAllocator->getMarker();
 
-    bufferCreation.reset()
-        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(SceneData2D))
-        .setName("sceneData2D")
-        .setData(&scene2d);
-    sceneBDAHandle = gpu->createBindlessBuffer(bufferCreation);
+    Array<uint32_t> keys;
+    keys.init(scratchAllocator, count * 4, count * 4);
+    uint32_t* indices = keys.data + count;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        keys[i] = sortKey(quads[i]);
+        indices[i] = i;
+    }
+
+    radixSort(keys.data, indices, indices + count, indices + count * 2, count);
+
+    //The ring is write combined memory, so it is only ever written front to back.
+    QuadData2D* frameQuads = ringData + RENDERER_2D_MAX_SPRITES * currentFrame;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        frameQuads[i] = quads[indices[i]];
+    }
+
+    scratchAllocator->freeMarker(sortMarker);
+
+    return count;
 }
 
 void Renderer2D::drawQuad(CommandBuffer& commandBuffer)
 {
+    const uint32_t count = stream(gpu->currentFrame);
+
     commandBuffer.bindPipeline(pipeline2D);
 
     camera2D.updateUICamera();
@@ -173,29 +187,69 @@ void Renderer2D::drawQuad(CommandBuffer& commandBuffer)
 
     commandBuffer.bindlessDescriptorSet(0);
 
-    Buffer* quadPositionBuffer = gpu->accessBuffer(positionalBDAHandle);
+    Buffer* ringBuffer = gpu->accessBuffer(ringBufferHandle);
     Buffer* sceneBuffer = gpu->accessBuffer(sceneBDAHandle);
 
     vmaCopyMemoryToAllocation(gpu->VMAAllocator, &scene2d, sceneBuffer->vmaAllocation, 0, sizeof(SceneData2D));
 
     PushConstant pushConstants{};
-    pushConstants.quadPostionAddress = quadPositionBuffer->bufferAddress;
+    pushConstants.quadPostionAddress = ringBuffer->bufferAddress;
     pushConstants.sceneAddress = sceneBuffer->bufferAddress;
 
     vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
 
-    commandBuffer.draw(6, instanceCount, 0, 0);
+    //The first instance selects this frames part of the ring.
+    if (count > 0)
+    {
+        commandBuffer.draw(6, count, 0, RENDERER_2D_MAX_SPRITES * gpu->currentFrame);
+    }
 }
 
-void Renderer2D::shutdown()
+#if defined(VOID_2D_BENCHMARK)
+void Renderer2D::benchmark()
 {
-    quadData.shutdown();
+    static constexpr uint32_t spriteCounts[] = { 10000, 50000, RENDERER_2D_MAX_SPRITES };
+    static constexpr uint32_t layerCount = 8;
 
-    for (uint32_t i = 0; i < ATLAS_COUNT; ++i)
+    const uint32_t retainedCount = quads.size;
+
+    for (uint32_t countIndex = 0; countIndex < ArraySize(spriteCounts); ++countIndex)
     {
-        gpu->destroyTexture({ sTextureAlasHandles[i] });
+        const uint32_t count = spriteCounts[countIndex];
+
+        //Random positions, layers and atlases so the sort has real work to do.
+        quads.setSize(retainedCount);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const vec3s position{ getRandomValue(0.f, (float)Window::instance()->width), getRandomValue(0.f, (float)Window::instance()->height), (i % layerCount) / (float)layerCount };
+            addQuad(position, vec2s{ 16.f, 16.f }, vec4s{ 0.f, 0.f, 1.f, 1.f }, Colour::white, i % 2 == 0 ? atlas.getSprite(SpriteID(i % SPRITE_COUNT)).textureID : INVALID_TEXTURE_ID);
+        }
+
+        static constexpr uint32_t iterations = 100;
+
+        const int64_t startTime = timeNow();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            stream(0);
+        }
+        const double elapsedMS = timeDeltaMilliseconds(startTime, timeNow()) / iterations;
+
+        vprint("Stream %u sprites: %3.4fms, %.0f sprites/ms.\n", quads.size, elapsedMS, quads.size / elapsedMS);
     }
-    gpu->destroyBuffer(positionalBDAHandle);
+
+    quads.setSize(retainedCount);
+}
+#endif //VOID_2D_BENCHMARK
+
+void Renderer2D::shutdown()
+{
+    MapBufferParameters ringMap{ ringBufferHandle, 0, 0 };
+    gpu->unmapBuffer(ringMap);
+
+    quads.shutdown();
+
+    atlas.shutdown(*gpu);
+    gpu->destroyBuffer(ringBufferHandle);
     gpu->destroyBuffer(sceneBDAHandle);
 
     gpu->destroyPipeline(pipeline2D);
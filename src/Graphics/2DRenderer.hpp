@@ -19,53 +19,74 @@
 #include "Application/Window.hpp"
 
 #include "ShaderData.hpp"
+#include "SpriteAtlas.hpp"
 
 #include <SDL3/SDL_mouse.h>
 
+//Define this to log how many sprites per millisecond the CPU submission sorts and streams for 10K, 50K and the full capacity when the game starts.
+//#define VOID_2D_BENCHMARK
+
+//Sprites one frame can stream, the ring buffer holds this many per frame in flight and the rest of a frame is dropped.
+static constexpr uint32_t RENDERER_2D_MAX_SPRITES = 65536;
+
 struct SceneData2D
 {
 	mat4s ortho;
 };
 
-enum TextureAtlas
-{
-	ATLAS_TEST,
-
-	ATLAS_COUNT
-};
+struct GPUDevice;
 
-static constexpr const char* sAtlasPaths[COUNT] =
+//Mirrors QuadData in 2DShader.vert. The position is the corner at the start of the uv rectangle and z is the layer.
+struct QuadData2D
 {
-	"Assets/Textures/mainMenuUI.png"
+	vec2s position;
+	vec2s size;
+	vec4s uvRect;
+	//Packed like Colour, red in the lowest byte.
+	uint32_t colour;
+	uint32_t textureID;
+	float layer;
+	float padd;
 };
 
-struct GPUDevice;
-
+//Quads stay until clear() and are streamed again every frame, so changes show up on the next draw.
+//drawQuad sorts them by layer and texture into this frames part of a persistently mapped ring buffer.
+//The textures are bindless, so the whole frame is a single instanced draw.
 struct Renderer2D
 {
 	void init(GPUDevice& inGPU);
-	void loadTexture(TextureAtlas atlas);
 	void addQuad(vec3s position, vec2s scale);
-	void addQuad(vec3s position, vec2s scale, vec2s spriteSize, vec2s rowAndColumn, vec2s offset, TextureAtlas atlas);
-	void loadBuffer();
+	//Draws a sprite from the atlas stretched over the quad.
+	void addSprite(vec3s position, vec2s scale, SpriteID sprite);
+	//The uv rectangle is (u, v) at the position followed by (u, v) at the opposite corner, textureID is a bindless index or UINT16_MAX.
+	void addQuad(vec3s position, vec2s scale, vec4s uvRect, uint32_t colour, uint32_t textureID);
+	void clear();
+	//Sorts and writes the quads into the ring buffer for this frame, returns the number written.
+	uint32_t stream(uint32_t currentFrame);
 	void drawQuad(CommandBuffer& commandBuffer);
 	void shutdown();
 
+#if defined(VOID_2D_BENCHMARK)
+	//Streams random sprites and logs the throughput, the quads added so far are kept.
+	void benchmark();
+#endif //VOID_2D_BENCHMARK
+
 	SceneData2D scene2d{};
 
 	Camera camera2D;
 
 	GPUDevice* gpu;
 
-	int width;
-	int height;
-
 	PipelineHandle pipeline2D;
 	DescriptorSetLayoutHandle descriptorSetLayout2D;
-	BufferHandle positionalBDAHandle = INVALID_BUFFER;
+	//RENDERER_2D_MAX_SPRITES quads per frame in flight, mapped for the lifetime of the renderer.
+	BufferHandle ringBufferHandle = INVALID_BUFFER;
 	BufferHandle sceneBDAHandle = INVALID_BUFFER;
+	QuadData2D* ringData = nullptr;
+
+	Array<QuadData2D> quads;
 
-	uint32_t instanceCount = 0;
+	SpriteAtlas atlas;
 };
 
 #endif // !RENDER_2D_HDR
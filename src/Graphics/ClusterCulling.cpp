@@ -0,0 +1,279 @@
+#include "ClusterCulling.hpp"
+#include "CommandBuffer.hpp"
+#include "GeometryBuffer.hpp"
+
+#include "Foundation/File.hpp"
+#include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
+
+namespace
+{
+    //Uniform scale is assumed, so the largest axis scale is used for the radius.
+    float transformScale(const mat4s& transform)
+    {
+        return max(max(glms_vec3_norm(glms_vec3(transform.col[0])), glms_vec3_norm(glms_vec3(transform.col[1]))), glms_vec3_norm(glms_vec3(transform.col[2])));
+    }
+
+    //Same test as clusterCulling.comp, the cone rejects clusters where every triangle faces away from the eye.
+    bool clusterVisible(const MeshCluster& cluster, const mat4s& transform, float scale, const Frustum& frustum)
+    {
+        const vec3s centre = glms_mat4_mulv3(transform, cluster.centre, 1.f);
+        const float radius = cluster.radius * scale;
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            const vec4s& plane = frustum.planes[i];
+            if (plane.x * centre.x + plane.y * centre.y + plane.z * centre.z + plane.w < -radius)
+            {
+                return false;
+            }
+        }
+
+        const vec3s apex = glms_mat4_mulv3(transform, cluster.coneApex, 1.f);
+        const vec3s axis = glms_vec3_normalize(glms_mat4_mulv3(transform, cluster.coneAxis, 0.f));
+        return glms_vec3_dot(glms_vec3_normalize(glms_vec3_sub(apex, frustum.eye)), axis) < cluster.coneCutoff;
+    }
+}
+
+void ClusterCuller::init(GPUDevice& gpu, const InstanceCuller& culler, const Array<Model>& models, const GeometryBuffer& geometry)
+{
+    Allocator* allocator = &MemoryService::instance()->systemAllocator;
+
+    FileReadResult computeShaderCode = fileReadBinary("Assets/Shaders/clusterCulling.comp.spv", &MemoryService::instance()->scratchAllocator);
+
+    PipelineCreation pipelineCreation{};
+    pipelineCreation.shaders.setName("clusterCulling")
+        .addStage(computeShaderCode.data, uint32_t(computeShaderCode.size), VK_SHADER_STAGE_COMPUTE_BIT)
+        .setSPVInput(true);
+    cullingPipeline = gpu.createPipeline(pipelineCreation);
+
+    clusters.init(allocator, 0);
+    chunks.init(allocator, 0);
+
+    maxInstances = 0;
+    maxDrawCount = 0;
+    uint32_t indexEnd = 0;
+    for (uint32_t model = 0; model < models.size; ++model)
+    {
+        //Only LOD 0 is clustered, its bucket keeps one spare slot for the branch-free compaction.
+        const uint32_t bucket = model * MAX_MESH_LODS;
+        const uint32_t bucketEnd = bucket + 1 < culler.bucketCount ? culler.visibleFirst[bucket + 1] : culler.visibleIndices.size;
+        const uint32_t modelInstances = bucketEnd - culler.visibleFirst[bucket] - 1;
+
+        const Array<MeshDraw>& meshDraws = models[model].meshDraws;
+        for (uint32_t mesh = 0; mesh < meshDraws.size; ++mesh)
+        {
+            const MeshDraw& meshDraw = meshDraws[mesh];
+            if (meshDraw.clusterCount == 0)
+            {
+                continue;
+            }
+
+            const uint32_t meshFirstCluster = clusters.size;
+            for (uint32_t cluster = 0; cluster < meshDraw.clusterCount; ++cluster)
+            {
+                const MeshCluster& meshCluster = models[model].clusters[meshDraw.firstCluster + cluster];
+                indexEnd = max(indexEnd, meshCluster.firstIndex + meshCluster.indexCount);
+                clusters.push(meshCluster);
+            }
+
+            for (uint32_t first = 0; first < meshDraw.clusterCount; first += CLUSTER_CHUNK_SIZE)
+            {
+                chunks.push(ClusterChunk{ meshFirstCluster + first, min(CLUSTER_CHUNK_SIZE, meshDraw.clusterCount - first), bucket, meshDraw.vertexOffset, meshDraw.materialIndex });
+                maxDrawCount += modelInstances;
+            }
+
+            maxInstances = max(maxInstances, modelInstances);
+        }
+    }
+
+    VOID_ASSERTM(maxInstances <= UINT16_MAX, "%u LOD 0 instances is more than the cluster culling dispatch can cover.", maxInstances);
+
+    //The CPU reference reads the cluster indices from a host copy instead of the GPU buffer every frame.
+    sourceIndices.init(allocator, indexEnd, indexEnd);
+    if (indexEnd > 0)
+    {
+        Buffer* geometryIndices = gpu.accessBuffer(geometry.indexBuffer);
+        vmaCopyAllocationToMemory(gpu.VMAAllocator, geometryIndices->vmaAllocation, 0, sourceIndices.data, sizeof(uint32_t) * indexEnd);
+    }
+
+    BufferCreation bufferCreation{};
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(MeshCluster) * clusters.size)
+        .setName("clusters")
+        .setCategory(GPU_MEMORY_CATEGORY_GEOMETRY)
+        .setData(clusters.data);
+    clusterBuffer = gpu.createBindlessBuffer(bufferCreation);
+
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(ClusterChunk) * chunks.size)
+        .setName("clusterChunks")
+        .setCategory(GPU_MEMORY_CATEGORY_GEOMETRY)
+        .setData(chunks.data);
+    chunkBuffer = gpu.createBindlessBuffer(bufferCreation);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        //The counters are cleared with vkCmdFillBuffer every frame.
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * 2)
+            .setName("clusterCounts")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        countBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * CLUSTER_INDEX_CAPACITY)
+            .setName("clusterIndices")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        indexBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(DrawCommand) * maxDrawCount)
+            .setName("clusterDrawCommands")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        drawCommandBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+    }
+}
+
+void ClusterCuller::shutdown(GPUDevice& gpu)
+{
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        gpu.destroyBuffer(countBuffer[i]);
+        gpu.destroyBuffer(indexBuffer[i]);
+        gpu.destroyBuffer(drawCommandBuffer[i]);
+    }
+
+    gpu.destroyBuffer(clusterBuffer);
+    gpu.destroyBuffer(chunkBuffer);
+
+    gpu.destroyPipeline(cullingPipeline);
+
+    sourceIndices.shutdown();
+    chunks.shutdown();
+    clusters.shutdown();
+}
+
+void ClusterCuller::cull(GPUDevice& gpu, const InstanceCuller& culler, const Frustum& frustum, const EntityData* entities, uint32_t currentFrame)
+{
+    hostDrawCount = 0;
+    if (chunks.size == 0)
+    {
+        return;
+    }
+
+    MapBufferParameters indexMap{ indexBuffer[currentFrame], 0, 0 };
+    uint32_t* indices = static_cast<uint32_t*>(gpu.mapBuffer(indexMap));
+    MapBufferParameters commandMap{ drawCommandBuffer[currentFrame], 0, 0 };
+    DrawCommand* commands = static_cast<DrawCommand*>(gpu.mapBuffer(commandMap));
+
+    uint32_t indexCount = 0;
+    for (uint32_t chunkIndex = 0; chunkIndex < chunks.size; ++chunkIndex)
+    {
+        const ClusterChunk& chunk = chunks[chunkIndex];
+        const uint32_t visibleFirst = culler.visibleFirst[chunk.bucketIndex];
+
+        for (uint32_t visibleSlot = 0; visibleSlot < culler.visibleCount[chunk.bucketIndex]; ++visibleSlot)
+        {
+            const mat4s transform = unpackEntityTransform(entities[culler.visibleIndices[visibleFirst + visibleSlot]]);
+            const float scale = transformScale(transform);
+
+            //Like the compute version, a chunk that doesn't fit in the index buffer is dropped as a whole.
+            const uint32_t drawFirst = indexCount;
+            bool overflow = false;
+            for (uint32_t clusterIndex = chunk.firstCluster; clusterIndex < chunk.firstCluster + chunk.clusterCount; ++clusterIndex)
+            {
+                const MeshCluster& cluster = clusters[clusterIndex];
+                if (clusterVisible(cluster, transform, scale, frustum) == false)
+                {
+                    continue;
+                }
+
+                if (indexCount + cluster.indexCount > CLUSTER_INDEX_CAPACITY)
+                {
+                    overflow = true;
+                    break;
+                }
+
+                memoryCopy(indices + indexCount, sourceIndices.data + cluster.firstIndex, sizeof(uint32_t) * cluster.indexCount);
+                indexCount += cluster.indexCount;
+            }
+
+            if (overflow)
+            {
+                indexCount = drawFirst;
+                continue;
+            }
+
+            if (indexCount == drawFirst)
+            {
+                continue;
+            }
+
+            DrawCommand& command = commands[hostDrawCount++];
+            command.command.indexCount = indexCount - drawFirst;
+            command.command.instanceCount = 1;
+            command.command.firstIndex = drawFirst;
+            command.command.vertexOffset = chunk.vertexOffset;
+            command.command.firstInstance = visibleFirst + visibleSlot;
+            command.materialIndex = chunk.materialIndex;
+        }
+    }
+
+    gpu.unmapBuffer(commandMap);
+    gpu.unmapBuffer(indexMap);
+}
+
+void ClusterCuller::cull(CommandBuffer& commandBuffer, const GPUCuller& gpuCuller, const Frustum& frustum, BufferHandle entityBuffer, BufferHandle visibleIndexBuffer,
+                         const GeometryBuffer& geometry, uint32_t currentFrame)
+{
+    if (chunks.size == 0)
+    {
+        return;
+    }
+
+    GPUDevice& gpu = *commandBuffer.device;
+
+    ClusterCullingPushConstants pushConstants{};
+    pushConstants.planeAddress = gpu.accessBuffer(gpuCuller.planeBuffer[currentFrame])->bufferAddress;
+    pushConstants.modelPositionAddress = gpu.accessBuffer(entityBuffer)->bufferAddress;
+    pushConstants.clusterAddress = gpu.accessBuffer(clusterBuffer)->bufferAddress;
+    pushConstants.chunkAddress = gpu.accessBuffer(chunkBuffer)->bufferAddress;
+    pushConstants.bucketAddress = gpu.accessBuffer(gpuCuller.bucketBuffer)->bufferAddress;
+    pushConstants.bucketCountAddress = gpu.accessBuffer(gpuCuller.countBuffer[currentFrame])->bufferAddress;
+    pushConstants.visibleIndexAddress = gpu.accessBuffer(visibleIndexBuffer)->bufferAddress;
+    pushConstants.sourceIndexAddress = gpu.accessBuffer(geometry.indexBuffer)->bufferAddress;
+    pushConstants.clusterIndexAddress = gpu.accessBuffer(indexBuffer[currentFrame])->bufferAddress;
+    pushConstants.countAddress = gpu.accessBuffer(countBuffer[currentFrame])->bufferAddress;
+    pushConstants.drawCommandAddress = gpu.accessBuffer(drawCommandBuffer[currentFrame])->bufferAddress;
+    pushConstants.eye = frustum.eye;
+    pushConstants.indexCapacity = CLUSTER_INDEX_CAPACITY;
+
+    //The frame graph orders this after instance culling, only the counter clear has to be waited on here.
+    commandBuffer.fillBuffer(countBuffer[currentFrame], 0, 0, 0);
+    commandBuffer.memoryBarrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    //One workgroup per chunk and LOD 0 instance slot, groups past the visible count of their bucket exit straight away.
+    commandBuffer.bindPipeline(cullingPipeline);
+    vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    commandBuffer.dispatch(chunks.size, maxInstances, 1);
+}
+
+void ClusterCuller::draw(CommandBuffer& commandBuffer, uint32_t currentFrame, bool gpuCulled)
+{
+    if (chunks.size == 0)
+    {
+        return;
+    }
+
+    commandBuffer.bindIndexBuffer(indexBuffer[currentFrame], 0, VK_INDEX_TYPE_UINT32);
+
+    if (gpuCulled)
+    {
+        commandBuffer.drawIndexedIndirectCount(drawCommandBuffer[currentFrame], 0, countBuffer[currentFrame], 0, maxDrawCount, sizeof(DrawCommand));
+    }
+    else if (hostDrawCount > 0)
+    {
+        commandBuffer.drawIndexedIndirect(drawCommandBuffer[currentFrame], hostDrawCount, 0, sizeof(DrawCommand));
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef CLUSTER_CULLING_HDR
+#define CLUSTER_CULLING_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Array.hpp"
+
+#include "GPUDevice.hpp"
+#include "FrustumCulling.hpp"
+
+//Each workgroup of clusterCulling.comp tests one chunk of clusters, so chunks are never larger than the workgroup.
+static constexpr uint32_t CLUSTER_CHUNK_SIZE = 64;
+//Indices the culled clusters of one frame can write, chunks that don't fit are dropped for that frame.
+static constexpr uint32_t CLUSTER_INDEX_CAPACITY = void_mega(2);
+
+struct CommandBuffer;
+
+//Culls the meshlets of every visible LOD 0 instance against the frustum and their normal cone, then writes the indices of the
+//surviving clusters into a per frame index buffer with one draw per instance and chunk. This keeps cluster culling working without mesh shaders.
+//Coarser LODs are small on screen so they are drawn whole by the GPUCuller.
+struct ClusterCuller
+{
+    void init(GPUDevice& gpu, const InstanceCuller& culler, const Array<Model>& models, const GeometryBuffer& geometry);
+    void shutdown(GPUDevice& gpu);
+
+    //CPU reference, uses the visible instances of the InstanceCuller and uploads the index lists and draws.
+    void cull(GPUDevice& gpu, const InstanceCuller& culler, const Frustum& frustum, const EntityData* entities, uint32_t currentFrame);
+    //Records the cluster culling dispatch from a frame graph compute pass after GPUCuller::cull.
+    void cull(CommandBuffer& commandBuffer, const GPUCuller& gpuCuller, const Frustum& frustum, BufferHandle entityBuffer, BufferHandle visibleIndexBuffer,
+              const GeometryBuffer& geometry, uint32_t currentFrame);
+
+    //Binds the cluster index buffer, the push constants have to point drawCommandAddress at drawCommandBuffer first.
+    void draw(CommandBuffer& commandBuffer, uint32_t currentFrame, bool gpuCulled);
+
+    PipelineHandle cullingPipeline;
+
+    //Static data.
+    BufferHandle clusterBuffer;
+    BufferHandle chunkBuffer;
+
+    //Per frame data, the count buffer holds the draw count followed by the written index count.
+    BufferHandle countBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle indexBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle drawCommandBuffer[FRAMES_IN_FLIGHT];
+
+    Array<MeshCluster> clusters;
+    Array<ClusterChunk> chunks;
+
+    //Host copy of the clustered index ranges for the CPU reference, indexed the same as the geometry index buffer.
+    Array<uint32_t> sourceIndices;
+
+    //Instances in the LOD 0 bucket of the largest model, the dispatch covers this many instances per chunk.
+    uint32_t maxInstances = 0;
+    uint32_t maxDrawCount = 0;
+
+    //Draw count written by the CPU reference.
+    uint32_t hostDrawCount = 0;
+};
+
+#endif // !CLUSTER_CULLING_HDR
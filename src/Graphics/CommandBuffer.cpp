@@ -259,6 +259,14 @@ void CommandBuffer::drawIndexedIndirect(BufferHandle bufferHandle, uint32_t draw
     vkCmdDrawIndexedIndirect(vkCommandBuffer, vkBuffer, vkOffset, drawCount, stride);
 }
 
+void CommandBuffer::drawIndexedIndirectCount(BufferHandle bufferHandle, uint32_t offset, BufferHandle countHandle, uint32_t countOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+    Buffer* buffer = device->accessBuffer(bufferHandle);
+    Buffer* countBuffer = device->accessBuffer(countHandle);
+
+    vkCmdDrawIndexedIndirectCount(vkCommandBuffer, buffer->vkBuffer, VkDeviceSize(offset), countBuffer->vkBuffer, VkDeviceSize(countOffset), maxDrawCount, stride);
+}
+
 void CommandBuffer::dispatch(uint32_t groupX, uint32_t groupY, uint32_t groupZ)
 {
     vkCmdDispatch(vkCommandBuffer, groupX, groupY, groupZ);
@@ -277,11 +285,28 @@ void CommandBuffer::fillBuffer(BufferHandle buffer, uint32_t offset, uint32_t si
 {
     Buffer* vkBuffer = device->accessBuffer(buffer);
     vkCmdFillBuffer(vkCommandBuffer, vkBuffer->vkBuffer, VkDeviceSize(offset), size ? 
-                                                                                VkDeviceSize(offset) : 
-                                                                                VkDeviceSize(vkBuffer->size), 
+                                                                                VkDeviceSize(size) : 
+                                                                                VK_WHOLE_SIZE, 
                                                                                 data);
 }
 
+void CommandBuffer::memoryBarrier(VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = srcStage;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstStageMask = dstStage;
+    barrier.dstAccessMask = dstAccess;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &barrier;
+
+    vkCmdPipelineBarrier2(vkCommandBuffer, &dependencyInfo);
+}
+
 void CommandBuffer::pushMarker(const char* name)
 {
     device->pushGPUTimestamp(this, name);
@@ -309,6 +334,7 @@ void CommandBuffer::popMarker()
 void CommandBuffer::reset()
 {
     isRecording = false;
+    presentTransitioned = false;
     currentPipeline = nullptr;
     currentCommand = 0;
 }
\ No newline at end of file
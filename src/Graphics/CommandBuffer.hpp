@@ -24,11 +24,14 @@ struct CommandBuffer
                                           uint32_t firstInstance);
     void drawIndirect(BufferHandle handle, uint32_t offset, uint32_t stride);
     void drawIndexedIndirect(BufferHandle handle, uint32_t drawCount, uint32_t offset, uint32_t stride);
+    void drawIndexedIndirectCount(BufferHandle handle, uint32_t offset, BufferHandle countHandle, uint32_t countOffset, uint32_t maxDrawCount, uint32_t stride);
 
     void dispatch(uint32_t groupX, uint32_t groupY, uint32_t groupZ);
     void dispatchIndirect(BufferHandle handle, uint32_t offset);
 
     void fillBuffer(BufferHandle buffer, uint32_t offset, uint32_t size, uint32_t data);
+    //Global memory barrier, used between passes that communicate through bindless buffers.
+    void memoryBarrier(VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
 
     void pushMarker(const char* name);
     void popMarker();
@@ -41,6 +44,8 @@ struct CommandBuffer
 
     Pipeline* currentPipeline;
     bool isRecording;
+    //Set when rendering was ended and the swapchain image moved to present by the recorder (the frame graph), so present() leaves it alone.
+    bool presentTransitioned;
 
     uint32_t handle;
 
@@ -0,0 +1,157 @@
+#include "DepthPyramid.hpp"
+#include "CommandBuffer.hpp"
+
+#include "Foundation/File.hpp"
+#include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
+
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/vec3.h"
+
+namespace
+{
+    //depthPyramid.comp runs 8x8 threads per group.
+    static constexpr uint32_t DEPTH_PYRAMID_GROUP_SIZE = 8;
+
+    uint32_t previousPowerOfTwo(uint32_t value)
+    {
+        uint32_t result = 1;
+        while (result * 2 <= value)
+        {
+            result *= 2;
+        }
+
+        return result;
+    }
+}
+
+void DepthPyramid::init(GPUDevice& gpu)
+{
+    FileReadResult computeShaderCode = fileReadBinary("Assets/Shaders/depthPyramid.comp.spv", &MemoryService::instance()->scratchAllocator);
+
+    //Level 0 samples the depth texture through the bindless array.
+    PipelineCreation pipelineCreation{};
+    pipelineCreation.shaders.setName("depthPyramid")
+        .addStage(computeShaderCode.data, uint32_t(computeShaderCode.size), VK_SHADER_STAGE_COMPUTE_BIT)
+        .setSPVInput(true);
+    pipelineCreation.addDescriptorSetLayout(gpu.bindlessDescriptorSetLayoutHandle);
+    reducePipeline = gpu.createPipeline(pipelineCreation);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        pyramidBuffer[i] = INVALID_BUFFER;
+    }
+
+    resize(gpu);
+}
+
+void DepthPyramid::shutdown(GPUDevice& gpu)
+{
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        gpu.destroyBuffer(pyramidBuffer[i]);
+    }
+
+    gpu.destroyPipeline(reducePipeline);
+}
+
+void DepthPyramid::resize(GPUDevice& gpu)
+{
+    sourceWidth = gpu.swapchainWidth;
+    sourceHeight = gpu.swapchainHeight;
+
+    width = previousPowerOfTwo(sourceWidth);
+    height = previousPowerOfTwo(sourceHeight);
+
+    uint32_t texelCount = 0;
+    levelCount = 0;
+    for (uint32_t levelWidth = width, levelHeight = height; ; levelWidth = max(levelWidth / 2, 1u), levelHeight = max(levelHeight / 2, 1u))
+    {
+        VOID_ASSERTM(levelCount < DEPTH_PYRAMID_MAX_LEVELS, "A %ux%u depth pyramid needs more than %u levels.", width, height, DEPTH_PYRAMID_MAX_LEVELS);
+
+        levelOffsets[levelCount++] = texelCount;
+        texelCount += levelWidth * levelHeight;
+
+        if (levelWidth == 1 && levelHeight == 1)
+        {
+            break;
+        }
+    }
+
+    //The old buffers are only freed once the frames using them have finished.
+    BufferCreation bufferCreation{};
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        if (pyramidBuffer[i].index != INVALID_INDEX)
+        {
+            gpu.destroyBuffer(pyramidBuffer[i]);
+        }
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(float) * texelCount)
+            .setName("depthPyramid")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        pyramidBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+    }
+}
+
+void DepthPyramid::build(CommandBuffer& commandBuffer, TextureHandle depthTexture, uint32_t currentFrame)
+{
+    GPUDevice& gpu = *commandBuffer.device;
+
+    if (sourceWidth != gpu.swapchainWidth || sourceHeight != gpu.swapchainHeight)
+    {
+        resize(gpu);
+    }
+
+    DepthPyramidPushConstants pushConstants{};
+    pushConstants.pyramidAddress = gpu.accessBuffer(pyramidBuffer[currentFrame])->bufferAddress;
+    pushConstants.depthTexture = depthTexture.index;
+
+    commandBuffer.bindPipeline(reducePipeline);
+    commandBuffer.bindlessDescriptorSet(0);
+
+    //Every level reads the one above it, so each dispatch waits on the last.
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        pushConstants.level = level;
+        pushConstants.sourceOffset = level > 0 ? levelOffsets[level - 1] : 0;
+        pushConstants.sourceWidth = level > 0 ? max(width >> (level - 1), 1u) : sourceWidth;
+        pushConstants.sourceHeight = level > 0 ? max(height >> (level - 1), 1u) : sourceHeight;
+        pushConstants.destinationOffset = levelOffsets[level];
+        pushConstants.destinationWidth = max(width >> level, 1u);
+        pushConstants.destinationHeight = max(height >> level, 1u);
+
+        if (level > 0)
+        {
+            commandBuffer.memoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+        }
+
+        vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        commandBuffer.dispatch((pushConstants.destinationWidth + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+                               (pushConstants.destinationHeight + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, 1);
+    }
+}
+
+void DepthPyramid::fillOcclusion(GPUDevice& gpu, const Camera& camera, const mat4s& globalModel, uint32_t currentFrame, CullingOcclusion& occlusion) const
+{
+    occlusion.view = glms_mat4_mul(camera.view, globalModel);
+    occlusion.pyramidAddress = gpu.accessBuffer(pyramidBuffer[currentFrame])->bufferAddress;
+    occlusion.projectionX = camera.projection.m00;
+    occlusion.projectionY = camera.projection.m11;
+    occlusion.nearPlane = camera.nearPlane;
+
+    //depth = (m22 * z + m32) / -z for a view space z, written with the positive view depth d = -z.
+    occlusion.depthScale = camera.projection.m32;
+    occlusion.depthBias = camera.projection.m22;
+    occlusion.radiusScale = glms_vec3_norm(glms_vec3(globalModel.col[0]));
+
+    occlusion.pyramidWidth = width;
+    occlusion.pyramidHeight = height;
+    occlusion.levelCount = levelCount;
+    for (uint32_t level = 0; level < DEPTH_PYRAMID_MAX_LEVELS; ++level)
+    {
+        occlusion.levelOffsets[level] = levelOffsets[level];
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef DEPTH_PYRAMID_HDR
+#define DEPTH_PYRAMID_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Camera.hpp"
+
+#include "GPUDevice.hpp"
+#include "ShaderData.hpp"
+
+struct CommandBuffer;
+
+//Hierarchical depth used for occlusion culling. Level 0 is the swapchain rounded down to a power of two and every level after it halves
+//the one above down to a single texel. A texel keeps the farthest depth under it, so a sphere nearer than that is never hidden.
+//The levels are packed one after the other in a storage buffer, this avoids a storage image view per level.
+struct DepthPyramid
+{
+    void init(GPUDevice& gpu);
+    void shutdown(GPUDevice& gpu);
+
+    //Records the reduction from a frame graph compute pass that samples the depth texture, the pyramid follows the swapchain size.
+    void build(CommandBuffer& commandBuffer, TextureHandle depthTexture, uint32_t currentFrame);
+    //Fills the data the late culling phase tests against, call after build. The global model has to be a uniform scale like for the frustum.
+    void fillOcclusion(GPUDevice& gpu, const Camera& camera, const mat4s& globalModel, uint32_t currentFrame, CullingOcclusion& occlusion) const;
+
+    //Helpers
+    void resize(GPUDevice& gpu);
+
+    PipelineHandle reducePipeline;
+
+    //Per frame data.
+    BufferHandle pyramidBuffer[FRAMES_IN_FLIGHT];
+
+    uint32_t levelOffsets[DEPTH_PYRAMID_MAX_LEVELS]{};
+    uint32_t levelCount = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    //Swapchain size the pyramid was sized for.
+    uint16_t sourceWidth = 0;
+    uint16_t sourceHeight = 0;
+};
+
+#endif // !DEPTH_PYRAMID_HDR
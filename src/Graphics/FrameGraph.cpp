@@ -0,0 +1,893 @@
+#include "FrameGraph.hpp"
+#include "CommandBuffer.hpp"
+
+#include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
+#include "Foundation/Log.hpp"
+
+namespace
+{
+    static constexpr uint16_t WRITE_USAGES = FRAME_GRAPH_COLOUR_ATTACHMENT | FRAME_GRAPH_DEPTH_ATTACHMENT | FRAME_GRAPH_STORAGE_WRITE | FRAME_GRAPH_TRANSFER_WRITE;
+    static constexpr uint16_t ATTACHMENT_USAGES = FRAME_GRAPH_COLOUR_ATTACHMENT | FRAME_GRAPH_DEPTH_ATTACHMENT;
+    static constexpr VkAccessFlags2 WRITE_ACCESS = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    //Barriers recorded in one vkCmdPipelineBarrier2.
+    static constexpr uint32_t MAX_PASS_BARRIERS = 32;
+
+    VkPipelineStageFlags2 usageStage(uint16_t usage, FrameGraphPassType type)
+    {
+        const VkPipelineStageFlags2 shaderStage = type == FRAME_GRAPH_COMPUTE ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT :
+                                                                                VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+
+        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+        stage |= usage & FRAME_GRAPH_COLOUR_ATTACHMENT ? VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT : 0;
+        stage |= usage & FRAME_GRAPH_DEPTH_ATTACHMENT ? VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT : 0;
+        stage |= usage & (FRAME_GRAPH_SAMPLED | FRAME_GRAPH_STORAGE_READ | FRAME_GRAPH_STORAGE_WRITE) ? shaderStage : 0;
+        stage |= usage & FRAME_GRAPH_INDIRECT_READ ? VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT : 0;
+        stage |= usage & FRAME_GRAPH_INDEX_READ ? VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT : 0;
+        stage |= usage & (FRAME_GRAPH_TRANSFER_READ | FRAME_GRAPH_TRANSFER_WRITE) ? VK_PIPELINE_STAGE_2_TRANSFER_BIT : 0;
+        return stage;
+    }
+
+    VkAccessFlags2 usageAccess(uint16_t usage)
+    {
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+        access |= usage & FRAME_GRAPH_COLOUR_ATTACHMENT ? VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : 0;
+        access |= usage & FRAME_GRAPH_DEPTH_ATTACHMENT ? VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0;
+        access |= usage & FRAME_GRAPH_SAMPLED ? VK_ACCESS_2_SHADER_SAMPLED_READ_BIT : 0;
+        access |= usage & FRAME_GRAPH_STORAGE_READ ? VK_ACCESS_2_SHADER_STORAGE_READ_BIT : 0;
+        //Storage writes are mostly atomics in this renderer so they read as well.
+        access |= usage & FRAME_GRAPH_STORAGE_WRITE ? VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT : 0;
+        access |= usage & FRAME_GRAPH_INDIRECT_READ ? VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT : 0;
+        access |= usage & FRAME_GRAPH_INDEX_READ ? VK_ACCESS_2_INDEX_READ_BIT : 0;
+        access |= usage & FRAME_GRAPH_TRANSFER_READ ? VK_ACCESS_2_TRANSFER_READ_BIT : 0;
+        access |= usage & FRAME_GRAPH_TRANSFER_WRITE ? VK_ACCESS_2_TRANSFER_WRITE_BIT : 0;
+        return access;
+    }
+
+    VkImageLayout usageLayout(uint16_t usage, VkFormat format)
+    {
+        if (usage & FRAME_GRAPH_COLOUR_ATTACHMENT)
+        {
+            VOID_ASSERTM((usage & ~FRAME_GRAPH_COLOUR_ATTACHMENT) == 0, "A colour attachment can't be used any other way in the same pass.");
+            return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        }
+
+        if (usage & FRAME_GRAPH_DEPTH_ATTACHMENT)
+        {
+            VOID_ASSERTM((usage & ~FRAME_GRAPH_DEPTH_ATTACHMENT) == 0, "A depth attachment can't be used any other way in the same pass.");
+            return TextureFormat::hasStencil(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        }
+
+        if (usage & (FRAME_GRAPH_STORAGE_READ | FRAME_GRAPH_STORAGE_WRITE))
+        {
+            return VK_IMAGE_LAYOUT_GENERAL;
+        }
+
+        if (usage == FRAME_GRAPH_SAMPLED)
+        {
+            return VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+        }
+
+        if (usage == FRAME_GRAPH_TRANSFER_READ)
+        {
+            return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        }
+
+        if (usage == FRAME_GRAPH_TRANSFER_WRITE)
+        {
+            return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        }
+
+        //Mixed reads, e.g. sampled and copied in the same pass.
+        return VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    VkImageUsageFlags usageImageFlags(uint16_t usage)
+    {
+        //Transient textures go in the bindless array like every other texture, which requires them to be sampled.
+        VkImageUsageFlags flags = VK_IMAGE_USAGE_SAMPLED_BIT;
+        flags |= usage & FRAME_GRAPH_COLOUR_ATTACHMENT ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : 0;
+        flags |= usage & FRAME_GRAPH_DEPTH_ATTACHMENT ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : 0;
+        flags |= usage & (FRAME_GRAPH_STORAGE_READ | FRAME_GRAPH_STORAGE_WRITE) ? VK_IMAGE_USAGE_STORAGE_BIT : 0;
+        flags |= usage & FRAME_GRAPH_TRANSFER_READ ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0;
+        flags |= usage & FRAME_GRAPH_TRANSFER_WRITE ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0;
+        return flags;
+    }
+
+    VkImageAspectFlags formatAspect(VkFormat format)
+    {
+        if (TextureFormat::hasDepthOrStencil(format) == false)
+        {
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+
+        VkImageAspectFlags aspect = TextureFormat::isStencilOnly(format) ? 0 : VK_IMAGE_ASPECT_DEPTH_BIT;
+        aspect |= TextureFormat::hasStencil(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0;
+        return aspect;
+    }
+
+    bool sameAttachments(const FrameGraphPass& a, const FrameGraphPass& b)
+    {
+        if (a.colourAttachmentCount != b.colourAttachmentCount || a.depthAttachment != b.depthAttachment)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < a.colourAttachmentCount; ++i)
+        {
+            if (a.colourAttachments[i] != b.colourAttachments[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    //Moves the resource to its new usage, returns true and fills the barrier when the previous accesses have to be waited on.
+    bool transition(FrameGraphState& state, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess, VkImageLayout layout, bool write, bool image,
+                    FrameGraphBarrier& barrier)
+    {
+        const bool layoutChange = image && state.layout != layout;
+
+        barrier.srcStage = VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccess = VK_ACCESS_2_NONE;
+        barrier.dstStage = dstStage;
+        barrier.dstAccess = dstAccess;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = layout;
+
+        if (layoutChange || write)
+        {
+            //Everything since the last write has to finish first and the write itself has to be made available.
+            barrier.srcStage = state.writeStage | state.readStage;
+            barrier.srcAccess = state.writeAccess;
+        }
+        else if (state.writeStage != VK_PIPELINE_STAGE_2_NONE && ((dstStage & ~state.readStage) || (dstAccess & ~state.readAccess)))
+        {
+            //Reads only wait on the last write, unless an earlier read already waited on it in the same stages.
+            barrier.srcStage = state.writeStage;
+            barrier.srcAccess = state.writeAccess;
+        }
+
+        if (layoutChange || write)
+        {
+            //A layout transition is a write that is already visible to the stages of the barrier.
+            state.writeStage = dstStage;
+            state.writeAccess = write ? dstAccess & WRITE_ACCESS : VK_ACCESS_2_NONE;
+            state.readStage = write ? VK_PIPELINE_STAGE_2_NONE : dstStage;
+            state.readAccess = write ? VK_ACCESS_2_NONE : dstAccess;
+        }
+        else
+        {
+            state.readStage |= dstStage;
+            state.readAccess |= dstAccess;
+        }
+
+        state.layout = image ? layout : state.layout;
+
+        return layoutChange || barrier.srcStage != VK_PIPELINE_STAGE_2_NONE;
+    }
+}
+
+void FrameGraph::init(GPUDevice& newGPU, Allocator* newAllocator)
+{
+    gpu = &newGPU;
+    allocator = newAllocator;
+
+    resources.init(allocator, 16);
+    passes.init(allocator, 16);
+    accesses.init(allocator, 64);
+    barriers.init(allocator, 64);
+    memorySlots.init(allocator, 8);
+    slotStates.init(allocator, 8);
+
+    compiled = false;
+}
+
+void FrameGraph::shutdown()
+{
+    destroyTransientTextures();
+
+    slotStates.shutdown();
+    memorySlots.shutdown();
+    barriers.shutdown();
+    accesses.shutdown();
+    passes.shutdown();
+    resources.shutdown();
+}
+
+uint32_t FrameGraph::importSwapchain()
+{
+    FrameGraphResource resource{};
+    resource.name = "Swapchain";
+    resource.type = FRAME_GRAPH_SWAPCHAIN;
+    resource.format = gpu->vulkanSurfaceFormat.format;
+    resource.importedLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    resource.clearValue.color = { 1.f, 1.f, 1.f, 1.f };
+    resources.push(resource);
+
+    return resources.size - 1;
+}
+
+uint32_t FrameGraph::importTexture(const char* name, TextureHandle texture, VkImageLayout layout)
+{
+    FrameGraphResource resource{};
+    resource.name = name;
+    resource.type = FRAME_GRAPH_TEXTURE;
+    resource.texture = texture;
+    resource.format = gpu->accessTexture(texture)->vkFormat;
+    resource.importedLayout = layout;
+    resources.push(resource);
+
+    return resources.size - 1;
+}
+
+uint32_t FrameGraph::importBuffer(const char* name)
+{
+    FrameGraphResource resource{};
+    resource.name = name;
+    resource.type = FRAME_GRAPH_BUFFER;
+    resources.push(resource);
+
+    return resources.size - 1;
+}
+
+uint32_t FrameGraph::createTexture(const char* name, VkFormat format, uint16_t width, uint16_t height)
+{
+    FrameGraphResource resource{};
+    resource.name = name;
+    resource.type = FRAME_GRAPH_TEXTURE;
+    resource.format = format;
+    resource.width = width;
+    resource.height = height;
+    resource.transient = true;
+    //Reverse-Z, depth clears to the far plane at 0.
+    resource.clearValue = TextureFormat::hasDepthOrStencil(format) ? VkClearValue{ .depthStencil = { 0.f, 0 } } : VkClearValue{};
+    resources.push(resource);
+
+    return resources.size - 1;
+}
+
+void FrameGraph::setTexture(uint32_t resource, TextureHandle texture)
+{
+    VOID_ASSERTM(resources[resource].transient == false, "Transient texture %s is owned by the frame graph.", resources[resource].name);
+    resources[resource].texture = texture;
+}
+
+void FrameGraph::setClearValue(uint32_t resource, const VkClearValue& clearValue)
+{
+    resources[resource].clearValue = clearValue;
+}
+
+void FrameGraph::setOutput(uint32_t resource)
+{
+    resources[resource].output = true;
+}
+
+uint32_t FrameGraph::addPass(const char* name, FrameGraphPassType type, FrameGraphExecute execute, void* userData)
+{
+    FrameGraphPass pass{};
+    pass.name = name;
+    pass.type = type;
+    pass.execute = execute;
+    pass.userData = userData;
+    passes.push(pass);
+
+    compiled = false;
+
+    return passes.size - 1;
+}
+
+void FrameGraph::use(uint32_t pass, uint32_t resource, uint16_t usage)
+{
+    VOID_ASSERTM(resources[resource].type != FRAME_GRAPH_BUFFER || (usage & (ATTACHMENT_USAGES | FRAME_GRAPH_SAMPLED)) == 0,
+                 "Buffer %s can't be used as an image.", resources[resource].name);
+
+    FrameGraphPass& graphPass = passes[pass];
+    if (usage & FRAME_GRAPH_COLOUR_ATTACHMENT)
+    {
+        VOID_ASSERTM(graphPass.colourAttachmentCount < FRAME_GRAPH_MAX_COLOUR_ATTACHMENTS, "Pass %s has too many colour attachments.", graphPass.name);
+        graphPass.colourAttachments[graphPass.colourAttachmentCount++] = resource;
+    }
+
+    if (usage & FRAME_GRAPH_DEPTH_ATTACHMENT)
+    {
+        graphPass.depthAttachment = resource;
+    }
+
+    for (uint32_t i = 0; i < accesses.size; ++i)
+    {
+        if (accesses[i].pass == pass && accesses[i].resource == resource)
+        {
+            accesses[i].usage |= usage;
+            return;
+        }
+    }
+
+    accesses.push(FrameGraphAccess{ pass, resource, usage });
+    compiled = false;
+}
+
+void FrameGraph::setSideEffect(uint32_t pass)
+{
+    passes[pass].sideEffect = true;
+}
+
+void FrameGraph::compile()
+{
+    StackAllocator* scratchAllocator = &MemoryService::instance()->scratchAllocator;
+    size_t marker = scratchAllocator->getMarker();
+
+    //Cull from the back, a pass is kept when it writes something a kept pass or an output needs.
+    //A kept pass keeps every earlier writer of anything it touches, attachments are loaded so their earlier contents are needed too.
+    Array<uint8_t> needed;
+    needed.init(scratchAllocator, resources.size, resources.size);
+    for (uint32_t resource = 0; resource < resources.size; ++resource)
+    {
+        needed[resource] = resources[resource].output;
+    }
+
+    uint32_t culledCount = 0;
+    for (int32_t pass = passes.size - 1; pass >= 0; --pass)
+    {
+        bool kept = passes[pass].sideEffect;
+        for (uint32_t i = 0; i < accesses.size && kept == false; ++i)
+        {
+            const FrameGraphAccess& access = accesses[i];
+            kept = access.pass == uint32_t(pass) && (access.usage & WRITE_USAGES) && needed[access.resource];
+        }
+
+        passes[pass].culled = kept == false;
+        culledCount += kept == false;
+        if (kept == false)
+        {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < accesses.size; ++i)
+        {
+            needed[accesses[i].resource] |= accesses[i].pass == uint32_t(pass);
+        }
+    }
+
+    //Lifetimes and the usage flags of the transient textures.
+    for (uint32_t resource = 0; resource < resources.size; ++resource)
+    {
+        resources[resource].firstPass = FRAME_GRAPH_INVALID;
+        resources[resource].lastPass = FRAME_GRAPH_INVALID;
+        resources[resource].usage = 0;
+    }
+
+    for (uint32_t i = 0; i < accesses.size; ++i)
+    {
+        const FrameGraphAccess& access = accesses[i];
+        if (passes[access.pass].culled)
+        {
+            continue;
+        }
+
+        FrameGraphResource& resource = resources[access.resource];
+        resource.firstPass = min(resource.firstPass, access.pass);
+        resource.lastPass = resource.lastPass == FRAME_GRAPH_INVALID ? access.pass : max(resource.lastPass, access.pass);
+        resource.usage |= usageImageFlags(access.usage);
+    }
+
+    scratchAllocator->freeMarker(marker);
+
+    createTransientTextures();
+
+    //The first run finds the state every resource ends the frame in, the second starts from it so the next frame waits on this one.
+    buildBarriers(false);
+    buildBarriers(true);
+
+    compiled = true;
+
+    uint32_t transientCount = 0;
+    for (uint32_t resource = 0; resource < resources.size; ++resource)
+    {
+        transientCount += resources[resource].transient && resources[resource].firstPass != FRAME_GRAPH_INVALID;
+    }
+
+    vprint("Frame graph: %u passes (%u culled), %u barriers, %u transient textures in %u allocations.\n", passes.size, culledCount, barriers.size,
+           transientCount, memorySlots.size);
+}
+
+void FrameGraph::createTransientTextures()
+{
+    destroyTransientTextures();
+
+    transientWidth = gpu->swapchainWidth;
+    transientHeight = gpu->swapchainHeight;
+
+    StackAllocator* scratchAllocator = &MemoryService::instance()->scratchAllocator;
+    size_t marker = scratchAllocator->getMarker();
+
+    //Largest first, every texture joins the first slot with compatible memory whose textures are all dead before it starts or born after it ends.
+    Array<uint32_t> order;
+    order.init(scratchAllocator, resources.size);
+    Array<VkMemoryRequirements> requirements;
+    requirements.init(scratchAllocator, resources.size, resources.size);
+    Array<VkMemoryRequirements> slotRequirements;
+    slotRequirements.init(scratchAllocator, resources.size);
+
+    VkDeviceSize unaliasedSize = 0;
+    for (uint32_t index = 0; index < resources.size; ++index)
+    {
+        FrameGraphResource& resource = resources[index];
+        resource.memorySlot = FRAME_GRAPH_INVALID;
+        if (resource.transient == false || resource.firstPass == FRAME_GRAPH_INVALID)
+        {
+            continue;
+        }
+
+        //Matches the image vulkanCreateTexture makes.
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.format = resource.format;
+        imageInfo.usage = resource.usage;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = resource.width ? resource.width : transientWidth;
+        imageInfo.extent.height = resource.height ? resource.height : transientHeight;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkDeviceImageMemoryRequirements imageRequirements{};
+        imageRequirements.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+        imageRequirements.pCreateInfo = &imageInfo;
+
+        VkMemoryRequirements2 memoryRequirements{};
+        memoryRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        vkGetDeviceImageMemoryRequirements(gpu->vulkanDevice, &imageRequirements, &memoryRequirements);
+
+        requirements[index] = memoryRequirements.memoryRequirements;
+        unaliasedSize += requirements[index].size;
+
+        uint32_t position = order.size;
+        order.push(index);
+        while (position > 0 && requirements[order[position - 1]].size < requirements[index].size)
+        {
+            order[position] = order[position - 1];
+            --position;
+        }
+        order[position] = index;
+    }
+
+    for (uint32_t i = 0; i < order.size; ++i)
+    {
+        FrameGraphResource& resource = resources[order[i]];
+        const VkMemoryRequirements& resourceRequirements = requirements[order[i]];
+
+        for (uint32_t slot = 0; slot < slotRequirements.size && resource.memorySlot == FRAME_GRAPH_INVALID; ++slot)
+        {
+            if ((slotRequirements[slot].memoryTypeBits & resourceRequirements.memoryTypeBits) == 0)
+            {
+                continue;
+            }
+
+            bool overlaps = false;
+            for (uint32_t j = 0; j < i && overlaps == false; ++j)
+            {
+                const FrameGraphResource& other = resources[order[j]];
+                overlaps = other.memorySlot == slot && other.firstPass <= resource.lastPass && resource.firstPass <= other.lastPass;
+            }
+
+            if (overlaps == false)
+            {
+                resource.memorySlot = slot;
+                slotRequirements[slot].size = max(slotRequirements[slot].size, resourceRequirements.size);
+                slotRequirements[slot].alignment = max(slotRequirements[slot].alignment, resourceRequirements.alignment);
+                slotRequirements[slot].memoryTypeBits &= resourceRequirements.memoryTypeBits;
+            }
+        }
+
+        if (resource.memorySlot == FRAME_GRAPH_INVALID)
+        {
+            resource.memorySlot = slotRequirements.size;
+            slotRequirements.push(resourceRequirements);
+        }
+    }
+
+    VkDeviceSize aliasedSize = 0;
+    for (uint32_t slot = 0; slot < slotRequirements.size; ++slot)
+    {
+        VmaAllocationCreateInfo memoryInfo{};
+        memoryInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+        memoryInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        VmaAllocation allocation;
+        VkResult result = vmaAllocateMemory(gpu->VMAAllocator, &slotRequirements[slot], &memoryInfo, &allocation, nullptr);
+        VOID_ASSERTM(result == VK_SUCCESS, "Failed to allocate %lluKB for transient textures.", (unsigned long long)(slotRequirements[slot].size / 1024));
+        gpu->memory.track(allocation, GPU_MEMORY_CATEGORY_RENDER_TARGET);
+        memorySlots.push(allocation);
+        slotStates.push(FrameGraphState{});
+
+        aliasedSize += slotRequirements[slot].size;
+    }
+
+    for (uint32_t i = 0; i < order.size; ++i)
+    {
+        FrameGraphResource& resource = resources[order[i]];
+
+        TextureCreation textureCreation{};
+        textureCreation.setSize(resource.width ? resource.width : transientWidth, resource.height ? resource.height : transientHeight, 1)
+            .setFlags(1, resource.usage)
+            .setFormatType(resource.format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
+            .setName(resource.name)
+            .setAlias(memorySlots[resource.memorySlot]);
+        resource.texture = gpu->createTexture(textureCreation);
+    }
+
+    if (order.size)
+    {
+        vprint("Frame graph: %u transient textures use %lluKB, %lluKB without aliasing.\n", order.size, (unsigned long long)(aliasedSize / 1024),
+               (unsigned long long)(unaliasedSize / 1024));
+    }
+
+    scratchAllocator->freeMarker(marker);
+}
+
+void FrameGraph::destroyTransientTextures()
+{
+    for (uint32_t index = 0; index < resources.size; ++index)
+    {
+        FrameGraphResource& resource = resources[index];
+        if (resource.transient && resource.texture.index != INVALID_INDEX)
+        {
+            gpu->destroyTexture(resource.texture);
+            resource.texture.index = INVALID_INDEX;
+        }
+    }
+
+    //Destroying an image after the memory it was bound to is freed is allowed, the images are no longer used at this point.
+    for (uint32_t slot = 0; slot < memorySlots.size; ++slot)
+    {
+        gpu->memory.release(memorySlots[slot]);
+        vmaFreeMemory(gpu->VMAAllocator, memorySlots[slot]);
+    }
+
+    memorySlots.setSize(0);
+    slotStates.setSize(0);
+}
+
+void FrameGraph::buildBarriers(bool record)
+{
+    //Where the previous frame left every resource, or nothing for the first run.
+    for (uint32_t index = 0; index < resources.size; ++index)
+    {
+        FrameGraphResource& resource = resources[index];
+        const FrameGraphState endState = resource.state;
+
+        resource.state = FrameGraphState{};
+        resource.lastAccessPass = FRAME_GRAPH_INVALID;
+        resource.lastUsage = 0;
+
+        if (record == false)
+        {
+            resource.state.layout = resource.type == FRAME_GRAPH_TEXTURE && resource.transient == false ? resource.importedLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+            continue;
+        }
+
+        if (resource.type == FRAME_GRAPH_SWAPCHAIN)
+        {
+            //The acquire semaphore is waited on in the colour output stage, chaining to it makes the image available.
+            resource.state.writeStage = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+        else if (resource.type == FRAME_GRAPH_TEXTURE && resource.transient == false)
+        {
+            //Imported textures are returned to their layout at the end of the frame by an ALL_COMMANDS barrier when it changed.
+            const bool restored = endState.layout != resource.importedLayout;
+            resource.state.layout = resource.importedLayout;
+            resource.state.writeStage = restored ? VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT : endState.writeStage | endState.readStage;
+            resource.state.writeAccess = restored ? VK_ACCESS_2_NONE : endState.writeAccess;
+        }
+        else if (resource.type == FRAME_GRAPH_BUFFER)
+        {
+            resource.state.writeStage = endState.writeStage | endState.readStage;
+            resource.state.writeAccess = endState.writeAccess;
+        }
+    }
+
+    //Transient memory starts from whatever used the slot last in the previous frame.
+    for (uint32_t slot = 0; slot < slotStates.size; ++slot)
+    {
+        const FrameGraphState endState = slotStates[slot];
+        slotStates[slot] = FrameGraphState{};
+        if (record)
+        {
+            slotStates[slot].writeStage = endState.writeStage | endState.readStage;
+            slotStates[slot].writeAccess = endState.writeAccess;
+        }
+    }
+
+    barriers.setSize(0);
+
+    uint32_t previousPass = FRAME_GRAPH_INVALID;
+    for (uint32_t passIndex = 0; passIndex < passes.size; ++passIndex)
+    {
+        FrameGraphPass& pass = passes[passIndex];
+        pass.firstBarrier = barriers.size;
+        pass.barrierCount = 0;
+        pass.beginsRendering = false;
+        pass.endsRendering = false;
+        pass.renderingLastPass = FRAME_GRAPH_INVALID;
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        //Barriers only needed because the previous pass wrote the same attachments, merging the passes into one rendering instance removes them.
+        bool attachmentBarriersOnly = true;
+        for (uint32_t i = 0; i < accesses.size; ++i)
+        {
+            const FrameGraphAccess& access = accesses[i];
+            if (access.pass != passIndex)
+            {
+                continue;
+            }
+
+            FrameGraphResource& resource = resources[access.resource];
+            const bool image = resource.type != FRAME_GRAPH_BUFFER;
+
+            //A transient texture continues from the memory state of its slot, its contents are undefined.
+            if (resource.transient && resource.firstPass == passIndex)
+            {
+                resource.state = slotStates[resource.memorySlot];
+                resource.state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            }
+
+            const VkImageLayout layout = image ? usageLayout(access.usage, resource.format) : VK_IMAGE_LAYOUT_UNDEFINED;
+            const bool sameAttachment = (access.usage & ATTACHMENT_USAGES) && access.usage == resource.lastUsage && resource.lastAccessPass == previousPass &&
+                                        resource.state.layout == layout;
+
+            FrameGraphBarrier barrier{};
+            barrier.resource = access.resource;
+            if (transition(resource.state, usageStage(access.usage, pass.type), usageAccess(access.usage), layout, access.usage & WRITE_USAGES, image, barrier))
+            {
+                barriers.push(barrier);
+                attachmentBarriersOnly &= sameAttachment;
+            }
+
+            resource.lastAccessPass = passIndex;
+            resource.lastUsage = access.usage;
+            if (resource.transient)
+            {
+                slotStates[resource.memorySlot] = resource.state;
+            }
+        }
+
+        pass.barrierCount = barriers.size - pass.firstBarrier;
+
+        if (pass.type == FRAME_GRAPH_GRAPHICS && (pass.colourAttachmentCount || pass.depthAttachment != FRAME_GRAPH_INVALID))
+        {
+            FrameGraphPass* previous = previousPass != FRAME_GRAPH_INVALID ? &passes[previousPass] : nullptr;
+            if (previous && previous->endsRendering && attachmentBarriersOnly && sameAttachments(*previous, pass))
+            {
+                //Rasterisation order already covers attachment writes inside one rendering instance.
+                barriers.setSize(pass.firstBarrier);
+                pass.barrierCount = 0;
+                previous->endsRendering = false;
+
+                for (uint32_t begin = previousPass; begin != FRAME_GRAPH_INVALID; --begin)
+                {
+                    if (passes[begin].culled == false)
+                    {
+                        passes[begin].renderingLastPass = passIndex;
+                    }
+
+                    if (passes[begin].beginsRendering && passes[begin].culled == false)
+                    {
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                pass.beginsRendering = true;
+            }
+
+            pass.endsRendering = true;
+            pass.renderingLastPass = passIndex;
+        }
+
+        previousPass = passIndex;
+    }
+
+    //Return imported textures to their layout and hand the swapchain to present.
+    finalBarrier = barriers.size;
+    for (uint32_t index = 0; index < resources.size; ++index)
+    {
+        FrameGraphResource& resource = resources[index];
+        if (resource.type == FRAME_GRAPH_BUFFER || resource.transient || resource.firstPass == FRAME_GRAPH_INVALID || resource.state.layout == resource.importedLayout)
+        {
+            continue;
+        }
+
+        const bool swapchain = resource.type == FRAME_GRAPH_SWAPCHAIN;
+
+        FrameGraphBarrier barrier{};
+        barrier.resource = index;
+        barrier.srcStage = resource.state.writeStage | resource.state.readStage;
+        barrier.srcAccess = resource.state.writeAccess;
+        barrier.dstStage = swapchain ? VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        barrier.dstAccess = VK_ACCESS_2_NONE;
+        barrier.oldLayout = resource.state.layout;
+        barrier.newLayout = resource.importedLayout;
+        barriers.push(barrier);
+    }
+    finalBarrierCount = barriers.size - finalBarrier;
+}
+
+void FrameGraph::recordBarriers(CommandBuffer& commandBuffer, uint32_t firstBarrier, uint32_t barrierCount)
+{
+    if (barrierCount == 0)
+    {
+        return;
+    }
+
+    VOID_ASSERTM(barrierCount <= MAX_PASS_BARRIERS, "%u barriers is more than one batch can hold.", barrierCount);
+
+    //Buffers share one global memory barrier, only textures need their own barrier for the layout.
+    VkMemoryBarrier2 memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+
+    VkImageMemoryBarrier2 imageBarriers[MAX_PASS_BARRIERS];
+    uint32_t imageBarrierCount = 0;
+
+    for (uint32_t i = firstBarrier; i < firstBarrier + barrierCount; ++i)
+    {
+        const FrameGraphBarrier& barrier = barriers[i];
+        const FrameGraphResource& resource = resources[barrier.resource];
+
+        if (resource.type == FRAME_GRAPH_BUFFER)
+        {
+            memoryBarrier.srcStageMask |= barrier.srcStage;
+            memoryBarrier.srcAccessMask |= barrier.srcAccess;
+            memoryBarrier.dstStageMask |= barrier.dstStage;
+            memoryBarrier.dstAccessMask |= barrier.dstAccess;
+            continue;
+        }
+
+        VkImageMemoryBarrier2& imageBarrier = imageBarriers[imageBarrierCount++];
+        imageBarrier = VkImageMemoryBarrier2{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        imageBarrier.srcStageMask = barrier.srcStage;
+        imageBarrier.srcAccessMask = barrier.srcAccess;
+        imageBarrier.dstStageMask = barrier.dstStage;
+        imageBarrier.dstAccessMask = barrier.dstAccess;
+        imageBarrier.oldLayout = barrier.oldLayout;
+        imageBarrier.newLayout = barrier.newLayout;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = resource.type == FRAME_GRAPH_SWAPCHAIN ? gpu->vulkanSwapchainImages[gpu->vulkanImageIndex] : gpu->accessTexture(resource.texture)->vkImage;
+        imageBarrier.subresourceRange.aspectMask = formatAspect(resource.format);
+        imageBarrier.subresourceRange.baseMipLevel = 0;
+        imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        imageBarrier.subresourceRange.baseArrayLayer = 0;
+        imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    }
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = memoryBarrier.srcStageMask | memoryBarrier.dstStageMask ? 1 : 0;
+    dependencyInfo.pMemoryBarriers = &memoryBarrier;
+    dependencyInfo.imageMemoryBarrierCount = imageBarrierCount;
+    dependencyInfo.pImageMemoryBarriers = imageBarriers;
+
+    vkCmdPipelineBarrier2(commandBuffer.vkCommandBuffer, &dependencyInfo);
+}
+
+void FrameGraph::beginRendering(CommandBuffer& commandBuffer, const FrameGraphPass& pass)
+{
+    VkRenderingAttachmentInfo colourAttachments[FRAME_GRAPH_MAX_COLOUR_ATTACHMENTS]{};
+    VkRenderingAttachmentInfo depthAttachment{};
+    VkExtent2D extent{ transientWidth, transientHeight };
+
+    //Attachments are cleared by the first pass that uses them and only stored when a pass after this rendering instance needs them.
+    auto fillAttachment = [&](uint32_t index, VkRenderingAttachmentInfo& attachment)
+    {
+        const FrameGraphResource& resource = resources[index];
+        const bool swapchain = resource.type == FRAME_GRAPH_SWAPCHAIN;
+        const bool imported = resource.transient == false && swapchain == false;
+
+        attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        attachment.imageView = swapchain ? gpu->vulkanSwapchainImageViews[gpu->vulkanImageIndex] : gpu->accessTexture(resource.texture)->vkImageView;
+        attachment.imageLayout = usageLayout(swapchain || TextureFormat::hasDepthOrStencil(resource.format) == false ? FRAME_GRAPH_COLOUR_ATTACHMENT : FRAME_GRAPH_DEPTH_ATTACHMENT,
+                                             resource.format);
+        attachment.resolveMode = VK_RESOLVE_MODE_NONE;
+        attachment.loadOp = resource.firstPass == uint32_t(&pass - passes.data) && imported == false ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachment.storeOp = resource.transient && resource.output == false && resource.lastPass <= pass.renderingLastPass ? VK_ATTACHMENT_STORE_OP_DONT_CARE :
+                                                                                                                            VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.clearValue = resource.clearValue;
+
+        if (resource.transient == false && swapchain == false)
+        {
+            const Texture* texture = gpu->accessTexture(resource.texture);
+            extent = VkExtent2D{ texture->width, texture->height };
+        }
+        else if (resource.transient && resource.width)
+        {
+            extent = VkExtent2D{ resource.width, resource.height };
+        }
+    };
+
+    for (uint32_t i = 0; i < pass.colourAttachmentCount; ++i)
+    {
+        fillAttachment(pass.colourAttachments[i], colourAttachments[i]);
+    }
+
+    if (pass.depthAttachment != FRAME_GRAPH_INVALID)
+    {
+        fillAttachment(pass.depthAttachment, depthAttachment);
+    }
+
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea = { .extent = extent };
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount = pass.colourAttachmentCount;
+    renderingInfo.pColorAttachments = colourAttachments;
+    renderingInfo.pDepthAttachment = pass.depthAttachment != FRAME_GRAPH_INVALID ? &depthAttachment : nullptr;
+    renderingInfo.pStencilAttachment = pass.depthAttachment != FRAME_GRAPH_INVALID && TextureFormat::hasStencil(resources[pass.depthAttachment].format) ? &depthAttachment : nullptr;
+
+    vkCmdBeginRendering(commandBuffer.vkCommandBuffer, &renderingInfo);
+}
+
+void FrameGraph::execute(CommandBuffer& commandBuffer)
+{
+    if (compiled == false)
+    {
+        compile();
+    }
+    else if (transientWidth != gpu->swapchainWidth || transientHeight != gpu->swapchainHeight)
+    {
+        //Resizes are rare, wait for the frames in flight to finish with the memory instead of deferring the frees.
+        gpu->waitTimeline(gpu->timelineValue);
+        createTransientTextures();
+        buildBarriers(false);
+        buildBarriers(true);
+    }
+
+    for (uint32_t passIndex = 0; passIndex < passes.size; ++passIndex)
+    {
+        const FrameGraphPass& pass = passes[passIndex];
+        if (pass.culled)
+        {
+            continue;
+        }
+
+        recordBarriers(commandBuffer, pass.firstBarrier, pass.barrierCount);
+
+        if (pass.beginsRendering)
+        {
+            beginRendering(commandBuffer, pass);
+        }
+
+        commandBuffer.pushMarker(pass.name);
+        pass.execute(commandBuffer, pass.userData);
+        commandBuffer.popMarker();
+
+        if (pass.endsRendering)
+        {
+            vkCmdEndRendering(commandBuffer.vkCommandBuffer);
+        }
+    }
+
+    recordBarriers(commandBuffer, finalBarrier, finalBarrierCount);
+
+    for (uint32_t index = 0; index < resources.size; ++index)
+    {
+        commandBuffer.presentTransitioned |= resources[index].type == FRAME_GRAPH_SWAPCHAIN && resources[index].firstPass != FRAME_GRAPH_INVALID;
+    }
+}
+
+TextureHandle FrameGraph::getTexture(uint32_t resource) const
+{
+    return resources[resource].texture;
+}
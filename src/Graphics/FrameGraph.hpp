@@ -0,0 +1,192 @@
+#ifndef FRAME_GRAPH_HDR
+#define FRAME_GRAPH_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Array.hpp"
+
+#include "GPUDevice.hpp"
+
+struct CommandBuffer;
+
+static constexpr uint32_t FRAME_GRAPH_MAX_COLOUR_ATTACHMENTS = 4;
+static constexpr uint32_t FRAME_GRAPH_INVALID = UINT32_MAX;
+
+//How a pass uses a resource, a pass can combine several usages of the same resource.
+enum FrameGraphUsage : uint16_t
+{
+    FRAME_GRAPH_COLOUR_ATTACHMENT = 1 << 0,
+    FRAME_GRAPH_DEPTH_ATTACHMENT = 1 << 1,
+    FRAME_GRAPH_SAMPLED = 1 << 2,
+    FRAME_GRAPH_STORAGE_READ = 1 << 3,
+    FRAME_GRAPH_STORAGE_WRITE = 1 << 4,
+    FRAME_GRAPH_INDIRECT_READ = 1 << 5,
+    FRAME_GRAPH_INDEX_READ = 1 << 6,
+    FRAME_GRAPH_TRANSFER_READ = 1 << 7,
+    FRAME_GRAPH_TRANSFER_WRITE = 1 << 8,
+};
+
+enum FrameGraphResourceType : uint8_t
+{
+    FRAME_GRAPH_TEXTURE,
+    FRAME_GRAPH_BUFFER,
+    FRAME_GRAPH_SWAPCHAIN
+};
+
+//Shader reads and writes happen in the compute stage for compute passes and in the vertex and fragment stages for graphics passes.
+enum FrameGraphPassType : uint8_t
+{
+    FRAME_GRAPH_GRAPHICS,
+    FRAME_GRAPH_COMPUTE,
+    FRAME_GRAPH_TRANSFER
+};
+
+typedef void (*FrameGraphExecute)(CommandBuffer& commandBuffer, void* userData);
+
+//Resource state while the barriers are built.
+struct FrameGraphState
+{
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    //The last write and every stage that has read since, the reads are already ordered after the write.
+    VkPipelineStageFlags2 writeStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+    VkPipelineStageFlags2 readStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 readAccess = VK_ACCESS_2_NONE;
+};
+
+struct FrameGraphResource
+{
+    const char* name = nullptr;
+
+    TextureHandle texture{ INVALID_INDEX };
+    VkClearValue clearValue{};
+
+    //Transient textures, a size of 0 follows the swapchain.
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkImageUsageFlags usage = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+
+    //Imported textures start and end every frame in this layout, the swapchain ends in present.
+    VkImageLayout importedLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    FrameGraphResourceType type = FRAME_GRAPH_TEXTURE;
+    bool transient = false;
+    bool output = false;
+
+    //Compiled data.
+    uint32_t firstPass = FRAME_GRAPH_INVALID;
+    uint32_t lastPass = FRAME_GRAPH_INVALID;
+    uint32_t memorySlot = FRAME_GRAPH_INVALID;
+    uint32_t lastAccessPass = FRAME_GRAPH_INVALID;
+    uint16_t lastUsage = 0;
+    FrameGraphState state;
+};
+
+struct FrameGraphAccess
+{
+    uint32_t pass;
+    uint32_t resource;
+    uint16_t usage;
+};
+
+struct FrameGraphBarrier
+{
+    uint32_t resource;
+
+    VkPipelineStageFlags2 srcStage;
+    VkAccessFlags2 srcAccess;
+    VkPipelineStageFlags2 dstStage;
+    VkAccessFlags2 dstAccess;
+
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+};
+
+struct FrameGraphPass
+{
+    const char* name = nullptr;
+    FrameGraphExecute execute = nullptr;
+    void* userData = nullptr;
+
+    FrameGraphPassType type = FRAME_GRAPH_GRAPHICS;
+    bool sideEffect = false;
+
+    //Compiled data, barriers are recorded as one vkCmdPipelineBarrier2 before the pass.
+    uint32_t firstBarrier = 0;
+    uint32_t barrierCount = 0;
+
+    uint32_t colourAttachments[FRAME_GRAPH_MAX_COLOUR_ATTACHMENTS];
+    uint32_t colourAttachmentCount = 0;
+    uint32_t depthAttachment = FRAME_GRAPH_INVALID;
+
+    bool culled = false;
+    //Consecutive graphics passes with the same attachments share one dynamic rendering instance.
+    bool beginsRendering = false;
+    bool endsRendering = false;
+    uint32_t renderingLastPass = FRAME_GRAPH_INVALID;
+};
+
+//Passes declare the textures and buffers they use and are executed in the order they were added.
+//compile() culls passes that don't lead to an output, places transient textures whose lifetimes don't overlap in the same memory
+//and builds the smallest set of barriers between passes. Buffers are synchronised with one global memory barrier per pass
+//while textures get image barriers for their layout transitions.
+struct FrameGraph
+{
+    void init(GPUDevice& newGPU, Allocator* newAllocator);
+    void shutdown();
+
+    //Resources
+    uint32_t importSwapchain();
+    uint32_t importTexture(const char* name, TextureHandle texture, VkImageLayout layout);
+    //Buffers change per frame in flight so only their usage is tracked, not the handle.
+    uint32_t importBuffer(const char* name);
+    //Transient textures only live inside the frame, a width or height of 0 follows the swapchain size.
+    uint32_t createTexture(const char* name, VkFormat format, uint16_t width, uint16_t height);
+
+    void setTexture(uint32_t resource, TextureHandle texture);
+    void setClearValue(uint32_t resource, const VkClearValue& clearValue);
+    //Passes that don't contribute to an output are culled.
+    void setOutput(uint32_t resource);
+
+    //Passes
+    uint32_t addPass(const char* name, FrameGraphPassType type, FrameGraphExecute execute, void* userData);
+    void use(uint32_t pass, uint32_t resource, uint16_t usage);
+    //The pass has effects outside of the graph and is never culled.
+    void setSideEffect(uint32_t pass);
+
+    void compile();
+    //Transient textures are recreated when the swapchain has been resized.
+    void execute(CommandBuffer& commandBuffer);
+
+    TextureHandle getTexture(uint32_t resource) const;
+
+    //Helpers
+    void createTransientTextures();
+    void destroyTransientTextures();
+    void buildBarriers(bool record);
+    void recordBarriers(CommandBuffer& commandBuffer, uint32_t firstBarrier, uint32_t barrierCount);
+    void beginRendering(CommandBuffer& commandBuffer, const FrameGraphPass& pass);
+
+    GPUDevice* gpu = nullptr;
+    Allocator* allocator = nullptr;
+
+    Array<FrameGraphResource> resources;
+    Array<FrameGraphPass> passes;
+    Array<FrameGraphAccess> accesses;
+    Array<FrameGraphBarrier> barriers;
+    //One allocation per group of aliased transient textures.
+    Array<VmaAllocation> memorySlots;
+    //State of the memory behind each slot, a transient texture starts from whatever used its memory last.
+    Array<FrameGraphState> slotStates;
+
+    //Barriers that return imported textures to their layout at the end of the frame.
+    uint32_t finalBarrier = 0;
+    uint32_t finalBarrierCount = 0;
+
+    uint16_t transientWidth = 0;
+    uint16_t transientHeight = 0;
+    bool compiled = false;
+};
+
+#endif // !FRAME_GRAPH_HDR
@@ -0,0 +1,778 @@
+#include "FrustumCulling.hpp"
+#include "CommandBuffer.hpp"
+#include "LoadGLTF.hpp"
+#include "ShaderData.hpp"
+
+#include "Foundation/File.hpp"
+#include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
+#include "Foundation/Time.hpp"
+#include "Foundation/Camera.hpp"
+
+#include <immintrin.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    vec4s normalisePlane(float x, float y, float z, float w)
+    {
+        const float length = sqrtf(x * x + y * y + z * z);
+        VOID_ASSERTM(length > 0.f, "Degenerate frustum plane.");
+
+        const float inverseLength = 1.f / length;
+        return vec4s{ x * inverseLength, y * inverseLength, z * inverseLength, w * inverseLength };
+    }
+
+    //Branch-free compaction of the visible lanes into the bucket of their LOD, each lane always writes but only advances its bucket when visible.
+    void compactLanes(uint32_t mask, uint32_t slot, const uint32_t* slotToInstance, const int32_t* laneLod, uint32_t* const* outputs, uint32_t* written)
+    {
+        for (uint32_t lane = 0; lane < CULLING_LANE_WIDTH; ++lane)
+        {
+            const int32_t lod = laneLod[lane];
+            outputs[lod][written[lod]] = slotToInstance[slot + lane];
+            written[lod] += (mask >> lane) & 1;
+        }
+    }
+
+    PipelineHandle createComputePipeline(GPUDevice& gpu, const char* name, const char* shaderPath)
+    {
+        FileReadResult computeShaderCode = fileReadBinary(shaderPath, &MemoryService::instance()->scratchAllocator);
+
+        PipelineCreation pipelineCreation{};
+        pipelineCreation.shaders.setName(name)
+            .addStage(computeShaderCode.data, uint32_t(computeShaderCode.size), VK_SHADER_STAGE_COMPUTE_BIT)
+            .setSPVInput(true);
+
+        return gpu.createPipeline(pipelineCreation);
+    }
+
+    static constexpr uint32_t CULLING_GROUP_SIZE = 64;
+
+    //lodDistances are the LOD errors multiplied by the LOD scale, a LOD is picked once the distance is at least its lodDistance times the radius.
+    //The errors never shrink with the LOD so counting the passed LODs gives the LOD index.
+#if defined(__AVX__)
+    void cullRange(const InstanceCuller& culler, const Frustum& frustum, uint32_t first, uint32_t count, 
+                   const float* lodDistances, uint32_t lodCount, uint32_t* const* outputs, uint32_t* written)
+    {
+        __m256 planeX[6];
+        __m256 planeY[6];
+        __m256 planeZ[6];
+        __m256 planeW[6];
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            planeX[i] = _mm256_set1_ps(frustum.planes[i].x);
+            planeY[i] = _mm256_set1_ps(frustum.planes[i].y);
+            planeZ[i] = _mm256_set1_ps(frustum.planes[i].z);
+            planeW[i] = _mm256_set1_ps(frustum.planes[i].w);
+        }
+
+        const __m256 eyeX = _mm256_set1_ps(frustum.eye.x);
+        const __m256 eyeY = _mm256_set1_ps(frustum.eye.y);
+        const __m256 eyeZ = _mm256_set1_ps(frustum.eye.z);
+        const __m256 one = _mm256_set1_ps(1.f);
+
+        __m256 lodDistance[MAX_MESH_LODS];
+        for (uint32_t lod = 0; lod < lodCount; ++lod)
+        {
+            lodDistance[lod] = _mm256_set1_ps(lodDistances[lod]);
+        }
+
+        alignas(32) int32_t laneLod[CULLING_LANE_WIDTH];
+        for (uint32_t slot = first; slot < first + count; slot += CULLING_LANE_WIDTH)
+        {
+            const __m256 x = _mm256_loadu_ps(culler.centreX.data + slot);
+            const __m256 y = _mm256_loadu_ps(culler.centreY.data + slot);
+            const __m256 z = _mm256_loadu_ps(culler.centreZ.data + slot);
+            const __m256 radius = _mm256_loadu_ps(culler.radius.data + slot);
+            const __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), radius);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (uint32_t i = 0; i < 6; ++i)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_mul_ps(x, planeX[i]), planeW[i]);
+                distance = _mm256_add_ps(_mm256_mul_ps(y, planeY[i]), distance);
+                distance = _mm256_add_ps(_mm256_mul_ps(z, planeZ[i]), distance);
+
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+
+            const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+
+            const __m256 dx = _mm256_sub_ps(x, eyeX);
+            const __m256 dy = _mm256_sub_ps(y, eyeY);
+            const __m256 dz = _mm256_sub_ps(z, eyeZ);
+            const __m256 distanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+            __m256 lod = _mm256_setzero_ps();
+            for (uint32_t i = 1; i < lodCount; ++i)
+            {
+                const __m256 switchDistance = _mm256_mul_ps(lodDistance[i], radius);
+                const __m256 passed = _mm256_cmp_ps(distanceSquared, _mm256_mul_ps(switchDistance, switchDistance), _CMP_GE_OQ);
+                lod = _mm256_add_ps(lod, _mm256_and_ps(passed, one));
+            }
+            _mm256_store_si256(reinterpret_cast<__m256i*>(laneLod), _mm256_cvttps_epi32(lod));
+
+            compactLanes(mask, slot, culler.slotToInstance.data, laneLod, outputs, written);
+        }
+    }
+#else
+    void cullRange(const InstanceCuller& culler, const Frustum& frustum, uint32_t first, uint32_t count, 
+                   const float* lodDistances, uint32_t lodCount, uint32_t* const* outputs, uint32_t* written)
+    {
+        __m128 planeX[6];
+        __m128 planeY[6];
+        __m128 planeZ[6];
+        __m128 planeW[6];
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            planeX[i] = _mm_set1_ps(frustum.planes[i].x);
+            planeY[i] = _mm_set1_ps(frustum.planes[i].y);
+            planeZ[i] = _mm_set1_ps(frustum.planes[i].z);
+            planeW[i] = _mm_set1_ps(frustum.planes[i].w);
+        }
+
+        const __m128 eyeX = _mm_set1_ps(frustum.eye.x);
+        const __m128 eyeY = _mm_set1_ps(frustum.eye.y);
+        const __m128 eyeZ = _mm_set1_ps(frustum.eye.z);
+        const __m128 one = _mm_set1_ps(1.f);
+
+        __m128 lodDistance[MAX_MESH_LODS];
+        for (uint32_t lod = 0; lod < lodCount; ++lod)
+        {
+            lodDistance[lod] = _mm_set1_ps(lodDistances[lod]);
+        }
+
+        alignas(16) int32_t laneLod[CULLING_LANE_WIDTH];
+        for (uint32_t slot = first; slot < first + count; slot += CULLING_LANE_WIDTH)
+        {
+            const __m128 x = _mm_loadu_ps(culler.centreX.data + slot);
+            const __m128 y = _mm_loadu_ps(culler.centreY.data + slot);
+            const __m128 z = _mm_loadu_ps(culler.centreZ.data + slot);
+            const __m128 radius = _mm_loadu_ps(culler.radius.data + slot);
+            const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (uint32_t i = 0; i < 6; ++i)
+            {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(x, planeX[i]), planeW[i]);
+                distance = _mm_add_ps(_mm_mul_ps(y, planeY[i]), distance);
+                distance = _mm_add_ps(_mm_mul_ps(z, planeZ[i]), distance);
+
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+
+            const uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+
+            const __m128 dx = _mm_sub_ps(x, eyeX);
+            const __m128 dy = _mm_sub_ps(y, eyeY);
+            const __m128 dz = _mm_sub_ps(z, eyeZ);
+            const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+            __m128 lod = _mm_setzero_ps();
+            for (uint32_t i = 1; i < lodCount; ++i)
+            {
+                const __m128 switchDistance = _mm_mul_ps(lodDistance[i], radius);
+                const __m128 passed = _mm_cmpge_ps(distanceSquared, _mm_mul_ps(switchDistance, switchDistance));
+                lod = _mm_add_ps(lod, _mm_and_ps(passed, one));
+            }
+            _mm_store_si128(reinterpret_cast<__m128i*>(laneLod), _mm_cvttps_epi32(lod));
+
+            compactLanes(mask, slot, culler.slotToInstance.data, laneLod, outputs, written);
+        }
+    }
+#endif //__AVX__
+}
+
+void Frustum::extract(const mat4s& viewProjection, float farDistance)
+{
+    //cglm is column major so row i is (m0i, m1i, m2i, m3i).
+    const mat4s& m = viewProjection;
+
+    //Left, right, bottom, top.
+    planes[0] = normalisePlane(m.m03 + m.m00, m.m13 + m.m10, m.m23 + m.m20, m.m33 + m.m30);
+    planes[1] = normalisePlane(m.m03 - m.m00, m.m13 - m.m10, m.m23 - m.m20, m.m33 - m.m30);
+    planes[2] = normalisePlane(m.m03 + m.m01, m.m13 + m.m11, m.m23 + m.m21, m.m33 + m.m31);
+    planes[3] = normalisePlane(m.m03 - m.m01, m.m13 - m.m11, m.m23 - m.m21, m.m33 - m.m31);
+    //Reverse-Z puts the near plane at a depth of 1 so z <= w.
+    planes[4] = normalisePlane(m.m03 - m.m02, m.m13 - m.m12, m.m23 - m.m22, m.m33 - m.m32);
+    //w is the view depth for a perspective projection so w <= farDistance.
+    planes[5] = normalisePlane(-m.m03, -m.m13, -m.m23, farDistance - m.m33);
+}
+
+void Frustum::setLodView(const vec3s& newEye, const mat4s& projection, float viewportHeight)
+{
+    eye = newEye;
+    //m11 is the cotangent of half the vertical field of view.
+    lodScale = projection.m11 * viewportHeight * 0.5f / LOD_PIXEL_ERROR;
+}
+
+void InstanceCuller::init(Allocator* allocator, uint32_t newModelCount)
+{
+    modelCount = newModelCount;
+    bucketCount = modelCount * MAX_MESH_LODS;
+    instanceCount = 0;
+
+    centreX.init(allocator, CULLING_LANE_WIDTH);
+    centreY.init(allocator, CULLING_LANE_WIDTH);
+    centreZ.init(allocator, CULLING_LANE_WIDTH);
+    radius.init(allocator, CULLING_LANE_WIDTH);
+    slotToInstance.init(allocator, CULLING_LANE_WIDTH);
+    instanceToSlot.init(allocator, CULLING_LANE_WIDTH);
+
+    slotFirst.init(allocator, modelCount, modelCount);
+    slotCount.init(allocator, modelCount, modelCount);
+    lodCount.init(allocator, modelCount, modelCount);
+
+    lodError.init(allocator, bucketCount, bucketCount);
+    visibleFirst.init(allocator, bucketCount, bucketCount);
+    visibleCount.init(allocator, bucketCount, bucketCount);
+
+    visibleIndices.init(allocator, CULLING_LANE_WIDTH);
+
+    const float lodErrors[1] = { 0.f };
+    for (uint32_t model = 0; model < modelCount; ++model)
+    {
+        setLods(model, lodErrors, 1);
+    }
+}
+
+void InstanceCuller::shutdown()
+{
+    centreX.shutdown();
+    centreY.shutdown();
+    centreZ.shutdown();
+    radius.shutdown();
+    slotToInstance.shutdown();
+    instanceToSlot.shutdown();
+
+    slotFirst.shutdown();
+    slotCount.shutdown();
+    lodCount.shutdown();
+
+    lodError.shutdown();
+    visibleFirst.shutdown();
+    visibleCount.shutdown();
+
+    visibleIndices.shutdown();
+}
+
+void InstanceCuller::setLods(uint32_t model, const float* lodErrors, uint32_t newLodCount)
+{
+    VOID_ASSERTM(newLodCount > 0 && newLodCount <= MAX_MESH_LODS, "Model %u has %u LODs, it needs between 1 and %u.", model, newLodCount, MAX_MESH_LODS);
+
+    lodCount[model] = newLodCount;
+    for (uint32_t lod = 0; lod < MAX_MESH_LODS; ++lod)
+    {
+        //Buckets past the last LOD are never picked.
+        lodError[model * MAX_MESH_LODS + lod] = lod < newLodCount ? lodErrors[lod] : FLT_MAX;
+    }
+}
+
+void InstanceCuller::build(const uint32_t* modelIndices, const vec4s* spheres, uint32_t newInstanceCount)
+{
+    instanceCount = newInstanceCount;
+
+    for (uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        visibleCount[bucket] = 0;
+    }
+
+    //Count the instances of each model in its LOD 0 bucket.
+    for (uint32_t i = 0; i < instanceCount; ++i)
+    {
+        VOID_ASSERTM(modelIndices[i] < modelCount, "Instance %u has an invalid model index %u.", i, modelIndices[i]);
+        ++visibleCount[modelIndices[i] * MAX_MESH_LODS];
+    }
+
+    //Each model range is padded to the SIMD width so a lane never straddles two models.
+    //Every LOD bucket has room for all the instances of its model plus the one slot the branch-free compaction writes past the last visible instance.
+    uint32_t totalSlots = 0;
+    uint32_t totalVisible = 0;
+    for (uint32_t model = 0; model < modelCount; ++model)
+    {
+        const uint32_t modelInstances = visibleCount[model * MAX_MESH_LODS];
+
+        slotFirst[model] = totalSlots;
+        slotCount[model] = (modelInstances + CULLING_LANE_WIDTH - 1) & ~(CULLING_LANE_WIDTH - 1);
+        totalSlots += slotCount[model];
+
+        for (uint32_t lod = 0; lod < MAX_MESH_LODS; ++lod)
+        {
+            const uint32_t bucket = model * MAX_MESH_LODS + lod;
+            visibleFirst[bucket] = totalVisible;
+            visibleCount[bucket] = 0;
+
+            if (lod < lodCount[model])
+            {
+                totalVisible += modelInstances + 1;
+            }
+        }
+    }
+
+    centreX.setSize(totalSlots);
+    centreY.setSize(totalSlots);
+    centreZ.setSize(totalSlots);
+    radius.setSize(totalSlots);
+    slotToInstance.setSize(totalSlots);
+    instanceToSlot.setSize(instanceCount);
+    visibleIndices.setSize(totalVisible);
+
+    //Padding slots are disabled spheres.
+    for (uint32_t slot = 0; slot < totalSlots; ++slot)
+    {
+        centreX[slot] = 0.f;
+        centreY[slot] = 0.f;
+        centreZ[slot] = 0.f;
+        radius[slot] = -FLT_MAX;
+        slotToInstance[slot] = 0;
+    }
+
+    StackAllocator* scratchAllocator = &MemoryService::instance()->scratchAllocator;
+    size_t fillMarker = scratchAllocator->getMarker();
+
+    Array<uint32_t> modelFill;
+    modelFill.init(scratchAllocator, modelCount, modelCount);
+    for (uint32_t model = 0; model < modelCount; ++model)
+    {
+        modelFill[model] = 0;
+    }
+
+    for (uint32_t i = 0; i < instanceCount; ++i)
+    {
+        const uint32_t model = modelIndices[i];
+        const uint32_t slot = slotFirst[model] + modelFill[model]++;
+
+        centreX[slot] = spheres[i].x;
+        centreY[slot] = spheres[i].y;
+        centreZ[slot] = spheres[i].z;
+        radius[slot] = spheres[i].w;
+        slotToInstance[slot] = i;
+        instanceToSlot[i] = slot;
+    }
+
+    scratchAllocator->freeMarker(fillMarker);
+}
+
+void InstanceCuller::setCentre(uint32_t instanceIndex, const vec3s& centre)
+{
+    const uint32_t slot = instanceToSlot[instanceIndex];
+    centreX[slot] = centre.x;
+    centreY[slot] = centre.y;
+    centreZ[slot] = centre.z;
+}
+
+void InstanceCuller::disable(uint32_t instanceIndex)
+{
+    const uint32_t slot = instanceToSlot[instanceIndex];
+    centreX[slot] = 0.f;
+    centreY[slot] = 0.f;
+    centreZ[slot] = 0.f;
+    radius[slot] = -FLT_MAX;
+}
+
+void InstanceCuller::cull(const Frustum& frustum)
+{
+    for (uint32_t model = 0; model < modelCount; ++model)
+    {
+        const uint32_t firstBucket = model * MAX_MESH_LODS;
+
+        float lodDistances[MAX_MESH_LODS];
+        uint32_t* outputs[MAX_MESH_LODS];
+        for (uint32_t lod = 0; lod < lodCount[model]; ++lod)
+        {
+            lodDistances[lod] = lodError[firstBucket + lod] * frustum.lodScale;
+            outputs[lod] = visibleIndices.data + visibleFirst[firstBucket + lod];
+            visibleCount[firstBucket + lod] = 0;
+        }
+
+        cullRange(*this, frustum, slotFirst[model], slotCount[model], lodDistances, lodCount[model], outputs, visibleCount.data + firstBucket);
+    }
+}
+
+void GPUCuller::init(GPUDevice& gpu, const InstanceCuller& culler, const Array<Model>& models, const Model& debugSphere, 
+                     const uint32_t* modelIndices, const vec4s* spheres)
+{
+    Allocator* allocator = &MemoryService::instance()->systemAllocator;
+
+    instanceCount = culler.instanceCount;
+    bucketCount = culler.bucketCount;
+
+    VOID_ASSERTM(models.size == culler.modelCount, "The culler was built with %u models but the scene has %u.", culler.modelCount, models.size);
+    VOID_ASSERTM(debugSphere.meshDraws.size == 1, "Collider geometry have have one draw call.\n");
+
+    cullingPipeline = createComputePipeline(gpu, "instanceCulling", "Assets/Shaders/instanceCulling.comp.spv");
+    drawCommandPipeline = createComputePipeline(gpu, "drawCommands", "Assets/Shaders/drawCommands.comp.spv");
+
+    meshDrawCount = 0;
+    uint32_t debugDrawCount = 0;
+    for (uint32_t model = 0; model < culler.modelCount; ++model)
+    {
+        VOID_ASSERTM(models[model].lodCount == culler.lodCount[model], "Model %u has %u LODs but the culler was given %u.", model, models[model].lodCount, culler.lodCount[model]);
+
+        for (uint32_t lod = 0; lod < culler.lodCount[model]; ++lod)
+        {
+            for (uint32_t mesh = 0; mesh < models[model].meshDraws.size; ++mesh)
+            {
+                meshDrawCount += lod > 0 || models[model].meshDraws[mesh].clusterCount == 0;
+            }
+        }
+        debugDrawCount += culler.lodCount[model];
+    }
+
+    drawCount = meshDrawCount + debugDrawCount;
+
+    Array<CullingInstance> instances;
+    instances.init(allocator, instanceCount, instanceCount);
+    for (uint32_t i = 0; i < instanceCount; ++i)
+    {
+        const uint32_t model = modelIndices[i];
+        instances[i] = CullingInstance{ model * MAX_MESH_LODS, culler.lodCount[model], spheres[i].w };
+    }
+
+    Array<CullingBucket> buckets;
+    buckets.init(allocator, bucketCount, bucketCount);
+    for (uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        buckets[bucket] = CullingBucket{ culler.visibleFirst[bucket], culler.lodError[bucket] };
+    }
+
+    draws.init(allocator, drawCount, drawCount);
+
+    //Meshes with a shorter LOD chain than their model draw their last LOD in the coarser buckets.
+    //LOD 0 of meshes with clusters is drawn by the ClusterCuller instead.
+    uint32_t drawIndex = 0;
+    for (uint32_t model = 0; model < culler.modelCount; ++model)
+    {
+        for (uint32_t lod = 0; lod < culler.lodCount[model]; ++lod)
+        {
+            for (uint32_t mesh = 0; mesh < models[model].meshDraws.size; ++mesh)
+            {
+                const MeshDraw& meshDraw = models[model].meshDraws[mesh];
+                if (lod == 0 && meshDraw.clusterCount > 0)
+                {
+                    continue;
+                }
+
+                const MeshLod& meshLod = meshDraw.lods[min(lod, meshDraw.lodCount - 1)];
+                draws[drawIndex++] = CullingDraw{ meshLod.indexCount, meshLod.firstIndex, meshDraw.vertexOffset, model * MAX_MESH_LODS + lod, meshDraw.materialIndex };
+            }
+        }
+    }
+
+    const MeshDraw& sphereDraw = debugSphere.meshDraws[0];
+    for (uint32_t model = 0; model < culler.modelCount; ++model)
+    {
+        for (uint32_t lod = 0; lod < culler.lodCount[model]; ++lod)
+        {
+            draws[drawIndex++] = CullingDraw{ sphereDraw.count, sphereDraw.firstIndex, sphereDraw.vertexOffset, model * MAX_MESH_LODS + lod, 0 };
+        }
+    }
+
+    BufferCreation bufferCreation{};
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(CullingInstance) * instanceCount)
+        .setName("cullingInstances")
+        .setData(instances.data);
+    instanceBuffer = gpu.createBindlessBuffer(bufferCreation);
+
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(CullingBucket) * bucketCount)
+        .setName("cullingBuckets")
+        .setData(buckets.data);
+    bucketBuffer = gpu.createBindlessBuffer(bufferCreation);
+
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(CullingDraw) * drawCount)
+        .setName("cullingDraws")
+        .setData(draws.data);
+    drawBuffer = gpu.createBindlessBuffer(bufferCreation);
+
+    //Nothing is visible before the first late phase, so the first early phase draws nothing.
+    Array<uint32_t> visibility;
+    visibility.init(allocator, instanceCount, instanceCount);
+    memset(visibility.data, 0, sizeof(uint32_t) * instanceCount);
+
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * instanceCount)
+        .setName("cullingVisibility")
+        .setData(visibility.data);
+    visibilityBuffer = gpu.createBindlessBuffer(bufferCreation);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(Frustum::planes))
+            .setName("cullingPlanes")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        planeBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+
+        //The counters are cleared with vkCmdFillBuffer every frame.
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * (bucketCount + 2))
+            .setName("cullingCounts")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        countBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(DrawCommand) * drawCount)
+            .setName("cullingDrawCommands")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        drawCommandBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(CullingOcclusion))
+            .setName("cullingOcclusion")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        occlusionBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+    }
+
+#if defined(VOID_VALIDATE_GPU_CULLING)
+    expectedCounts.init(allocator, bucketCount * FRAMES_IN_FLIGHT, bucketCount * FRAMES_IN_FLIGHT);
+#endif //VOID_VALIDATE_GPU_CULLING
+
+    visibility.shutdown();
+    buckets.shutdown();
+    instances.shutdown();
+}
+
+void GPUCuller::shutdown(GPUDevice& gpu)
+{
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        gpu.destroyBuffer(planeBuffer[i]);
+        gpu.destroyBuffer(countBuffer[i]);
+        gpu.destroyBuffer(drawCommandBuffer[i]);
+        gpu.destroyBuffer(occlusionBuffer[i]);
+    }
+
+    gpu.destroyBuffer(instanceBuffer);
+    gpu.destroyBuffer(bucketBuffer);
+    gpu.destroyBuffer(drawBuffer);
+    gpu.destroyBuffer(visibilityBuffer);
+
+    gpu.destroyPipeline(cullingPipeline);
+    gpu.destroyPipeline(drawCommandPipeline);
+
+    draws.shutdown();
+
+#if defined(VOID_VALIDATE_GPU_CULLING)
+    expectedCounts.shutdown();
+#endif //VOID_VALIDATE_GPU_CULLING
+}
+
+void GPUCuller::cull(CommandBuffer& commandBuffer, const Frustum& frustum, BufferHandle entityBuffer, BufferHandle visibleIndexBuffer, uint32_t currentFrame,
+                     CullingPhase phase, const CullingOcclusion* occlusion)
+{
+    VOID_ASSERTM(phase != CULLING_PHASE_LATE || occlusion != nullptr, "The late culling phase needs the depth pyramid.");
+
+    GPUDevice& gpu = *commandBuffer.device;
+
+    //The late phase reuses the planes of the early one.
+    Buffer* planes = gpu.accessBuffer(planeBuffer[currentFrame]);
+    if (phase != CULLING_PHASE_LATE)
+    {
+        vmaCopyMemoryToAllocation(gpu.VMAAllocator, frustum.planes, planes->vmaAllocation, 0, sizeof(frustum.planes));
+    }
+
+    Buffer* occlusionData = gpu.accessBuffer(occlusionBuffer[currentFrame]);
+    if (occlusion)
+    {
+        vmaCopyMemoryToAllocation(gpu.VMAAllocator, occlusion, occlusionData->vmaAllocation, 0, sizeof(CullingOcclusion));
+    }
+
+    CullingPushConstants pushConstants{};
+    pushConstants.planeAddress = planes->bufferAddress;
+    pushConstants.modelPositionAddress = gpu.accessBuffer(entityBuffer)->bufferAddress;
+    pushConstants.instanceAddress = gpu.accessBuffer(instanceBuffer)->bufferAddress;
+    pushConstants.bucketAddress = gpu.accessBuffer(bucketBuffer)->bufferAddress;
+    pushConstants.countAddress = gpu.accessBuffer(countBuffer[currentFrame])->bufferAddress;
+    pushConstants.visibleIndexAddress = gpu.accessBuffer(visibleIndexBuffer)->bufferAddress;
+    pushConstants.drawAddress = gpu.accessBuffer(drawBuffer)->bufferAddress;
+    pushConstants.drawCommandAddress = gpu.accessBuffer(drawCommandBuffer[currentFrame])->bufferAddress;
+    pushConstants.eye = frustum.eye;
+    pushConstants.lodScale = frustum.lodScale;
+    pushConstants.instanceCount = instanceCount;
+    pushConstants.bucketCount = bucketCount;
+    pushConstants.meshDrawCount = meshDrawCount;
+    pushConstants.drawCount = drawCount;
+    pushConstants.visibilityAddress = gpu.accessBuffer(visibilityBuffer)->bufferAddress;
+    pushConstants.occlusionAddress = occlusionData->bufferAddress;
+    pushConstants.phase = phase;
+
+    //The frame graph orders the phases of one frame, the early phase also waits on the visibility the late phase of the last frame wrote.
+    commandBuffer.fillBuffer(countBuffer[currentFrame], 0, 0, 0);
+    commandBuffer.memoryBarrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    //Instances, appends the visible instances to their model range.
+    commandBuffer.bindPipeline(cullingPipeline);
+    vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    commandBuffer.dispatch((instanceCount + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE, 1, 1);
+
+    commandBuffer.memoryBarrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    //Draws, compacts the draws of visible models into indirect commands.
+    commandBuffer.bindPipeline(drawCommandPipeline);
+    vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    commandBuffer.dispatch((drawCount + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE, 1, 1);
+}
+
+void GPUCuller::writeDrawCommands(GPUDevice& gpu, const InstanceCuller& culler, uint32_t currentFrame)
+{
+    StackAllocator* scratchAllocator = &MemoryService::instance()->scratchAllocator;
+    size_t commandMarker = scratchAllocator->getMarker();
+
+    Array<DrawCommand> commands;
+    commands.init(scratchAllocator, drawCount, drawCount);
+
+    hostMeshDrawCount = 0;
+    hostDebugDrawCount = 0;
+    for (uint32_t drawIndex = 0; drawIndex < drawCount; ++drawIndex)
+    {
+        const CullingDraw& draw = draws[drawIndex];
+        const uint32_t visibleCount = culler.visibleCount[draw.bucketIndex];
+        if (visibleCount == 0)
+        {
+            continue;
+        }
+
+        const uint32_t slot = drawIndex < meshDrawCount ? hostMeshDrawCount++ : meshDrawCount + hostDebugDrawCount++;
+
+        DrawCommand& command = commands[slot];
+        command.command.indexCount = draw.indexCount;
+        command.command.instanceCount = visibleCount;
+        command.command.firstIndex = draw.firstIndex;
+        command.command.vertexOffset = draw.vertexOffset;
+        command.command.firstInstance = culler.visibleFirst[draw.bucketIndex];
+        command.materialIndex = draw.materialIndex;
+    }
+
+    Buffer* commandBuffer = gpu.accessBuffer(drawCommandBuffer[currentFrame]);
+    vmaCopyMemoryToAllocation(gpu.VMAAllocator, commands.data, commandBuffer->vmaAllocation, 0, sizeof(DrawCommand) * drawCount);
+
+    scratchAllocator->freeMarker(commandMarker);
+}
+
+void GPUCuller::drawMeshes(CommandBuffer& commandBuffer, uint32_t currentFrame, bool gpuCulled)
+{
+    if (gpuCulled)
+    {
+        commandBuffer.drawIndexedIndirectCount(drawCommandBuffer[currentFrame], 0, countBuffer[currentFrame], sizeof(uint32_t) * bucketCount, 
+                                               meshDrawCount, sizeof(DrawCommand));
+    }
+    else if (hostMeshDrawCount > 0)
+    {
+        commandBuffer.drawIndexedIndirect(drawCommandBuffer[currentFrame], hostMeshDrawCount, 0, sizeof(DrawCommand));
+    }
+}
+
+void GPUCuller::drawDebugSpheres(CommandBuffer& commandBuffer, uint32_t currentFrame, bool gpuCulled)
+{
+    if (gpuCulled)
+    {
+        commandBuffer.drawIndexedIndirectCount(drawCommandBuffer[currentFrame], sizeof(DrawCommand) * meshDrawCount, countBuffer[currentFrame], sizeof(uint32_t) * (bucketCount + 1), 
+                                               drawCount - meshDrawCount, sizeof(DrawCommand));
+    }
+    else if (hostDebugDrawCount > 0)
+    {
+        commandBuffer.drawIndexedIndirect(drawCommandBuffer[currentFrame], hostDebugDrawCount, sizeof(DrawCommand) * meshDrawCount, sizeof(DrawCommand));
+    }
+}
+
+#if defined(VOID_VALIDATE_GPU_CULLING)
+void GPUCuller::validate(GPUDevice& gpu, const InstanceCuller& culler, uint32_t currentFrame)
+{
+    uint32_t* expected = expectedCounts.data + bucketCount * currentFrame;
+
+    if (expectedValid[currentFrame])
+    {
+        StackAllocator* scratchAllocator = &MemoryService::instance()->scratchAllocator;
+        size_t readbackMarker = scratchAllocator->getMarker();
+
+        Array<uint32_t> gpuCounts;
+        gpuCounts.init(scratchAllocator, bucketCount, bucketCount);
+
+        Buffer* counts = gpu.accessBuffer(countBuffer[currentFrame]);
+        vmaCopyAllocationToMemory(gpu.VMAAllocator, counts->vmaAllocation, 0, gpuCounts.data, sizeof(uint32_t) * bucketCount);
+
+        for (uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+        {
+            //Spheres exactly on a plane or a LOD switch distance can land either side, so a mismatch is logged rather than asserted.
+            if (gpuCounts[bucket] != expected[bucket])
+            {
+                vprint("GPU culling mismatch on model %u LOD %u: GPU %u visible, CPU %u visible.\n", 
+                       bucket / MAX_MESH_LODS, bucket % MAX_MESH_LODS, gpuCounts[bucket], expected[bucket]);
+            }
+        }
+
+        scratchAllocator->freeMarker(readbackMarker);
+    }
+
+    for (uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        expected[bucket] = culler.visibleCount[bucket];
+    }
+
+    expectedValid[currentFrame] = true;
+}
+#endif //VOID_VALIDATE_GPU_CULLING
+
+void benchmarkInstanceCulling()
+{
+    static constexpr uint32_t instanceCounts[] = { 10000, 100000, 1000000 };
+    static constexpr float sceneRadius = 2000.f;
+
+    Allocator* allocator = &MemoryService::instance()->systemAllocator;
+
+    Camera camera{};
+    camera.initPerspective(0.01f, 5000.f, 60.f, 16.f / 9.f);
+    camera.update();
+
+    Frustum frustum{};
+    frustum.extract(camera.viewProjection, camera.farPlane);
+
+    for (uint32_t countIndex = 0; countIndex < ArraySize(instanceCounts); ++countIndex)
+    {
+        const uint32_t count = instanceCounts[countIndex];
+
+        Array<uint32_t> modelIndices;
+        modelIndices.init(allocator, count, count);
+        Array<vec4s> spheres;
+        spheres.init(allocator, count, count);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            modelIndices[i] = i % 3;
+            spheres[i] = vec4s{ getRandomValue(-sceneRadius, sceneRadius), getRandomValue(-sceneRadius, sceneRadius), getRandomValue(-sceneRadius, sceneRadius), 13.5f };
+        }
+
+        InstanceCuller culler{};
+        culler.init(allocator, 3);
+        culler.build(modelIndices.data, spheres.data, count);
+
+        //Keep the total work roughly the same for every instance count.
+        const uint32_t iterations = max(10u, 10000000u / count);
+
+        const int64_t startTime = timeNow();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            culler.cull(frustum);
+        }
+        const double elapsedMS = timeDeltaMilliseconds(startTime, timeNow()) / iterations;
+
+        uint32_t visible = 0;
+        for (uint32_t bucket = 0; bucket < culler.bucketCount; ++bucket)
+        {
+            visible += culler.visibleCount[bucket];
+        }
+        vprint("Cull %u instances (%u wide): %3.4fms, %.0f instances/ms, %u visible.\n", count, CULLING_LANE_WIDTH, elapsedMS, count / elapsedMS, visible);
+
+        culler.shutdown();
+        spheres.shutdown();
+        modelIndices.shutdown();
+    }
+}
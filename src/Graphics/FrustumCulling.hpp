@@ -0,0 +1,169 @@
+#ifndef FRUSTUM_CULLING_HDR
+#define FRUSTUM_CULLING_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Array.hpp"
+
+#include "GPUDevice.hpp"
+#include "LoadGLTF.hpp"
+
+#include "cglm/struct/mat4.h"
+#include "cglm/struct/vec4.h"
+
+//Define this to log the cull throughput for 10K, 100K and 1M instances when the game starts.
+//#define VOID_CULLING_BENCHMARK
+
+//Define this to read back the GPU culling counts and compare them against the CPU culler (useful on lavapipe).
+//#define VOID_VALIDATE_GPU_CULLING
+
+//The SIMD width used by the culler, AVX tests 8 spheres at a time while SSE tests 4.
+#if defined(__AVX__)
+static constexpr uint32_t CULLING_LANE_WIDTH = 8;
+#else
+static constexpr uint32_t CULLING_LANE_WIDTH = 4;
+#endif
+
+//The screen space error in pixels an instance LOD is allowed to have.
+static constexpr float LOD_PIXEL_ERROR = 1.f;
+
+struct Frustum
+{
+    //Planes are stored as (normal, distance) and point inside the frustum.
+    //The projection is reverse-Z with an infinite far plane so the far plane is built from the far distance instead.
+    void extract(const mat4s& viewProjection, float farDistance);
+    //The LOD scale is the pixels covered by one unit of error at a distance of one, divided by LOD_PIXEL_ERROR.
+    void setLodView(const vec3s& newEye, const mat4s& projection, float viewportHeight);
+
+    vec4s planes[6];
+
+    //Used to pick the LOD of each instance, a LOD scale of 0 always picks the coarsest LOD.
+    vec3s eye;
+    float lodScale;
+};
+
+//Culls bounding spheres against a frustum and writes a compacted list of the visible instances per bucket.
+//The spheres are stored SoA and bucketed per model. Each model owns MAX_MESH_LODS buckets in visibleIndices, one per LOD,
+//and every visible instance is written to the bucket of the LOD picked from its screen space error.
+struct InstanceCuller
+{
+    void init(Allocator* allocator, uint32_t newModelCount);
+    void shutdown();
+
+    //lodErrors are relative to the model radius like Model::lodError. Must be called before build, models default to a single LOD.
+    void setLods(uint32_t model, const float* lodErrors, uint32_t newLodCount);
+
+    //modelIndices and spheres (centre xyz, radius w) are indexed by instance.
+    void build(const uint32_t* modelIndices, const vec4s* spheres, uint32_t newInstanceCount);
+
+    void setCentre(uint32_t instanceIndex, const vec3s& centre);
+    //Deleted instances are never visible.
+    void disable(uint32_t instanceIndex);
+
+    void cull(const Frustum& frustum);
+
+    //SoA sphere data padded per model to the SIMD width.
+    Array<float> centreX;
+    Array<float> centreY;
+    Array<float> centreZ;
+    Array<float> radius;
+    Array<uint32_t> slotToInstance;
+    Array<uint32_t> instanceToSlot;
+
+    //Per model ranges.
+    Array<uint32_t> slotFirst;
+    Array<uint32_t> slotCount;
+    Array<uint32_t> lodCount;
+
+    //Per bucket data, bucket b is LOD b % MAX_MESH_LODS of model b / MAX_MESH_LODS.
+    Array<float> lodError;
+    Array<uint32_t> visibleFirst;
+    Array<uint32_t> visibleCount;
+
+    //Visible instance indices, bucket b owns [visibleFirst[b], visibleFirst[b] + visibleCount[b]).
+    Array<uint32_t> visibleIndices;
+
+    uint32_t modelCount = 0;
+    uint32_t bucketCount = 0;
+    uint32_t instanceCount = 0;
+};
+
+struct CommandBuffer;
+struct CullingDraw;
+
+//Two phase occlusion culling. The early phase draws the instances that were visible last frame, a depth pyramid is built from
+//that depth and the late phase tests every instance against it. It draws the ones that became visible and keeps the visibility for the next frame.
+enum CullingPhase : uint8_t
+{
+    //Occlusion culling is off, everything in the frustum is drawn.
+    CULLING_PHASE_ALL,
+    CULLING_PHASE_EARLY,
+    CULLING_PHASE_LATE
+};
+
+//Runs the same sphere test and LOD selection as InstanceCuller in a compute shader and writes the indirect draw commands.
+//Each bucket keeps the static visibleFirst range from the CPU culler, instances are appended to it with an atomic counter.
+//Visible mesh draws are compacted into one section of the command buffer and the debug sphere draws (one per bucket) into a second,
+//each section has its own draw count so every pipeline is drawn with a single indirect call.
+struct GPUCuller
+{
+    //modelIndices and spheres must be the same arrays the InstanceCuller was built with.
+    void init(GPUDevice& gpu, const InstanceCuller& culler, const Array<Model>& models, const Model& debugSphere, 
+              const uint32_t* modelIndices, const vec4s* spheres);
+    void shutdown(GPUDevice& gpu);
+
+    //Records the culling dispatches from a frame graph compute pass, the pass declares the buffers so the graph places the barrier before the draws.
+    //entityBuffer and visibleIndexBuffer are the per frame bindless buffers used by the vertex shaders.
+    //Each phase overwrites the counts and commands of the last one, so the draws of a phase have to be recorded before the next cull.
+    //The late phase needs the occlusion data of the depth pyramid built after the early draws.
+    void cull(CommandBuffer& commandBuffer, const Frustum& frustum, BufferHandle entityBuffer, BufferHandle visibleIndexBuffer, uint32_t currentFrame,
+              CullingPhase phase = CULLING_PHASE_ALL, const CullingOcclusion* occlusion = nullptr);
+
+    //Writes the same commands on the host from the CPU culler, used when GPU culling is off.
+    void writeDrawCommands(GPUDevice& gpu, const InstanceCuller& culler, uint32_t currentFrame);
+
+    //gpuCulled selects between the GPU written draw counts and the ones from writeDrawCommands.
+    void drawMeshes(CommandBuffer& commandBuffer, uint32_t currentFrame, bool gpuCulled);
+    void drawDebugSpheres(CommandBuffer& commandBuffer, uint32_t currentFrame, bool gpuCulled);
+
+#if defined(VOID_VALIDATE_GPU_CULLING)
+    //Compares the counts written FRAMES_IN_FLIGHT frames ago against the CPU counts of that frame and then stores this frames CPU counts.
+    //Call after the CPU cull and before cull() so the frame fence has already been waited on.
+    void validate(GPUDevice& gpu, const InstanceCuller& culler, uint32_t currentFrame);
+
+    Array<uint32_t> expectedCounts;
+    bool expectedValid[FRAMES_IN_FLIGHT]{};
+#endif //VOID_VALIDATE_GPU_CULLING
+
+    PipelineHandle cullingPipeline;
+    PipelineHandle drawCommandPipeline;
+
+    //Static data.
+    BufferHandle instanceBuffer;
+    BufferHandle bucketBuffer;
+    BufferHandle drawBuffer;
+    //One flag per instance written by the late phase and read by the next early phase. The frames in flight share it as they run in order on the queue.
+    BufferHandle visibilityBuffer;
+
+    //Per frame data, the count buffer holds the bucket counters followed by the mesh and debug draw counts.
+    BufferHandle planeBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle countBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle drawCommandBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle occlusionBuffer[FRAMES_IN_FLIGHT];
+
+    //Mesh draws of every model LOD followed by one debug sphere draw per bucket.
+    Array<CullingDraw> draws;
+
+    //Draw counts written by writeDrawCommands.
+    uint32_t hostMeshDrawCount = 0;
+    uint32_t hostDebugDrawCount = 0;
+
+    uint32_t instanceCount = 0;
+    uint32_t bucketCount = 0;
+    uint32_t meshDrawCount = 0;
+    uint32_t drawCount = 0;
+};
+
+//Logs the cull throughput over randomly scattered spheres.
+void benchmarkInstanceCulling();
+
+#endif // !FRUSTUM_CULLING_HDR
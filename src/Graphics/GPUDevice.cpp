@@ -129,6 +129,25 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
         texture->usage = creation.usage;
         texture->handle = handle;
 
+        //The mip chain is filled by blitting down from level 0, which needs a format that can be linearly filtered as a blit source.
+        //Block compressed textures bring their own levels.
+        if (texture->mipmaps > 1 && TextureFormat::isBlockCompressed(texture->vkFormat) == false)
+        {
+            VkFormatProperties formatProperties;
+            vkGetPhysicalDeviceFormatProperties(gpu.vulkanPhysicalDevice, texture->vkFormat, &formatProperties);
+
+            const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+            if ((formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures)
+            {
+                texture->usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            }
+            else
+            {
+                vprint("Texture %s format can not be blitted, only mip 0 is created.\n", creation.name ? creation.name : "");
+                texture->mipmaps = 1;
+            }
+        }
+
         //Create the image
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -139,18 +158,37 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
         imageInfo.extent.width  = creation.width;
         imageInfo.extent.height = creation.height;
         imageInfo.extent.depth = creation.depth;
-        imageInfo.mipLevels = creation.mipmaps;
+        imageInfo.mipLevels = texture->mipmaps;
         imageInfo.arrayLayers = creation.layerCount;
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
+        //Sampled images are sub allocated and can be copied from so defragmentation can move them, whatever the GPU writes keeps its own memory.
+        const VkImageUsageFlags writtenUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+        const GPUMemoryCategory category = (texture->usage & writtenUsage) ? GPU_MEMORY_CATEGORY_RENDER_TARGET : GPU_MEMORY_CATEGORY_TEXTURE;
+        if (category == GPU_MEMORY_CATEGORY_TEXTURE)
+        {
+            texture->usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            imageInfo.usage = texture->usage;
+        }
+
         VmaAllocationCreateInfo memoryInfo{};
-        memoryInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+        memoryInfo.flags = category == GPU_MEMORY_CATEGORY_TEXTURE ? 0 : VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
         memoryInfo.usage = VMA_MEMORY_USAGE_AUTO;
 
-        check(vmaCreateImage(gpu.VMAAllocator, &imageInfo, &memoryInfo, &texture->vkImage, &texture->vmaAllocation, nullptr));
+        if (creation.aliasAllocation)
+        {
+            //The owner of the allocation frees it, vmaDestroyImage only destroys the image when the allocation is null.
+            check(vmaCreateAliasingImage(gpu.VMAAllocator, creation.aliasAllocation, &imageInfo, &texture->vkImage));
+            texture->vmaAllocation = nullptr;
+        }
+        else
+        {
+            check(vmaCreateImage(gpu.VMAAllocator, &imageInfo, &memoryInfo, &texture->vkImage, &texture->vmaAllocation, nullptr));
+            gpu.memory.track(texture->vmaAllocation, category, handle.index);
+        }
 
         gpu.setResourceName(VK_OBJECT_TYPE_IMAGE, (uint64_t)(texture->vkImage), creation.name);
 
@@ -170,7 +208,7 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
             info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         }
 
-        info.subresourceRange.levelCount = 1;
+        info.subresourceRange.levelCount = texture->mipmaps;
         info.subresourceRange.layerCount = creation.layerCount;
         check(vkCreateImageView(gpu.vulkanDevice, &info, gpu.vulkanAllocationCallbacks, &texture->vkImageView));
 
@@ -185,6 +223,227 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
         gpu.textureToUpdateBindless.push(resourceUpdate);
     }
 
+    //Expects every level in TRANSFER_DST with level 0 filled, leaves every level in SHADER_READ_ONLY.
+    //Each level is a linear blit of the one above it, which is a 2x2 box filter for the power of two sizes.
+    void generateMipmaps(CommandBuffer* commandBuffer, Texture* texture, uint32_t layerCount)
+    {
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = texture->vkImage;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = layerCount;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = 1;
+        dependencyInfo.pImageMemoryBarriers = &barrier;
+
+        int32_t mipWidth = texture->width;
+        int32_t mipHeight = texture->height;
+        for (uint32_t level = 1; level < texture->mipmaps; ++level)
+        {
+            //The level above has been written by the copy or the last blit, it becomes the source.
+            barrier.subresourceRange.baseMipLevel = level - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+            vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &dependencyInfo);
+
+            const int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+            const int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+            VkImageBlit2 blit{};
+            blit.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
+            blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = layerCount;
+            blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = layerCount;
+
+            VkBlitImageInfo2 blitInfo{};
+            blitInfo.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2;
+            blitInfo.srcImage = texture->vkImage;
+            blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            blitInfo.dstImage = texture->vkImage;
+            blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            blitInfo.regionCount = 1;
+            blitInfo.pRegions = &blit;
+            blitInfo.filter = VK_FILTER_LINEAR;
+
+            vkCmdBlitImage2(commandBuffer->vkCommandBuffer, &blitInfo);
+
+            mipWidth = nextWidth;
+            mipHeight = nextHeight;
+        }
+
+        //Every level but the last was read as a blit source, the last one was only written.
+        VkImageMemoryBarrier2 finalBarriers[2]{ barrier, barrier };
+        finalBarriers[0].subresourceRange.baseMipLevel = 0;
+        finalBarriers[0].subresourceRange.levelCount = texture->mipmaps - 1;
+        finalBarriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        finalBarriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        finalBarriers[0].srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+        finalBarriers[0].dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+        finalBarriers[0].srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        finalBarriers[0].dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+
+        finalBarriers[1].subresourceRange.baseMipLevel = texture->mipmaps - 1;
+        finalBarriers[1].subresourceRange.levelCount = 1;
+        finalBarriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        finalBarriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        finalBarriers[1].srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        finalBarriers[1].dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+        finalBarriers[1].srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        finalBarriers[1].dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+
+        dependencyInfo.imageMemoryBarrierCount = 2;
+        dependencyInfo.pImageMemoryBarriers = finalBarriers;
+        vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &dependencyInfo);
+    }
+
+    //Bytes of one layer's data. Block compressed data comes with every level, level 0 first and tightly packed.
+    //Anything else is RGBA8 level 0 and the rest is blitted.
+    uint32_t textureUploadSize(const TextureCreation& creation, uint32_t mipmaps)
+    {
+        const uint32_t uploadLevels = TextureFormat::isBlockCompressed(creation.format) ? mipmaps : 1;
+
+        uint32_t imageSize = 0;
+        for (uint32_t level = 0; level < uploadLevels; ++level)
+        {
+            imageSize += TextureFormat::levelSize(creation.format, max(creation.width >> level, 1), max(creation.height >> level, 1));
+        }
+
+        return imageSize;
+    }
+
+    void fillTextureStaging(GPUDevice& gpu, const TextureCreation& creation, uint32_t imageSize, VmaAllocation stagingAllocation)
+    {
+        if (creation.images.capacity >= 1)
+        {
+            for (uint32_t i = 0; i < creation.layerCount; ++i)
+            {
+                //Copy buffer data
+                vmaCopyMemoryToAllocation(gpu.VMAAllocator, creation.images[i], stagingAllocation, imageSize * i, imageSize);
+            }
+        }
+        else
+        {
+            vmaCopyMemoryToAllocation(gpu.VMAAllocator, creation.initialData, stagingAllocation, 0, imageSize * creation.layerCount);
+        }
+    }
+
+    //Copies the uploaded levels from the staging buffer and generates the rest, leaves every level in SHADER_READ_ONLY.
+    void recordTextureUpload(CommandBuffer* commandBuffer, Texture* texture, const TextureCreation& creation, VkBuffer stagingBuffer)
+    {
+        const bool blockCompressed = TextureFormat::isBlockCompressed(creation.format);
+        const uint32_t uploadLevels = blockCompressed ? texture->mipmaps : 1;
+        VOID_ASSERTM(blockCompressed == false || creation.layerCount == 1, "Block compressed texture %s must have a single layer.", creation.name ? creation.name : "");
+
+        //Copy
+        VkImageMemoryBarrier2 barrierStaging{};
+        barrierStaging.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrierStaging.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrierStaging.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrierStaging.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrierStaging.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrierStaging.srcAccessMask = 0;
+        barrierStaging.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrierStaging.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+        barrierStaging.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        barrierStaging.image = texture->vkImage;
+        barrierStaging.subresourceRange.baseMipLevel = 0;
+        barrierStaging.subresourceRange.levelCount = texture->mipmaps;
+        barrierStaging.subresourceRange.baseArrayLayer = 0;
+        barrierStaging.subresourceRange.layerCount = creation.layerCount;
+        barrierStaging.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+        VkDependencyInfo barrierStagingDependencyInfo{};
+        barrierStagingDependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        barrierStagingDependencyInfo.imageMemoryBarrierCount = 1;
+        barrierStagingDependencyInfo.pImageMemoryBarriers = &barrierStaging;
+
+        vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &barrierStagingDependencyInfo);
+
+        VkBufferImageCopy2 regions[16]{};
+        VOID_ASSERTM(uploadLevels <= ArraySize(regions), "Texture %s has more than %u levels.", creation.name ? creation.name : "", uint32_t(ArraySize(regions)));
+
+        uint32_t bufferOffset = 0;
+        for (uint32_t level = 0; level < uploadLevels; ++level)
+        {
+            const uint32_t levelWidth = max(creation.width >> level, 1);
+            const uint32_t levelHeight = max(creation.height >> level, 1);
+
+            VkBufferImageCopy2& region = regions[level];
+            region.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
+            region.bufferOffset = bufferOffset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = creation.layerCount;
+
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { levelWidth, levelHeight, creation.depth };
+
+            bufferOffset += TextureFormat::levelSize(creation.format, levelWidth, levelHeight);
+        }
+
+        VkCopyBufferToImageInfo2 bufferTransfer{};
+        bufferTransfer.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2;
+        bufferTransfer.pRegions = regions;
+        bufferTransfer.regionCount = uploadLevels;
+        bufferTransfer.dstImage = texture->vkImage;
+        bufferTransfer.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        bufferTransfer.srcBuffer = stagingBuffer;
+
+        vkCmdCopyBufferToImage2(commandBuffer->vkCommandBuffer, &bufferTransfer);
+
+        if (texture->mipmaps > uploadLevels)
+        {
+            generateMipmaps(commandBuffer, texture, creation.layerCount);
+        }
+        else
+        {
+            VkImageMemoryBarrier2 barrierImage{};
+            barrierImage.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrierImage.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrierImage.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrierImage.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrierImage.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrierImage.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            barrierImage.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+            barrierImage.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+            barrierImage.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+            barrierImage.image = texture->vkImage;
+            barrierImage.subresourceRange.baseMipLevel = 0;
+            barrierImage.subresourceRange.levelCount = texture->mipmaps;
+            barrierImage.subresourceRange.baseArrayLayer = 0;
+            barrierImage.subresourceRange.layerCount = creation.layerCount;
+            barrierImage.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+            VkDependencyInfo barrierImageDependencyInfo{};
+            barrierImageDependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            barrierImageDependencyInfo.imageMemoryBarrierCount = 1;
+            barrierImageDependencyInfo.pImageMemoryBarriers = &barrierImage;
+
+            vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &barrierImageDependencyInfo);
+        }
+    }
+
     void vulkanFillWriteDescriptorSets(GPUDevice& gpu, const DescriptorSetLayout* descriptorSetLayout, VkDescriptorSet vkDescriptorSet,
                                        VkWriteDescriptorSet* descriptorWrite, VkDescriptorBufferInfo* bufferInfo, VkDescriptorImageInfo* imageInfo,
                                        VkSampler vkDefaultSampler, uint32_t& numResources, const uint32_t* resources, const SamplerHandle* samplers,
@@ -350,7 +609,7 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
         numResources = usedResources;
     }
 
-    void vulkanResizeTexture(GPUDevice gpu, Texture* texture, Texture* textureToDelete, uint16_t width, uint16_t height, uint16_t depth)
+    void vulkanResizeTexture(GPUDevice& gpu, Texture* texture, Texture* textureToDelete, uint16_t width, uint16_t height, uint16_t depth)
     {
         //The caching handles destroying this texture.
         textureToDelete->vkImageView = texture->vkImageView;
@@ -365,6 +624,20 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityF
                        .setSize(width, height, depth);
         vulkanCreateTexture(gpu, textureCreation, texture->handle, texture);
     }
+
+    //Only buffers and textures own VMA memory.
+    VmaAllocation resourceAllocation(GPUDevice& gpu, const ResourceUpdate& resource)
+    {
+        switch (resource.type)
+        {
+        case ResourceUpdateType::BUFFER:
+            return gpu.accessBuffer({ resource.handle })->vmaAllocation;
+        case ResourceUpdateType::TEXTURE:
+            return gpu.accessTexture({ resource.handle })->vmaAllocation;
+        default:
+            return VK_NULL_HANDLE;
+        }
+    }
 }//Anon
 
 struct CommandBufferRing
@@ -488,12 +761,20 @@ void GPUTimestampManager::init(Allocator* newAllocator, uint16_t newQueriesPerFr
 
     //Data is start, end in 2 uint64_t numbers.
     const uint32_t dataDataPerQuery = 2;
-    const size_t allocatorSize = sizeof(GPUTimestamp) * queriesPerFrame * maxFrame + sizeof(uint64_t) * queriesPerFrame * maxFrame * dataDataPerQuery;
+    const size_t timestampsSize = sizeof(GPUTimestamp) * queriesPerFrame * maxFrame;
+    const size_t dataSize = sizeof(uint64_t) * queriesPerFrame * maxFrame * dataDataPerQuery;
+    const size_t resolvedSize = sizeof(GPUTimestamp) * queriesPerFrame;
+    const size_t allocatorSize = timestampsSize + dataSize + resolvedSize + sizeof(uint32_t) * maxFrame;
     uint8_t* memory = void_allocam(allocatorSize, allocator);
 
     timestamps = reinterpret_cast<GPUTimestamp*>(memory);
     //Data is start, end in 2 uint64_t numbers.
-    timestampsData = reinterpret_cast<uint64_t*>(memory + sizeof(GPUTimestamp) * queriesPerFrame * maxFrame);
+    timestampsData = reinterpret_cast<uint64_t*>(memory + timestampsSize);
+    resolvedTimestamps = reinterpret_cast<GPUTimestamp*>(memory + timestampsSize + dataSize);
+    pendingQueries = reinterpret_cast<uint32_t*>(memory + timestampsSize + dataSize + resolvedSize);
+
+    memset(pendingQueries, 0, sizeof(uint32_t) * maxFrame);
+    resolvedQueries = 0;
 
     reset();
 }
@@ -513,20 +794,21 @@ void GPUTimestampManager::reset()
 {
     currentQuery = 0;
     parentIndex = 0;
-    currentFrameResolved = false;
     depth = 0;
 }
 
-//Returns the total queries for this frame.
-uint32_t GPUTimestampManager::resolve(uint32_t currentFrame, GPUTimestamp* timestampsToFill)
+//Returns the total queries of the last resolved frame.
+uint32_t GPUTimestampManager::resolve(GPUTimestamp* timestampsToFill)
 {
-    memoryCopy(timestampsToFill, &timestamps[currentFrame * queriesPerFrame], sizeof(GPUTimestamp) * currentQuery);
-    return currentQuery;
+    memoryCopy(timestampsToFill, resolvedTimestamps, sizeof(GPUTimestamp) * resolvedQueries);
+    return resolvedQueries;
 }
 
 //Returns the timestamp query index.
 uint32_t GPUTimestampManager::push(uint32_t currentFrame, const char* name)
 {
+    VOID_ASSERTM(currentQuery < queriesPerFrame, "More than %u GPU timestamps pushed in one frame.", queriesPerFrame);
+
     uint32_t queryIndex = (currentFrame * queriesPerFrame) + currentQuery;
 
     GPUTimestamp& timestamp = timestamps[queryIndex];
@@ -743,9 +1025,26 @@ vprint("Instance created.\n");
     UBO_ALIGNMENT = vulkanPhysicalProperties.limits.minUniformBufferOffsetAlignment;
     SSBO_ALIGNMENT = vulkanPhysicalProperties.limits.minStorageBufferOffsetAlignment;
 
+    //VK_EXT_memory_budget lets VMA read the heap budgets from the driver instead of estimating them from its own blocks.
+    uint32_t availableExtensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(vulkanPhysicalDevice, nullptr, &availableExtensionCount, nullptr);
+    VkExtensionProperties* availableExtensions = reinterpret_cast<VkExtensionProperties*>(void_alloca(sizeof(VkExtensionProperties) * availableExtensionCount, allocator));
+    vkEnumerateDeviceExtensionProperties(vulkanPhysicalDevice, nullptr, &availableExtensionCount, availableExtensions);
+
+    for (uint32_t i = 0; i < availableExtensionCount; ++i)
+    {
+        if (strcmp(availableExtensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+        {
+            memoryBudgetSupported = true;
+            break;
+        }
+    }
+
+    void_free(availableExtensions, allocator);
+
     //Get the logical device
-    uint32_t deviceExtensionCount = 1;
-    const char* deviceExtensions[] = { "VK_KHR_swapchain" };
+    const char* deviceExtensions[] = { "VK_KHR_swapchain", VK_EXT_MEMORY_BUDGET_EXTENSION_NAME };
+    uint32_t deviceExtensionCount = memoryBudgetSupported ? 2 : 1;
     const float queuePriority[] = { 1.f };
     VkDeviceQueueCreateInfo queueInfo[1]{};
     queueInfo[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -769,6 +1068,8 @@ vprint("Instance created.\n");
     physical12Features.scalarBlockLayout = true;
     physical12Features.runtimeDescriptorArray = true;
     physical12Features.descriptorBindingPartiallyBound = true;
+    physical12Features.drawIndirectCount = true;
+    physical12Features.timelineSemaphore = true;
 
     VkPhysicalDeviceVulkan13Features physical13Features{};
     physical13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
@@ -784,6 +1085,9 @@ vprint("Instance created.\n");
     physicalDeviceFeature2.pNext = &physical13Features;
 
     vkGetPhysicalDeviceFeatures2(vulkanPhysicalDevice, &physicalDeviceFeature2);
+    drawIndirectCountSupported = physical12Features.drawIndirectCount;
+    textureCompressionBCSupported = physicalDeviceFeature2.features.textureCompressionBC;
+    VOID_ASSERTM(physical12Features.timelineSemaphore, "Timeline semaphores are required for frame synchronisation.");
 
     VkDeviceCreateInfo deviceCreateInfo{};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -873,7 +1177,8 @@ vprint("Instance created.\n");
 
     //Create VMA Allocator
     VmaAllocatorCreateInfo allocatorInfo{};
-    allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+    allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT | (memoryBudgetSupported ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0);
+    allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_3;
     allocatorInfo.physicalDevice = vulkanPhysicalDevice;
     allocatorInfo.device = vulkanDevice;
     allocatorInfo.instance = vulkanInstance;
@@ -882,6 +1187,8 @@ vprint("Instance created.\n");
     result = vmaCreateAllocator(&allocatorInfo, &VMAAllocator);
     check(result);
 
+    memory.init(VMAAllocator);
+
     //Create the pools.
     static const uint32_t GLOBAL_POOL_ELEMENTS = 128;
     VkDescriptorPoolSize poolSizes[] =
@@ -940,29 +1247,33 @@ vprint("Instance created.\n");
     descriptorSets.init(allocator, 256, sizeof(DescriptorSet));
     samplers.init(allocator, 32, sizeof(Sampler));
 
-    //Init render frame informations. This includes fences, semaphores and command buffers.
+    //Init render frame informations. This includes semaphores and command buffers.
     //TODO: memory allocate memory of all the Device render frame stuff.
     uint8_t* memory = void_allocam(sizeof(GPUTimestampManager) + sizeof(CommandBuffer*) * 128, allocator);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.pNext = nullptr;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
     imageAvailableSemaphore.init(allocator, FRAMES_IN_FLIGHT, FRAMES_IN_FLIGHT);
-    fences.init(allocator, FRAMES_IN_FLIGHT, FRAMES_IN_FLIGHT);
 
     vprint("Semaphores created.\n");
     for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
     {
         vkCreateSemaphore(vulkanDevice, &semaphoreInfo, vulkanAllocationCallbacks, &imageAvailableSemaphore[i]);
-
-        vkCreateFence(vulkanDevice, &fenceInfo, vulkanAllocationCallbacks, &fences[i]);
     }
 
+    //Replaces the per frame fences, frames and uploads wait on the exact value of the work they depend on.
+    VkSemaphoreTypeCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo timelineSemaphoreInfo{};
+    timelineSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timelineSemaphoreInfo.pNext = &timelineInfo;
+
+    check(vkCreateSemaphore(vulkanDevice, &timelineSemaphoreInfo, vulkanAllocationCallbacks, &vulkanTimelineSemaphore));
+
     gpuTimestampManager = reinterpret_cast<GPUTimestampManager*>(memory);
     gpuTimestampManager->init(allocator, creation.GPUTimeQueriesPerFrame, uint16_t(swapchainImageCount));
 
@@ -1026,7 +1337,8 @@ vprint("Instance created.\n");
     dummyTexture = createTexture(dummyTextureCreation);
 
     DescriptorSetLayoutCreation bindlessLayoutCreation{};
-    bindlessLayoutCreation.addBinding({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, BINDLESS_TEXTURE_BINDING, MAX_BINDLESS_RESOURCES, VK_SHADER_STAGE_FRAGMENT_BIT, "BindlessTextures" })
+    //Compute reads textures too, the depth pyramid is reduced from the depth buffer.
+    bindlessLayoutCreation.addBinding({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, BINDLESS_TEXTURE_BINDING, MAX_BINDLESS_RESOURCES, VkShaderStageFlagBits(VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT), "BindlessTextures" })
                           .addBinding({ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, BINDLESS_IMAGE_BINDING, MAX_BINDLESS_RESOURCES, VK_SHADER_STAGE_FRAGMENT_BIT, "BindlessImages" })
                           .setSetIndex(0)
                           .setName("BindlessLayout");
@@ -1047,16 +1359,17 @@ vprint("Instance created.\n");
 void GPUDevice::shutdown()
 {
     vkDeviceWaitIdle(vulkanDevice);
+    memory.shutdown(*this);
     commandBufferRing.shutdown();
 
     for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
     {
         vkDestroySemaphore(vulkanDevice, imageAvailableSemaphore[i], vulkanAllocationCallbacks);
-        vkDestroyFence(vulkanDevice, fences[i], vulkanAllocationCallbacks);
     }
 
+    vkDestroySemaphore(vulkanDevice, vulkanTimelineSemaphore, vulkanAllocationCallbacks);
+
     imageAvailableSemaphore.shutdown();
-    fences.shutdown();
 
     gpuTimestampManager->shutdown();
     //Add pending bindless textures to delete.
@@ -1180,6 +1493,7 @@ BufferHandle GPUDevice::createBuffer(const BufferCreation& creation)
 
     VmaAllocationInfo allocationInfo{};
     check(vmaCreateBuffer(VMAAllocator, &bufferInfo, &memoryInfo, &buffer->vkBuffer, &buffer->vmaAllocation, &allocationInfo));
+    memory.track(buffer->vmaAllocation, creation.category, handle.index);
 
     setResourceName(VK_OBJECT_TYPE_BUFFER, reinterpret_cast<uint64_t>(buffer->vkBuffer), creation.name);
     buffer->vkDeviceMemory = allocationInfo.deviceMemory;
@@ -1221,6 +1535,7 @@ BufferHandle GPUDevice::createBindlessBuffer(const BufferCreation& creation)
 
     VmaAllocationInfo allocationInfo{};
     check(vmaCreateBuffer(VMAAllocator, &bufferInfo, &memoryInfo, &buffer->vkBuffer, &buffer->vmaAllocation, &allocationInfo));
+    memory.track(buffer->vmaAllocation, creation.category, handle.index);
 
     setResourceName(VK_OBJECT_TYPE_BUFFER, reinterpret_cast<uint64_t>(buffer->vkBuffer), creation.name);
     buffer->vkDeviceMemory = allocationInfo.deviceMemory;
@@ -1256,13 +1571,12 @@ TextureHandle GPUDevice::createTexture(const TextureCreation& creation)
     if (creation.initialData || creation.images.capacity >= 1)
     {
         //Create stating buffer
+        const uint32_t imageSize = textureUploadSize(creation, texture->mipmaps);
+
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-        uint32_t totalBufferSize = (creation.width * creation.height * 4) * creation.layerCount;
-        uint32_t imageSize = (creation.width * creation.height * 4);
-        bufferInfo.size = totalBufferSize;
+        bufferInfo.size = imageSize * creation.layerCount;
 
         VmaAllocationCreateInfo memoryInfo{};
         memoryInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
@@ -1272,19 +1586,10 @@ TextureHandle GPUDevice::createTexture(const TextureCreation& creation)
         VmaAllocation stagingAllocation;
         VkBuffer stagingBuffer;
         check(vmaCreateBuffer(VMAAllocator, &bufferInfo, &memoryInfo, &stagingBuffer, &stagingAllocation, &allocationInfo));
+        memory.track(stagingAllocation, GPU_MEMORY_CATEGORY_STAGING);
+
+        fillTextureStaging(*this, creation, imageSize, stagingAllocation);
 
-        if (creation.images.capacity >= 1)
-        {
-            for (uint32_t i = 0; i < creation.layerCount; ++i)
-            {
-                //Copy buffer data
-                vmaCopyMemoryToAllocation(VMAAllocator, creation.images[i], stagingAllocation, imageSize * i, imageSize);
-            }
-        }
-        else
-        {
-            vmaCopyMemoryToAllocation(VMAAllocator, creation.initialData, stagingAllocation, 0, totalBufferSize);
-        }
         //Execute command buffer
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1293,94 +1598,58 @@ TextureHandle GPUDevice::createTexture(const TextureCreation& creation)
         CommandBuffer* commandBuffer = getInstantCommandBuffer();
         vkBeginCommandBuffer(commandBuffer->vkCommandBuffer, &beginInfo);
 
-        //Copy
-        VkImageMemoryBarrier2 barrierStaging{};
-        barrierStaging.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-        barrierStaging.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        barrierStaging.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrierStaging.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrierStaging.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrierStaging.srcAccessMask = 0;
-        barrierStaging.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
-        barrierStaging.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
-        barrierStaging.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
-        barrierStaging.image = texture->vkImage;
-        barrierStaging.subresourceRange.baseMipLevel = 0;
-        barrierStaging.subresourceRange.levelCount = 1;
-        barrierStaging.subresourceRange.baseArrayLayer = 0;
-        barrierStaging.subresourceRange.layerCount = creation.layerCount;
-        barrierStaging.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        recordTextureUpload(commandBuffer, texture, creation, stagingBuffer);
 
-        VkDependencyInfo barrierStagingDependencyInfo{};
-        barrierStagingDependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-        barrierStagingDependencyInfo.imageMemoryBarrierCount = 1;
-        barrierStagingDependencyInfo.pImageMemoryBarriers = &barrierStaging;
+        vkEndCommandBuffer(commandBuffer->vkCommandBuffer);
 
-        vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &barrierStagingDependencyInfo);
+        //Only the upload is waited on, frames still in flight keep running.
+        waitTimeline(submitInstant(commandBuffer));
 
-        VkBufferImageCopy2 region{};
-        region.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
+        memory.release(stagingAllocation);
+        vmaDestroyBuffer(VMAAllocator, stagingBuffer, stagingAllocation);
 
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = creation.layerCount;
+        //TODO: Maybe I need to free the command buffer.
+        vkResetCommandBuffer(commandBuffer->vkCommandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+    }
 
-        region.imageOffset = { 0, 0, 0 };
-        region.imageExtent = { creation.width, creation.height, creation.depth };
+    return handle;
+}
 
-        VkCopyBufferToImageInfo2 bufferTransfer{};
-        bufferTransfer.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2;
-        bufferTransfer.pRegions = &region;
-        bufferTransfer.regionCount = 1;
-        bufferTransfer.dstImage = texture->vkImage;
-        bufferTransfer.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        bufferTransfer.srcBuffer = stagingBuffer;
+TextureHandle GPUDevice::createTexture(const TextureCreation& creation, CommandBuffer* commandBuffer)
+{
+    uint32_t resourceIndex = textures.obtainResource();
+    TextureHandle handle = { resourceIndex };
+    if (resourceIndex == INVALID_INDEX)
+    {
+        return handle;
+    }
 
-        vkCmdCopyBufferToImage2(commandBuffer->vkCommandBuffer, &bufferTransfer);
+    Texture* texture = accessTexture(handle);
 
-        VkImageMemoryBarrier2 barrierImage{};
-        barrierImage.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-        barrierImage.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrierImage.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrierImage.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrierImage.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrierImage.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
-        barrierImage.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
-        barrierImage.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
-        barrierImage.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
-        barrierImage.image = texture->vkImage;
-        barrierImage.subresourceRange.baseMipLevel = 0;
-        barrierImage.subresourceRange.levelCount = 1;
-        barrierImage.subresourceRange.baseArrayLayer = 0;
-        barrierImage.subresourceRange.layerCount = creation.layerCount;
-        barrierImage.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-
-        VkDependencyInfo barrierImageDependencyInfo{};
-        barrierImageDependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-        barrierImageDependencyInfo.imageMemoryBarrierCount = 1;
-        barrierImageDependencyInfo.pImageMemoryBarriers = &barrierImage;
-
-        vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &barrierImageDependencyInfo);
+    vulkanCreateTexture(*this, creation, handle, texture);
 
-        vkEndCommandBuffer(commandBuffer->vkCommandBuffer);
+    if (creation.initialData || creation.images.capacity >= 1)
+    {
+        const uint32_t imageSize = textureUploadSize(creation, texture->mipmaps);
 
-        //Submit command buffer
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer->vkCommandBuffer;
+        BufferCreation stagingCreation;
+        stagingCreation.set(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, imageSize * creation.layerCount)
+                       .setName("TextureStaging")
+                       .setCategory(GPU_MEMORY_CATEGORY_STAGING);
+        BufferHandle staging = createBuffer(stagingCreation);
+        if (staging.index == INVALID_INDEX)
+        {
+            vprint("Graphics error: Could not upload texture %s, the buffer pool is full.\n", creation.name ? creation.name : "");
+            return handle;
+        }
 
-        vkQueueSubmit(vulkanQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(vulkanQueue);
+        Buffer* stagingBuffer = accessBuffer(staging);
+        fillTextureStaging(*this, creation, imageSize, stagingBuffer->vmaAllocation);
 
-        vmaDestroyBuffer(VMAAllocator, stagingBuffer, stagingAllocation);
+        recordTextureUpload(commandBuffer, texture, creation, stagingBuffer->vkBuffer);
 
-        //TODO: Maybe I need to free the command buffer.
-        vkResetCommandBuffer(commandBuffer->vkCommandBuffer, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+        //Goes through the deletion queue, so it lives until the frame that copies from it has finished.
+        destroyBuffer(staging);
     }
 
     return handle;
@@ -1436,7 +1705,7 @@ PipelineHandle GPUDevice::createPipeline(const PipelineCreation& creation, bool
     }
 
     VkPushConstantRange range{};
-    range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    range.stageFlags = shaderStateData->graphicsPipeline ? VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
     range.offset = 0;
     range.size = 128;
 
@@ -1703,6 +1972,7 @@ SamplerHandle GPUDevice::createSampler(const SamplerCreation& creation)
     createInfo.minFilter = creation.minFilter;
     createInfo.magFilter = creation.magFilter;
     createInfo.mipmapMode = creation.mipFilter;
+    createInfo.maxLod = VK_LOD_CLAMP_NONE;
     createInfo.anisotropyEnable = 0;
     createInfo.compareEnable = 0;
     createInfo.unnormalizedCoordinates = 0;
@@ -2170,6 +2440,55 @@ void GPUDevice::updateDescriptorSet(DescriptorSetHandle set)
     }
 }
 
+void GPUDevice::replaceTexture(TextureHandle texture, TextureHandle replacement)
+{
+    //The bindless slot is rewritten when this frame is submitted. A descriptor can't change while a pending frame may sample it,
+    //not even with update after bind, so the older frames have to be done first.
+    waitOtherFrames();
+
+    Texture* current = accessTexture(texture);
+    Texture* incoming = accessTexture(replacement);
+
+    //The replacement slot takes the old image and goes through the deletion queue like any other texture.
+    const VkImage oldImage = current->vkImage;
+    const VkImageView oldImageView = current->vkImageView;
+    const VmaAllocation oldAllocation = current->vmaAllocation;
+
+    current->vkImage = incoming->vkImage;
+    current->vkImageView = incoming->vkImageView;
+    current->vmaAllocation = incoming->vmaAllocation;
+    current->vkFormat = incoming->vkFormat;
+    current->usage = incoming->usage;
+    current->width = incoming->width;
+    current->height = incoming->height;
+    current->depth = incoming->depth;
+    current->mipmaps = incoming->mipmaps;
+
+    incoming->vkImage = oldImage;
+    incoming->vkImageView = oldImageView;
+    incoming->vmaAllocation = oldAllocation;
+
+    memory.setOwner(current->vmaAllocation, texture.index);
+    memory.setOwner(incoming->vmaAllocation, replacement.index);
+
+    destroyTexture(replacement);
+
+    //A write still queued for the replacement would point its slot at the old image, the original slot gets the new view.
+    for (int32_t i = textureToUpdateBindless.size - 1; i >= 0; --i)
+    {
+        if (textureToUpdateBindless[i].handle == replacement.index)
+        {
+            textureToUpdateBindless.deleteSwap(i);
+        }
+    }
+
+    ResourceUpdate resourceUpdate{};
+    resourceUpdate.type = ResourceUpdateType::TEXTURE;
+    resourceUpdate.handle = texture.index;
+    resourceUpdate.currentFrame = currentFrame;
+    textureToUpdateBindless.push(resourceUpdate);
+}
+
 //Misc
 //TODO: For now specify a sampler for a texture or use the default one.
 void GPUDevice::linkTextureSampler(TextureHandle texture, SamplerHandle sampler)
@@ -2426,14 +2745,7 @@ void GPUDevice::transitionDepthImage(TextureHandle texture)
 
     vkEndCommandBuffer(commandBuffer->vkCommandBuffer);
 
-    //Submit command buffer
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer->vkCommandBuffer;
-
-    vkQueueSubmit(vulkanQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(vulkanQueue);
+    waitTimeline(submitInstant(commandBuffer));
 }
 
 //Map/Unmap
@@ -2485,11 +2797,17 @@ CommandBuffer* GPUDevice::getCommandBuffer(VkQueueFlagBits /*type*/, bool begin)
     {
         vkCmdResetQueryPool(comBuffer->vkCommandBuffer, vulkanTimestampQueryPool,
             currentFrame * gpuTimestampManager->queriesPerFrame * 2,
-            gpuTimestampManager->queriesPerFrame);
+            gpuTimestampManager->queriesPerFrame * 2);
 
         gpuTimestampReset = false;
     }
 
+    //Recorded first so the moved textures are ready for everything the frame draws.
+    if (begin)
+    {
+        memory.recordDefragmentationPass(*this, comBuffer);
+    }
+
     return comBuffer;
 }
 
@@ -2504,14 +2822,79 @@ void GPUDevice::queueCommandBuffer(CommandBuffer* commandBuffer)
     queuedCommandBuffers[numQueuedCommandBuffers++] = commandBuffer;
 }
 
+//Timeline
+uint64_t GPUDevice::submitInstant(CommandBuffer* commandBuffer)
+{
+    const uint64_t signalValue = ++timelineValue;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer->vkCommandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &vulkanTimelineSemaphore;
+
+    check(vkQueueSubmit(vulkanQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    return signalValue;
+}
+
+void GPUDevice::waitTimeline(uint64_t value)
+{
+    if (timelineReached(value))
+    {
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &vulkanTimelineSemaphore;
+    waitInfo.pValues = &value;
+
+    check(vkWaitSemaphores(vulkanDevice, &waitInfo, UINT64_MAX));
+    completedTimelineValue = max(completedTimelineValue, value);
+}
+
+bool GPUDevice::timelineReached(uint64_t value)
+{
+    if (completedTimelineValue >= value)
+    {
+        return true;
+    }
+
+    vkGetSemaphoreCounterValue(vulkanDevice, vulkanTimelineSemaphore, &completedTimelineValue);
+    return completedTimelineValue >= value;
+}
+
+void GPUDevice::waitOtherFrames()
+{
+    for (uint32_t frame = 0; frame < FRAMES_IN_FLIGHT; ++frame)
+    {
+        if (frame != currentFrame)
+        {
+            waitTimeline(frameTimelineValues[frame]);
+        }
+    }
+}
+
 //Rendering
 bool GPUDevice::newFrame()
 {
-    //Fence wait and reset.
+    //Waits on the last submission of this frame slot, later frames and uploads are left running.
     if (swapchainIsValid)
     {
-        vkWaitForFences(vulkanDevice, 1, &fences[currentFrame], VK_TRUE, UINT64_MAX);
-        vkResetFences(vulkanDevice, 1, &fences[currentFrame]);
+        waitTimeline(frameTimelineValues[currentFrame]);
+
+        //The frame that last used this slot has finished, so its queries can be read without waiting.
+        resolveGPUTimestamps();
+
         VkResult result = vkAcquireNextImageKHR(vulkanDevice, vulkanSwapchain, UINT64_MAX, imageAvailableSemaphore[currentFrame], VK_NULL_HANDLE, &vulkanImageIndex);
         if (result == VK_ERROR_OUT_OF_DATE_KHR)
         {
@@ -2531,6 +2914,60 @@ bool GPUDevice::newFrame()
     //Command pool rest.
     commandBufferRing.resetPools(currentFrame);
 
+    //Resource deletion using reverse iteration and swap with last element, only what the GPU has finished with is destroyed.
+    if (resourceDeletionQueue.size > 0)
+    {
+        for (int32_t i = resourceDeletionQueue.size - 1; i >= 0; --i)
+        {
+            ResourceUpdate& resourceDeletion = resourceDeletionQueue[i];
+
+            //Memory in the open defragmentation pass is freed once the pass has ended.
+            if (memory.isMoving(resourceAllocation(*this, resourceDeletion)))
+            {
+                continue;
+            }
+
+            if (resourceDeletion.timelineValue != 0 && timelineReached(resourceDeletion.timelineValue))
+            {
+                switch (resourceDeletion.type)
+                {
+                case ResourceUpdateType::BUFFER:
+                    destroyBufferInstant(resourceDeletion.handle);
+                    break;
+                case ResourceUpdateType::PIPELINE:
+                    destroyPipelineInstant(resourceDeletion.handle);
+                    break;
+                case ResourceUpdateType::DESCRIPTOR_SET:
+                    destroyDescriptorSetInstant(resourceDeletion.handle);
+                    break;
+                case ResourceUpdateType::DESCRIPTOR_SET_LAYOUT:
+                    destroyDescriptorSetLayoutInstant(resourceDeletion.handle);
+                    break;
+                case ResourceUpdateType::SAMPLER:
+                    destroySamplerInstant(resourceDeletion.handle);
+                    break;
+                case ResourceUpdateType::SHADER_STATE:
+                    destroyShaderStateInstant(resourceDeletion.handle);
+                    break;
+                case ResourceUpdateType::TEXTURE:
+                    destroyTextureInstant(resourceDeletion.handle);
+                    break;
+                default:
+                    VOID_ERROR("You can delete what you're trying to delete.\n");
+                    break;
+                }
+
+                //Mark resource as free
+                resourceDeletion.currentFrame = UINT32_MAX;
+                //swap element
+                resourceDeletionQueue.deleteSwap(i);
+            }
+        }
+    }
+
+    memory.updateDefragmentation(*this);
+    memory.updateBudgets(absoluteFrame);
+
     //Descriptor set update.
     if (descriptorSetUpdates.size)
     {
@@ -2556,31 +2993,35 @@ void GPUDevice::present()
         CommandBuffer* commandBuffer = queuedCommandBuffers[comBuffer];
         enqueuedCommandBuffers[comBuffer] = commandBuffer->vkCommandBuffer;
 
-        vkCmdEndRendering(commandBuffer->vkCommandBuffer);
-
-        VkImageMemoryBarrier2 barrier{}; 
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
-        barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
-        barrier.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_2_NONE;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = vulkanSwapchainImages[vulkanImageIndex];
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-
-        VkDependencyInfo barrierPresentDependencyInfo{};
-        barrierPresentDependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-        barrierPresentDependencyInfo.imageMemoryBarrierCount = 1;
-        barrierPresentDependencyInfo.pImageMemoryBarriers = &barrier;
-
-        vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &barrierPresentDependencyInfo);
+        //Frames recorded through the frame graph already ended rendering and transitioned the swapchain image.
+        if (commandBuffer->presentTransitioned == false)
+        {
+            vkCmdEndRendering(commandBuffer->vkCommandBuffer);
+
+            VkImageMemoryBarrier2 barrier{}; 
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_NONE;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = vulkanSwapchainImages[vulkanImageIndex];
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+            VkDependencyInfo barrierPresentDependencyInfo{};
+            barrierPresentDependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            barrierPresentDependencyInfo.imageMemoryBarrierCount = 1;
+            barrierPresentDependencyInfo.pImageMemoryBarriers = &barrier;
+
+            vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &barrierPresentDependencyInfo);
+        }
 
         vkEndCommandBuffer(commandBuffer->vkCommandBuffer);
     }
@@ -2625,7 +3066,8 @@ void GPUDevice::present()
                 descriptorImageInfo.sampler = vkDefaultSampler->vkSampler;
             }
 
-            descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            //Depth textures are sampled in the read only layout the frame graph moves them to.
+            descriptorImageInfo.imageLayout = TextureFormat::hasDepthOrStencil(texture->vkFormat) ? VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
             descriptorWrite.pImageInfo = &descriptorImageInfo;
 
             textureToUpdate.currentFrame = UINT32_MAX;
@@ -2640,50 +3082,53 @@ void GPUDevice::present()
         }
     }
 
-    //Subit command buffer.
+    //Subit command buffer, signalling the binary semaphore for present and the next timeline value for the frame.
     VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT };
 
+    const uint64_t frameValue = ++timelineValue;
+    //Binary semaphores ignore their value.
+    const uint64_t waitValues[] = { 0 };
+    const uint64_t signalValues[] = { 0, frameValue };
+    VkSemaphore signalSemaphores[] = { renderFinishSemaphore[vulkanImageIndex], vulkanTimelineSemaphore };
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = 2;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
     submitInfo.waitSemaphoreCount = 1;
     submitInfo.pWaitSemaphores = &imageAvailableSemaphore[currentFrame];
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = numQueuedCommandBuffers;
     submitInfo.pCommandBuffers = enqueuedCommandBuffers;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &renderFinishSemaphore[vulkanImageIndex];
+    submitInfo.signalSemaphoreCount = 2;
+    submitInfo.pSignalSemaphores = signalSemaphores;
 
-    vkQueueSubmit(vulkanQueue, 1, &submitInfo, fences[currentFrame]);
+    vkQueueSubmit(vulkanQueue, 1, &submitInfo, VK_NULL_HANDLE);
 
     numQueuedCommandBuffers = 0;
+    frameTimelineValues[currentFrame] = frameValue;
+
+    //Everything destroyed while this frame was recorded may still be used by it.
+    for (uint32_t i = 0; i < resourceDeletionQueue.size; ++i)
+    {
+        if (resourceDeletionQueue[i].timelineValue == 0)
+        {
+            resourceDeletionQueue[i].timelineValue = frameValue;
+        }
+    }
 
-    //Resolve GPU Timestamp
+    //GPU timestamps are read back FRAMES_IN_FLIGHT frames later in newFrame, once the timeline has reached this frame's value.
     if (timestampsEnabled)
     {
         if (gpuTimestampManager->hasValidQueries())
         {
-            //Query GPU for timestamps.
-            const uint32_t queryOffset = (currentFrame * gpuTimestampManager->queriesPerFrame) * 2;
-            const uint32_t queryCount = gpuTimestampManager->currentQuery * 2;
-            vkGetQueryPoolResults(vulkanDevice, vulkanTimestampQueryPool, queryOffset, queryCount, sizeof(uint64_t) * queryCount * 2,
-                &gpuTimestampManager->timestampsData[queryOffset], sizeof(gpuTimestampManager->timestampsData[0]),
-                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
-
-            //Calcute and cache the elapsed time.
-            for (uint32_t i = 0; i < gpuTimestampManager->currentQuery; ++i)
-            {
-                uint32_t index = (currentFrame * gpuTimestampManager->queriesPerFrame) + i;
-
-                GPUTimestamp& timestamp = gpuTimestampManager->timestamps[index];
-
-                double start = static_cast<double>(gpuTimestampManager->timestampsData[(index * 2)]);
-                double end = static_cast<double>(gpuTimestampManager->timestampsData[(index * 2) + 1]);
-                double range = end - start;
-                double elaspedTime = range * gpuTimestampFrequency;
-
-                timestamp.elapsedMS = elaspedTime;
-                timestamp.frameIndex = absoluteFrame;
-            }
+            gpuTimestampManager->pendingQueries[currentFrame] = gpuTimestampManager->currentQuery;
         }
         else if (gpuTimestampManager->currentQuery)
         {
@@ -2691,13 +3136,12 @@ void GPUDevice::present()
         }
 
         gpuTimestampManager->reset();
-        gpuTimestampReset = true;
-    }
-    else
-    {
-        gpuTimestampReset = false;
     }
 
+    //Queries must be reset before they are written again, so reset the slot every frame in case timestamps get enabled.
+    gpuTimestampReset = true;
+    timestampsEnabled = timestampsRequested;
+
     frameCountersAdvanced();
 
     VkPresentInfoKHR presentInfo{};
@@ -2718,51 +3162,6 @@ void GPUDevice::present()
     {
         VOID_ERROR("Failed or present swapchain image!");
     }
-
-    //Resource deletion  using reverse iteration and swap with last element.
-    if (resourceDeletionQueue.size > 0)
-    {
-        for (int32_t i = resourceDeletionQueue.size - 1; i >= 0; --i)
-        {
-            ResourceUpdate& resourceDeletion = resourceDeletionQueue[i];
-
-            if (resourceDeletion.currentFrame == currentFrame)
-            {
-                switch (resourceDeletion.type)
-                {
-                case ResourceUpdateType::BUFFER:
-                    destroyBufferInstant(resourceDeletion.handle);
-                    break;
-                case ResourceUpdateType::PIPELINE:
-                    destroyPipelineInstant(resourceDeletion.handle);
-                    break;
-                case ResourceUpdateType::DESCRIPTOR_SET:
-                    destroyDescriptorSetInstant(resourceDeletion.handle);
-                    break;
-                case ResourceUpdateType::DESCRIPTOR_SET_LAYOUT:
-                    destroyDescriptorSetLayoutInstant(resourceDeletion.handle);
-                    break;
-                case ResourceUpdateType::SAMPLER:
-                    destroySamplerInstant(resourceDeletion.handle);
-                    break;
-                case ResourceUpdateType::SHADER_STATE:
-                    destroyShaderStateInstant(resourceDeletion.handle);
-                    break;
-                case ResourceUpdateType::TEXTURE:
-                    destroyTextureInstant(resourceDeletion.handle);
-                    break;
-                default:
-                    VOID_ERROR("You can delete what you're trying to delete.\n");
-                    break;
-                }
-
-                //Mark resource as free
-                resourceDeletion.currentFrame = UINT32_MAX;
-                //swap element
-                resourceDeletionQueue.deleteSwap(i);
-            }
-        }
-    }
 }
 
 void GPUDevice::resize(uint16_t width, uint16_t height)
@@ -2872,12 +3271,55 @@ void GPUDevice::popMarker(VkCommandBuffer commandBuffer)
 //GPU timings
 void GPUDevice::setGPUTimestampsEnable(bool flag)
 {
-    timestampsEnabled = flag;
+    timestampsRequested = flag;
 }
 
 uint32_t GPUDevice::getGPUTimestamps(GPUTimestamp* outTimestamps)
 {
-    return gpuTimestampManager->resolve(previousFrame, outTimestamps);
+    return gpuTimestampManager->resolve(outTimestamps);
+}
+
+void GPUDevice::resolveGPUTimestamps()
+{
+    const uint32_t queries = gpuTimestampManager->pendingQueries[currentFrame];
+    if (queries == 0)
+    {
+        return;
+    }
+
+    gpuTimestampManager->pendingQueries[currentFrame] = 0;
+
+    //No wait bit, the timeline wait guarantees the results are available. If the driver disagrees the frame is skipped rather than stalling.
+    const uint32_t queryOffset = (currentFrame * gpuTimestampManager->queriesPerFrame) * 2;
+    const uint32_t queryCount = queries * 2;
+    VkResult result = vkGetQueryPoolResults(vulkanDevice, vulkanTimestampQueryPool, queryOffset, queryCount, sizeof(uint64_t) * queryCount,
+        &gpuTimestampManager->timestampsData[queryOffset], sizeof(gpuTimestampManager->timestampsData[0]),
+        VK_QUERY_RESULT_64_BIT);
+
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    //Calcute and cache the elapsed time.
+    const uint32_t frameIndex = absoluteFrame - FRAMES_IN_FLIGHT;
+    for (uint32_t i = 0; i < queries; ++i)
+    {
+        uint32_t index = (currentFrame * gpuTimestampManager->queriesPerFrame) + i;
+
+        GPUTimestamp& timestamp = gpuTimestampManager->timestamps[index];
+
+        double start = static_cast<double>(gpuTimestampManager->timestampsData[(index * 2)]);
+        double end = static_cast<double>(gpuTimestampManager->timestampsData[(index * 2) + 1]);
+        double range = end - start;
+        double elaspedTime = range * gpuTimestampFrequency;
+
+        timestamp.elapsedMS = elaspedTime;
+        timestamp.frameIndex = frameIndex;
+    }
+
+    memoryCopy(gpuTimestampManager->resolvedTimestamps, &gpuTimestampManager->timestamps[currentFrame * gpuTimestampManager->queriesPerFrame], sizeof(GPUTimestamp) * queries);
+    gpuTimestampManager->resolvedQueries = queries;
 }
 
 void GPUDevice::pushGPUTimestamp(CommandBuffer* commandBuffer, const char* name)
@@ -2910,6 +3352,7 @@ void GPUDevice::destroyBufferInstant(uint32_t buffer)
 
     if (buff && buff->parentBuffer.index == INVALID_BUFFER.index)
     {
+        memory.release(buff->vmaAllocation);
         vmaDestroyBuffer(VMAAllocator, buff->vkBuffer, buff->vmaAllocation);
     }
 
@@ -2923,6 +3366,7 @@ void GPUDevice::destroyTextureInstant(uint32_t texture)
     if (text)
     {
         vkDestroyImageView(vulkanDevice, text->vkImageView, vulkanAllocationCallbacks);
+        memory.release(text->vmaAllocation);
         vmaDestroyImage(VMAAllocator, text->vkImage, text->vmaAllocation);
     }
     textures.releaseResource(texture);
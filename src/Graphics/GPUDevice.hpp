@@ -9,6 +9,7 @@
 #include "Foundation/Platform.hpp"
 
 #include "Graphics/GPUResources.hpp"
+#include "Graphics/GPUMemory.hpp"
 
 #include "Foundation/ResourcePool.hpp"
 #include "Foundation/String.hpp"
@@ -43,8 +44,8 @@ struct GPUTimestampManager
 
     bool hasValidQueries() const;
     void reset();
-    //Returns the total queries for this frame.
-    uint32_t resolve(uint32_t currentFrame, GPUTimestamp* timestampsToFill);
+    //Returns the total queries of the last resolved frame.
+    uint32_t resolve(GPUTimestamp* timestampsToFill);
 
     //Returns the timestamp query index.
     uint32_t push(uint32_t currentFrame, const char* name);
@@ -54,13 +55,16 @@ struct GPUTimestampManager
     GPUTimestamp* timestamps = nullptr;
     uint64_t* timestampsData = nullptr;
 
+    //Copy of the last frame read back from the query pool, the per frame timestamps are overwritten while the next frame records.
+    GPUTimestamp* resolvedTimestamps = nullptr;
+    //Queries submitted per frame in flight that haven't been read back yet.
+    uint32_t* pendingQueries = nullptr;
+
     uint32_t queriesPerFrame = 0;
     uint32_t currentQuery = 0;
     uint32_t parentIndex = 0;
     uint32_t depth = 0;
-
-    //Used to query the GPU only once per frame if getGPUTimestamps is called more than once per frame.
-    bool currentFrameResolved = false;
+    uint32_t resolvedQueries = 0;
 };
 
 struct DeviceCreation
@@ -94,6 +98,8 @@ struct GPUDevice
     BufferHandle createBuffer(const BufferCreation& creation);
     BufferHandle createBindlessBuffer(const BufferCreation& creation);
     TextureHandle createTexture(const TextureCreation& creation);
+    //Records the upload into commandBuffer instead of waiting on it, the texture can be sampled once that submission has finished.
+    TextureHandle createTexture(const TextureCreation& creation, CommandBuffer* commandBuffer);
     PipelineHandle createPipeline(const PipelineCreation& creation, bool debugRendering = false);
     SamplerHandle createSampler(const SamplerCreation& creation);
     DescriptorSetLayoutHandle createDescriptorSetLayout(const DescriptorSetLayoutCreation& creation);
@@ -119,6 +125,10 @@ struct GPUDevice
 
     //Update/Reload resources
     void updateDescriptorSet(DescriptorSetHandle set);
+    //Moves the image of replacement into texture, the handle and so the bindless index stay the same. The replacement must be uploaded
+    //already and its handle is gone after this. The old image is destroyed once the frames that may still sample it are done.
+    //Waits on the other frames in flight.
+    void replaceTexture(TextureHandle texture, TextureHandle replacement);
 
     //Misc
     //TODO: For now specify a sampler for a texture or use the default one.
@@ -146,6 +156,15 @@ struct GPUDevice
 
     void queueCommandBuffer(CommandBuffer* commandBuffer);
 
+    //Timeline
+    //Submits an ended command buffer outside of the frame and returns the timeline value it signals.
+    uint64_t submitInstant(CommandBuffer* commandBuffer);
+    //Blocks until the GPU has finished the work that signals value, without waiting on anything submitted after it.
+    void waitTimeline(uint64_t value);
+    bool timelineReached(uint64_t value);
+    //Blocks until every frame in flight other than the one being recorded has finished, nothing on the GPU uses what they used after it.
+    void waitOtherFrames();
+
     //Rendering
     bool newFrame();
     void present();
@@ -166,7 +185,10 @@ struct GPUDevice
     //GPU timings
     void setGPUTimestampsEnable(bool flag);
 
+    //Returns the timestamps of the newest frame that has finished on the GPU, FRAMES_IN_FLIGHT frames behind the one being recorded.
     uint32_t getGPUTimestamps(GPUTimestamp* outTimestamps);
+    //Reads back the queries of the current frame slot, the timeline value of its last submission must have been reached.
+    void resolveGPUTimestamps();
     void pushGPUTimestamp(CommandBuffer* commandBuffer, const char* name);
     void popGPUTimestamp(CommandBuffer* commandBuffer);
 
@@ -257,7 +279,14 @@ struct GPUDevice
     //Per frame synchronisation
     Array<VkSemaphore> imageAvailableSemaphore;
     Array<VkSemaphore> renderFinishSemaphore;
-    Array<VkFence> fences;
+
+    //Counts submitted GPU work, every frame and instant submission signals the next value.
+    VkSemaphore vulkanTimelineSemaphore;
+    uint64_t timelineValue = 0;
+    //Highest value the GPU is known to have reached, refreshed in newFrame and waitTimeline.
+    uint64_t completedTimelineValue = 0;
+    //Value signalled by the last submission of each frame slot, waited on before the slot is reused.
+    uint64_t frameTimelineValues[FRAMES_IN_FLIGHT]{};
 
     TextureHandle depthTexture;
 
@@ -274,8 +303,10 @@ struct GPUDevice
     uint32_t vulkanImageIndex;
 
     VmaAllocator VMAAllocator;
+    GPUMemoryService memory;
 
     //These are dynamic - so that workload can handled correctly.
+    //Deletions are retired once the timeline reaches the value of the frame they were queued in.
     Array<ResourceUpdate> resourceDeletionQueue;
     Array<DescriptorSetUpdate> descriptorSetUpdates;
     Array<ResourceUpdate> textureToUpdateBindless;
@@ -290,6 +321,11 @@ struct GPUDevice
     bool swapchainIsValid = false;
 
     bool timestampsEnabled = false;
+    //Applied at the end of the frame so a frame never records unbalanced timestamps.
+    bool timestampsRequested = false;
+    bool drawIndirectCountSupported = false;
+    bool textureCompressionBCSupported = false;
+    bool memoryBudgetSupported = false;
     bool verticalSync = false;
 };
 
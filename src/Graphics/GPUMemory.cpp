@@ -0,0 +1,487 @@
+#include "GPUMemory.hpp"
+
+#include "GPUDevice.hpp"
+#include "CommandBuffer.hpp"
+
+#include "Foundation/Assert.hpp"
+#include "Foundation/Log.hpp"
+#include "Foundation/Numerics.hpp"
+
+#include "vender/imgui/imgui.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    const char* CATEGORY_NAMES[GPU_MEMORY_CATEGORY_COUNT] = { "Textures", "Render targets", "Geometry", "Per frame", "Staging", "Other" };
+
+    //The owner index goes above the category, UINT32_MAX for allocations no pool owns.
+    void* packUserData(GPUMemoryCategory category, uint32_t ownerIndex)
+    {
+        return reinterpret_cast<void*>((uintptr_t(ownerIndex) << 8) | category);
+    }
+
+    GPUMemoryCategory userDataCategory(void* userData)
+    {
+        return GPUMemoryCategory(reinterpret_cast<uintptr_t>(userData) & 0xFF);
+    }
+
+    uint32_t userDataOwner(void* userData)
+    {
+        return uint32_t(reinterpret_cast<uintptr_t>(userData) >> 8);
+    }
+
+    double toMB(uint64_t bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    //Only sampled 2D textures can be recreated from what the Texture keeps, cubemaps do not store their layer count.
+    Texture* movableTexture(GPUDevice& gpu, VmaAllocation allocation, void* userData)
+    {
+        if (userDataCategory(userData) != GPU_MEMORY_CATEGORY_TEXTURE || userDataOwner(userData) >= gpu.textures.poolSize)
+        {
+            return nullptr;
+        }
+
+        Texture* texture = gpu.accessTexture({ userDataOwner(userData) });
+        if (texture->vmaAllocation != allocation || texture->imageViewType != VK_IMAGE_VIEW_TYPE_2D ||
+            (texture->usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0)
+        {
+            return nullptr;
+        }
+
+        return texture;
+    }
+}
+
+void GPUMemoryService::init(VmaAllocator inVMAAllocator)
+{
+    vmaAllocator = inVMAAllocator;
+
+    memset(categories, 0, sizeof(categories));
+
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(vmaAllocator, &memoryProperties);
+
+    heapCount = memoryProperties->memoryHeapCount;
+    for (uint32_t heap = 0; heap < heapCount; ++heap)
+    {
+        heapFlags[heap] = memoryProperties->memoryHeaps[heap].flags;
+    }
+
+    vmaGetHeapBudgets(vmaAllocator, budgets);
+
+    defragmentation = VK_NULL_HANDLE;
+    passOpen = false;
+    defragmentationRequested = false;
+    releasedBytes = 0;
+}
+
+void GPUMemoryService::shutdown(GPUDevice& gpu)
+{
+    if (passOpen)
+    {
+        endDefragmentationPass(gpu);
+    }
+
+    if (defragmentation != VK_NULL_HANDLE)
+    {
+        endDefragmentation();
+    }
+}
+
+void GPUMemoryService::track(VmaAllocation allocation, GPUMemoryCategory category, uint32_t ownerIndex)
+{
+    if (allocation == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    vmaSetAllocationUserData(vmaAllocator, allocation, packUserData(category, ownerIndex));
+
+    VmaAllocationInfo allocationInfo{};
+    vmaGetAllocationInfo(vmaAllocator, allocation, &allocationInfo);
+
+    categories[category].bytes += allocationInfo.size;
+    ++categories[category].allocations;
+}
+
+void GPUMemoryService::release(VmaAllocation allocation)
+{
+    if (allocation == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    VmaAllocationInfo allocationInfo{};
+    vmaGetAllocationInfo(vmaAllocator, allocation, &allocationInfo);
+
+    const GPUMemoryCategory category = userDataCategory(allocationInfo.pUserData);
+    categories[category].bytes -= min(categories[category].bytes, uint64_t(allocationInfo.size));
+    categories[category].allocations -= categories[category].allocations > 0 ? 1 : 0;
+
+    //Staging buffers come and go with every upload, they do not count towards starting a defragmentation.
+    if (category != GPU_MEMORY_CATEGORY_STAGING)
+    {
+        releasedBytes += allocationInfo.size;
+    }
+}
+
+void GPUMemoryService::setOwner(VmaAllocation allocation, uint32_t ownerIndex)
+{
+    if (allocation == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    VmaAllocationInfo allocationInfo{};
+    vmaGetAllocationInfo(vmaAllocator, allocation, &allocationInfo);
+
+    vmaSetAllocationUserData(vmaAllocator, allocation, packUserData(userDataCategory(allocationInfo.pUserData), ownerIndex));
+}
+
+void GPUMemoryService::updateBudgets(uint32_t frameIndex)
+{
+    vmaSetCurrentFrameIndex(vmaAllocator, frameIndex);
+    vmaGetHeapBudgets(vmaAllocator, budgets);
+}
+
+void GPUMemoryService::logReport() const
+{
+    vprint("GPU memory:\n");
+    for (uint32_t heap = 0; heap < heapCount; ++heap)
+    {
+        const VmaBudget& budget = budgets[heap];
+        vprint("    Heap %u %-12s %9.2fMB of %9.2fMB budget, %9.2fMB in %u blocks.\n", heap,
+               (heapFlags[heap] & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "host",
+               toMB(budget.usage), toMB(budget.budget), toMB(budget.statistics.blockBytes), budget.statistics.blockCount);
+    }
+
+    for (uint32_t category = 0; category < GPU_MEMORY_CATEGORY_COUNT; ++category)
+    {
+        vprint("    %-16s %9.2fMB in %u allocations.\n", CATEGORY_NAMES[category], toMB(categories[category].bytes), categories[category].allocations);
+    }
+
+    vprint("    Last defragmentation moved %.2fMB in %u allocations and freed %.2fMB in %u blocks.\n", toMB(lastStatistics.bytesMoved),
+           lastStatistics.allocationsMoved, toMB(lastStatistics.bytesFreed), lastStatistics.deviceMemoryBlocksFreed);
+}
+
+void GPUMemoryService::imguiDraw()
+{
+    static char buff[128];
+
+    for (uint32_t heap = 0; heap < heapCount; ++heap)
+    {
+        const VmaBudget& budget = budgets[heap];
+        const float used = budget.budget > 0 ? float(double(budget.usage) / double(budget.budget)) : 0.f;
+
+        snprintf(buff, sizeof(buff), "%.1fMB / %.1fMB", toMB(budget.usage), toMB(budget.budget));
+        ImGui::Text("Heap %u %s", heap, (heapFlags[heap] & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "device local" : "host");
+        ImGui::ProgressBar(used, { -1.f, 0.f }, buff);
+        ImGui::Text("    %.1fMB allocated in %u blocks, %.1fMB used by %u allocations", toMB(budget.statistics.blockBytes), budget.statistics.blockCount,
+                    toMB(budget.statistics.allocationBytes), budget.statistics.allocationCount);
+    }
+
+    ImGui::Separator();
+
+    for (uint32_t category = 0; category < GPU_MEMORY_CATEGORY_COUNT; ++category)
+    {
+        ImGui::Text("%-16s %9.2fMB %6u allocations", CATEGORY_NAMES[category], toMB(categories[category].bytes), categories[category].allocations);
+    }
+
+    ImGui::Separator();
+
+    if (defragmentation != VK_NULL_HANDLE)
+    {
+        ImGui::Text("Defragmenting, pass %u", passCount);
+    }
+    else
+    {
+        ImGui::Text("%.1fMB freed since the last defragmentation", toMB(releasedBytes));
+        ImGui::SameLine();
+        if (ImGui::Button("Defragment"))
+        {
+            requestDefragmentation();
+        }
+    }
+
+    ImGui::Text("Last defragmentation moved %.1fMB in %u allocations, freed %u blocks", toMB(lastStatistics.bytesMoved), lastStatistics.allocationsMoved,
+                lastStatistics.deviceMemoryBlocksFreed);
+}
+
+void GPUMemoryService::requestDefragmentation()
+{
+    defragmentationRequested = true;
+}
+
+void GPUMemoryService::updateDefragmentation(GPUDevice& gpu)
+{
+    //newFrame has waited on the submission of the frame that used this slot, which is the one the pass was recorded in.
+    if (passOpen && gpu.absoluteFrame - passFrame >= FRAMES_IN_FLIGHT)
+    {
+        endDefragmentationPass(gpu);
+    }
+
+    if (defragmentation != VK_NULL_HANDLE || (defragmentationRequested == false && releasedBytes < GPU_DEFRAGMENTATION_TRIGGER_BYTES))
+    {
+        return;
+    }
+
+    VmaDefragmentationInfo info{};
+    info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    info.maxBytesPerPass = GPU_DEFRAGMENTATION_PASS_BYTES;
+    info.maxAllocationsPerPass = GPU_DEFRAGMENTATION_PASS_MOVES;
+
+    const VkResult result = vmaBeginDefragmentation(vmaAllocator, &info, &defragmentation);
+    VOID_ASSERTM(result == VK_SUCCESS, "Vulkan Asset Code %u", result);
+
+    defragmentationRequested = false;
+    releasedBytes = 0;
+    passCount = 0;
+}
+
+void GPUMemoryService::recordDefragmentationPass(GPUDevice& gpu, CommandBuffer* commandBuffer)
+{
+    if (defragmentation == VK_NULL_HANDLE || passOpen)
+    {
+        return;
+    }
+
+    //VK_SUCCESS means there is nothing left worth moving.
+    if (vmaBeginDefragmentationPass(vmaAllocator, defragmentation, &pass) == VK_SUCCESS)
+    {
+        endDefragmentation();
+        return;
+    }
+
+    VOID_ASSERTM(pass.moveCount <= GPU_DEFRAGMENTATION_PASS_MOVES, "Defragmentation pass has %u moves.", pass.moveCount);
+
+    passOpen = true;
+    passFrame = gpu.absoluteFrame;
+    ++passCount;
+
+    //The moved textures get their new views in the shared bindless set when this frame is submitted. An older frame still in flight
+    //could otherwise sample a slot while its descriptor changes, or see the new image before this frame's copy has filled it.
+    //Passes are rare and capped in size, so stalling on the other frames is cheaper than tracking which slots they use.
+    gpu.waitOtherFrames();
+
+    //Old images are read once the frames before have finished sampling them, the new ones are ready for the draws after.
+    VkImageMemoryBarrier2 barriers[GPU_DEFRAGMENTATION_PASS_MOVES * 2]{};
+    Texture* movedTextures[GPU_DEFRAGMENTATION_PASS_MOVES]{};
+    uint32_t barrierCount = 0;
+    uint64_t movedBytes = 0;
+
+    for (uint32_t i = 0; i < pass.moveCount; ++i)
+    {
+        VmaDefragmentationMove& move = pass.pMoves[i];
+        passImages[i] = VK_NULL_HANDLE;
+        passImageViews[i] = VK_NULL_HANDLE;
+
+        VmaAllocationInfo allocationInfo{};
+        vmaGetAllocationInfo(vmaAllocator, move.srcAllocation, &allocationInfo);
+
+        //Buffers stay where they are, their device addresses are baked into other buffers and push constants.
+        Texture* texture = movableTexture(gpu, move.srcAllocation, allocationInfo.pUserData);
+        if (texture == nullptr)
+        {
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.format = texture->vkFormat;
+        imageInfo.usage = texture->usage;
+        imageInfo.imageType = texture->imageType;
+        imageInfo.extent = { texture->width, texture->height, texture->depth };
+        imageInfo.mipLevels = texture->mipmaps;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImage image;
+        if (vkCreateImage(gpu.vulkanDevice, &imageInfo, gpu.vulkanAllocationCallbacks, &image) != VK_SUCCESS)
+        {
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        vmaBindImageMemory(vmaAllocator, move.dstTmpAllocation, image);
+        gpu.setResourceName(VK_OBJECT_TYPE_IMAGE, (uint64_t)image, texture->name);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = texture->imageViewType;
+        viewInfo.format = texture->vkFormat;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = texture->mipmaps;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        vkCreateImageView(gpu.vulkanDevice, &viewInfo, gpu.vulkanAllocationCallbacks, &imageView);
+        gpu.setResourceName(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)imageView, texture->name);
+
+        VkImageMemoryBarrier2& source = barriers[barrierCount++];
+        source.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        source.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        source.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        source.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        source.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        source.srcAccessMask = 0;
+        source.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+        source.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        source.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        source.image = texture->vkImage;
+        source.subresourceRange = viewInfo.subresourceRange;
+
+        VkImageMemoryBarrier2& destination = barriers[barrierCount++];
+        destination = source;
+        destination.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        destination.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        destination.srcStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+        destination.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        destination.image = image;
+
+        //The texture keeps its handle and bindless index, only the image and view under it change.
+        passImages[i] = texture->vkImage;
+        passImageViews[i] = texture->vkImageView;
+        movedTextures[i] = texture;
+        texture->vkImage = image;
+        texture->vkImageView = imageView;
+
+        movedBytes += allocationInfo.size;
+    }
+
+    //Nothing was moved, the pass can end before anything is recorded.
+    if (barrierCount == 0)
+    {
+        endDefragmentationPass(gpu);
+        return;
+    }
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = barrierCount;
+    dependencyInfo.pImageMemoryBarriers = barriers;
+    vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &dependencyInfo);
+
+    gpu.pushMarker(commandBuffer->vkCommandBuffer, "Defragmentation");
+
+    for (uint32_t i = 0; i < pass.moveCount; ++i)
+    {
+        const Texture* texture = movedTextures[i];
+        if (texture == nullptr)
+        {
+            continue;
+        }
+
+        VkImageCopy2 regions[16]{};
+        VOID_ASSERTM(texture->mipmaps <= ArraySize(regions), "Texture %s has more than %u levels.", texture->name ? texture->name : "", uint32_t(ArraySize(regions)));
+
+        for (uint32_t level = 0; level < texture->mipmaps; ++level)
+        {
+            VkImageCopy2& region = regions[level];
+            region.sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2;
+            region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+            region.dstSubresource = region.srcSubresource;
+            region.extent = { max(uint32_t(texture->width) >> level, 1u), max(uint32_t(texture->height) >> level, 1u), texture->depth };
+        }
+
+        VkCopyImageInfo2 copyInfo{};
+        copyInfo.sType = VK_STRUCTURE_TYPE_COPY_IMAGE_INFO_2;
+        copyInfo.srcImage = passImages[i];
+        copyInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        copyInfo.dstImage = texture->vkImage;
+        copyInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        copyInfo.regionCount = texture->mipmaps;
+        copyInfo.pRegions = regions;
+        vkCmdCopyImage2(commandBuffer->vkCommandBuffer, &copyInfo);
+
+        //Queued like any new texture, the descriptor is written before the frame is submitted.
+        ResourceUpdate resourceUpdate{};
+        resourceUpdate.type = ResourceUpdateType::TEXTURE;
+        resourceUpdate.handle = texture->handle.index;
+        resourceUpdate.currentFrame = gpu.currentFrame;
+        gpu.textureToUpdateBindless.push(resourceUpdate);
+    }
+
+    gpu.popMarker(commandBuffer->vkCommandBuffer);
+
+    //Only the destination barriers are needed now, they take the new images to shader reads.
+    uint32_t readCount = 0;
+    for (uint32_t i = 1; i < barrierCount; i += 2)
+    {
+        VkImageMemoryBarrier2& barrier = barriers[readCount++];
+        barrier = barriers[i];
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    }
+
+    dependencyInfo.imageMemoryBarrierCount = readCount;
+    vkCmdPipelineBarrier2(commandBuffer->vkCommandBuffer, &dependencyInfo);
+
+#if defined(VOID_GPU_DEFRAGMENTATION_LOG)
+    vprint("Defragmentation pass %u moves %u textures, %.2fMB.\n", passCount, readCount, toMB(movedBytes));
+#else
+    (void)movedBytes;
+#endif //VOID_GPU_DEFRAGMENTATION_LOG
+}
+
+bool GPUMemoryService::isMoving(VmaAllocation allocation) const
+{
+    if (passOpen == false || allocation == VK_NULL_HANDLE)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pass.moveCount; ++i)
+    {
+        if (pass.pMoves[i].srcAllocation == allocation)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void GPUMemoryService::endDefragmentationPass(GPUDevice& gpu)
+{
+    for (uint32_t i = 0; i < pass.moveCount; ++i)
+    {
+        if (passImages[i] != VK_NULL_HANDLE)
+        {
+            vkDestroyImageView(gpu.vulkanDevice, passImageViews[i], gpu.vulkanAllocationCallbacks);
+            vkDestroyImage(gpu.vulkanDevice, passImages[i], gpu.vulkanAllocationCallbacks);
+        }
+    }
+
+    //The moved allocations now point at the memory the new images are bound to.
+    const VkResult result = vmaEndDefragmentationPass(vmaAllocator, defragmentation, &pass);
+    passOpen = false;
+
+    if (result == VK_SUCCESS || passCount >= GPU_DEFRAGMENTATION_MAX_PASSES)
+    {
+        endDefragmentation();
+    }
+}
+
+void GPUMemoryService::endDefragmentation()
+{
+    vmaEndDefragmentation(vmaAllocator, defragmentation, &lastStatistics);
+    defragmentation = VK_NULL_HANDLE;
+
+#if defined(VOID_GPU_DEFRAGMENTATION_LOG)
+    vprint("Defragmentation done after %u passes, moved %.2fMB in %u allocations and freed %.2fMB in %u blocks.\n", passCount,
+           toMB(lastStatistics.bytesMoved), lastStatistics.allocationsMoved, toMB(lastStatistics.bytesFreed), lastStatistics.deviceMemoryBlocksFreed);
+#endif //VOID_GPU_DEFRAGMENTATION_LOG
+}
@@ -0,0 +1,92 @@
+#ifndef GPU_MEMORY_HDR
+#define GPU_MEMORY_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Memory.hpp"
+
+#include "Graphics/GPUResources.hpp"
+
+#include <vulkan/vulkan.h>
+#include "vender/vk_mem_alloc.h"
+
+struct CommandBuffer;
+struct GPUDevice;
+
+//Define this to log every defragmentation pass and what a finished defragmentation moved.
+//#define VOID_GPU_DEFRAGMENTATION_LOG
+
+//Bytes freed since the last defragmentation before another one is started on its own.
+static constexpr uint64_t GPU_DEFRAGMENTATION_TRIGGER_BYTES = uint64_t(void_mega(64));
+//Work one pass may do, a pass is recorded into the first command buffer of a frame.
+static constexpr uint64_t GPU_DEFRAGMENTATION_PASS_BYTES = uint64_t(void_mega(16));
+static constexpr uint32_t GPU_DEFRAGMENTATION_PASS_MOVES = 16;
+//A defragmentation is ended after this many passes even if VMA still finds moves.
+static constexpr uint32_t GPU_DEFRAGMENTATION_MAX_PASSES = 64;
+
+struct GPUMemoryCategoryStatistics
+{
+    uint64_t bytes;
+    uint32_t allocations;
+};
+
+//Accounts every VMA allocation by category, reports the heap budgets and compacts texture memory a bounded amount per frame.
+//The category and the pool index of the owner are stored in the allocation user data, track is called after an allocation is
+//created and release before it is freed.
+struct GPUMemoryService
+{
+    void init(VmaAllocator inVMAAllocator);
+    //Finishes a defragmentation still in progress, the device must be idle.
+    void shutdown(GPUDevice& gpu);
+
+    //Accounting
+    void track(VmaAllocation allocation, GPUMemoryCategory category, uint32_t ownerIndex = UINT32_MAX);
+    void release(VmaAllocation allocation);
+    //For allocations that change hands, such as the images swapped by GPUDevice::replaceTexture.
+    void setOwner(VmaAllocation allocation, uint32_t ownerIndex);
+
+    //Budgets
+    //Called once per frame, VMA refreshes its budget from the driver when the frame index changes.
+    void updateBudgets(uint32_t frameIndex);
+    void logReport() const;
+    void imguiDraw();
+
+    //Defragmentation
+    void requestDefragmentation();
+    //Called in newFrame once the deletions are done, ends the open pass when the frame it was recorded in has finished
+    //and starts a defragmentation when one was requested or enough memory was freed.
+    void updateDefragmentation(GPUDevice& gpu);
+    //Begins a pass and records the copies of the textures it moves, called with the first command buffer of the frame.
+    void recordDefragmentationPass(GPUDevice& gpu, CommandBuffer* commandBuffer);
+    //Allocations in the open pass can not be freed until it ends.
+    bool isMoving(VmaAllocation allocation) const;
+
+    //Helpers
+    void endDefragmentationPass(GPUDevice& gpu);
+    void endDefragmentation();
+
+    VmaAllocator vmaAllocator = VK_NULL_HANDLE;
+
+    GPUMemoryCategoryStatistics categories[GPU_MEMORY_CATEGORY_COUNT]{};
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS]{};
+    VkMemoryHeapFlags heapFlags[VK_MAX_MEMORY_HEAPS]{};
+    uint32_t heapCount = 0;
+
+    VmaDefragmentationContext defragmentation = VK_NULL_HANDLE;
+    VmaDefragmentationPassMoveInfo pass{};
+    //Images and views the moved textures had before the pass, destroyed when it ends. Null for the moves that were ignored.
+    VkImage passImages[GPU_DEFRAGMENTATION_PASS_MOVES];
+    VkImageView passImageViews[GPU_DEFRAGMENTATION_PASS_MOVES];
+    //Absolute frame the open pass was recorded in.
+    uint32_t passFrame = 0;
+    uint32_t passCount = 0;
+
+    //Freed since the last defragmentation started.
+    uint64_t releasedBytes = 0;
+    VmaDefragmentationStats lastStatistics{};
+
+    bool passOpen = false;
+    bool defragmentationRequested = false;
+};
+
+#endif // !GPU_MEMORY_HDR
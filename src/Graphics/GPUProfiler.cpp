@@ -3,6 +3,7 @@
 #include "Foundation/HashMap.hpp"
 #include "Foundation/Numerics.hpp"
 #include "Foundation/Colour.hpp"
+#include "Foundation/Log.hpp"
 
 #include "vender/imgui/imgui.h"
 
@@ -16,14 +17,45 @@ namespace
     //GPU Task names to colours
     FlatHashMap<uint64_t, uint32_t> nameToColour;
     uint32_t initialFramesPaused = 3;
+
+    //Nearest rank percentile of an ascending array.
+    float percentile(const float* sorted, uint32_t count, float fraction)
+    {
+        const uint32_t rank = ceilU32(fraction * count);
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+
+    void sortAscending(float* values, uint32_t count)
+    {
+        //At most maxFrames samples, insertion sort is plenty.
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            const float value = values[i];
+            uint32_t j = i;
+            while (j > 0 && values[j - 1] > value)
+            {
+                values[j] = values[j - 1];
+                --j;
+            }
+            values[j] = value;
+        }
+    }
 }
 
 void GPUProfiler::init(Allocator* newAllocator, uint32_t newMaxFrames) 
 {
     allocator = newAllocator;
     maxFrames = newMaxFrames;
-    timestamps = reinterpret_cast<GPUTimestamp*>(void_alloca(sizeof(GPUTimestamp) * maxFrames * 32, allocator));
+    timestamps = reinterpret_cast<GPUTimestamp*>(void_alloca(sizeof(GPUTimestamp) * maxFrames * GPU_PROFILER_MAX_TIMESTAMPS, allocator));
     perFrameActive = reinterpret_cast<uint16_t*>(void_alloca(sizeof(uint16_t) * maxFrames, allocator));
+    scopeHistory = reinterpret_cast<float*>(void_alloca(sizeof(float) * maxFrames * GPU_PROFILER_MAX_SCOPES, allocator));
+    sortedHistory = reinterpret_cast<float*>(void_alloca(sizeof(float) * maxFrames, allocator));
+
+    memset(scopeNames, 0, sizeof(scopeNames));
+    memset(scopeWrite, 0, sizeof(scopeWrite));
+    memset(scopeSamples, 0, sizeof(scopeSamples));
+    scopeCount = 0;
+    lastFrameIndex = UINT32_MAX;
 
     maxDuration = 16.666f;
     currentFrame = 0;
@@ -31,6 +63,7 @@ void GPUProfiler::init(Allocator* newAllocator, uint32_t newMaxFrames)
     maxTime = 0.f;
     averageTime = 0.f;
     paused = false;
+    memory = nullptr;
 
     memset(perFrameActive, 0, 2 * maxFrames);
 
@@ -44,10 +77,13 @@ void GPUProfiler::shutdown()
 
     void_free(timestamps, allocator);
     void_free(perFrameActive, allocator);
+    void_free(scopeHistory, allocator);
+    void_free(sortedHistory, allocator);
 }
 
 void GPUProfiler::update(GPUDevice& gpu) 
 {
+    memory = &gpu.memory;
     gpu.setGPUTimestampsEnable(paused == false);
 
     if (initialFramesPaused) 
@@ -61,13 +97,22 @@ void GPUProfiler::update(GPUDevice& gpu)
         return;
     }
 
-    uint32_t activeTimestamps = gpu.getGPUTimestamps(&timestamps[32 * currentFrame]);
+    uint32_t activeTimestamps = gpu.getGPUTimestamps(&timestamps[GPU_PROFILER_MAX_TIMESTAMPS * currentFrame]);
+    activeTimestamps = min(activeTimestamps, GPU_PROFILER_MAX_TIMESTAMPS);
+
+    //Nothing new was resolved since the last update, either timestamps are paused or the GPU is behind.
+    if (activeTimestamps == 0 || timestamps[GPU_PROFILER_MAX_TIMESTAMPS * currentFrame].frameIndex == lastFrameIndex)
+    {
+        return;
+    }
+
+    lastFrameIndex = timestamps[GPU_PROFILER_MAX_TIMESTAMPS * currentFrame].frameIndex;
     perFrameActive[currentFrame] = static_cast<uint16_t>(activeTimestamps);
 
     //Get the colours
     for (uint32_t i = 0; i < activeTimestamps; ++i) 
     {
-        GPUTimestamp& timestamp = timestamps[32 * currentFrame + i];
+        GPUTimestamp& timestamp = timestamps[GPU_PROFILER_MAX_TIMESTAMPS * currentFrame + i];
 
         uint64_t hashedName = hashCalculate(timestamp.name);
         uint32_t colourIndex = nameToColour.get(hashedName);
@@ -79,6 +124,17 @@ void GPUProfiler::update(GPUDevice& gpu)
         }
 
         timestamp.colour = Colour::getDistinctColour(colourIndex);
+
+        //Scopes past the limit are still drawn but get no statistics.
+        if (colourIndex < GPU_PROFILER_MAX_SCOPES)
+        {
+            scopeNames[colourIndex] = timestamp.name;
+            scopeCount = max(scopeCount, colourIndex + 1);
+
+            scopeHistory[colourIndex * maxFrames + scopeWrite[colourIndex]] = static_cast<float>(timestamp.elapsedMS);
+            scopeWrite[colourIndex] = (scopeWrite[colourIndex] + 1) % maxFrames;
+            scopeSamples[colourIndex] = min(scopeSamples[colourIndex] + 1, maxFrames);
+        }
     }
 
     currentFrame = (currentFrame + 1) % maxFrames;
@@ -92,6 +148,56 @@ void GPUProfiler::update(GPUDevice& gpu)
     }
 }
 
+uint32_t GPUProfiler::getStatistics(GPUScopeStatistics* outStatistics)
+{
+    for (uint32_t scope = 0; scope < scopeCount; ++scope)
+    {
+        GPUScopeStatistics& statistics = outStatistics[scope];
+        statistics = GPUScopeStatistics{ scopeNames[scope], 0.f, 0.f, 0.f, 0.f, 0.f, scopeSamples[scope] };
+        if (statistics.samples == 0)
+        {
+            continue;
+        }
+
+        //The ring is full or filled from the start, so the first samples are always the valid ones.
+        memoryCopy(sortedHistory, &scopeHistory[scope * maxFrames], sizeof(float) * statistics.samples);
+        sortAscending(sortedHistory, statistics.samples);
+
+        double total = 0.0;
+        for (uint32_t i = 0; i < statistics.samples; ++i)
+        {
+            total += sortedHistory[i];
+        }
+
+        statistics.average = static_cast<float>(total / statistics.samples);
+        statistics.p50 = percentile(sortedHistory, statistics.samples, 0.5f);
+        statistics.p95 = percentile(sortedHistory, statistics.samples, 0.95f);
+        statistics.p99 = percentile(sortedHistory, statistics.samples, 0.99f);
+        statistics.max = sortedHistory[statistics.samples - 1];
+    }
+
+    return scopeCount;
+}
+
+void GPUProfiler::logStatistics()
+{
+    GPUScopeStatistics statistics[GPU_PROFILER_MAX_SCOPES];
+    const uint32_t count = getStatistics(statistics);
+
+    vprint("GPU timings over the last %u frames:\n", maxFrames);
+    for (uint32_t scope = 0; scope < count; ++scope)
+    {
+        const GPUScopeStatistics& scopeStatistics = statistics[scope];
+        vprint("    %-24s ave %2.4fms p50 %2.4fms p95 %2.4fms p99 %2.4fms max %2.4fms (%u samples)\n", scopeStatistics.name, scopeStatistics.average,
+               scopeStatistics.p50, scopeStatistics.p95, scopeStatistics.p99, scopeStatistics.max, scopeStatistics.samples);
+    }
+
+    if (memory)
+    {
+        memory->logReport();
+    }
+}
+
 void GPUProfiler::imguiDraw()
 {
     if (initialFramesPaused)
@@ -134,7 +240,7 @@ void GPUProfiler::imguiDraw()
         uint32_t frameIndex = (currentFrame - 1 - i) % maxFrames;
 
         float frameX = cursorPos.x + rectX;
-        GPUTimestamp* frameTimestamps = &timestamps[frameIndex * 32];
+        GPUTimestamp* frameTimestamps = &timestamps[frameIndex * GPU_PROFILER_MAX_TIMESTAMPS];
         float frameTime = static_cast<float>(frameTimestamps[0].elapsedMS);
         //Clamp values to note destroy the frame data.
         frameTime = clamp(frameTime, 0.00001f, 1000.f);
@@ -177,7 +283,7 @@ void GPUProfiler::imguiDraw()
     selectedFrame = selectedFrame == -1 ? (currentFrame - 1) % maxFrames : selectedFrame;
     if (selectedFrame >= 0)
     {
-        GPUTimestamp* frameTimestamps = &timestamps[selectedFrame * 32];
+        GPUTimestamp* frameTimestamps = &timestamps[selectedFrame * GPU_PROFILER_MAX_TIMESTAMPS];
 
         float x = cursorPos.x + graphWidth;
         float y = cursorPos.y;
@@ -205,6 +311,17 @@ void GPUProfiler::imguiDraw()
     ImGui::SameLine();
     ImGui::LabelText("", "Ave %3.4fms", averageTime);
 
+    ImGui::Separator();
+
+    GPUScopeStatistics statistics[GPU_PROFILER_MAX_SCOPES];
+    const uint32_t scopes = getStatistics(statistics);
+    for (uint32_t scope = 0; scope < scopes; ++scope)
+    {
+        const GPUScopeStatistics& scopeStatistics = statistics[scope];
+        ImGui::Text("%-24s Ave %2.4fms P50 %2.4fms P95 %2.4fms P99 %2.4fms", scopeStatistics.name, scopeStatistics.average,
+                    scopeStatistics.p50, scopeStatistics.p95, scopeStatistics.p99);
+    }
+
     ImGui::Separator();
     ImGui::Checkbox("Paused", &paused);
 
@@ -216,4 +333,10 @@ void GPUProfiler::imguiDraw()
     {
         maxDuration = maxDurations[maxDurationIndex];
     }
+
+    if (memory)
+    {
+        ImGui::Separator();
+        memory->imguiDraw();
+    }
 }
\ No newline at end of file
@@ -5,6 +5,24 @@
 #include "Foundation/Memory.hpp"
 #include "GPUDevice.hpp"
 
+//Timestamps kept per frame and the number of distinct scopes (marker names) with statistics.
+static constexpr uint32_t GPU_PROFILER_MAX_TIMESTAMPS = 32;
+static constexpr uint32_t GPU_PROFILER_MAX_SCOPES = 32;
+
+struct GPUScopeStatistics
+{
+    const char* name;
+
+    float average;
+    float p50;
+    float p95;
+    float p99;
+    float max;
+
+    uint32_t samples;
+};
+
+//The timestamps come from frames that have already finished on the GPU, so the profiler never stalls the CPU and can stay on in benchmark runs.
 struct GPUProfiler 
 {
     void init(Allocator* newAllocator, uint32_t newMaxFrames);
@@ -12,12 +30,27 @@ struct GPUProfiler
 
     void update(GPUDevice& gpu);
 
+    //Fills one entry per scope seen over the last maxFrames resolved frames, returns the number of scopes.
+    uint32_t getStatistics(GPUScopeStatistics* outStatistics);
+    void logStatistics();
+
     void imguiDraw();
 
     Allocator* allocator;
     GPUTimestamp* timestamps;
     uint16_t* perFrameActive;
 
+    //Per scope ring of the last maxFrames durations, a scope is indexed the same as its colour.
+    float* scopeHistory;
+    float* sortedHistory;
+    const char* scopeNames[GPU_PROFILER_MAX_SCOPES];
+    uint32_t scopeWrite[GPU_PROFILER_MAX_SCOPES];
+    uint32_t scopeSamples[GPU_PROFILER_MAX_SCOPES];
+    uint32_t scopeCount;
+
+    //Frame index of the last resolved timestamps, the same frame is only recorded once.
+    uint32_t lastFrameIndex;
+
     uint32_t maxFrames;
     uint32_t currentFrame;
 
@@ -27,6 +60,9 @@ struct GPUProfiler
 
     float maxDuration;
     bool paused;
+
+    //Heap budgets and per category usage are drawn and logged with the timings.
+    GPUMemoryService* memory;
 };
 
 
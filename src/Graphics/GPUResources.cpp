@@ -52,6 +52,7 @@ BufferCreation& BufferCreation::reset()
 {
     size = 0;
     initialData = nullptr;
+    category = GPU_MEMORY_CATEGORY_OTHER;
 
     return *this;
 }
@@ -78,6 +79,13 @@ BufferCreation& BufferCreation::setName(const char* inName)
     return *this;
 }
 
+BufferCreation& BufferCreation::setCategory(GPUMemoryCategory inCategory)
+{
+    category = inCategory;
+
+    return *this;
+}
+
 TextureCreation::~TextureCreation() 
 {
     if (images.size > 0) 
@@ -132,6 +140,12 @@ TextureCreation& TextureCreation::setImages(const Array<uint8_t*>& inImages, uin
     return *this;
 }
 
+TextureCreation& TextureCreation::setAlias(VmaAllocation allocation)
+{
+    aliasAllocation = allocation;
+    return *this;
+}
+
 SamplerCreation& SamplerCreation::setMinMagMip(VkFilter min, VkFilter mag, VkSamplerMipmapMode mip) 
 {
     minFilter = min;
@@ -45,6 +45,22 @@ enum ResourceUpdateType : uint8_t
     COUNT
 };
 
+//What an allocation holds, GPUMemoryService keeps the bytes per category.
+enum GPUMemoryCategory : uint8_t
+{
+    //Sampled images uploaded once, the only allocations defragmentation moves.
+    GPU_MEMORY_CATEGORY_TEXTURE,
+    //Attachments and storage images the GPU writes, including the frame graph memory.
+    GPU_MEMORY_CATEGORY_RENDER_TARGET,
+    GPU_MEMORY_CATEGORY_GEOMETRY,
+    //Buffers with a copy per frame in flight that are rewritten every frame.
+    GPU_MEMORY_CATEGORY_PER_FRAME,
+    GPU_MEMORY_CATEGORY_STAGING,
+    GPU_MEMORY_CATEGORY_OTHER,
+
+    GPU_MEMORY_CATEGORY_COUNT
+};
+
 struct Allocator;
 struct DeviceStateVulkan;
 
@@ -270,10 +286,13 @@ struct BufferCreation
     void* initialData = nullptr;
     const char* name = nullptr;
 
+    GPUMemoryCategory category = GPU_MEMORY_CATEGORY_OTHER;
+
     BufferCreation& reset();
     BufferCreation& set(VkBufferUsageFlags flags, uint32_t bufferSize);
     BufferCreation& setData(void *data);
     BufferCreation& setName(const char* inName);
+    BufferCreation& setCategory(GPUMemoryCategory inCategory);
 };
 
 struct TextureCreation 
@@ -296,12 +315,16 @@ struct TextureCreation
 
     const char* name = nullptr;
 
+    //When set the image is placed at the start of this allocation instead of getting its own memory, used to alias transient textures.
+    VmaAllocation aliasAllocation = nullptr;
+
     TextureCreation& setSize(uint16_t newWidth, uint16_t newHeight, uint16_t newDepth);
     TextureCreation& setFlags(uint8_t newMipmaps, VkImageUsageFlags newUsage);
     TextureCreation& setFormatType(VkFormat newFormat, VkImageType newImageType, VkImageViewType newImageViewType);
     TextureCreation& setName(const char* inName);
     TextureCreation& setData(void* data);
     TextureCreation& setImages(const Array<uint8_t*>& inImages, uint32_t imageCount);
+    TextureCreation& setAlias(VmaAllocation allocation);
 };
 
 struct SamplerCreation 
@@ -489,6 +512,28 @@ namespace TextureFormat
         return value >= VK_FORMAT_D16_UNORM && value <= VK_FORMAT_D32_SFLOAT_S8_UINT;
     }
 
+    static bool isBlockCompressed(VkFormat value)
+    {
+        return value >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && value <= VK_FORMAT_BC7_SRGB_BLOCK;
+    }
+
+    //Bytes per 4x4 block of the BC formats.
+    static uint32_t blockBytes(VkFormat value)
+    {
+        return (value <= VK_FORMAT_BC1_RGBA_SRGB_BLOCK || value == VK_FORMAT_BC4_UNORM_BLOCK || value == VK_FORMAT_BC4_SNORM_BLOCK) ? 8 : 16;
+    }
+
+    //Bytes of one level, block compressed levels are rounded up to whole blocks.
+    static uint32_t levelSize(VkFormat value, uint32_t width, uint32_t height)
+    {
+        if (isBlockCompressed(value))
+        {
+            return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(value);
+        }
+
+        return width * height * 4;
+    }
+
 }//TextureFormat
 
 struct ResourceData 
@@ -608,6 +653,8 @@ struct ResourceUpdate
     uint32_t handle;
     uint32_t currentFrame;
     ResourceUpdateType type;
+    //Deletions only, 0 until the frame that queued it is submitted.
+    uint64_t timelineValue = 0;
 };
 
 struct Buffer 
@@ -0,0 +1,69 @@
+#include "GeometryBuffer.hpp"
+
+void GeometryBuffer::init(GPUDevice& gpu, uint32_t vertexBytes, uint32_t newIndexCount)
+{
+    Allocator* allocator = &MemoryService::instance()->systemAllocator;
+
+    vertexAllocator.init(allocator, vertexBytes);
+    indexAllocator.init(allocator, newIndexCount);
+
+    BufferCreation bufferCreation{};
+    bufferCreation.set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, vertexBytes)
+        .setName("geometryVertices")
+        .setCategory(GPU_MEMORY_CATEGORY_GEOMETRY);
+    vertexBuffer = gpu.createBindlessBuffer(bufferCreation);
+
+    //The cluster culler reads the indices through the device address.
+    bufferCreation.reset()
+        .set(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, uint32_t(sizeof(uint32_t) * newIndexCount))
+        .setName("geometryIndices")
+        .setCategory(GPU_MEMORY_CATEGORY_GEOMETRY);
+    indexBuffer = gpu.createBindlessBuffer(bufferCreation);
+}
+
+void GeometryBuffer::shutdown(GPUDevice& gpu)
+{
+    VOID_ASSERTM(vertexAllocator.usedSize == 0 && indexAllocator.usedSize == 0, "Geometry is still allocated, %u vertex bytes and %u indices.", 
+                                                                                vertexAllocator.usedSize, indexAllocator.usedSize);
+
+    gpu.destroyBuffer(vertexBuffer);
+    gpu.destroyBuffer(indexBuffer);
+
+    vertexAllocator.shutdown();
+    indexAllocator.shutdown();
+}
+
+int32_t GeometryBuffer::addVertices(GPUDevice& gpu, const void* vertices, uint32_t vertexCount, uint32_t vertexStride)
+{
+    const uint32_t vertexBytes = vertexCount * vertexStride;
+    const uint32_t offset = vertexAllocator.allocate(vertexBytes, vertexStride);
+    VOID_ASSERTM(offset != INVALID_OFFSET, "The geometry vertex buffer is full, %u bytes requested with %u of %u used.", 
+                                           vertexBytes, vertexAllocator.usedSize, vertexAllocator.size);
+
+    Buffer* buffer = gpu.accessBuffer(vertexBuffer);
+    vmaCopyMemoryToAllocation(gpu.VMAAllocator, vertices, buffer->vmaAllocation, offset, vertexBytes);
+
+    return int32_t(offset / vertexStride);
+}
+
+uint32_t GeometryBuffer::addIndices(GPUDevice& gpu, const uint32_t* indices, uint32_t indexCount)
+{
+    const uint32_t firstIndex = indexAllocator.allocate(indexCount);
+    VOID_ASSERTM(firstIndex != INVALID_OFFSET, "The geometry index buffer is full, %u indices requested with %u of %u used.", 
+                                               indexCount, indexAllocator.usedSize, indexAllocator.size);
+
+    Buffer* buffer = gpu.accessBuffer(indexBuffer);
+    vmaCopyMemoryToAllocation(gpu.VMAAllocator, indices, buffer->vmaAllocation, sizeof(uint32_t) * firstIndex, sizeof(uint32_t) * indexCount);
+
+    return firstIndex;
+}
+
+void GeometryBuffer::removeVertices(int32_t vertexOffset, uint32_t vertexCount, uint32_t vertexStride)
+{
+    vertexAllocator.free(uint32_t(vertexOffset) * vertexStride, vertexCount * vertexStride);
+}
+
+void GeometryBuffer::removeIndices(uint32_t firstIndex, uint32_t indexCount)
+{
+    indexAllocator.free(firstIndex, indexCount);
+}
@@ -0,0 +1,31 @@
+#ifndef GEOMETRY_BUFFER_HDR
+#define GEOMETRY_BUFFER_HDR
+
+#include "Foundation/OffsetAllocator.hpp"
+
+#include "GPUDevice.hpp"
+
+//Every mesh shares one vertex buffer and one 32 bit index buffer, draws address their range through firstIndex and vertexOffset.
+//The vertex buffer is read through its device address, so mixed vertex formats share it by aligning each range to its stride.
+struct GeometryBuffer
+{
+    void init(GPUDevice& gpu, uint32_t vertexBytes, uint32_t newIndexCount);
+    void shutdown(GPUDevice& gpu);
+
+    //Returns the vertex offset in units of vertexStride.
+    int32_t addVertices(GPUDevice& gpu, const void* vertices, uint32_t vertexCount, uint32_t vertexStride);
+    //Returns the first index.
+    uint32_t addIndices(GPUDevice& gpu, const uint32_t* indices, uint32_t indexCount);
+
+    void removeVertices(int32_t vertexOffset, uint32_t vertexCount, uint32_t vertexStride);
+    void removeIndices(uint32_t firstIndex, uint32_t indexCount);
+
+    //Vertex ranges are in bytes, index ranges are in indices.
+    OffsetAllocator vertexAllocator;
+    OffsetAllocator indexAllocator;
+
+    BufferHandle vertexBuffer;
+    BufferHandle indexBuffer;
+};
+
+#endif // !GEOMETRY_BUFFER_HDR
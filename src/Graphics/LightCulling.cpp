@@ -0,0 +1,127 @@
+#include "LightCulling.hpp"
+#include "CommandBuffer.hpp"
+
+#include "Foundation/File.hpp"
+#include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
+
+#include "cglm/struct/vec3.h"
+
+#include <math.h>
+
+namespace
+{
+    //lightCulling.comp runs one thread per cluster.
+    static constexpr uint32_t LIGHT_CULLING_GROUP_SIZE = 64;
+}
+
+void LightCuller::init(GPUDevice& gpu)
+{
+    FileReadResult computeShaderCode = fileReadBinary("Assets/Shaders/lightCulling.comp.spv", &MemoryService::instance()->scratchAllocator);
+
+    PipelineCreation pipelineCreation{};
+    pipelineCreation.shaders.setName("lightCulling")
+        .addStage(computeShaderCode.data, uint32_t(computeShaderCode.size), VK_SHADER_STAGE_COMPUTE_BIT)
+        .setSPVInput(true);
+    cullingPipeline = gpu.createPipeline(pipelineCreation);
+
+    lights.init(&MemoryService::instance()->systemAllocator, 64);
+
+    BufferCreation bufferCreation{};
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(GPULight) * LIGHT_MAX_COUNT)
+            .setName("lights")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        lightBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * LIGHT_CLUSTER_COUNT)
+            .setName("lightGrid")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        gridBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+
+        bufferCreation.reset()
+            .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * LIGHT_CLUSTER_COUNT * LIGHT_CLUSTER_MAX_LIGHTS)
+            .setName("lightIndices")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
+        indexBuffer[i] = gpu.createBindlessBuffer(bufferCreation);
+    }
+}
+
+void LightCuller::shutdown(GPUDevice& gpu)
+{
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; ++i)
+    {
+        gpu.destroyBuffer(lightBuffer[i]);
+        gpu.destroyBuffer(gridBuffer[i]);
+        gpu.destroyBuffer(indexBuffer[i]);
+    }
+
+    gpu.destroyPipeline(cullingPipeline);
+
+    lights.shutdown();
+}
+
+uint32_t LightCuller::addPointLight(const vec3s& position, const vec3s& colour, float intensity, float radius)
+{
+    VOID_ASSERTM(lights.size < LIGHT_MAX_COUNT, "Only %u lights fit in the light buffer.", LIGHT_MAX_COUNT);
+
+    lights.push(GPULight{ position, radius, colour, intensity, vec3s{ 0.f, 0.f, -1.f }, 0.f, 1.f });
+    return lights.size - 1;
+}
+
+uint32_t LightCuller::addSpotLight(const vec3s& position, const vec3s& direction, const vec3s& colour, float intensity, float radius, float innerAngle, float outerAngle)
+{
+    VOID_ASSERTM(lights.size < LIGHT_MAX_COUNT, "Only %u lights fit in the light buffer.", LIGHT_MAX_COUNT);
+
+    //Same cone falloff as getSpotAngleAttenuation in coreShaderNew.frag, with the scale and offset done here.
+    const float cosOuter = cosf(outerAngle);
+    const float spotScale = 1.f / max(cosf(innerAngle) - cosOuter, 1e-4f);
+
+    lights.push(GPULight{ position, radius, colour, intensity, glms_vec3_normalize(direction), spotScale, -cosOuter * spotScale });
+    return lights.size - 1;
+}
+
+void LightCuller::update(GPUDevice& gpu, uint32_t currentFrame)
+{
+    if (lights.size)
+    {
+        Buffer* buffer = gpu.accessBuffer(lightBuffer[currentFrame]);
+        vmaCopyMemoryToAllocation(gpu.VMAAllocator, lights.data, buffer->vmaAllocation, 0, sizeof(GPULight) * lights.size);
+    }
+}
+
+void LightCuller::cull(CommandBuffer& commandBuffer, const mat4s& view, const mat4s& projection, float viewFar, uint32_t currentFrame)
+{
+    GPUDevice& gpu = *commandBuffer.device;
+
+    LightCullingPushConstants pushConstants{};
+    pushConstants.view = view;
+    pushConstants.lightAddress = gpu.accessBuffer(lightBuffer[currentFrame])->bufferAddress;
+    pushConstants.lightGridAddress = gpu.accessBuffer(gridBuffer[currentFrame])->bufferAddress;
+    pushConstants.lightIndexAddress = gpu.accessBuffer(indexBuffer[currentFrame])->bufferAddress;
+    pushConstants.projectionX = projection.m00;
+    pushConstants.projectionY = projection.m11;
+    pushConstants.gridNear = LIGHT_GRID_NEAR;
+    pushConstants.gridFar = LIGHT_GRID_FAR;
+    pushConstants.viewFar = viewFar;
+    pushConstants.lightCount = lights.size;
+
+    //Empty clusters still have their count cleared, so this runs without lights too.
+    commandBuffer.bindPipeline(cullingPipeline);
+    vkCmdPushConstants(commandBuffer.vkCommandBuffer, commandBuffer.currentPipeline->vkPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    commandBuffer.dispatch((LIGHT_CLUSTER_COUNT + LIGHT_CULLING_GROUP_SIZE - 1) / LIGHT_CULLING_GROUP_SIZE, 1, 1);
+}
+
+void LightCuller::fillSceneData(GPUDevice& gpu, UniformData& sceneData, uint32_t currentFrame) const
+{
+    sceneData.lightAddress = gpu.accessBuffer(lightBuffer[currentFrame])->bufferAddress;
+    sceneData.lightGridAddress = gpu.accessBuffer(gridBuffer[currentFrame])->bufferAddress;
+    sceneData.lightIndexAddress = gpu.accessBuffer(indexBuffer[currentFrame])->bufferAddress;
+
+    //slice = log(d / near) / log(far / near) * LIGHT_GRID_Z
+    sceneData.lightSliceScale = LIGHT_GRID_Z / logf(LIGHT_GRID_FAR / LIGHT_GRID_NEAR);
+    sceneData.lightSliceBias = -logf(LIGHT_GRID_NEAR) * sceneData.lightSliceScale;
+}
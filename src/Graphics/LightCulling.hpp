@@ -0,0 +1,57 @@
+#ifndef LIGHT_CULLING_HDR
+#define LIGHT_CULLING_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Array.hpp"
+
+#include "GPUDevice.hpp"
+#include "ShaderData.hpp"
+
+//Define this to fill the level with 1,000 moving lights and log the light culling and shading times after a few hundred frames.
+//#define VOID_LIGHT_BENCHMARK
+
+//Froxel grid, the screen is split into LIGHT_GRID_X by LIGHT_GRID_Y tiles and the view depth into LIGHT_GRID_Z exponential slices.
+//Must match lightCulling.comp and coreShaderNew.frag.
+static constexpr uint32_t LIGHT_GRID_X = 16;
+static constexpr uint32_t LIGHT_GRID_Y = 9;
+static constexpr uint32_t LIGHT_GRID_Z = 24;
+static constexpr uint32_t LIGHT_CLUSTER_COUNT = LIGHT_GRID_X * LIGHT_GRID_Y * LIGHT_GRID_Z;
+//Lights past this in one cluster are dropped for that cluster.
+static constexpr uint32_t LIGHT_CLUSTER_MAX_LIGHTS = 128;
+static constexpr uint32_t LIGHT_MAX_COUNT = 4096;
+
+//The slices are spaced exponentially between these view depths, the first and last slice stretch to the camera and the far plane.
+static constexpr float LIGHT_GRID_NEAR = 0.1f;
+static constexpr float LIGHT_GRID_FAR = 500.f;
+
+struct CommandBuffer;
+
+//Assigns point and spot lights to the froxels they touch with a compute pass each frame. Every cluster gets a light count in the grid buffer
+//and a fixed range of LIGHT_CLUSTER_MAX_LIGHTS indices in the index buffer, the main fragment shader only iterates the lights of its cluster.
+struct LightCuller
+{
+    void init(GPUDevice& gpu);
+    void shutdown(GPUDevice& gpu);
+
+    //Returns the light index, spot angles are in radians.
+    uint32_t addPointLight(const vec3s& position, const vec3s& colour, float intensity, float radius);
+    uint32_t addSpotLight(const vec3s& position, const vec3s& direction, const vec3s& colour, float intensity, float radius, float innerAngle, float outerAngle);
+
+    //Uploads the lights of this frame, call after they have been moved and before cull.
+    void update(GPUDevice& gpu, uint32_t currentFrame);
+    //Records the light culling dispatch from a frame graph compute pass.
+    void cull(CommandBuffer& commandBuffer, const mat4s& view, const mat4s& projection, float viewFar, uint32_t currentFrame);
+
+    //Points the scene data at the grid of this frame.
+    void fillSceneData(GPUDevice& gpu, UniformData& sceneData, uint32_t currentFrame) const;
+
+    PipelineHandle cullingPipeline;
+
+    BufferHandle lightBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle gridBuffer[FRAMES_IN_FLIGHT];
+    BufferHandle indexBuffer[FRAMES_IN_FLIGHT];
+
+    Array<GPULight> lights;
+};
+
+#endif // !LIGHT_CULLING_HDR
@@ -8,11 +8,14 @@
 #include <tlsf.h>
 #include <meshoptimizer.h>
 
+#include <string.h>
+
 #include "Foundation/Memory.hpp"
 #include "Foundation/File.hpp"
 #include "Foundation/Numerics.hpp"
 
 #include "GPUResources.hpp"
+#include "TextureCompression.hpp"
 
 struct Transform
 {
@@ -37,6 +40,275 @@ struct Transform
     }
 };
 
+struct ImageDecode
+{
+    const cgltf_image* image;
+    TextureHandle* outTexture;
+    char cookedPath[MAX_FILE_PATH];
+    TextureUsage usage;
+    bool blockCompression;
+
+    //Written by the job.
+    CompressedImage compressed;
+    uint8_t* imageData;
+    int width;
+    int height;
+    bool blockCompressed;
+    bool cookedUnreadable;
+    bool cookFailed;
+};
+
+namespace
+{
+    //The post-transform cache size used for the ACMR/ATVR statistics, 16 is close to what current GPUs behave like.
+    static constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+    //Allows the overdraw pass to make the vertex cache up to 5% worse.
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    //Each LOD aims for half the triangles of the previous one.
+    static constexpr float LOD_REDUCTION = 0.5f;
+    //A LOD that keeps more than this much of the previous one isn't worth drawing.
+    static constexpr float LOD_MIN_REDUCTION = 0.85f;
+    //Largest error the simplifier may introduce per LOD, relative to the mesh extent.
+    static constexpr float LOD_MAX_ERROR = 0.1f;
+    static constexpr uint32_t LOD_MIN_INDICES = 3 * 64;
+
+    //124 triangles keeps the triangle data of a meshlet a multiple of 4 bytes.
+    static constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+    static constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+    //Trades some vertex reuse for tighter normal cones.
+    static constexpr float MESHLET_CONE_WEIGHT = 0.25f;
+
+#if defined(VOID_OPTIMISE_MESHES) && defined(VOID_MESH_STATISTICS)
+    void logMeshStatistics(const char* label, const uint32_t* indices, uint32_t indexCount, const void* vertices, uint32_t vertexCount, uint32_t vertexStride)
+    {
+        const meshopt_VertexCacheStatistics cacheStatistics = meshopt_analyzeVertexCache(indices, indexCount, vertexCount, VERTEX_CACHE_SIZE, 0, 0);
+        const meshopt_OverdrawStatistics overdrawStatistics = meshopt_analyzeOverdraw(indices, indexCount, static_cast<const float*>(vertices), vertexCount, vertexStride);
+        const meshopt_VertexFetchStatistics fetchStatistics = meshopt_analyzeVertexFetch(indices, indexCount, vertexCount, vertexStride);
+
+        vprint("    %-6s ACMR %.3f ATVR %.3f overdraw %.3f overfetch %.3f\n", 
+               label, cacheStatistics.acmr, cacheStatistics.atvr, overdrawStatistics.overdraw, fetchStatistics.overfetch);
+    }
+#endif //VOID_OPTIMISE_MESHES && VOID_MESH_STATISTICS
+
+#if defined(VOID_TEXTURE_MEMORY_REPORT)
+    uint32_t textureChainSize(VkFormat format, uint32_t width, uint32_t height, uint32_t levelCount)
+    {
+        uint32_t size = 0;
+        for (uint32_t level = 0; level < levelCount; ++level)
+        {
+            size += TextureFormat::levelSize(format, max(width >> level, 1u), max(height >> level, 1u));
+        }
+
+        return size;
+    }
+
+    //Images shared between materials count towards each of them, the model total counts every image once.
+    void logTextureMemory(const char* modelPath, const cgltf_data* cgltfData, const Array<uint32_t>& imageSizesRGBA, const Array<uint32_t>& imageSizesResident)
+    {
+        vprint("%s texture memory, RGBA8 with mips against what is resident.\n", modelPath);
+
+        for (uint32_t materialIndex = 0; materialIndex < cgltfData->materials_count; ++materialIndex)
+        {
+            const cgltf_material& material = cgltfData->materials[materialIndex];
+
+            const cgltf_texture* textures[] = { material.pbr_metallic_roughness.base_color_texture.texture, material.pbr_metallic_roughness.metallic_roughness_texture.texture,
+                                                material.normal_texture.texture, material.occlusion_texture.texture, material.emissive_texture.texture };
+
+            uint64_t sizeRGBA = 0;
+            uint64_t sizeResident = 0;
+            for (uint32_t i = 0; i < ArraySize(textures); ++i)
+            {
+                if (textures[i] != nullptr && textures[i]->image != nullptr)
+                {
+                    const uint32_t imageIndex = uint32_t(cgltf_image_index(cgltfData, textures[i]->image));
+                    sizeRGBA += imageSizesRGBA[imageIndex];
+                    sizeResident += imageSizesResident[imageIndex];
+                }
+            }
+
+            vprint("    %-32s %8.2fMB -> %8.2fMB\n", material.name ? material.name : "unnamed", sizeRGBA / (1024.0 * 1024.0), sizeResident / (1024.0 * 1024.0));
+        }
+
+        uint64_t totalRGBA = 0;
+        uint64_t totalResident = 0;
+        for (uint32_t i = 0; i < imageSizesRGBA.size; ++i)
+        {
+            totalRGBA += imageSizesRGBA[i];
+            totalResident += imageSizesResident[i];
+        }
+
+        vprint("    %-32s %8.2fMB -> %8.2fMB\n", "Total", totalRGBA / (1024.0 * 1024.0), totalResident / (1024.0 * 1024.0));
+    }
+#endif //VOID_TEXTURE_MEMORY_REPORT
+
+    //Runs on a worker so it only touches the decode and the allocator, anything worth logging is flagged for the main thread.
+    void decodeImage(ImageDecode& decode, Allocator* allocator)
+    {
+        //A cooked file is used as is, delete it to cook the image again.
+        if (decode.blockCompression && fileExists(decode.cookedPath))
+        {
+            decode.blockCompressed = ktx2Read(decode.cookedPath, allocator, decode.compressed);
+            decode.cookedUnreadable = decode.blockCompressed == false;
+
+            if (decode.blockCompressed && decode.compressed.format != compressedFormat(decode.usage))
+            {
+                void_free(decode.compressed.data, allocator);
+                decode.compressed = CompressedImage{};
+                decode.blockCompressed = false;
+            }
+        }
+
+        if (decode.blockCompressed)
+        {
+            return;
+        }
+
+        const cgltf_image& image = *decode.image;
+
+        int comp = 0;
+        if (image.uri != nullptr)
+        {
+            decode.imageData = stbi_load(image.uri, &decode.width, &decode.height, &comp, 4);
+        }
+        else
+        {
+            const uint8_t* rawBufferData = reinterpret_cast<const uint8_t*>(image.buffer_view->buffer->data) + image.buffer_view->offset;
+            decode.imageData = stbi_load_from_memory(rawBufferData, int(image.buffer_view->size), &decode.width, &decode.height, &comp, 4);
+        }
+
+        if (decode.imageData != nullptr && decode.blockCompression)
+        {
+            compressImage(decode.imageData, uint32_t(decode.width), uint32_t(decode.height), decode.usage, allocator, decode.compressed);
+            decode.cookFailed = ktx2Write(decode.cookedPath, decode.compressed, allocator) == false;
+            decode.blockCompressed = true;
+
+            //Only the blocks are uploaded, the pixels can go before the job finishes.
+            stbi_image_free(decode.imageData);
+            decode.imageData = nullptr;
+        }
+    }
+
+#if defined(VOID_OPTIMISE_MESHES)
+    //Reorders a primitive for the post-transform cache, then for overdraw and finally reorders the vertices in the order the indices first use them.
+    //Position has to be the first member of the vertex. Returns the vertex count, which drops if the primitive had unreferenced vertices.
+    uint32_t optimiseMesh(uint32_t* indices, uint32_t indexCount, void* vertices, uint32_t vertexCount, uint32_t vertexStride, 
+                          const char* modelPath, uint32_t primitiveIndex)
+    {
+#if defined(VOID_MESH_STATISTICS)
+        vprint("%s primitive %u, %u triangles and %u vertices.\n", modelPath, primitiveIndex, indexCount / 3, vertexCount);
+        logMeshStatistics("Before", indices, indexCount, vertices, vertexCount, vertexStride);
+#endif //VOID_MESH_STATISTICS
+
+        meshopt_optimizeVertexCache(indices, indices, indexCount, vertexCount);
+        meshopt_optimizeOverdraw(indices, indices, indexCount, static_cast<const float*>(vertices), vertexCount, vertexStride, OVERDRAW_THRESHOLD);
+        vertexCount = uint32_t(meshopt_optimizeVertexFetch(vertices, indices, indexCount, vertices, vertexCount, vertexStride));
+
+#if defined(VOID_MESH_STATISTICS)
+        logMeshStatistics("After", indices, indexCount, vertices, vertexCount, vertexStride);
+#endif //VOID_MESH_STATISTICS
+
+        return vertexCount;
+    }
+#endif //VOID_OPTIMISE_MESHES
+
+    //Each LOD is simplified from the previous one, meshopt_simplifySloppy is used when the topology stops meshopt_simplify from reaching the target.
+    //indices holds LOD 0 and needs room for MAX_MESH_LODS times its size, the other LODs are appended after it.
+    void generateLods(MeshDraw& meshDraw, uint32_t* indices, const float* positions, uint32_t vertexCount, uint32_t vertexStride, float meshExtent)
+    {
+        uint32_t written = meshDraw.lods[0].indexCount;
+        float error = 0.f;
+        while (meshDraw.lodCount < MAX_MESH_LODS)
+        {
+            const MeshLod& previous = meshDraw.lods[meshDraw.lodCount - 1];
+            const size_t targetCount = size_t(previous.indexCount * LOD_REDUCTION) / 3 * 3;
+            if (targetCount < LOD_MIN_INDICES)
+            {
+                break;
+            }
+
+            const uint32_t* source = indices + previous.firstIndex;
+            uint32_t* destination = indices + written;
+
+            float resultError = 0.f;
+            size_t lodIndexCount = meshopt_simplify(destination, source, previous.indexCount, positions, vertexCount, vertexStride, targetCount, LOD_MAX_ERROR, 0, &resultError);
+            if (lodIndexCount > previous.indexCount * LOD_MIN_REDUCTION)
+            {
+                lodIndexCount = meshopt_simplifySloppy(destination, source, previous.indexCount, positions, vertexCount, vertexStride, targetCount, LOD_MAX_ERROR, &resultError);
+            }
+
+            if (lodIndexCount == 0 || lodIndexCount > previous.indexCount * LOD_MIN_REDUCTION)
+            {
+                break;
+            }
+
+            meshopt_optimizeVertexCache(destination, destination, lodIndexCount, vertexCount);
+
+            //The error is reported relative to the mesh extent and adds on to the error of the LOD it was built from.
+            error += resultError * meshExtent;
+            meshDraw.lods[meshDraw.lodCount++] = MeshLod{ written, uint32_t(lodIndexCount), error };
+            written += uint32_t(lodIndexCount);
+        }
+
+        meshDraw.lodIndexCount = written;
+    }
+
+    //Splits LOD 0 into meshlets and rewrites its indices in meshlet order so every cluster is a contiguous index range.
+    //The bounds are moved into model space with the node matrix, so culling only needs the instance transform.
+    //Cluster firstIndex is relative to the mesh until the indices are uploaded.
+    void buildMeshlets(MeshDraw& meshDraw, Array<MeshCluster>& clusters, uint32_t* indices, const float* positions, uint32_t vertexCount, uint32_t vertexStride, 
+                       StackAllocator* scratchAllocator)
+    {
+        const uint32_t indexCount = meshDraw.lods[0].indexCount;
+        const uint32_t maxMeshlets = uint32_t(meshopt_buildMeshletsBound(indexCount, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES));
+
+        size_t meshletMarker = scratchAllocator->getMarker();
+
+        Array<meshopt_Meshlet> meshlets;
+        meshlets.init(scratchAllocator, maxMeshlets, maxMeshlets);
+        Array<uint32_t> meshletVertices;
+        meshletVertices.init(scratchAllocator, maxMeshlets * MESHLET_MAX_VERTICES, maxMeshlets * MESHLET_MAX_VERTICES);
+        Array<uint8_t> meshletTriangles;
+        meshletTriangles.init(scratchAllocator, maxMeshlets * MESHLET_MAX_TRIANGLES * 3, maxMeshlets * MESHLET_MAX_TRIANGLES * 3);
+
+        const uint32_t meshletCount = uint32_t(meshopt_buildMeshlets(meshlets.data, meshletVertices.data, meshletTriangles.data, indices, indexCount, 
+                                                                     positions, vertexCount, vertexStride, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, MESHLET_CONE_WEIGHT));
+
+        const mat4s& node = meshDraw.model;
+        const float nodeScale = max(max(glms_vec3_norm(glms_vec3(node.col[0])), glms_vec3_norm(glms_vec3(node.col[1]))), glms_vec3_norm(glms_vec3(node.col[2])));
+
+        meshDraw.firstCluster = clusters.size;
+        meshDraw.clusterCount = meshletCount;
+
+        uint32_t written = 0;
+        for (uint32_t meshletIndex = 0; meshletIndex < meshletCount; ++meshletIndex)
+        {
+            const meshopt_Meshlet& meshlet = meshlets[meshletIndex];
+            const meshopt_Bounds bounds = meshopt_computeMeshletBounds(meshletVertices.data + meshlet.vertex_offset, meshletTriangles.data + meshlet.triangle_offset, 
+                                                                       meshlet.triangle_count, positions, vertexCount, vertexStride);
+
+            MeshCluster cluster{};
+            cluster.centre = glms_mat4_mulv3(node, vec3s{ bounds.center[0], bounds.center[1], bounds.center[2] }, 1.f);
+            cluster.radius = bounds.radius * nodeScale;
+            cluster.coneApex = glms_mat4_mulv3(node, vec3s{ bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2] }, 1.f);
+            cluster.coneAxis = glms_vec3_normalize(glms_mat4_mulv3(node, vec3s{ bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2] }, 0.f));
+            cluster.coneCutoff = bounds.cone_cutoff;
+            cluster.firstIndex = written;
+            cluster.indexCount = meshlet.triangle_count * 3;
+            clusters.push(cluster);
+
+            for (uint32_t i = 0; i < cluster.indexCount; ++i)
+            {
+                indices[written++] = meshletVertices[meshlet.vertex_offset + meshletTriangles[meshlet.triangle_offset + i]];
+            }
+        }
+
+        VOID_ASSERTM(written == indexCount, "Meshlets hold %u indices but the mesh has %u.", written, indexCount);
+
+        scratchAllocator->freeMarker(meshletMarker);
+    }
+}
+
 cgltf_data* Model::setupModel(const char* modelPath)
 {
     allocator = &MemoryService::instance()->systemAllocator;
@@ -66,9 +338,8 @@ cgltf_data* Model::setupModel(const char* modelPath)
         VOID_ERROR("The gltf model is invalid");
     }
 
-    currentIndexBuffer = INVALID_BUFFER;
-
     meshDraws.init(allocator, uint32_t(cgltfData->meshes_count));
+    clusters.init(allocator, 0);
 
     //These two are tightly coupled. nodeparent describes the relationship between the children and parents.
     nodeParents.init(allocator, cgltfData->nodes_count);
@@ -158,103 +429,267 @@ cgltf_data* Model::setupModel(const char* modelPath)
     return cgltfData;
 }
 
-void Model::loadModel(const char* modelPath, GPUDevice& gpu, DescriptorSetLayoutHandle descriptorSetLayout)
+void ImageDecodeQueue::init(Allocator* inAllocator, JobScheduler* inJobScheduler, TextureStreamer* inStreamer)
 {
-    isModel = true;
-    cgltf_data* cgltfData = setupModel(modelPath);
+    allocator = inAllocator;
+    jobScheduler = inJobScheduler;
+    streamer = inStreamer;
+
+    decodes.init(allocator, 16);
+    finished.init(allocator, 16);
+
+    barrier = jobScheduler->CreateBarrier();
+
+    //stb keeps this in a global, it is set here once instead of from the jobs.
+    stbi_set_flip_vertically_on_load(0);
+}
+
+void ImageDecodeQueue::shutdown()
+{
+    VOID_ASSERTM(decodes.size == 0, "%u images were queued but never uploaded.", decodes.size);
+
+    jobScheduler->DestroyBarrier(barrier);
+    barrier = nullptr;
+
+    decodes.shutdown();
+    finished.shutdown();
+}
+
+void ImageDecodeQueue::push(const cgltf_image* image, const char* cookedPath, TextureUsage usage, bool blockCompression, TextureHandle* outTexture)
+{
+    ImageDecode* decode = void_allocat(ImageDecode, allocator);
+    *decode = ImageDecode{};
+    decode->image = image;
+    decode->outTexture = outTexture;
+    snprintf(decode->cookedPath, MAX_FILE_PATH, "%s", cookedPath);
+    decode->usage = usage;
+    decode->blockCompression = blockCompression;
+
+    const uint32_t decodeIndex = decodes.size;
+    decodes.push(decode);
 
-    images.init(allocator, cgltfData->images_count);
-    //GLB version.
-    for (uint32_t imageIndex = 0; imageIndex < cgltfData->images_count; ++imageIndex)
     {
-        cgltf_image image = cgltfData->images[imageIndex];
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finished.setCapacity(decodes.size);
+    }
+
+    //Low priority so a level load never holds up the physics or transform jobs of the frame.
+    JPH::JobHandle job = jobScheduler->createJob("DecodeImage", JOB_PRIORITY_LOW, [this, decode, decodeIndex]()
+    {
+        decodeImage(*decode, &jobAllocator);
 
-        stbi_set_flip_vertically_on_load(0);
-        if (image.uri != nullptr)
         {
-            TextureHandle textureResource;
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            finished.push(decodeIndex);
+        }
+        finishedCondition.notify_one();
+    });
+    barrier->AddJob(job);
+}
+
+void ImageDecodeQueue::uploadAll(GPUDevice& gpu)
+{
+    //With no worker threads the jobs only run while this thread waits on the barrier.
+    if (jobScheduler->GetMaxConcurrency() <= 1)
+    {
+        jobScheduler->WaitForJobs(barrier);
+    }
 
-            int comp;
-            int width;
-            int height;
-            uint8_t mipLevels = 1;
+    for (uint32_t uploaded = 0; uploaded < decodes.size; ++uploaded)
+    {
+        uint32_t decodeIndex;
+        {
+            std::unique_lock<std::mutex> lock(finishedMutex);
+            finishedCondition.wait(lock, [this, uploaded]() { return finished.size > uploaded; });
+            decodeIndex = finished[uploaded];
+        }
+
+        ImageDecode& decode = *decodes[decodeIndex];
+        const cgltf_image& image = *decode.image;
+
+        if (decode.cookedUnreadable)
+        {
+            vprint("%s is not a KTX2 file with block compressed levels, it is ignored.\n", decode.cookedPath);
+        }
+
+        if (decode.cookFailed)
+        {
+            vprint("Could not write the cooked texture %s.\n", decode.cookedPath);
+        }
 
-            uint8_t *imageData = stbi_load(image.uri, &width, &height, &comp, 4);
-            if (imageData == nullptr)
+        if (decode.blockCompressed == false && decode.imageData == nullptr)
+        {
+            VOID_ERROR("Error loading texture %s", image.uri ? image.uri : decode.cookedPath);
+        }
+
+        if (decode.blockCompressed && streamer)
+        {
+            //Only the tail levels are uploaded here, the streamer brings in the rest once something needs them.
+            *decode.outTexture = streamer->addTexture(gpu, decode.compressed, image.uri);
+        }
+        else
+        {
+            TextureCreation creation;
+            if (decode.blockCompressed)
             {
-                textureResource = INVALID_TEXTURE;
-                VOID_ERROR("Error loading texture %s", image.uri);
+                //Every level comes from the cooked data, nothing is generated on the GPU.
+                creation.setData(decode.compressed.data)
+                    .setFormatType(decode.compressed.format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
+                    .setFlags(uint8_t(decode.compressed.levelCount), VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+                    .setSize(static_cast<uint16_t>(decode.compressed.width), static_cast<uint16_t>(decode.compressed.height), 1)
+                    .setName(image.uri);
             }
+            else
+            {
+                //Full chain down to 1x1, createTexture blits the levels below 0.
+                uint8_t mipLevels = 1;
+                uint32_t w = decode.width;
+                uint32_t h = decode.height;
 
-            // TODO: Add mipmap support later.
-            uint32_t w = width;
-            uint32_t h = height;
+                while (w > 1 || h > 1)
+                {
+                    w = w > 1 ? w / 2 : 1;
+                    h = h > 1 ? h / 2 : 1;
 
-            while (w > 1 && h > 1)
-            {
-                w /= 2;
-                h /= 2;
+                    ++mipLevels;
+                }
 
-                ++mipLevels;
+                creation.setData(decode.imageData)
+                    .setFormatType(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
+                    .setFlags(mipLevels, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+                    .setSize(static_cast<uint16_t>(decode.width), static_cast<uint16_t>(decode.height), 1)
+                    .setName(image.uri);
             }
 
-            TextureCreation creation;
-            creation.setData(imageData)
-                .setFormatType(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
-                .setFlags(mipLevels, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-                .setSize(static_cast<uint16_t>(width), static_cast<uint16_t>(height), 1)
-                .setName(image.uri);
+            *decode.outTexture = gpu.createTexture(creation);
+        }
+
+        VOID_ASSERT(decode.outTexture->index != INVALID_TEXTURE.index);
+
+        if (decode.compressed.data)
+        {
+            void_free(decode.compressed.data, &jobAllocator);
+        }
+
+        stbi_image_free(decode.imageData);
+    }
+
+    //Every job has handed its image over by now, this releases them from the barrier so it can be used again.
+    jobScheduler->WaitForJobs(barrier);
+
+    for (uint32_t i = 0; i < decodes.size; ++i)
+    {
+        void_free(decodes[i], allocator);
+    }
+
+    decodes.clear();
+    finished.clear();
+}
+
+cgltf_data* Model::queueImages(const char* modelPath, const GPUDevice& gpu, ImageDecodeQueue& decodeQueue)
+{
+    isModel = true;
+    cgltf_data* cgltfData = setupModel(modelPath);
+
+    //Sized up front, the jobs write the handles straight into it.
+    images.init(allocator, uint32_t(cgltfData->images_count), uint32_t(cgltfData->images_count));
 
-            TextureHandle newTexture = gpu.createTexture(creation);
-            
-            VOID_ASSERT(newTexture.index != INVALID_TEXTURE.index);
+    //Normal maps go to BC5 and occlusion maps that are not shared with a colour slot to BC4, everything else to BC7.
+    Array<TextureUsage> imageUsages;
+    imageUsages.init(allocator, uint32_t(cgltfData->images_count), uint32_t(cgltfData->images_count));
+    Array<bool> imageHasColour;
+    imageHasColour.init(allocator, uint32_t(cgltfData->images_count), uint32_t(cgltfData->images_count));
+    for (uint32_t imageIndex = 0; imageIndex < cgltfData->images_count; ++imageIndex)
+    {
+        imageUsages[imageIndex] = TEXTURE_USAGE_COLOUR;
+        imageHasColour[imageIndex] = false;
+    }
 
-            free(imageData);
+    for (uint32_t materialIndex = 0; materialIndex < cgltfData->materials_count; ++materialIndex)
+    {
+        const cgltf_material& material = cgltfData->materials[materialIndex];
 
-            images.push(newTexture);
+        const cgltf_texture* colourTextures[] = { material.pbr_metallic_roughness.base_color_texture.texture, 
+                                                  material.pbr_metallic_roughness.metallic_roughness_texture.texture, material.emissive_texture.texture };
+        for (uint32_t i = 0; i < ArraySize(colourTextures); ++i)
+        {
+            if (colourTextures[i] != nullptr && colourTextures[i]->image != nullptr)
+            {
+                imageHasColour[uint32_t(cgltf_image_index(cgltfData, colourTextures[i]->image))] = true;
+            }
         }
-        else
+
+        if (material.normal_texture.texture != nullptr && material.normal_texture.texture->image != nullptr)
+        {
+            imageUsages[uint32_t(cgltf_image_index(cgltfData, material.normal_texture.texture->image))] = TEXTURE_USAGE_NORMAL;
+        }
+
+        if (material.occlusion_texture.texture != nullptr && material.occlusion_texture.texture->image != nullptr)
         {
-            int comp = 0;
-            int width = 0;
-            int height = 0;
-            uint8_t mipLevels = 1;
+            imageUsages[uint32_t(cgltf_image_index(cgltfData, material.occlusion_texture.texture->image))] = TEXTURE_USAGE_MASK;
+        }
+    }
 
-            uint8_t* rawBufferData = reinterpret_cast<uint8_t*>(image.buffer_view->buffer->data) + image.buffer_view->offset;
-            stbi_info_from_memory(rawBufferData, int(image.buffer_view->size), &width, &height, &comp);
+    for (uint32_t imageIndex = 0; imageIndex < cgltfData->images_count; ++imageIndex)
+    {
+        const cgltf_image& image = cgltfData->images[imageIndex];
 
-            //TODO: Add mipmap support later.
-            uint32_t w = width;
-            uint32_t h = height;
+        TextureUsage usage = imageUsages[imageIndex];
+        if (imageHasColour[imageIndex] && usage == TEXTURE_USAGE_MASK)
+        {
+            usage = TEXTURE_USAGE_COLOUR;
+        }
 
-            while (w > 1 && h > 1)
-            {
-                w /= 2;
-                h /= 2;
+        //Cooked images live next to the source image, or next to the model for images inside the glb.
+        char cookedPath[MAX_FILE_PATH];
+        if (image.uri != nullptr)
+        {
+            snprintf(cookedPath, MAX_FILE_PATH, "%s", image.uri);
 
-                ++mipLevels;
+            char* extension = strrchr(cookedPath, '.');
+            if (extension == nullptr)
+            {
+                extension = cookedPath + strlen(cookedPath);
             }
+            snprintf(extension, MAX_FILE_PATH - size_t(extension - cookedPath), ".ktx2");
+        }
+        else
+        {
+            snprintf(cookedPath, MAX_FILE_PATH, "%s.image%u.ktx2", modelPath, imageIndex);
+        }
 
-            int x;
-            int y;
-            uint8_t* textureData = stbi_load_from_memory(rawBufferData, int(image.buffer_view->size), &x, &y, &comp, 4);
+        decodeQueue.push(&image, cookedPath, usage, gpu.textureCompressionBCSupported, &images[imageIndex]);
+    }
 
-            TextureCreation textureCreation{};
-            textureCreation.setFormatType(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
-                .setSize(static_cast<uint16_t>(width), static_cast<uint16_t>(height), 1)
-                .setData(textureData)
-                .setFlags(mipLevels, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-                .setName(nullptr);
+    imageUsages.shutdown();
+    imageHasColour.shutdown();
 
-            TextureHandle newTexture = gpu.createTexture(textureCreation);
-            VOID_ASSERT(newTexture.index != INVALID_TEXTURE.index);
+    return cgltfData;
+}
 
-            images.push(newTexture);
+void Model::loadModel(const char* modelPath, cgltf_data* cgltfData, GPUDevice& gpu, GeometryBuffer& geometry)
+{
+    float modelExtent = 0.f;
 
-            stbi_image_free(textureData);
-        }
+#if defined(VOID_TEXTURE_MEMORY_REPORT)
+    Array<uint32_t> imageSizesRGBA;
+    imageSizesRGBA.init(allocator, images.size, images.size);
+    Array<uint32_t> imageSizesResident;
+    imageSizesResident.init(allocator, images.size, images.size);
+
+    for (uint32_t imageIndex = 0; imageIndex < images.size; ++imageIndex)
+    {
+        const Texture* texture = gpu.accessTexture(images[imageIndex]);
+        imageSizesRGBA[imageIndex] = textureChainSize(VK_FORMAT_R8G8B8A8_UNORM, texture->width, texture->height, texture->mipmaps);
+        imageSizesResident[imageIndex] = textureChainSize(texture->vkFormat, texture->width, texture->height, texture->mipmaps);
     }
 
+    logTextureMemory(modelPath, cgltfData, imageSizesRGBA, imageSizesResident);
+
+    imageSizesRGBA.shutdown();
+    imageSizesResident.shutdown();
+#endif //VOID_TEXTURE_MEMORY_REPORT
+
     SamplerCreation samplerCreation{};
     samplerCreation.minFilter = VK_FILTER_LINEAR;
     samplerCreation.magFilter = VK_FILTER_LINEAR;
@@ -273,8 +708,12 @@ void Model::loadModel(const char* modelPath, GPUDevice& gpu, DescriptorSetLayout
         char* samplerName = resourceNameBuffer.appendUseF("Sampler_%u", samplerIndex);
 
         SamplerCreation creation;
-        creation.minFilter = sampler.min_filter == cgltf_filter_type_linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+        creation.minFilter = (sampler.min_filter == cgltf_filter_type_linear || sampler.min_filter == cgltf_filter_type_linear_mipmap_nearest ||
+                              sampler.min_filter == cgltf_filter_type_linear_mipmap_linear) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
         creation.magFilter = sampler.mag_filter == cgltf_filter_type_linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+        //Only an explicit nearest mip mode keeps nearest, textures without a mode blend between their generated levels.
+        creation.mipFilter = (sampler.min_filter == cgltf_filter_type_nearest_mipmap_nearest || sampler.min_filter == cgltf_filter_type_linear_mipmap_nearest) ?
+                              VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
         creation.name = samplerName;
 
         SamplerHandle newSampler = gpu.createSampler(creation);
@@ -307,31 +746,15 @@ void Model::loadModel(const char* modelPath, GPUDevice& gpu, DescriptorSetLayout
                 meshDraw.indexOffset = 0;
                 uint32_t indexCount = uint32_t(meshPrimitive.indices->count);
                 meshDraw.count = indexCount;
-                meshDraw.componentType = meshPrimitive.indices->component_type == cgltf_component_type_r_32u ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+                //Indices are always widened to 32 bit so every mesh can share the geometry index buffer.
+                meshDraw.componentType = VK_INDEX_TYPE_UINT32;
 
                 size_t stackPrimitveMarker = scratchAllocator->getMarker();
 
-                uint32_t indexCompenentSize = (uint32_t)cgltf_component_size(meshPrimitive.indices->component_type);
+                //The LODs are appended after the source indices.
                 Array<uint32_t> indices;
-                indices.init(scratchAllocator, indexCount, indexCount);
-                cgltf_accessor_unpack_indices(meshPrimitive.indices, indices.data, indexCompenentSize, indices.size);
-
-                BufferCreation bufferCreation{};
-                bufferCreation.set(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, uint32_t(indices.size * meshPrimitive.indices->stride))
-                    .setName("indices")
-                    .setData(indices.data);
-                currentIndexBuffer = gpu.createBuffer(bufferCreation);
-
-                meshDraw.indexBuffer = currentIndexBuffer;
-
-                //Here we are adding the scene buffer (that effect every model) into the descriptor set layout.
-                DescriptorSetCreation dsCreation{};
-                bufferCreation.reset()
-                    .set(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(MaterialData))
-                    .setName("material");
-                meshDraw.materialBuffer = gpu.createBuffer(bufferCreation);
-                dsCreation.buffer(meshDraw.materialBuffer, 0)
-                    .setLayout(descriptorSetLayout);
+                indices.init(scratchAllocator, indexCount * MAX_MESH_LODS, indexCount);
+                cgltf_accessor_unpack_indices(meshPrimitive.indices, indices.data, sizeof(uint32_t), indices.size);
 
                 cgltf_material* material = meshPrimitive.material;
                 VOID_ASSERTM(material != nullptr, "The model mesh materials can't be null.\n");
@@ -580,15 +1003,46 @@ void Model::loadModel(const char* modelPath, GPUDevice& gpu, DescriptorSetLayout
                     };
                 }
 
-                bufferCreation.reset()
-                    .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(Vertices) * vertex.size)
-                    .setName("Vertices")
-                    .setData(vertex.data);
-                meshDraw.vertexBuffer = gpu.createBindlessBuffer(bufferCreation);
+#if defined(VOID_OPTIMISE_MESHES)
+                vertexCount = optimiseMesh(indices.data, indexCount, vertex.data, vertexCount, sizeof(Vertices), modelPath, primitiveIndex);
+#endif //VOID_OPTIMISE_MESHES
+
+                meshDraw.lods[0] = MeshLod{ 0, indexCount, 0.f };
+                meshDraw.lodCount = 1;
+                meshDraw.lodIndexCount = indexCount;
+
+                const float meshExtent = meshopt_simplifyScale(vertex[0].position, vertexCount, sizeof(Vertices));
+                modelExtent = max(modelExtent, meshExtent);
+
+#if defined(VOID_GENERATE_LODS)
+                generateLods(meshDraw, indices.data, vertex[0].position, vertexCount, sizeof(Vertices), meshExtent);
+#endif //VOID_GENERATE_LODS
+
+                //The LODs are simplified from the cache ordered indices, so the meshlets are built after them.
+                meshDraw.firstCluster = clusters.size;
+                meshDraw.clusterCount = 0;
+#if defined(VOID_BUILD_MESHLETS)
+                buildMeshlets(meshDraw, clusters, indices.data, vertex[0].position, vertexCount, sizeof(Vertices), scratchAllocator);
+#endif //VOID_BUILD_MESHLETS
+
+                meshDraw.indexBuffer = geometry.indexBuffer;
+                meshDraw.firstIndex = geometry.addIndices(gpu, indices.data, meshDraw.lodIndexCount);
+                for (uint32_t lod = 0; lod < meshDraw.lodCount; ++lod)
+                {
+                    meshDraw.lods[lod].firstIndex += meshDraw.firstIndex;
+                }
+
+                for (uint32_t clusterIndex = meshDraw.firstCluster; clusterIndex < meshDraw.firstCluster + meshDraw.clusterCount; ++clusterIndex)
+                {
+                    clusters[clusterIndex].firstIndex += meshDraw.firstIndex;
+                }
+
+                meshDraw.vertexBuffer = geometry.vertexBuffer;
+                meshDraw.vertexCount = vertexCount;
+                meshDraw.vertexOffset = geometry.addVertices(gpu, vertex.data, vertexCount, sizeof(Vertices));
 
                 scratchAllocator->freeMarker(stackPrimitveMarker);
 
-                meshDraw.descriptorSet = gpu.createDescriptorSet(dsCreation);
                 meshDraws.push(meshDraw);
             }
         }
@@ -598,10 +1052,29 @@ void Model::loadModel(const char* modelPath, GPUDevice& gpu, DescriptorSetLayout
     nodeStack.shutdown();
     nodeMatrix.shutdown();
 
+    //Meshes with a shorter chain keep drawing their last LOD.
+    lodCount = 1;
+    for (uint32_t meshIndex = 0; meshIndex < meshDraws.size; ++meshIndex)
+    {
+        lodCount = max(lodCount, meshDraws[meshIndex].lodCount);
+    }
+
+    const float modelRadius = max(modelExtent * 0.5f, FLT_EPSILON);
+    for (uint32_t lod = 0; lod < lodCount; ++lod)
+    {
+        float error = 0.f;
+        for (uint32_t meshIndex = 0; meshIndex < meshDraws.size; ++meshIndex)
+        {
+            const MeshDraw& meshDraw = meshDraws[meshIndex];
+            error = max(error, meshDraw.lods[min(lod, meshDraw.lodCount - 1)].error);
+        }
+        lodError[lod] = error / modelRadius;
+    }
+
     cgltf_free(cgltfData);
 }
 
-void Model::loadCollider(const char* modelPath, GPUDevice& gpu)
+void Model::loadCollider(const char* modelPath, GPUDevice& gpu, GeometryBuffer& geometry)
 {
     isModel = false;
 
@@ -629,22 +1102,14 @@ void Model::loadCollider(const char* modelPath, GPUDevice& gpu)
                 meshDraw.indexOffset = 0;
                 uint32_t indexCount = uint32_t(meshPrimitive.indices->count);
                 meshDraw.count = indexCount;
-                meshDraw.componentType = meshPrimitive.indices->component_type == cgltf_component_type_r_32u ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+                //Indices are always widened to 32 bit so every mesh can share the geometry index buffer.
+                meshDraw.componentType = VK_INDEX_TYPE_UINT32;
 
                 size_t stackPrimitveMarker = scratchAllocator->getMarker();
 
-                uint32_t indexCompenentSize = (uint32_t)cgltf_component_size(meshPrimitive.indices->component_type);
                 Array<uint32_t> indices;
                 indices.init(scratchAllocator, indexCount, indexCount);
-                cgltf_accessor_unpack_indices(meshPrimitive.indices, indices.data, indexCompenentSize, indices.size);
-
-                BufferCreation bufferCreation{};
-                bufferCreation.set(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, uint32_t(indices.size * meshPrimitive.indices->stride))
-                    .setName("indices")
-                    .setData(indices.data);
-                currentIndexBuffer = gpu.createBuffer(bufferCreation);
-
-                meshDraw.indexBuffer = currentIndexBuffer;
+                cgltf_accessor_unpack_indices(meshPrimitive.indices, indices.data, sizeof(uint32_t), indices.size);
 
                 const cgltf_accessor* positionAccessor = cgltf_find_accessor(&meshPrimitive, cgltf_attribute_type_position, 0);
 
@@ -671,11 +1136,23 @@ void Model::loadCollider(const char* modelPath, GPUDevice& gpu)
                     VOID_ERROR("No position data found in model %s", modelPath);
                 }
 
-                bufferCreation.reset()
-                    .set(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(ColliderVertices) * vertex.size)
-                    .setName("Vertices")
-                    .setData(vertex.data);
-                meshDraw.vertexBuffer = gpu.createBindlessBuffer(bufferCreation);
+#if defined(VOID_OPTIMISE_MESHES)
+                vertexCount = optimiseMesh(indices.data, indexCount, vertex.data, vertexCount, sizeof(ColliderVertices), modelPath, primitiveIndex);
+#endif //VOID_OPTIMISE_MESHES
+
+                meshDraw.indexBuffer = geometry.indexBuffer;
+                meshDraw.firstIndex = geometry.addIndices(gpu, indices.data, indexCount);
+
+                //Colliders are only used for debug drawing so they keep a single LOD and no meshlets.
+                meshDraw.lods[0] = MeshLod{ meshDraw.firstIndex, indexCount, 0.f };
+                meshDraw.lodCount = 1;
+                meshDraw.lodIndexCount = indexCount;
+                meshDraw.firstCluster = 0;
+                meshDraw.clusterCount = 0;
+
+                meshDraw.vertexBuffer = geometry.vertexBuffer;
+                meshDraw.vertexCount = vertexCount;
+                meshDraw.vertexOffset = geometry.addVertices(gpu, vertex.data, vertexCount, sizeof(ColliderVertices));
 
                 scratchAllocator->freeMarker(stackPrimitveMarker);
 
@@ -688,24 +1165,23 @@ void Model::loadCollider(const char* modelPath, GPUDevice& gpu)
     nodeStack.shutdown();
     nodeMatrix.shutdown();
 
+    lodCount = 1;
+    lodError[0] = 0.f;
+
     cgltf_free(cgltfData);
 }
 
-void Model::shutdownModel(GPUDevice& gpu)
+void Model::shutdownModel(GPUDevice& gpu, GeometryBuffer& geometry)
 {
     for (uint32_t meshIndex = 0; meshIndex < meshDraws.size; ++meshIndex)
     {
         MeshDraw& meshDraw = meshDraws[meshIndex];
-        if (isModel)
-        {
-            gpu.destroyDescriptorSet(meshDraw.descriptorSet);
-            gpu.destroyBuffer(meshDraw.materialBuffer);
-        }
-        gpu.destroyBuffer(meshDraw.vertexBuffer);
-        gpu.destroyBuffer(meshDraw.indexBuffer);
+        geometry.removeVertices(meshDraw.vertexOffset, meshDraw.vertexCount, isModel ? sizeof(Vertices) : sizeof(ColliderVertices));
+        geometry.removeIndices(meshDraw.firstIndex, meshDraw.lodIndexCount);
     }
 
     meshDraws.shutdown();
+    clusters.shutdown();
 
     if (isModel)
     {
@@ -2,8 +2,13 @@
 #define LOAD_GLTF_HDR
 
 #include "Foundation/Array.hpp"
+#include "Foundation/JobScheduler.hpp"
 
 #include "GPUDevice.hpp"
+#include "GeometryBuffer.hpp"
+#include "ShaderData.hpp"
+#include "TextureCompression.hpp"
+#include "TextureStreamer.hpp"
 
 #include "cglm/struct/mat3.h"
 #include "cglm/struct/mat4.h"
@@ -12,6 +17,27 @@
 
 #include <cgltf.h>
 
+#include <condition_variable>
+#include <mutex>
+
+//Define this to reorder the indices and vertices of every primitive with meshoptimizer when a model is loaded.
+#define VOID_OPTIMISE_MESHES
+
+//Define this to log the ACMR/ATVR, overdraw and overfetch of every primitive before and after optimisation.
+//#define VOID_MESH_STATISTICS
+
+//Define this to log the texture memory of every material as RGBA8 with mips and as it is resident after block compression.
+//#define VOID_TEXTURE_MEMORY_REPORT
+
+//Define this to build a chain of simplified LODs for every model primitive when it is loaded.
+#define VOID_GENERATE_LODS
+
+//The most LODs a primitive can have, LOD 0 is the source mesh.
+static constexpr uint32_t MAX_MESH_LODS = 4;
+
+//Define this to split LOD 0 of every model primitive into meshlets that are culled per instance before drawing.
+#define VOID_BUILD_MESHLETS
+
 struct Vertices
 {
     float position[3];
@@ -25,6 +51,14 @@ struct ColliderVertices
     float position[3];
 };
 
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    //Object space error of the simplification, it never shrinks from one LOD to the next.
+    float error;
+};
+
 struct MeshDraw
 {
     mat4s model;
@@ -40,19 +74,33 @@ struct MeshDraw
 
     BufferHandle vertexBuffer;
     BufferHandle indexBuffer;
-    BufferHandle materialBuffer;
 
     uint32_t indexOffset;
 
     uint32_t count;
     uint32_t flags;
 
-    VkIndexType indexType;
+    //Range of the mesh in the shared geometry buffer.
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
 
-    DescriptorSetHandle descriptorSet;
+    //Every LOD shares the vertices of the mesh, their indices are stored back to back from firstIndex.
+    MeshLod lods[MAX_MESH_LODS];
+    uint32_t lodCount;
+    uint32_t lodIndexCount;
+
+    //Meshlets of LOD 0 in Model::clusters, LOD 0 indices are stored in meshlet order so each cluster is one index range.
+    uint32_t firstCluster;
+    uint32_t clusterCount;
+
+    VkIndexType indexType;
 
     VkIndexType componentType;
 
+    //Index into the scene's bindless material buffer.
+    uint32_t materialIndex;
+
     //Indices used for bindless textures.
     uint16_t diffuseTextureIndex;
     uint16_t roughnessTextureIndex;
@@ -77,21 +125,64 @@ struct MaterialData
 
     vec3s specularValue;
     uint32_t flags;
+    //Keeps the stride the same as the scalar layout in the shaders.
+    uint32_t padd[2];
 };
 
 struct cgltf_data;
 
+//One image being decoded, defined in LoadGLTF.cpp.
+struct ImageDecode;
+
+//Decodes, mips and cooks model images as low priority jobs while the main thread uploads each one as soon as it is done.
+//The images of several models can be queued before any of them is uploaded so they all decode at the same time.
+struct ImageDecodeQueue
+{
+    //Block compressed images are handed to the streamer when there is one, the rest are created fully resident.
+    void init(Allocator* inAllocator, JobScheduler* inJobScheduler, TextureStreamer* inStreamer);
+    void shutdown();
+
+    //The job starts straight away. The cgltf data of the image has to stay loaded until uploadAll returns.
+    void push(const cgltf_image* image, const char* cookedPath, TextureUsage usage, bool blockCompression, TextureHandle* outTexture);
+    //Creates a texture for every queued image in the order they finish decoding and returns once they have all been uploaded.
+    void uploadAll(GPUDevice& gpu);
+
+    Array<ImageDecode*> decodes;
+    //Indices into decodes in the order the jobs finished. Its capacity always covers every decode so a job never grows it.
+    Array<uint32_t> finished;
+
+    std::mutex finishedMutex;
+    std::condition_variable finishedCondition;
+
+    JobScheduler* jobScheduler = nullptr;
+    JPH::JobSystem::Barrier* barrier = nullptr;
+
+    TextureStreamer* streamer = nullptr;
+
+    Allocator* allocator = nullptr;
+    //The heap allocator is not thread safe, everything a job allocates comes from here.
+    MallocAllocator jobAllocator;
+};
+
 struct Model
 {
     cgltf_data* setupModel(const char* modelPath);
-    void loadModel(const char* modelPath, GPUDevice& gpu, DescriptorSetLayoutHandle descriptorSetLayout);
-    void loadCollider(const char* modelPath, GPUDevice& gpu);
-    void shutdownModel(GPUDevice& gpu);
+    //First half of loading a model, parses it and queues a decode for every image. The images are valid once the queue has uploaded them.
+    cgltf_data* queueImages(const char* modelPath, const GPUDevice& gpu, ImageDecodeQueue& decodeQueue);
+    //Second half, needs the images uploaded. Creates the samplers, uploads the meshes and frees the cgltf data.
+    void loadModel(const char* modelPath, cgltf_data* cgltfData, GPUDevice& gpu, GeometryBuffer& geometry);
+    void loadCollider(const char* modelPath, GPUDevice& gpu, GeometryBuffer& geometry);
+    void shutdownModel(GPUDevice& gpu, GeometryBuffer& geometry);
 
     Array<MeshDraw> meshDraws;
+    Array<MeshCluster> clusters;
 
     mat4s finalMatrix;
 
+    //Largest LOD error of any mesh, relative to the model radius so it can be scaled by the bounding radius of an instance.
+    float lodError[MAX_MESH_LODS];
+    uint32_t lodCount;
+
     Array<SamplerHandle> samplers;
     Array<TextureHandle> images;
 
@@ -104,8 +195,6 @@ struct Model
     HeapAllocator* allocator;
     StackAllocator* scratchAllocator;
 
-    BufferHandle currentIndexBuffer = INVALID_BUFFER;
-
     SamplerHandle dummySampler;
     //This value tracks how many of the same model we have. This is to support instance rendering. 
     uint32_t instanceCount;
@@ -3,6 +3,9 @@
 
 #include "cglm/struct/mat4.h"
 #include "cglm/struct/vec4.h"
+#include "cglm/struct/vec3.h"
+
+#include <stdint.h>
 
 #include <vulkan/vulkan_core.h>
 
@@ -13,26 +16,239 @@ struct UniformData
     mat4s globalModel;
     vec4s eye;
     vec4s light;
+
+    //Clustered lights written by lightCulling.comp, the slice of a view depth d is log(d) * lightSliceScale + lightSliceBias.
+    VkDeviceAddress lightAddress;
+    VkDeviceAddress lightGridAddress;
+    VkDeviceAddress lightIndexAddress;
+    float lightSliceScale;
+    float lightSliceBias;
 };
 
 //Here we are going to attempt full bindless for the debug renderer to make this as painless as possible in the future.
+//Mirrors ModelPosition in instanceData.h, uploaded every frame so it is kept as small as the shaders allow.
 struct EntityData
 {
-    mat4s position;
-    //We need this because the final matrix that comes out the glb after multiplying 
-    //all local nodes together needs to be the same as the collision geometry.
-    //Meaning that model matrix we get out of the actual geometry needs to be given to the debug geometry if they tied together when creating the buffer.
-    mat4s debugModel;
-    //Colour will be used as a key for various different objects.
-    vec4s colour;
-    float padd[4];
+    //Rows of the 3x4 affine transform, the translation is in w. Set with packEntityTransform.
+    vec4s rows[3];
+    //Colour will be used as a key for various different objects, RGBA8 unorm from packColour.
+    uint32_t colour;
+    //The debug geometry is a unit shape, this scales it up to the collision shape.
+    float debugScale;
 };
 
+static_assert(sizeof(EntityData) == 56, "EntityData has to match ModelPosition in instanceData.h.");
+
+inline void packEntityTransform(EntityData& entity, const mat4s& transform)
+{
+    for (uint32_t row = 0; row < 3; ++row)
+    {
+        entity.rows[row] = { transform.raw[0][row], transform.raw[1][row], transform.raw[2][row], transform.raw[3][row] };
+    }
+}
+
+inline mat4s unpackEntityTransform(const EntityData& entity)
+{
+    mat4s transform = glms_mat4_identity();
+    for (uint32_t row = 0; row < 3; ++row)
+    {
+        transform.raw[0][row] = entity.rows[row].x;
+        transform.raw[1][row] = entity.rows[row].y;
+        transform.raw[2][row] = entity.rows[row].z;
+        transform.raw[3][row] = entity.rows[row].w;
+    }
+
+    return transform;
+}
+
+inline vec3s entityTranslation(const EntityData& entity)
+{
+    return { entity.rows[0].w, entity.rows[1].w, entity.rows[2].w };
+}
+
+//Red in the lowest byte to match unpackUnorm4x8.
+inline uint32_t packColour(vec4s colour)
+{
+    uint32_t packed = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        packed |= uint32_t(glm_clamp(colour.raw[i], 0.f, 1.f) * 255.f + 0.5f) << (i * 8);
+    }
+
+    return packed;
+}
+
 struct PushConstants
 {
     VkDeviceAddress vertexDataAddress;
     VkDeviceAddress modelPositionAddress;
     VkDeviceAddress sceneAddress;
+    //Compacted visible instance indices written by the culler, gl_InstanceIndex indexes into this.
+    VkDeviceAddress visibleIndexAddress;
+    VkDeviceAddress materialAddress;
+    //The vertex shader reads the material of each draw from the command at gl_DrawID.
+    VkDeviceAddress drawCommandAddress;
+};
+
+//Mirrors the push constants of instanceCulling.comp and drawCommands.comp.
+struct CullingPushConstants
+{
+    VkDeviceAddress planeAddress;
+    VkDeviceAddress modelPositionAddress;
+    VkDeviceAddress instanceAddress;
+    VkDeviceAddress bucketAddress;
+    VkDeviceAddress countAddress;
+    VkDeviceAddress visibleIndexAddress;
+    VkDeviceAddress drawAddress;
+    VkDeviceAddress drawCommandAddress;
+    vec3s eye;
+    float lodScale;
+    uint32_t instanceCount;
+    uint32_t bucketCount;
+    uint32_t meshDrawCount;
+    uint32_t drawCount;
+    //Per instance visibility left by the last late phase, and the depth pyramid data of the late phase.
+    VkDeviceAddress visibilityAddress;
+    VkDeviceAddress occlusionAddress;
+    uint32_t phase;
+};
+
+//Each pyramid level halves the one above it, 16 levels cover a 32K swapchain.
+static constexpr uint32_t DEPTH_PYRAMID_MAX_LEVELS = 16;
+
+//Mirrors CullingOcclusion in instanceCulling.comp, the late culling phase tests the instance spheres against the depth pyramid.
+struct CullingOcclusion
+{
+    mat4s view;
+    VkDeviceAddress pyramidAddress;
+    float projectionX;
+    float projectionY;
+    float nearPlane;
+    //The reverse-Z depth of a view depth d is depthScale / d - depthBias.
+    float depthScale;
+    float depthBias;
+    //Scale of the global model, the instance radii are in entity space.
+    float radiusScale;
+    uint32_t pyramidWidth;
+    uint32_t pyramidHeight;
+    uint32_t levelCount;
+    uint32_t levelOffsets[DEPTH_PYRAMID_MAX_LEVELS];
+};
+
+//Mirrors the push constants of depthPyramid.comp, one dispatch per level.
+struct DepthPyramidPushConstants
+{
+    VkDeviceAddress pyramidAddress;
+    uint32_t sourceOffset;
+    uint32_t destinationOffset;
+    uint32_t sourceWidth;
+    uint32_t sourceHeight;
+    uint32_t destinationWidth;
+    uint32_t destinationHeight;
+    //Level 0 reads the depth texture through the bindless array instead of the level above.
+    uint32_t depthTexture;
+    uint32_t level;
+};
+
+//Static per entity data used by the GPU culler.
+struct CullingInstance
+{
+    //The LOD 0 bucket of the model, the LOD buckets follow it.
+    uint32_t firstBucket;
+    uint32_t lodCount;
+    float radius;
+};
+
+//Static per bucket data, one bucket per model LOD.
+struct CullingBucket
+{
+    uint32_t visibleFirst;
+    float lodError;
+};
+
+struct CullingDraw
+{
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t bucketIndex;
+    uint32_t materialIndex;
+};
+
+//Indirect command followed by the material of the draw.
+struct DrawCommand
+{
+    VkDrawIndexedIndirectCommand command;
+    uint32_t materialIndex;
+};
+
+//Bounds of a meshlet in model space, the normal cone rejects clusters that face away from the camera.
+struct MeshCluster
+{
+    vec3s centre;
+    float radius;
+    vec3s coneApex;
+    float coneCutoff;
+    vec3s coneAxis;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+//Up to CLUSTER_CHUNK_SIZE clusters of one mesh, clusterCulling.comp runs one workgroup per chunk and visible LOD 0 instance.
+struct ClusterChunk
+{
+    uint32_t firstCluster;
+    uint32_t clusterCount;
+    uint32_t bucketIndex;
+    int32_t vertexOffset;
+    uint32_t materialIndex;
+};
+
+//Mirrors the push constants of clusterCulling.comp.
+struct ClusterCullingPushConstants
+{
+    VkDeviceAddress planeAddress;
+    VkDeviceAddress modelPositionAddress;
+    VkDeviceAddress clusterAddress;
+    VkDeviceAddress chunkAddress;
+    VkDeviceAddress bucketAddress;
+    VkDeviceAddress bucketCountAddress;
+    VkDeviceAddress visibleIndexAddress;
+    VkDeviceAddress sourceIndexAddress;
+    VkDeviceAddress clusterIndexAddress;
+    VkDeviceAddress countAddress;
+    VkDeviceAddress drawCommandAddress;
+    vec3s eye;
+    uint32_t indexCapacity;
+};
+
+//Point or spot light in the same space as the scene, after the global model.
+struct GPULight
+{
+    vec3s position;
+    float radius;
+    vec3s colour;
+    float intensity;
+    //The cone attenuation is clamp(dot(-direction, L) * spotScale + spotOffset), points use a scale of 0 and an offset of 1.
+    vec3s direction;
+    float spotScale;
+    float spotOffset;
+};
+
+//Mirrors the push constants of lightCulling.comp.
+struct LightCullingPushConstants
+{
+    //View matrix followed by the projection scale, froxel bounds are built in view space.
+    mat4s view;
+    VkDeviceAddress lightAddress;
+    VkDeviceAddress lightGridAddress;
+    VkDeviceAddress lightIndexAddress;
+    float projectionX;
+    float projectionY;
+    float gridNear;
+    float gridFar;
+    float viewFar;
+    uint32_t lightCount;
 };
 
 #endif // !SHADER_DATA_HDR
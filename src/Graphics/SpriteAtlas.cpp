@@ -0,0 +1,330 @@
+#include "SpriteAtlas.hpp"
+
+#include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
+
+#include "vender/stb_image.h"
+
+#include <string.h>
+
+namespace
+{
+    struct SourceImage
+    {
+        const char* path;
+        uint8_t* data;
+        int width;
+        int height;
+    };
+
+    //Where a sprite comes from and where it was packed, in texels from the top left.
+    struct SpritePlacement
+    {
+        uint32_t image;
+        uint16_t sourceX;
+        uint16_t sourceY;
+        uint16_t width;
+        uint16_t height;
+        uint16_t pageX;
+        uint16_t pageY;
+        uint32_t page;
+    };
+}
+
+void SkylinePacker::init(Allocator* allocator, uint16_t inWidth, uint16_t inHeight)
+{
+    width = inWidth;
+    height = inHeight;
+
+    skyline.init(allocator, 16);
+    skyline.push(SkylineNode{ 0, 0, width });
+}
+
+void SkylinePacker::shutdown()
+{
+    skyline.shutdown();
+}
+
+uint16_t SkylinePacker::fit(uint32_t nodeIndex, uint16_t rectWidth, uint16_t rectHeight) const
+{
+    if (skyline[nodeIndex].x + rectWidth > width)
+    {
+        return UINT16_MAX;
+    }
+
+    //The rectangle rests on the highest segment it spans.
+    uint16_t y = 0;
+    int32_t widthLeft = rectWidth;
+    for (uint32_t i = nodeIndex; widthLeft > 0; ++i)
+    {
+        y = max(y, skyline[i].y);
+        widthLeft -= skyline[i].width;
+    }
+
+    return y + rectHeight <= height ? y : UINT16_MAX;
+}
+
+bool SkylinePacker::pack(uint16_t rectWidth, uint16_t rectHeight, uint16_t& outX, uint16_t& outY)
+{
+    uint32_t bestIndex = UINT32_MAX;
+    uint32_t bestTop = UINT32_MAX;
+    uint32_t bestWidth = UINT32_MAX;
+    for (uint32_t i = 0; i < skyline.size; ++i)
+    {
+        const uint16_t y = fit(i, rectWidth, rectHeight);
+        if (y == UINT16_MAX)
+        {
+            continue;
+        }
+
+        //Lowest top edge wins, ties go to the narrowest segment to leave the wide ones free.
+        const uint32_t top = y + rectHeight;
+        if (top < bestTop || (top == bestTop && skyline[i].width < bestWidth))
+        {
+            bestIndex = i;
+            bestTop = top;
+            bestWidth = skyline[i].width;
+            outX = skyline[i].x;
+            outY = y;
+        }
+    }
+
+    if (bestIndex == UINT32_MAX)
+    {
+        return false;
+    }
+
+    //The new segment replaces the start of the ones it covers.
+    skyline.push(SkylineNode{});
+    for (uint32_t i = skyline.size - 1; i > bestIndex; --i)
+    {
+        skyline[i] = skyline[i - 1];
+    }
+    skyline[bestIndex] = SkylineNode{ outX, uint16_t(bestTop), rectWidth };
+
+    for (uint32_t i = bestIndex + 1; i < skyline.size;)
+    {
+        const uint16_t coveredEnd = skyline[i - 1].x + skyline[i - 1].width;
+        if (skyline[i].x >= coveredEnd)
+        {
+            break;
+        }
+
+        const uint16_t shrink = coveredEnd - skyline[i].x;
+        if (shrink < skyline[i].width)
+        {
+            skyline[i].x += shrink;
+            skyline[i].width -= shrink;
+            break;
+        }
+
+        skyline.erase(i);
+    }
+
+    //Neighbours at the same height become one segment.
+    for (uint32_t i = 0; i + 1 < skyline.size;)
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(i + 1);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    return true;
+}
+
+void SpriteAtlas::init(GPUDevice& gpu)
+{
+    Allocator* allocator = &MemoryService::instance()->systemAllocator;
+
+    SourceImage images[SPRITE_COUNT]{};
+    uint32_t imageCount = 0;
+
+    SpritePlacement placements[SPRITE_COUNT]{};
+    uint32_t order[SPRITE_COUNT];
+    uint32_t placedCount = 0;
+
+    for (uint32_t i = 0; i < SPRITE_COUNT; ++i)
+    {
+        const SpriteSource& source = sSpriteSources[i];
+
+        //Sprites that fail to load are drawn untextured.
+        sprites[i].textureID = UINT16_MAX;
+
+        uint32_t image = 0;
+        while (image < imageCount && strcmp(images[image].path, source.path) != 0)
+        {
+            ++image;
+        }
+
+        if (image == imageCount)
+        {
+            int comp;
+            stbi_set_flip_vertically_on_load(0);
+            images[image].path = source.path;
+            images[image].data = stbi_load(source.path, &images[image].width, &images[image].height, &comp, 4);
+            ++imageCount;
+
+            if (images[image].data == nullptr)
+            {
+                VOID_ERROR("Error loading sprite image %s", source.path);
+            }
+        }
+
+        if (images[image].data == nullptr)
+        {
+            continue;
+        }
+
+        const uint16_t imageWidth = uint16_t(images[image].width);
+        const uint16_t imageHeight = uint16_t(images[image].height);
+        const uint16_t spriteWidth = source.width != 0 ? source.width : imageWidth - source.x;
+        const uint16_t spriteHeight = source.height != 0 ? source.height : imageHeight - source.y;
+
+        if (source.x + spriteWidth > imageWidth || source.y + spriteHeight > imageHeight)
+        {
+            VOID_ERROR("Sprite %s is outside of %s.", source.name, source.path);
+            continue;
+        }
+
+        placements[i] = SpritePlacement{ image, source.x, uint16_t(imageHeight - source.y - spriteHeight), spriteWidth, spriteHeight };
+        sprites[i].size = vec2s{ (float)spriteWidth, (float)spriteHeight };
+
+        //Tallest first packs tightest on a skyline.
+        uint32_t slot = placedCount++;
+        while (slot > 0 && placements[order[slot - 1]].height < spriteHeight)
+        {
+            order[slot] = order[slot - 1];
+            --slot;
+        }
+        order[slot] = i;
+    }
+
+    SkylinePacker packers[SPRITE_ATLAS_MAX_PAGES];
+    uint16_t pageWidths[SPRITE_ATLAS_MAX_PAGES]{};
+    uint16_t pageHeights[SPRITE_ATLAS_MAX_PAGES]{};
+    pageCount = 0;
+
+    for (uint32_t i = 0; i < placedCount; ++i)
+    {
+        SpritePlacement& placement = placements[order[i]];
+        const uint16_t paddedWidth = placement.width + SPRITE_ATLAS_PADDING * 2;
+        const uint16_t paddedHeight = placement.height + SPRITE_ATLAS_PADDING * 2;
+
+        VOID_ASSERTM(paddedWidth <= SPRITE_ATLAS_PAGE_SIZE && paddedHeight <= SPRITE_ATLAS_PAGE_SIZE, "Sprite %s is larger than an atlas page.", sSpriteSources[order[i]].name);
+
+        //Earlier pages are tried first so small sprites fill the gaps left by big ones.
+        uint32_t page = 0;
+        uint16_t x = 0;
+        uint16_t y = 0;
+        while (page < pageCount && packers[page].pack(paddedWidth, paddedHeight, x, y) == false)
+        {
+            ++page;
+        }
+
+        if (page == pageCount)
+        {
+            VOID_ASSERTM(pageCount < SPRITE_ATLAS_MAX_PAGES, "The sprites need more than %u atlas pages.", SPRITE_ATLAS_MAX_PAGES);
+
+            packers[pageCount++].init(allocator, SPRITE_ATLAS_PAGE_SIZE, SPRITE_ATLAS_PAGE_SIZE);
+            packers[page].pack(paddedWidth, paddedHeight, x, y);
+        }
+
+        placement.page = page;
+        placement.pageX = x + SPRITE_ATLAS_PADDING;
+        placement.pageY = y + SPRITE_ATLAS_PADDING;
+
+        pageWidths[page] = max(pageWidths[page], uint16_t(x + paddedWidth));
+        pageHeights[page] = max(pageHeights[page], uint16_t(y + paddedHeight));
+    }
+
+    for (uint32_t page = 0; page < pageCount; ++page)
+    {
+        packers[page].shutdown();
+
+        const uint32_t pageWidth = pageWidths[page];
+        const uint32_t pageHeight = pageHeights[page];
+
+        uint8_t* pixels = void_allocam(pageWidth * pageHeight * 4, allocator);
+        memset(pixels, 0, pageWidth * pageHeight * 4);
+
+        for (uint32_t i = 0; i < placedCount; ++i)
+        {
+            const SpritePlacement& placement = placements[order[i]];
+            if (placement.page != page)
+            {
+                continue;
+            }
+
+            const SourceImage& image = images[placement.image];
+            for (uint32_t row = 0; row < placement.height; ++row)
+            {
+                memcpy(pixels + ((placement.pageY + row) * pageWidth + placement.pageX) * 4,
+                       image.data + ((placement.sourceY + row) * image.width + placement.sourceX) * 4,
+                       placement.width * 4);
+            }
+        }
+
+        TextureCreation creation;
+        creation.setData(pixels)
+            .setFormatType(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
+            .setFlags(1, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+            .setSize(uint16_t(pageWidth), uint16_t(pageHeight), 1)
+            .setName("spriteAtlas");
+        pages[page] = gpu.createTexture(creation);
+
+        void_free(pixels, allocator);
+    }
+
+    for (uint32_t i = 0; i < placedCount; ++i)
+    {
+        const SpritePlacement& placement = placements[order[i]];
+        const float pageWidth = pageWidths[placement.page];
+        const float pageHeight = pageHeights[placement.page];
+
+        Sprite& sprite = sprites[order[i]];
+        sprite.textureID = pages[placement.page].index;
+        sprite.uvRect = vec4s{ placement.pageX / pageWidth, placement.pageY / pageHeight,
+                               (placement.pageX + placement.width) / pageWidth, (placement.pageY + placement.height) / pageHeight };
+    }
+
+    for (uint32_t i = 0; i < imageCount; ++i)
+    {
+        free(images[i].data);
+    }
+}
+
+void SpriteAtlas::shutdown(GPUDevice& gpu)
+{
+    for (uint32_t i = 0; i < pageCount; ++i)
+    {
+        gpu.destroyTexture(pages[i]);
+    }
+
+    pageCount = 0;
+}
+
+const Sprite& SpriteAtlas::getSprite(SpriteID sprite) const
+{
+    VOID_ASSERTM(sprite < SPRITE_COUNT, "Sprite %u does not exist.", sprite);
+
+    return sprites[sprite];
+}
+
+SpriteID SpriteAtlas::findSprite(const char* name) const
+{
+    for (uint32_t i = 0; i < SPRITE_COUNT; ++i)
+    {
+        if (strcmp(sSpriteSources[i].name, name) == 0)
+        {
+            return SpriteID(i);
+        }
+    }
+
+    return SPRITE_COUNT;
+}
@@ -0,0 +1,101 @@
+#ifndef SPRITE_ATLAS_HDR
+#define SPRITE_ATLAS_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Array.hpp"
+
+#include "GPUDevice.hpp"
+
+#include "cglm/struct/vec2.h"
+#include "cglm/struct/vec4.h"
+
+//Atlas pages are packed up to this size and then trimmed to what they use.
+static constexpr uint16_t SPRITE_ATLAS_PAGE_SIZE = 2048;
+static constexpr uint32_t SPRITE_ATLAS_MAX_PAGES = 4;
+//Empty texels around every sprite so linear filtering never reads a neighbour.
+static constexpr uint16_t SPRITE_ATLAS_PADDING = 1;
+
+enum SpriteID : uint16_t
+{
+    SPRITE_MENU_TITLE,
+    SPRITE_START_BUTTON,
+    SPRITE_EXIT_BUTTON,
+
+    SPRITE_COUNT
+};
+
+//Part of an image file that becomes one sprite. y is measured up from the bottom of the image like the rows of the old hand written atlas,
+//a width or height of 0 reaches the edge of the image.
+struct SpriteSource
+{
+    const char* name;
+    const char* path;
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+//Indexed by SpriteID, a file used by several sprites is only loaded once.
+static constexpr SpriteSource sSpriteSources[SPRITE_COUNT] =
+{
+    { "menuTitle",      "Assets/Textures/mainMenuUI.png", 0, 384, 0, 128 },
+    { "startButton",    "Assets/Textures/mainMenuUI.png", 0, 256, 0, 128 },
+    { "exitButton",     "Assets/Textures/mainMenuUI.png", 0, 128, 0, 128 },
+};
+
+struct Sprite
+{
+    //(u, v) of the top left corner followed by the bottom right, the same order Renderer2D::addQuad takes.
+    vec4s uvRect;
+    //Size in texels before packing.
+    vec2s size;
+    //Bindless index of the page the sprite is on.
+    uint32_t textureID;
+};
+
+struct SkylineNode
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+};
+
+//Bottom left skyline packer, the top edge of everything placed so far is kept as a list of horizontal segments
+//and a rectangle goes where its top would end up lowest.
+struct SkylinePacker
+{
+    void init(Allocator* allocator, uint16_t inWidth, uint16_t inHeight);
+    void shutdown();
+
+    //Returns false when the rectangle does not fit.
+    bool pack(uint16_t rectWidth, uint16_t rectHeight, uint16_t& outX, uint16_t& outY);
+
+    //Helpers
+    //Lowest y a rectangle starting at the node can sit at, UINT16_MAX when it runs off the page.
+    uint16_t fit(uint32_t nodeIndex, uint16_t rectWidth, uint16_t rectHeight) const;
+
+    Array<SkylineNode> skyline;
+
+    uint16_t width = 0;
+    uint16_t height = 0;
+};
+
+//Packs every sprite in sSpriteSources into as few textures as possible at load. The 2D renderer and the GUI refer to sprites by ID,
+//and everything on one page shares a texture.
+struct SpriteAtlas
+{
+    void init(GPUDevice& gpu);
+    void shutdown(GPUDevice& gpu);
+
+    const Sprite& getSprite(SpriteID sprite) const;
+    //Name to sprite lookup for data driven UI, returns SPRITE_COUNT when there is no sprite with the name.
+    SpriteID findSprite(const char* name) const;
+
+    Sprite sprites[SPRITE_COUNT]{};
+
+    TextureHandle pages[SPRITE_ATLAS_MAX_PAGES];
+    uint32_t pageCount = 0;
+};
+
+#endif // !SPRITE_ATLAS_HDR
@@ -0,0 +1,584 @@
+#include "TextureCompression.hpp"
+#include "GPUResources.hpp"
+
+#include "Foundation/Memory.hpp"
+#include "Foundation/File.hpp"
+#include "Foundation/Numerics.hpp"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+    static constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    struct KTX2Header
+    {
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+    static_assert(sizeof(KTX2Header) == 80, "The KTX2 header is 80 bytes.");
+
+    struct KTX2Level
+    {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    //Data format descriptor values from the Khronos data format specification.
+    static constexpr uint32_t KHR_DF_MODEL_BC1A = 128;
+    static constexpr uint32_t KHR_DF_MODEL_BC4 = 131;
+    static constexpr uint32_t KHR_DF_MODEL_BC5 = 132;
+    static constexpr uint32_t KHR_DF_MODEL_BC7 = 134;
+    static constexpr uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+    static constexpr uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+    static constexpr uint32_t KHR_DF_VERSION = 2;
+
+    //BC7 mode 6 interpolates 16 colours between the endpoints with these weights out of 64.
+    static constexpr uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct BitWriter
+    {
+        void write(uint32_t value, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; ++i, ++bit)
+            {
+                data[bit >> 3] |= uint8_t(((value >> i) & 1) << (bit & 7));
+            }
+        }
+
+        uint8_t* data;
+        uint32_t bit = 0;
+    };
+
+    uint32_t levelCountForSize(uint32_t width, uint32_t height)
+    {
+        uint32_t levels = 1;
+        while ((width > 1 || height > 1) && levels < COMPRESSED_IMAGE_MAX_LEVELS)
+        {
+            width = max(width / 2, 1u);
+            height = max(height / 2, 1u);
+            ++levels;
+        }
+
+        return levels;
+    }
+
+    //2x2 box filter, the last row or column of an odd size is folded into its neighbour. Normals are renormalised after averaging.
+    void downsample(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint8_t* destination, TextureUsage usage)
+    {
+        const uint32_t width = max(sourceWidth / 2, 1u);
+        const uint32_t height = max(sourceHeight / 2, 1u);
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const uint32_t x0 = min(x * 2, sourceWidth - 1);
+                const uint32_t x1 = min(x * 2 + 1, sourceWidth - 1);
+                const uint32_t y0 = min(y * 2, sourceHeight - 1);
+                const uint32_t y1 = min(y * 2 + 1, sourceHeight - 1);
+
+                float sum[4];
+                for (uint32_t channel = 0; channel < 4; ++channel)
+                {
+                    sum[channel] = (float(source[(y0 * sourceWidth + x0) * 4 + channel]) + float(source[(y0 * sourceWidth + x1) * 4 + channel]) +
+                                    float(source[(y1 * sourceWidth + x0) * 4 + channel]) + float(source[(y1 * sourceWidth + x1) * 4 + channel])) * 0.25f;
+                }
+
+                if (usage == TEXTURE_USAGE_NORMAL)
+                {
+                    float normal[3] = { sum[0] / 127.5f - 1.f, sum[1] / 127.5f - 1.f, sum[2] / 127.5f - 1.f };
+                    const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                    for (uint32_t channel = 0; channel < 3 && length > 0.f; ++channel)
+                    {
+                        sum[channel] = (normal[channel] / length + 1.f) * 127.5f;
+                    }
+                }
+
+                for (uint32_t channel = 0; channel < 4; ++channel)
+                {
+                    destination[(y * width + x) * 4 + channel] = uint8_t(min(sum[channel] + 0.5f, 255.f));
+                }
+            }
+        }
+    }
+
+    //Two endpoints and 3 bit indices, the 8 value mode is used whenever the block is not flat.
+    void encodeBC4Block(const uint8_t values[16], uint8_t* output)
+    {
+        uint8_t high = values[0];
+        uint8_t low = values[0];
+        for (uint32_t i = 1; i < 16; ++i)
+        {
+            high = max(high, values[i]);
+            low = min(low, values[i]);
+        }
+
+        uint32_t palette[8] = { high, low };
+        for (uint32_t i = 2; i < 8; ++i)
+        {
+            palette[i] = ((8 - i) * high + (i - 1) * low + 3) / 7;
+        }
+
+        memset(output, 0, 8);
+        output[0] = high;
+        output[1] = low;
+
+        BitWriter writer{ output, 16 };
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t bestIndex = 0;
+            uint32_t bestError = UINT32_MAX;
+            for (uint32_t index = 0; index < 8 && high != low; ++index)
+            {
+                const int32_t difference = int32_t(palette[index]) - int32_t(values[i]);
+                const uint32_t error = uint32_t(difference * difference);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestIndex = index;
+                }
+            }
+
+            writer.write(bestIndex, 3);
+        }
+    }
+
+    //Quantises an endpoint to 7 bits a channel and picks the shared p bit that gets closest.
+    void quantiseBC7Endpoint(const float endpoint[4], uint32_t quantised[4], uint32_t& pBit)
+    {
+        float bestError = FLT_MAX;
+        for (uint32_t p = 0; p < 2; ++p)
+        {
+            uint32_t candidate[4];
+            float error = 0.f;
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                candidate[channel] = uint32_t(min(max((endpoint[channel] - float(p)) * 0.5f + 0.5f, 0.f), 127.f));
+                const float difference = float((candidate[channel] << 1) | p) - endpoint[channel];
+                error += difference * difference;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                pBit = p;
+                memcpy(quantised, candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    //Mode 6, one subset with RGBA endpoints along the principal axis of the block and 4 bit indices.
+    void encodeBC7Block(const uint8_t pixels[16][4], uint8_t* output)
+    {
+        float mean[4]{};
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                mean[channel] += pixels[i][channel] / 16.f;
+            }
+        }
+
+        float covariance[4][4]{};
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                for (uint32_t column = 0; column < 4; ++column)
+                {
+                    covariance[row][column] += (pixels[i][row] - mean[row]) * (pixels[i][column] - mean[column]);
+                }
+            }
+        }
+
+        //A few power iterations are plenty for a 4x4 block.
+        float axis[4] = { 1.f, 1.f, 1.f, 1.f };
+        for (uint32_t iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[4]{};
+            float length = 0.f;
+            for (uint32_t row = 0; row < 4; ++row)
+            {
+                for (uint32_t column = 0; column < 4; ++column)
+                {
+                    next[row] += covariance[row][column] * axis[column];
+                }
+                length += next[row] * next[row];
+            }
+
+            if (length < 1e-8f)
+            {
+                break;
+            }
+
+            length = 1.f / sqrtf(length);
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                axis[channel] = next[channel] * length;
+            }
+        }
+
+        float minProjection = FLT_MAX;
+        float maxProjection = -FLT_MAX;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            float projection = 0.f;
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                projection += (pixels[i][channel] - mean[channel]) * axis[channel];
+            }
+            minProjection = min(minProjection, projection);
+            maxProjection = max(maxProjection, projection);
+        }
+
+        float endpoints[2][4];
+        for (uint32_t channel = 0; channel < 4; ++channel)
+        {
+            endpoints[0][channel] = min(max(mean[channel] + axis[channel] * minProjection, 0.f), 255.f);
+            endpoints[1][channel] = min(max(mean[channel] + axis[channel] * maxProjection, 0.f), 255.f);
+        }
+
+        uint32_t quantised[2][4];
+        uint32_t pBits[2];
+        quantiseBC7Endpoint(endpoints[0], quantised[0], pBits[0]);
+        quantiseBC7Endpoint(endpoints[1], quantised[1], pBits[1]);
+
+        uint32_t palette[16][4];
+        for (uint32_t index = 0; index < 16; ++index)
+        {
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                const uint32_t first = (quantised[0][channel] << 1) | pBits[0];
+                const uint32_t second = (quantised[1][channel] << 1) | pBits[1];
+                palette[index][channel] = ((64 - BC7_WEIGHTS[index]) * first + BC7_WEIGHTS[index] * second + 32) >> 6;
+            }
+        }
+
+        uint32_t indices[16];
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t bestError = UINT32_MAX;
+            for (uint32_t index = 0; index < 16; ++index)
+            {
+                uint32_t error = 0;
+                for (uint32_t channel = 0; channel < 4; ++channel)
+                {
+                    const int32_t difference = int32_t(palette[index][channel]) - int32_t(pixels[i][channel]);
+                    error += uint32_t(difference * difference);
+                }
+
+                if (error < bestError)
+                {
+                    bestError = error;
+                    indices[i] = index;
+                }
+            }
+        }
+
+        //The first index is stored without its top bit, so the endpoints are swapped when it would be set.
+        if (indices[0] & 8)
+        {
+            for (uint32_t channel = 0; channel < 4; ++channel)
+            {
+                const uint32_t swap = quantised[0][channel];
+                quantised[0][channel] = quantised[1][channel];
+                quantised[1][channel] = swap;
+            }
+
+            const uint32_t swap = pBits[0];
+            pBits[0] = pBits[1];
+            pBits[1] = swap;
+
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                indices[i] = 15 - indices[i];
+            }
+        }
+
+        memset(output, 0, 16);
+        BitWriter writer{ output };
+        writer.write(1 << 6, 7);
+        for (uint32_t channel = 0; channel < 4; ++channel)
+        {
+            writer.write(quantised[0][channel], 7);
+            writer.write(quantised[1][channel], 7);
+        }
+        writer.write(pBits[0], 1);
+        writer.write(pBits[1], 1);
+
+        writer.write(indices[0], 3);
+        for (uint32_t i = 1; i < 16; ++i)
+        {
+            writer.write(indices[i], 4);
+        }
+    }
+
+    void encodeLevel(const uint8_t* rgba, uint32_t width, uint32_t height, TextureUsage usage, uint8_t* output)
+    {
+        const uint32_t blockBytes = TextureFormat::blockBytes(compressedFormat(usage));
+
+        for (uint32_t blockY = 0; blockY < height; blockY += 4)
+        {
+            for (uint32_t blockX = 0; blockX < width; blockX += 4)
+            {
+                //Blocks past the edge of small levels repeat the last row and column.
+                uint8_t pixels[16][4];
+                for (uint32_t i = 0; i < 16; ++i)
+                {
+                    const uint32_t x = min(blockX + (i & 3), width - 1);
+                    const uint32_t y = min(blockY + (i >> 2), height - 1);
+                    memcpy(pixels[i], rgba + (y * width + x) * 4, 4);
+                }
+
+                if (usage == TEXTURE_USAGE_COLOUR)
+                {
+                    encodeBC7Block(pixels, output);
+                }
+                else
+                {
+                    uint8_t channel[16];
+                    for (uint32_t i = 0; i < 16; ++i)
+                    {
+                        channel[i] = pixels[i][0];
+                    }
+                    encodeBC4Block(channel, output);
+
+                    if (usage == TEXTURE_USAGE_NORMAL)
+                    {
+                        for (uint32_t i = 0; i < 16; ++i)
+                        {
+                            channel[i] = pixels[i][1];
+                        }
+                        encodeBC4Block(channel, output + 8);
+                    }
+                }
+
+                output += blockBytes;
+            }
+        }
+    }
+
+    uint32_t dataFormatModel(VkFormat format)
+    {
+        switch (format)
+        {
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+                return KHR_DF_MODEL_BC4;
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+                return KHR_DF_MODEL_BC5;
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+                return KHR_DF_MODEL_BC7;
+            default:
+                return KHR_DF_MODEL_BC1A;
+        }
+    }
+}
+
+VkFormat compressedFormat(TextureUsage usage)
+{
+    switch (usage)
+    {
+        case TEXTURE_USAGE_NORMAL:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        case TEXTURE_USAGE_MASK:
+            return VK_FORMAT_BC4_UNORM_BLOCK;
+        default:
+            return VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+}
+
+void compressImage(const uint8_t* rgba, uint32_t width, uint32_t height, TextureUsage usage, Allocator* allocator, CompressedImage& outImage)
+{
+    outImage.format = compressedFormat(usage);
+    outImage.width = width;
+    outImage.height = height;
+    outImage.levelCount = levelCountForSize(width, height);
+
+    outImage.size = 0;
+    for (uint32_t level = 0; level < outImage.levelCount; ++level)
+    {
+        outImage.size += TextureFormat::levelSize(outImage.format, max(width >> level, 1u), max(height >> level, 1u));
+    }
+    outImage.data = void_allocam(outImage.size, allocator);
+
+    //Each level is filtered from the one above, two buffers are swapped down the chain.
+    uint8_t* levels[2] = { void_allocam(max(width / 2, 1u) * max(height / 2, 1u) * 4, allocator),
+                           void_allocam(max(width / 4, 1u) * max(height / 4, 1u) * 4, allocator) };
+
+    const uint8_t* source = rgba;
+    uint8_t* output = outImage.data;
+    for (uint32_t level = 0; level < outImage.levelCount; ++level)
+    {
+        const uint32_t levelWidth = max(width >> level, 1u);
+        const uint32_t levelHeight = max(height >> level, 1u);
+
+        if (level > 0)
+        {
+            uint8_t* destination = levels[(level - 1) & 1];
+            downsample(source, max(width >> (level - 1), 1u), max(height >> (level - 1), 1u), destination, usage);
+            source = destination;
+        }
+
+        encodeLevel(source, levelWidth, levelHeight, usage, output);
+        output += TextureFormat::levelSize(outImage.format, levelWidth, levelHeight);
+    }
+
+    void_free(levels[0], allocator);
+    void_free(levels[1], allocator);
+}
+
+bool ktx2Write(const char* path, const CompressedImage& image, Allocator* allocator)
+{
+    const uint32_t blockBytes = TextureFormat::blockBytes(image.format);
+    const uint32_t sampleCount = image.format == VK_FORMAT_BC5_UNORM_BLOCK ? 2 : 1;
+
+    const uint32_t levelIndexOffset = sizeof(KTX2Header);
+    const uint32_t dfdOffset = levelIndexOffset + sizeof(KTX2Level) * image.levelCount;
+    const uint32_t dfdLength = sizeof(uint32_t) * (1 + 6 + 4 * sampleCount);
+
+    //Levels are stored smallest first, each aligned to the block size.
+    uint32_t fileSize = dfdOffset + dfdLength;
+    KTX2Level levels[COMPRESSED_IMAGE_MAX_LEVELS]{};
+    for (int32_t level = int32_t(image.levelCount) - 1; level >= 0; --level)
+    {
+        fileSize = (fileSize + blockBytes - 1) / blockBytes * blockBytes;
+
+        levels[level].byteOffset = fileSize;
+        levels[level].byteLength = TextureFormat::levelSize(image.format, max(image.width >> level, 1u), max(image.height >> level, 1u));
+        levels[level].uncompressedByteLength = levels[level].byteLength;
+
+        fileSize += uint32_t(levels[level].byteLength);
+    }
+
+    uint8_t* file = void_allocam(fileSize, allocator);
+    memset(file, 0, fileSize);
+
+    KTX2Header header{};
+    memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vkFormat = image.format;
+    header.typeSize = 1;
+    header.pixelWidth = image.width;
+    header.pixelHeight = image.height;
+    header.faceCount = 1;
+    header.levelCount = image.levelCount;
+    header.dfdByteOffset = dfdOffset;
+    header.dfdByteLength = dfdLength;
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + levelIndexOffset, levels, sizeof(KTX2Level) * image.levelCount);
+
+    //One basic descriptor block with a sample per channel of the 4x4 block.
+    uint32_t dfd[1 + 6 + 4 * 2]{};
+    dfd[0] = dfdLength;
+    dfd[1] = 0;
+    dfd[2] = KHR_DF_VERSION | ((24 + 16 * sampleCount) << 16);
+    dfd[3] = dataFormatModel(image.format) | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16);
+    dfd[4] = 3 | (3 << 8);
+    dfd[5] = blockBytes;
+    dfd[6] = 0;
+    for (uint32_t sample = 0; sample < sampleCount; ++sample)
+    {
+        uint32_t* sampleWords = dfd + 7 + sample * 4;
+        sampleWords[0] = (sample * 64) | ((blockBytes * 8 / sampleCount - 1) << 16) | (sample << 24);
+        sampleWords[1] = 0;
+        sampleWords[2] = 0;
+        sampleWords[3] = UINT32_MAX;
+    }
+    memcpy(file + dfdOffset, dfd, dfdLength);
+
+    const uint8_t* levelData = image.data;
+    for (uint32_t level = 0; level < image.levelCount; ++level)
+    {
+        memcpy(file + levels[level].byteOffset, levelData, levels[level].byteLength);
+        levelData += levels[level].byteLength;
+    }
+
+    FileHandle fileHandle = nullptr;
+    fileOpen(path, "wb", &fileHandle);
+    const bool written = fileHandle != nullptr && fileWrite(file, fileSize, 1, fileHandle) == 1;
+    if (fileHandle)
+    {
+        fileClose(fileHandle);
+    }
+
+    void_free(file, allocator);
+
+    return written;
+}
+
+bool ktx2Read(const char* path, Allocator* allocator, CompressedImage& outImage)
+{
+    if (fileExists(path) == false)
+    {
+        return false;
+    }
+
+    FileReadResult file = fileReadBinary(path, allocator);
+    const uint8_t* fileData = reinterpret_cast<const uint8_t*>(file.data);
+
+    KTX2Header header{};
+    bool valid = file.size >= sizeof(KTX2Header);
+    if (valid)
+    {
+        memcpy(&header, fileData, sizeof(header));
+
+        const VkFormat format = VkFormat(header.vkFormat);
+        valid = memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0 && TextureFormat::isBlockCompressed(format) &&
+                header.supercompressionScheme == 0 && header.pixelDepth == 0 && header.layerCount <= 1 && header.faceCount == 1 &&
+                header.levelCount > 0 && header.levelCount <= COMPRESSED_IMAGE_MAX_LEVELS &&
+                sizeof(KTX2Header) + sizeof(KTX2Level) * header.levelCount <= file.size;
+    }
+
+    if (valid)
+    {
+        outImage.format = VkFormat(header.vkFormat);
+        outImage.width = header.pixelWidth;
+        outImage.height = header.pixelHeight;
+        outImage.levelCount = header.levelCount;
+
+        KTX2Level levels[COMPRESSED_IMAGE_MAX_LEVELS];
+        memcpy(levels, fileData + sizeof(KTX2Header), sizeof(KTX2Level) * header.levelCount);
+
+        outImage.size = 0;
+        for (uint32_t level = 0; level < header.levelCount && valid; ++level)
+        {
+            const uint32_t levelSize = TextureFormat::levelSize(outImage.format, max(outImage.width >> level, 1u), max(outImage.height >> level, 1u));
+            valid = levels[level].byteLength == levelSize && levels[level].byteOffset + levelSize <= file.size;
+            outImage.size += levelSize;
+        }
+
+        if (valid)
+        {
+            outImage.data = void_allocam(outImage.size, allocator);
+
+            uint8_t* output = outImage.data;
+            for (uint32_t level = 0; level < header.levelCount; ++level)
+            {
+                memcpy(output, fileData + levels[level].byteOffset, levels[level].byteLength);
+                output += levels[level].byteLength;
+            }
+        }
+    }
+
+    void_free(file.data, allocator);
+
+    return valid;
+}
@@ -0,0 +1,50 @@
+#ifndef TEXTURE_COMPRESSION_HDR
+#define TEXTURE_COMPRESSION_HDR
+
+#include "Foundation/Platform.hpp"
+
+#include <vulkan/vulkan.h>
+
+struct Allocator;
+
+static constexpr uint32_t COMPRESSED_IMAGE_MAX_LEVELS = 16;
+
+//Picks the block format a texture is encoded to.
+enum TextureUsage : uint8_t
+{
+    //BC7, base colour and emissive, also metallic roughness since it needs more than two channels.
+    TEXTURE_USAGE_COLOUR,
+    //BC5, x and y of a tangent space normal map, z is rebuilt in the shader.
+    TEXTURE_USAGE_NORMAL,
+    //BC4, a single channel such as occlusion.
+    TEXTURE_USAGE_MASK,
+
+    TEXTURE_USAGE_COUNT
+};
+
+//A block compressed image with its whole mip chain, level 0 first and tightly packed the way GPUDevice::createTexture uploads it.
+struct CompressedImage
+{
+    uint8_t* data = nullptr;
+    uint32_t size = 0;
+
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levelCount = 0;
+};
+
+VkFormat compressedFormat(TextureUsage usage);
+
+//Nothing here touches shared state, every allocation comes from the allocator passed in so images can be cooked on worker threads.
+
+//Box filters the mip chain of an RGBA8 image and encodes every level. The data is allocated from the allocator, the caller frees it.
+void compressImage(const uint8_t* rgba, uint32_t width, uint32_t height, TextureUsage usage, Allocator* allocator, CompressedImage& outImage);
+
+//KTX2 without supercompression, one face and one layer.
+bool ktx2Write(const char* path, const CompressedImage& image, Allocator* allocator);
+//Returns false when the file is missing or is not a KTX2 this loader understands, the data is allocated from the allocator.
+//Nothing is logged, the caller reports a file that exists but could not be read.
+bool ktx2Read(const char* path, Allocator* allocator, CompressedImage& outImage);
+
+#endif // !TEXTURE_COMPRESSION_HDR
@@ -0,0 +1,285 @@
+#include "TextureStreamer.hpp"
+
+#include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    //Bytes of every level above the given one, which is also where that level starts in the packed data.
+    uint32_t levelOffset(const CompressedImage& image, uint32_t level)
+    {
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < level; ++i)
+        {
+            offset += TextureFormat::levelSize(image.format, max(image.width >> i, 1u), max(image.height >> i, 1u));
+        }
+
+        return offset;
+    }
+
+    uint32_t chainSize(const CompressedImage& image, uint32_t firstLevel)
+    {
+        return image.size - levelOffset(image, firstLevel);
+    }
+
+    void fillCreation(TextureCreation& creation, const CompressedImage& image, uint32_t firstLevel, const char* name)
+    {
+        creation.setData(image.data + levelOffset(image, firstLevel))
+            .setFormatType(image.format, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D)
+            .setFlags(uint8_t(image.levelCount - firstLevel), VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+            .setSize(uint16_t(max(image.width >> firstLevel, 1u)), uint16_t(max(image.height >> firstLevel, 1u)), 1)
+            .setName(name);
+    }
+}
+
+void TextureStreamer::init(Allocator* inAllocator, const GPUDevice& gpu)
+{
+    allocator = inAllocator;
+
+    textures.init(allocator, 64);
+    streamIndices.init(allocator, gpu.textures.poolSize, gpu.textures.poolSize);
+    for (uint32_t i = 0; i < streamIndices.size; ++i)
+    {
+        streamIndices[i] = UINT16_MAX;
+    }
+
+    residentBytes = 0;
+    budgetBytes = queryBudget(gpu);
+    streamCursor = 0;
+}
+
+void TextureStreamer::shutdown(GPUDevice& gpu)
+{
+    for (uint32_t i = 0; i < textures.size; ++i)
+    {
+        if (textures[i].pending.index != INVALID_INDEX)
+        {
+            gpu.destroyTexture(textures[i].pending);
+        }
+
+        void_free(textures[i].image.data, allocator);
+    }
+
+    textures.shutdown();
+    streamIndices.shutdown();
+}
+
+TextureHandle TextureStreamer::addTexture(GPUDevice& gpu, const CompressedImage& image, const char* name)
+{
+    uint32_t tailLevel = 0;
+    while (tailLevel + 1 < image.levelCount && max(image.width >> tailLevel, image.height >> tailLevel) > TEXTURE_STREAMING_TAIL_SIZE)
+    {
+        ++tailLevel;
+    }
+
+    TextureCreation creation;
+    fillCreation(creation, image, tailLevel, name);
+    TextureHandle handle = gpu.createTexture(creation);
+
+    if (tailLevel == 0 || handle.index == INVALID_INDEX)
+    {
+        return handle;
+    }
+
+    VOID_ASSERTM(textures.size < UINT16_MAX, "Too many streamed textures.");
+
+    StreamedTexture streamed{};
+    streamed.image = image;
+    streamed.image.data = void_allocam(image.size, allocator);
+    memcpy(streamed.image.data, image.data, image.size);
+    streamed.handle = handle;
+    streamed.pending = { INVALID_INDEX };
+    snprintf(streamed.name, sizeof(streamed.name), "%s", name ? name : "");
+    streamed.residentBytes = chainSize(image, tailLevel);
+    streamed.lastUsedFrame = gpu.absoluteFrame;
+    streamed.residentLevel = uint8_t(tailLevel);
+    streamed.tailLevel = uint8_t(tailLevel);
+    streamed.wantedLevel = uint8_t(tailLevel);
+
+    streamIndices[handle.index] = uint16_t(textures.size);
+    textures.push(streamed);
+
+    residentBytes += streamed.residentBytes;
+
+    return handle;
+}
+
+void TextureStreamer::requestScreenSize(TextureHandle texture, float pixels)
+{
+    if (texture.index >= streamIndices.size || streamIndices[texture.index] == UINT16_MAX)
+    {
+        return;
+    }
+
+    StreamedTexture& streamed = textures[streamIndices[texture.index]];
+
+    //A texel per pixel, the texture is assumed to be stretched once across what it is drawn on.
+    const float texels = (float)max(streamed.image.width, streamed.image.height);
+    const uint32_t level = pixels >= texels ? 0 : uint32_t(log2f(texels / max(pixels, 1.f)));
+
+    streamed.wantedLevel = uint8_t(min(uint32_t(streamed.wantedLevel), level));
+}
+
+void TextureStreamer::update(GPUDevice& gpu, CommandBuffer* commandBuffer)
+{
+    budgetBytes = queryBudget(gpu);
+
+    const uint32_t frame = gpu.absoluteFrame;
+
+    //Once the frame an upload was recorded in has been submitted, its slot holds a timeline value at least as late as it.
+    for (uint32_t i = 0; i < textures.size; ++i)
+    {
+        StreamedTexture& texture = textures[i];
+        if (texture.pending.index != INVALID_INDEX && texture.pendingFrame != frame &&
+            gpu.timelineReached(gpu.frameTimelineValues[texture.pendingSlot]))
+        {
+            gpu.replaceTexture(texture.handle, texture.pending);
+            texture.pending = { INVALID_INDEX };
+        }
+    }
+
+    for (uint32_t i = 0; i < textures.size; ++i)
+    {
+        if (textures[i].wantedLevel <= textures[i].residentLevel)
+        {
+            textures[i].lastUsedFrame = frame;
+        }
+    }
+
+    //Over budget anything can lose its top level, starting with what was needed longest ago.
+    while (int64_t(residentBytes) > budgetBytes)
+    {
+        if (evictLeastRecentlyUsed(gpu, commandBuffer, UINT32_MAX) == false)
+        {
+            break;
+        }
+    }
+
+    uint32_t uploadedBytes = 0;
+    for (uint32_t i = 0; i < textures.size; ++i)
+    {
+        StreamedTexture& texture = textures[(streamCursor + i) % textures.size];
+        if (texture.wantedLevel >= texture.residentLevel || texture.pending.index != INVALID_INDEX)
+        {
+            continue;
+        }
+
+        uint32_t level = texture.wantedLevel;
+        while (level < texture.residentLevel)
+        {
+            const int64_t needed = int64_t(residentBytes - texture.residentBytes + chainSize(texture.image, level));
+            if (needed <= budgetBytes)
+            {
+                break;
+            }
+
+            //Room is only made from textures nothing asked for this frame, after that the level is stepped back until it fits.
+            if (evictLeastRecentlyUsed(gpu, commandBuffer, frame) == false)
+            {
+                ++level;
+            }
+        }
+
+        //Making room may have stepped this texture itself down, its upload is recorded already then.
+        if (level == texture.residentLevel || texture.pending.index != INVALID_INDEX)
+        {
+            continue;
+        }
+
+        const uint32_t levelBytes = chainSize(texture.image, level);
+        if (uploadedBytes > 0 && uploadedBytes + levelBytes > TEXTURE_STREAMING_UPLOAD_BYTES)
+        {
+            streamCursor = (streamCursor + i) % textures.size;
+            break;
+        }
+
+        if (setResidentLevel(gpu, commandBuffer, texture, level))
+        {
+            uploadedBytes += levelBytes;
+        }
+    }
+
+    for (uint32_t i = 0; i < textures.size; ++i)
+    {
+        textures[i].wantedLevel = textures[i].tailLevel;
+    }
+}
+
+bool TextureStreamer::setResidentLevel(GPUDevice& gpu, CommandBuffer* commandBuffer, StreamedTexture& texture, uint32_t level)
+{
+#if defined(VOID_TEXTURE_STREAMING_LOG)
+    vprint("Texture %s level %u -> %u, %.2fMB of %.2fMB resident.\n", texture.name, texture.residentLevel, level,
+           residentBytes / (1024.0 * 1024.0), budgetBytes / (1024.0 * 1024.0));
+#endif //VOID_TEXTURE_STREAMING_LOG
+
+    TextureCreation creation;
+    fillCreation(creation, texture.image, level, texture.name);
+    TextureHandle pending = gpu.createTexture(creation, commandBuffer);
+    if (pending.index == INVALID_INDEX)
+    {
+        vprint("Graphics error: Could not stream texture %s, the texture pool is full.\n", texture.name);
+        return false;
+    }
+
+    texture.pending = pending;
+    texture.pendingFrame = gpu.absoluteFrame;
+    texture.pendingSlot = gpu.currentFrame;
+
+    //Counted from now on, the old levels stay on the GPU a few frames longer until the swap.
+    residentBytes -= texture.residentBytes;
+    texture.residentBytes = chainSize(texture.image, level);
+    texture.residentLevel = uint8_t(level);
+    residentBytes += texture.residentBytes;
+
+    return true;
+}
+
+bool TextureStreamer::evictLeastRecentlyUsed(GPUDevice& gpu, CommandBuffer* commandBuffer, uint32_t usedBeforeFrame)
+{
+    StreamedTexture* oldest = nullptr;
+    for (uint32_t i = 0; i < textures.size; ++i)
+    {
+        StreamedTexture& texture = textures[i];
+        if (texture.residentLevel < texture.tailLevel && texture.pending.index == INVALID_INDEX && texture.lastUsedFrame < usedBeforeFrame &&
+            (oldest == nullptr || texture.lastUsedFrame < oldest->lastUsedFrame))
+        {
+            oldest = &texture;
+        }
+    }
+
+    if (oldest == nullptr)
+    {
+        return false;
+    }
+
+    return setResidentLevel(gpu, commandBuffer, *oldest, oldest->residentLevel + 1u);
+}
+
+int64_t TextureStreamer::queryBudget(const GPUDevice& gpu) const
+{
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(gpu.VMAAllocator, budgets);
+
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(gpu.VMAAllocator, &memoryProperties);
+
+    uint64_t budget = 0;
+    uint64_t usage = 0;
+    for (uint32_t heap = 0; heap < memoryProperties->memoryHeapCount; ++heap)
+    {
+        if (memoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            budget += budgets[heap].budget;
+            usage += budgets[heap].usage;
+        }
+    }
+
+    //What everything else uses comes off the share, the streamed levels themselves are part of it.
+    const uint64_t otherUsage = usage - min(usage, residentBytes);
+
+    return int64_t(budget * TEXTURE_STREAMING_BUDGET_SHARE) - int64_t(otherUsage);
+}
@@ -0,0 +1,81 @@
+#ifndef TEXTURE_STREAMER_HDR
+#define TEXTURE_STREAMER_HDR
+
+#include "Foundation/Platform.hpp"
+#include "Foundation/Array.hpp"
+
+#include "GPUDevice.hpp"
+#include "TextureCompression.hpp"
+
+//Define this to log every change of resident levels and the budget it was made under.
+//#define VOID_TEXTURE_STREAMING_LOG
+
+//Textures start with only the levels this size and smaller resident, anything no larger is never streamed.
+static constexpr uint32_t TEXTURE_STREAMING_TAIL_SIZE = 64;
+//Share of the device local heap budget the streamer may fill, the rest is left for everything that is not streamed.
+static constexpr float TEXTURE_STREAMING_BUDGET_SHARE = 0.8f;
+//Bytes streamed in per frame. One texture is always let through so a large level can not get stuck.
+static constexpr uint32_t TEXTURE_STREAMING_UPLOAD_BYTES = void_mega(32);
+
+struct StreamedTexture
+{
+    //Every level of the texture, kept in system memory to stream from.
+    CompressedImage image;
+    TextureHandle handle;
+    //Texture the next levels are uploaded to in the frame command buffer, swapped into handle once that frame has finished.
+    TextureHandle pending;
+    char name[64];
+
+    uint32_t residentBytes;
+    //Last frame the top resident level was needed, the oldest is evicted first.
+    uint32_t lastUsedFrame;
+    //Frame the pending upload was recorded in and its slot, the timeline value of the slot says when the copy is done.
+    uint32_t pendingFrame;
+    uint32_t pendingSlot;
+
+    //Finest level on the GPU, or of the pending upload while there is one.
+    uint8_t residentLevel;
+    //Coarsest level that is ever the top one, everything from here down stays resident.
+    uint8_t tailLevel;
+    //Finest level asked for this frame, reset to the tail after every update.
+    uint8_t wantedLevel;
+};
+
+//Keeps the finest levels of block compressed textures resident only while something on screen needs them.
+//New levels are uploaded into a separate texture as part of the frame and moved into the streamed one through GPUDevice::replaceTexture
+//once the copy has finished, so the bindless index in MaterialData never changes and the old levels are sampled until then.
+//The textures are still owned and destroyed by whoever added them, the streamer only decides which levels are resident.
+struct TextureStreamer
+{
+    void init(Allocator* inAllocator, const GPUDevice& gpu);
+    void shutdown(GPUDevice& gpu);
+
+    //Creates the texture with only its tail resident and keeps a copy of every level. Textures too small to stream are created whole.
+    TextureHandle addTexture(GPUDevice& gpu, const CompressedImage& image, const char* name);
+    //Asks for enough detail to cover a size in pixels on screen, the finest request of the frame wins. Textures that are not streamed are ignored.
+    void requestScreenSize(TextureHandle texture, float pixels);
+    //Swaps in the uploads that have finished, evicts the least recently used levels while over budget,
+    //then records the upload of what was asked for this frame into the command buffer.
+    void update(GPUDevice& gpu, CommandBuffer* commandBuffer);
+
+    //Helpers
+    //Records the upload of the chain from level on, returns false when there was no texture left to upload to.
+    bool setResidentLevel(GPUDevice& gpu, CommandBuffer* commandBuffer, StreamedTexture& texture, uint32_t level);
+    //Drops the top level of the texture used longest ago, as long as it was last used before the frame. Returns false when there is none.
+    bool evictLeastRecentlyUsed(GPUDevice& gpu, CommandBuffer* commandBuffer, uint32_t usedBeforeFrame);
+    int64_t queryBudget(const GPUDevice& gpu) const;
+
+    Array<StreamedTexture> textures;
+    //Texture pool index to an entry in textures, UINT16_MAX for textures that are not streamed.
+    Array<uint16_t> streamIndices;
+
+    uint64_t residentBytes = 0;
+    int64_t budgetBytes = 0;
+
+    //Where the next update starts streaming in so every texture gets its turn under the upload limit.
+    uint32_t streamCursor = 0;
+
+    Allocator* allocator = nullptr;
+};
+
+#endif // !TEXTURE_STREAMER_HDR
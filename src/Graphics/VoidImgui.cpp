@@ -331,12 +331,14 @@ namespace
         //Create vertex and index buffer
         BufferCreation vbCreation;
         vbCreation.set(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBufferSize)
-            .setName("vertexBufferHandle_Imgui");
+            .setName("vertexBufferHandle_Imgui")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
         vertexBufferHandle = gpu->createBuffer(vbCreation);
 
         BufferCreation ibCreation;
         ibCreation.set(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBufferSize)
-            .setName("indexBufferSize");
+            .setName("indexBufferSize")
+            .setCategory(GPU_MEMORY_CATEGORY_PER_FRAME);
         indexBufferHandle = gpu->createBuffer(ibCreation);
     }
 
@@ -3,60 +3,90 @@
 #include "Game/Scene.hpp"
 #include "Game/Player.hpp"
 #include "Physics.hpp"
+#include "Foundation/Assert.hpp"
 #include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
 
 #include <Jolt/Physics/Body/Body.h>
 
+void ContactEventQueue::init(Allocator* inAllocator, uint32_t inCapacity)
+{
+    allocator = inAllocator;
+    capacity = inCapacity;
+    events = (ContactEvent*)void_alloca(sizeof(ContactEvent) * capacity, allocator);
+    count.store(0, std::memory_order_relaxed);
+}
+
+void ContactEventQueue::shutdown()
+{
+    void_free(events, allocator);
+    events = nullptr;
+    capacity = 0;
+}
+
+void ContactEventQueue::push(ContactEventType type, uint32_t entityIndex)
+{
+    const uint32_t index = count.fetch_add(1, std::memory_order_relaxed);
+    if (index < capacity)
+    {
+        events[index] = ContactEvent{ entityIndex, type };
+    }
+}
+
+uint32_t ContactEventQueue::size() const
+{
+    return min(count.load(std::memory_order_relaxed), capacity);
+}
+
+const ContactEvent& ContactEventQueue::operator[](uint32_t index) const
+{
+    VOID_ASSERTM(index < size(), "Contact event %u is out of range.", index);
+    return events[index];
+}
+
+uint32_t ContactEventQueue::dropped() const
+{
+    const uint32_t pushed = count.load(std::memory_order_relaxed);
+    return pushed > capacity ? pushed - capacity : 0;
+}
+
+void ContactEventQueue::clear()
+{
+    count.store(0, std::memory_order_relaxed);
+}
+
 VoidContactListener::VoidContactListener()
 {
-    toDeleteQueue.init(&MemoryService::instance()->systemAllocator, 4);
+    events.init(&MemoryService::instance()->systemAllocator, CONTACT_EVENT_CAPACITY);
 }
 
 // See: ContactListener
 JPH::ValidateResult	VoidContactListener::OnContactValidate(const JPH::Body& inBody1, const JPH::Body& inBody2, JPH::RVec3Arg inBaseOffset, const JPH::CollideShapeResult& inCollisionResult)
 {
     //vprint("Contact validate validate.\n");
-    uintptr_t pointer1 = inBody1.GetUserData();
-    if (pointer1 != 0)
+    //Called from the physics jobs, so nothing is changed here. The main thread acts on the events once the update is done.
+    const JPH::Body* bodies[2] = { &inBody1, &inBody2 };
+    for (uint32_t i = 0; i < 2; ++i)
     {
-        Entity* currentEntity = ((Entity*)pointer1);
-        switch (currentEntity->entityType)
+        const Entity* currentEntity = (const Entity*)bodies[i]->GetUserData();
+        if (currentEntity == nullptr)
         {
-        case EntityType::PLAYER:
-            static_cast<Player*>(currentEntity->entityData)->crashNoise();
-            break;
-        case EntityType::ROCK:
-            if (currentEntity->isDeleted == false)
-            {
-                mutex.lock();
-                toDeleteQueue.push(currentEntity->entityIndex);
-                mutex.unlock();
-            }
-            break;
-	default:
-	    break;
+            continue;
         }
-    }
 
-    uintptr_t pointer2 = inBody2.GetUserData();
-    if (pointer2 != 0)
-    {
-        Entity* currentEntity = ((Entity*)pointer2);
         switch (currentEntity->entityType)
         {
         case EntityType::PLAYER:
-            static_cast<Player*>(currentEntity->entityData)->crashNoise();
+            events.push(CONTACT_EVENT_PLAYER_CRASH, currentEntity->entityIndex);
             break;
         case EntityType::ROCK:
             if (currentEntity->isDeleted == false)
             {
-                mutex.lock();
-                toDeleteQueue.push(currentEntity->entityIndex);
-                mutex.unlock();
+                events.push(CONTACT_EVENT_ROCK_HIT, currentEntity->entityIndex);
             }
             break;
         default:
-	    break;
+            break;
         }
     }
 
@@ -8,7 +8,46 @@
 // Jolt includes
 #include <Jolt/Physics/Collision/ContactListener.h>
 
-#include <mutex>
+#include <atomic>
+
+//Events the physics jobs hand to the main thread, one queue is enough for the frame as deleted rocks stop colliding.
+static constexpr uint32_t CONTACT_EVENT_CAPACITY = 1024;
+
+enum ContactEventType : uint8_t
+{
+    CONTACT_EVENT_PLAYER_CRASH,
+    CONTACT_EVENT_ROCK_HIT
+};
+
+struct ContactEvent
+{
+    uint32_t entityIndex;
+    ContactEventType type;
+};
+
+//Lock free queue the contact callbacks push to from any physics job, each push claims its slot with one atomic add.
+//The main thread only reads it between updates, once every job that could push has finished, so it needs nothing more.
+struct ContactEventQueue
+{
+    void init(Allocator* inAllocator, uint32_t inCapacity);
+    void shutdown();
+
+    //Any thread while the physics is updating. Events past the capacity are dropped.
+    void push(ContactEventType type, uint32_t entityIndex);
+
+    //Main thread between updates.
+    uint32_t size() const;
+    const ContactEvent& operator[](uint32_t index) const;
+    //Events that didn't fit since the last clear.
+    uint32_t dropped() const;
+    void clear();
+
+    ContactEvent* events = nullptr;
+    uint32_t capacity = 0;
+    std::atomic<uint32_t> count{ 0 };
+
+    Allocator* allocator = nullptr;
+};
 
 class VoidContactListener : public JPH::ContactListener
 {
@@ -25,8 +64,7 @@ public:
 
     virtual void OnContactRemoved(const JPH::SubShapeIDPair& inSubShapePair) override;
 
-    Array<uint32_t> toDeleteQueue;
-    std::mutex mutex;
+    ContactEventQueue events;
 };
 
 #endif // !CONTACT_LISTENER_HDR
@@ -1,6 +1,7 @@
 #include "Physics.hpp"
 
 #include "Foundation/Memory.hpp"
+#include "Foundation/Numerics.hpp"
 #include "ContactListener.hpp"
 
 #include <Jolt/Jolt.h>
@@ -9,7 +10,6 @@
 #include <Jolt/RegisterTypes.h>
 #include <Jolt/Core/Factory.h>
 #include <Jolt/Core/TempAllocator.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
 #include <Jolt/Physics/PhysicsSettings.h>
 #include <Jolt/Physics/PhysicsSystem.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
@@ -89,10 +89,8 @@ void Physics::initPhysics()
     // If you implement your own default material (PhysicsMaterial::sDefault) make sure to initialize it before this function or else this function will create one for you.
     JPH::RegisterTypes();
 
-    // We need a job system that will execute physics jobs on multiple threads. Typically
-    // you would implement the JobSystem interface yourself and let Jolt Physics run on top
-    // of your own job scheduler. JobSystemThreadPool is an example implementation.
-    jobSystem.Init(JPH::cMaxPhysicsJobs, JPH::cMaxPhysicsBarriers, std::thread::hardware_concurrency() - 1);
+    //Physics runs on the engine's job scheduler, which main starts before anything else.
+    jobSystem = JobScheduler::instance();
 
     physicsSystem.Init(cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broadPhaseLayerInterface, objectVsBroadphaseLayerFilter, objectVsObjectLayerFilter);
 
@@ -109,19 +107,53 @@ void Physics::initPhysics()
     step = 0;
 }
 
-void Physics::updatePhysics(float delta)
+void Physics::beginUpdate(float delta)
 {
-    // If you take larger steps than 1 / 60th of a second you need to do multiple collision steps in order to keep the simulation stable. 
-    // Do 1 collision step per 1 / 60th of a second (round up).
-    int cCollisionSteps = 1;
+    VOID_ASSERTM(updateCounter.pending.load() == 0, "The last physics update hasn't been finished.");
+
+    accumulator += delta;
+
+    uint32_t steps = uint32_t(accumulator / cDeltaTime);
+    if (steps > cMaxStepsPerFrame)
+    {
+        steps = cMaxStepsPerFrame;
+        accumulator = cDeltaTime * cMaxStepsPerFrame;
+    }
+
+    if (steps > 0)
+    {
+        accumulator -= cDeltaTime * steps;
+
+        // If you take larger steps than 1 / 60th of a second you need to do multiple collision steps in order to keep the simulation stable.
+        // Catching up is done as one update with a collision step per fixed step, so the broad phase and islands are only built once.
+        //The update waits on its own jobs from a worker, so the calling thread is free until finishUpdate.
+        JobScheduler::instance()->createJob("PhysicsUpdate", JOB_PRIORITY_HIGH, [this, steps]()
+        {
+            physicsSystem.Update(cDeltaTime * steps, int(steps), &tempAllocator, jobSystem);
+        }, &updateCounter);
+    }
+
+    accumulator = max(accumulator, 0.f);
+    pendingAlpha = accumulator / cDeltaTime;
+    pendingSteps = steps;
+}
+
+uint32_t Physics::finishUpdate()
+{
+    JobScheduler::instance()->wait(updateCounter);
+
+    //The alpha goes with the steps, so frames that render an update a frame late still advance by their own time.
+    interpolationAlpha = pendingAlpha;
 
-    // Step the world
-    physicsSystem.Update(cDeltaTime, cCollisionSteps, &tempAllocator, &jobSystem);
+    const uint32_t steps = pendingSteps;
+    pendingSteps = 0;
+    return steps;
 }
 
 void Physics::shutdownPhysics()
 {
-    contactListener.toDeleteQueue.shutdown();
+    finishUpdate();
+    contactListener.events.shutdown();
     //// Unregisters all types with the factory and cleans up the default material
     //JPH::UnregisterTypes();
 
@@ -2,6 +2,7 @@
 #define PHYSICS_HDR
 
 #include "Foundation/Platform.hpp"
+#include "Foundation/JobScheduler.hpp"
 #include "Foundation/Log.hpp"
 #include "Foundation/Memory.hpp"
 
@@ -13,7 +14,6 @@
 #include <Jolt/RegisterTypes.h>
 #include <Jolt/Core/Factory.h>
 #include <Jolt/Core/TempAllocator.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
 #include <Jolt/Physics/PhysicsSettings.h>
 #include <Jolt/Physics/PhysicsSystem.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
@@ -247,10 +247,8 @@ struct Physics
     // The main way to interact with the bodies in the physics system is through the body interface. There is a locking and a non-locking
     // variant of this. We're going to use the locking version (even though we're not planning to access bodies from multiple threads)
     JPH::PhysicsSystem physicsSystem;
-    // We need a job system that will execute physics jobs on multiple threads. Typically
-    // you would implement the JobSystem interface yourself and let Jolt Physics run on top
-    // of your own job scheduler. JobSystemThreadPool is an example implementation.
-    JPH::JobSystemThreadPool jobSystem;
+    //The engine's job scheduler, physics jobs share its threads with everything else.
+    JPH::JobSystem* jobSystem = nullptr;
     JPH::BodyInterface* bodyInterface;
 
     uint32_t step = 0;
@@ -283,8 +281,20 @@ struct Physics
 
     // We simulate the physics world in discrete time steps. 60 Hz is a good rate to update the physics system.
     static constexpr float cDeltaTime = 1.0f / 60.0f;
-
-	void updatePhysics(float delta);
+    // Steps one frame may catch up on, any time beyond that is dropped so a long frame can't make the next ones longer.
+    static constexpr uint32_t cMaxStepsPerFrame = 4;
+
+    // Starts a job that advances the simulation by every whole step of time built up. Nothing may touch the bodies until finishUpdate.
+    void beginUpdate(float delta);
+    // Waits for the update begun last, running other jobs meanwhile, and returns how many steps it took. Returns 0 when none is running.
+    uint32_t finishUpdate();
+
+    float accumulator = 0.f;
+    // Unsimulated time left over as a fraction of a step when the finished update began, renderers blend the last two step results by it.
+    float interpolationAlpha = 0.f;
+    float pendingAlpha = 0.f;
+    uint32_t pendingSteps = 0;
+    JobCounter updateCounter;
 
 	void shutdownPhysics();
 
@@ -5,12 +5,12 @@
 #extension GL_EXT_shader_16bit_storage: require
 #extension GL_ARB_gpu_shader_int64 : enable
 
-const vec3 pos[4] = vec3[4]
+const vec2 pos[4] = vec2[4]
 (
-	vec3(0.0, 0.0, 0.0),
-	vec3(1.0, 0.0, 0.0),
-	vec3(1.0, 1.0, 0.0),
-	vec3(0.0, 1.0, 0.0)
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 1.0)
 );
 
 const int indices[6] = int[6]
@@ -18,13 +18,16 @@ const int indices[6] = int[6]
 	0, 1, 2, 2, 3, 0
 );
 
-struct QuadPosition
+//Must match QuadData2D in 2DRenderer.hpp.
+struct Quad
 {
-    mat4 transform;
-    vec4 colour;
-    vec2 texCoords[4];
+    vec2 position;
+    vec2 size;
+    vec4 uvRect;
+    uint colour;
     uint textureID;
-    float padd[3];
+    float layer;
+    float padd;
 };
 
 struct SceneData2D
@@ -32,9 +35,9 @@ struct SceneData2D
     mat4 ortho;
 };
 
-layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer QuadPositionData
+layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer QuadData
 {
-    QuadPosition quadPositions[];
+    Quad quads[];
 };
 
 layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer SceneBuffer2DData
@@ -44,7 +47,7 @@ layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer Sce
 
 layout(scalar, push_constant) uniform entityIndex
 {
-    QuadPositionData quadPositionsReference;
+    QuadData quadReference;
     SceneBuffer2DData scene2D;
 };
 
@@ -54,16 +57,16 @@ layout(location = 2) flat out uint textureID;
 
 void main()
 {
-    int idx = indices[gl_VertexIndex];
-    vec3 position = pos[idx];
+    vec2 corner = pos[indices[gl_VertexIndex]];
 
-    vec2 texcoord = vec2(quadPositionsReference.quadPositions[gl_InstanceIndex].texCoords[idx].x, quadPositionsReference.quadPositions[gl_InstanceIndex].texCoords[idx].y);
+    //gl_InstanceIndex includes the first instance, which selects this frames part of the ring.
+    Quad quad = quadReference.quads[gl_InstanceIndex];
 
-    gl_Position = scene2D.sceneData2D.ortho * quadPositionsReference.quadPositions[gl_InstanceIndex].transform * vec4(position, 1.0);
+    gl_Position = scene2D.sceneData2D.ortho * vec4(quad.position + corner * quad.size, quad.layer, 1.0);
 
-    textureID = quadPositionsReference.quadPositions[gl_InstanceIndex].textureID;
+    textureID = quad.textureID;
 
-    vTexcoord = texcoord;
+    vTexcoord = mix(quad.uvRect.xy, quad.uvRect.zw, corner);
 
-    vColour = quadPositionsReference.quadPositions[gl_InstanceIndex].colour;
-}
\ No newline at end of file
+    vColour = unpackUnorm4x8(quad.colour);
+}
@@ -190,7 +190,9 @@ void main()
     //NOTE: Normal textures are encoded to [0, 1] but we need it to be maped to [-1, 1] value.
     if (textures.z != INVALID_TEXTURE_INDEX) 
     {
-        N = normalize(texture(globalTextures[nonuniformEXT(textures.z)], vTexcoord0).rgb * 2.0 - 1.0);
+        //Normal maps can be BC5 which only keeps x and y, z is rebuilt since tangent space normals always face out.
+        vec2 normalXY = texture(globalTextures[nonuniformEXT(textures.z)], vTexcoord0).rg * 2.0 - 1.0;
+        N = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
         N = normalize(TBN * N);
     }
     vec3 H = normalize(L + V);
@@ -6,6 +6,9 @@
 #extension GL_EXT_shader_16bit_storage: require
 #extension GL_EXT_shader_8bit_storage: require
 #extension GL_ARB_gpu_shader_int64 : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "instanceData.h"
 
 struct Vertices
 {
@@ -15,15 +18,6 @@ struct Vertices
     float16_t tu, tv;
 };
 
-//Here we are going to attempt full bindless for the debug renderer to make this as painless as possible in the future.
-struct ModelPosition
-{
-    mat4 pos; 
-    mat4 debugModel;
-    vec4 colour;
-    float padd[4];
-};
-
 struct SceneData
 {
     mat4 view;
@@ -33,7 +27,7 @@ struct SceneData
     vec4 light;
 };
 
-layout(scalar, set = 1, binding = 0) uniform MaterialConstant
+struct MaterialData
 {
     mat4 model;
     mat4 modelInv;
@@ -48,6 +42,7 @@ layout(scalar, set = 1, binding = 0) uniform MaterialConstant
     uint emissiveTextureIndex;
     vec3 specularValue;
     uint flags;
+    uint padd[2];
 };
 
 layout(buffer_reference, buffer_reference_align = 8, scalar) readonly buffer VertexData
@@ -65,11 +60,40 @@ layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer Sce
     SceneData sceneData;
 };
 
+layout(buffer_reference, buffer_reference_align = 8, scalar) readonly buffer VisibleIndexData
+{
+    uint visibleIndices[];
+};
+
+layout(buffer_reference, buffer_reference_align = 8, scalar) readonly buffer MaterialBufferData
+{
+    MaterialData materials[];
+};
+
+//VkDrawIndexedIndirectCommand followed by the material of the draw.
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+    uint materialIndex;
+};
+
+layout(buffer_reference, buffer_reference_align = 8, scalar) readonly buffer DrawCommandData
+{
+    DrawCommand drawCommands[];
+};
+
 layout(scalar, push_constant) uniform entityIndex
 {
     VertexData vertexDataReference;
     ModelPositionData modelPositionsReference;
     SceneBufferData sceneBufferReference;
+    VisibleIndexData visibleIndicesReference;
+    MaterialBufferData materialReference;
+    DrawCommandData drawCommandReference;
 };
 
 layout(location = 0) out vec2 vTexcoord0;
@@ -77,6 +101,7 @@ layout(location = 1) out vec3 vNormal;
 layout(location = 2) out vec4 vTangent;
 layout(location = 3) out vec4 vPosition;
 layout(location = 4) out vec4 vColour;
+layout(location = 5) flat out uint vMaterialIndex;
 
 mat3 adjugate(in mat4 m)
 {
@@ -102,7 +127,11 @@ void main()
 
     vec2 texcoord = vec2(vertexDataReference.vertexData[gl_VertexIndex].tu, vertexDataReference.vertexData[gl_VertexIndex].tv);
 
-    mat4 modelPostion = modelPositionsReference.modelPositions[gl_InstanceIndex].pos * model;
+    //firstInstance points at this model's section of the culled list.
+    uint instanceIndex = visibleIndicesReference.visibleIndices[gl_InstanceIndex];
+
+    uint materialIndex = drawCommandReference.drawCommands[gl_DrawID].materialIndex;
+    mat4 modelPostion = instanceMatrix(modelPositionsReference.modelPositions[instanceIndex]) * materialReference.materials[materialIndex].model;
 
     gl_Position = sceneBufferReference.sceneData.project * sceneBufferReference.sceneData.view * sceneBufferReference.sceneData.globalModel * modelPostion * vec4(position, 1.0);
     vPosition  =  sceneBufferReference.sceneData.globalModel * modelPostion * vec4(position, 1.0);
@@ -111,5 +140,6 @@ void main()
     vNormal = mat3(adjugate(modelPostion)) * normal;
 
     vTangent = tangent;
+    vMaterialIndex = materialIndex;
     vColour = vec4(1.f, 1.f, 1.f, 1.f);//modelPositionsReference.modelPositions[2].colour;
 }
\ No newline at end of file
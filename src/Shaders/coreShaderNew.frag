@@ -5,6 +5,33 @@
 // Enable non uniform qualifier extension
 #extension GL_EXT_nonuniform_qualifier : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_ARB_gpu_shader_int64 : enable
+
+struct Light
+{
+    vec3 position;
+    float radius;
+    vec3 colour;
+    float intensity;
+    vec3 direction;
+    float spotScale;
+    float spotOffset;
+};
+
+layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer LightData
+{
+    Light lights[];
+};
+
+layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer LightGridData
+{
+    uint counts[];
+};
+
+layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer LightIndexData
+{
+    uint indices[];
+};
 
 struct SceneData
 {
@@ -13,6 +40,12 @@ struct SceneData
     mat4 globalModel;
     vec4 eye;
     vec4 light;
+
+    LightData lightReference;
+    LightGridData lightGridReference;
+    LightIndexData lightIndexReference;
+    float lightSliceScale;
+    float lightSliceBias;
 };
 
 struct Vertices
@@ -40,7 +73,7 @@ layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer Sce
     SceneData sceneData;
 };
 
-layout(scalar, set = 1, binding = 0) uniform MaterialConstant
+struct MaterialData
 {
     mat4 model;
     mat4 modelInv;
@@ -55,6 +88,7 @@ layout(scalar, set = 1, binding = 0) uniform MaterialConstant
     uint emissiveTextureIndex;
     vec3 specularValue;
     uint flags;
+    uint padd[2];
 };
 
 layout(set = 0, binding = 0) uniform sampler2D globalTextures[];
@@ -70,11 +104,18 @@ layout(set = 0, binding = 1) writeonly uniform image2D globalImages2D[];
 #define PI 3.1415926538
 #define INVALID_TEXTURE_INDEX 65535
 
+//Must match LightCulling.hpp.
+#define LIGHT_GRID_X 16
+#define LIGHT_GRID_Y 9
+#define LIGHT_GRID_Z 24
+#define LIGHT_CLUSTER_MAX_LIGHTS 128
+
 layout(location = 0) in vec2 vTexcoord0;
 layout(location = 1) in vec3 vNormal;
 layout(location = 2) in vec4 vTangent;
 layout(location = 3) in vec4 vPosition;
 layout(location = 4) in vec4 vColour;
+layout(location = 5) flat in uint vMaterialIndex;
 
 layout(location = 0) out vec4 fragColour;
 
@@ -155,11 +196,23 @@ float heaviside(float value)
     return 0.0;
 }
 
+layout(scalar, buffer_reference) readonly buffer VisibleIndexData
+{
+    uint visibleIndices[];
+};
+
+layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer MaterialBufferData
+{
+    MaterialData materials[];
+};
+
 layout(scalar, push_constant) uniform entityIndex
 {
     VertexData vertexDataReference;
     ModelPositionData modelPositionsReference;
     SceneBufferData sceneBufferReference;
+    VisibleIndexData visibleIndicesReference;
+    MaterialBufferData materialReference;
 };
 
 float distributionGGX(float NoH, float roughness)
@@ -230,12 +283,61 @@ float spotLight()
     return lightIntensity * attenuation;
 }
 
+//Froxel of the fragment, found from its view space position the same way lightCulling.comp builds the froxel bounds.
+uint lightCluster(vec3 viewPosition)
+{
+    SceneData sceneData = sceneBufferReference.sceneData;
+
+    float depth = max(-viewPosition.z, 1e-4);
+    vec2 ndc = vec2(sceneData.project[0][0], sceneData.project[1][1]) * viewPosition.xy / depth;
+    uvec2 tile = uvec2(clamp((ndc * 0.5 + 0.5) * vec2(LIGHT_GRID_X, LIGHT_GRID_Y), vec2(0.0), vec2(LIGHT_GRID_X - 1, LIGHT_GRID_Y - 1)));
+    uint slice = uint(clamp(log(depth) * sceneData.lightSliceScale + sceneData.lightSliceBias, 0.0, float(LIGHT_GRID_Z - 1)));
+
+    return tile.x + tile.y * LIGHT_GRID_X + slice * LIGHT_GRID_X * LIGHT_GRID_Y;
+}
+
+//Same BRDF as the spot and directional light below, for every light of the fragment's cluster.
+vec3 clusteredLights(vec3 N, vec3 V, vec3 baseColour, vec3 f0, float roughness)
+{
+    SceneData sceneData = sceneBufferReference.sceneData;
+
+    uint cluster = lightCluster((sceneData.view * vPosition).xyz);
+    uint lightCount = sceneData.lightGridReference.counts[cluster];
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0; i < lightCount; ++i)
+    {
+        Light light = sceneData.lightReference.lights[sceneData.lightIndexReference.indices[cluster * LIGHT_CLUSTER_MAX_LIGHTS + i]];
+
+        vec3 posToLight = light.position - vPosition.xyz;
+        vec3 L = normalize(posToLight);
+        float cone = clamp(dot(-light.direction, L) * light.spotScale + light.spotOffset, 0.0, 1.0);
+        float attenuation = getSquareFalloffAttenuation(posToLight, 1.0 / light.radius) * cone * cone;
+
+        vec3 H = normalize(V + L);
+        float NoV = abs(dot(N, V)) + 1e-5;
+        float NoL = clamp(dot(N, L), 0.0, 1.0);
+        float NoH = clamp(dot(N, H), 0.0, 1.0);
+
+        vec3 Fd = baseColour * diffuseLambert();
+        float D = distributionGGX(NoH, roughness);
+        float G = visibilitySmithGGXCorrelated(NoL, NoV, roughness);
+        vec3 F = fresnelSchlick(clamp(dot(H, V), 0.0, 1.0), f0);
+
+        result += ((D * G) * F) * Fd * light.colour * (light.intensity * attenuation * NoL);
+    }
+
+    return result;
+}
+
 void main()
 {
+    MaterialData material = materialReference.materials[vMaterialIndex];
+
 //Only here to turn off lighting if I need it.
-//    if(textures.x != INVALID_TEXTURE_INDEX)
+//    if(material.textures.x != INVALID_TEXTURE_INDEX)
 //    {
-//        fragColour = texture(globalTextures[nonuniformEXT(textures.x)], vTexcoord0) * baseColourFactor;
+//        fragColour = texture(globalTextures[nonuniformEXT(material.textures.x)], vTexcoord0) * material.baseColourFactor;
 //        fragColour *= vColour;
 //    }
 //    else
@@ -246,14 +348,14 @@ void main()
     mat3 TBN = mat3(1.0);
     vec4 baseColour = vec4(0.5);
     baseColour.a = 1.f;
-    if(textures.x != INVALID_TEXTURE_INDEX)
+    if(material.textures.x != INVALID_TEXTURE_INDEX)
     {
-        baseColour = texture(globalTextures[nonuniformEXT(textures.x)], vTexcoord0) * baseColourFactor;
+        baseColour = texture(globalTextures[nonuniformEXT(material.textures.x)], vTexcoord0) * material.baseColourFactor;
     }
 
-    //bool useAlphaMask = (flags & DrawFlags_AlphaMask) != 0;
-    //if (useAlphaMask && baseColour.a < alphaCutoff)
-    if (baseColour.a < alphaCutoff)
+    //bool useAlphaMask = (material.flags & DrawFlags_AlphaMask) != 0;
+    //if (useAlphaMask && baseColour.a < material.alphaCutoff)
+    if (baseColour.a < material.alphaCutoff)
     {
         baseColour.a = 0.f;
     }
@@ -267,31 +369,33 @@ void main()
     vec3 V = normalize(sceneBufferReference.sceneData.eye.xyz - vPosition.xyz);
     vec3 L = normalize(sceneBufferReference.sceneData.light.xyz - vPosition.xyz);
     //NOTE: Normal textures are encoded to [0, 1] but we need it to be maped to [-1, 1] value.
-    if (textures.z != INVALID_TEXTURE_INDEX) 
+    if (material.textures.z != INVALID_TEXTURE_INDEX) 
     {
-        N = normalize(texture(globalTextures[nonuniformEXT(textures.z)], vTexcoord0).rgb * 2.0 - 1.0);
+        //Normal maps can be BC5 which only keeps x and y, z is rebuilt since tangent space normals always face out.
+        vec2 normalXY = texture(globalTextures[nonuniformEXT(material.textures.z)], vTexcoord0).rg * 2.0 - 1.0;
+        N = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
         N = normalize(TBN * N);
     }
     vec3 H = normalize(L + V);
 
-    float metalness = metallicRoughnessOcclusionFactor.x;
-    float roughness = metallicRoughnessOcclusionFactor.y;
+    float metalness = material.metallicRoughnessOcclusionFactor.x;
+    float roughness = material.metallicRoughnessOcclusionFactor.y;
 
-    if (textures.y != INVALID_TEXTURE_INDEX) 
+    if (material.textures.y != INVALID_TEXTURE_INDEX) 
     {
         //Red channel for occlusion value.
         //Green channel contains roughness values.
         //Blue channel contains metalness.
-        vec4 rm = texture(globalTextures[nonuniformEXT(textures.y)], vTexcoord0);
+        vec4 rm = texture(globalTextures[nonuniformEXT(material.textures.y)], vTexcoord0);
 
         roughness *= rm.g;
         metalness *= rm.b;
     } 
 
-    float occlusion = metallicRoughnessOcclusionFactor.z;
-    if (textures.w != INVALID_TEXTURE_INDEX) 
+    float occlusion = material.metallicRoughnessOcclusionFactor.z;
+    if (material.textures.w != INVALID_TEXTURE_INDEX) 
     {
-        vec4 o = texture(globalTextures[nonuniformEXT(textures.w)], vTexcoord0);
+        vec4 o = texture(globalTextures[nonuniformEXT(material.textures.w)], vTexcoord0);
         occlusion *= o.r;
     }
 
@@ -300,11 +404,11 @@ void main()
     baseColour.rgb = decodeSRGB(baseColour.rgb);
 
     vec3 emissive = vec3(0);
-    if (emissiveTextureIndex != INVALID_TEXTURE_INDEX) 
+    if (material.emissiveTextureIndex != INVALID_TEXTURE_INDEX) 
     {
-        vec4 e = texture(globalTextures[nonuniformEXT(emissiveTextureIndex)], vTexcoord0);
+        vec4 e = texture(globalTextures[nonuniformEXT(material.emissiveTextureIndex)], vTexcoord0);
 
-        emissive += decodeSRGB(e.rgb) * emissiveFactor;
+        emissive += decodeSRGB(e.rgb) * material.emissiveFactor;
     }
 
     vec3 lightDirection = vec3(1.f, -1.f, 10.f);
@@ -319,7 +423,7 @@ void main()
     //diffuse BRDF
     vec3 Fd = baseColour.rgb * diffuseLambert();
 
-    vec3 reflecence = (specularValue * specularValue) * 0.16;
+    vec3 reflecence = (material.specularValue * material.specularValue) * 0.16;
 
     //specular BRDF
     vec3 f0 = mix(vec3(0.04), baseColour.rgb, metalness);
@@ -336,7 +440,7 @@ void main()
     vec3 luminance = ((specular * Fd) * spotLightIntensity * NoL);
     vec3 luminance1 = ((specular * Fd) * directionalLightIntensity * NoL) * vec3(1.0, 0.867, 0.684);
 
-    vec3 lightOutput = luminance + luminance1;
+    vec3 lightOutput = luminance + luminance1 + clusteredLights(N, V, baseColour.rgb, f0, roughness);
 
     vec3 ambient = occlusion * (baseColour.rgb * 0.01);
 
@@ -5,24 +5,15 @@
 #extension GL_EXT_buffer_reference2 : require
 #extension GL_EXT_shader_16bit_storage: require
 #extension GL_EXT_shader_8bit_storage: require
+#extension GL_GOOGLE_include_directive : require
+
+#include "instanceData.h"
 
 struct Vertices
 {
     float px, py, pz;
 };
 
-//Here we are going to attempt full bindless for the debug renderer to make this as painless as possible in the future.
-struct ModelPosition
-{
-    mat4 pos; 
-    //all local nodes together needs to be the same as the collision geometry.
-    //Meaning that model matrix we get out of the actual geometry needs to be given to the debug geometry if they tied together when creating the buffer.
-    mat4 debugModel;
-    //Colour will be used as a key for various different objects.
-    vec4 colour;
-    float padd[4];
-};
-
 struct SceneData
 {
     mat4 view;
@@ -47,11 +38,17 @@ layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer Sce
     SceneData sceneData;
 };
 
+layout(scalar, buffer_reference) readonly buffer VisibleIndexData
+{
+    uint visibleIndices[];
+};
+
 layout(scalar, push_constant) uniform entityIndex
 {
     VertexData vertexDataReference;
     ModelPositionData modelPositionsReference;
     SceneBufferData sceneBufferReference;
+    VisibleIndexData visibleIndicesReference;
 };
 
 //Pipeline layout needs changing over the default one.
@@ -63,6 +60,10 @@ void main()
                          vertexDataReference.vertexData[gl_VertexIndex].py, 
                          vertexDataReference.vertexData[gl_VertexIndex].pz);
 
-    gl_Position = sceneBufferReference.sceneData.project * sceneBufferReference.sceneData.view * sceneBufferReference.sceneData.globalModel * modelPositionsReference.modelPositions[gl_InstanceIndex].pos * modelPositionsReference.modelPositions[gl_InstanceIndex].debugModel * vec4(position, 1.0);
-    vColour = modelPositionsReference.modelPositions[gl_InstanceIndex].colour;
+    uint instanceIndex = visibleIndicesReference.visibleIndices[gl_InstanceIndex];
+    ModelPosition instance = modelPositionsReference.modelPositions[instanceIndex];
+
+    //The collider geometry is a unit shape scaled up to the collision shape.
+    gl_Position = sceneBufferReference.sceneData.project * sceneBufferReference.sceneData.view * sceneBufferReference.sceneData.globalModel * instanceMatrix(instance) * vec4(position * instance.debugScale, 1.0);
+    vColour = instanceColour(instance);
 }
\ No newline at end of file
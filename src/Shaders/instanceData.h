@@ -0,0 +1,29 @@
+//Per entity data in the positional buffer, mirrors EntityData in ShaderData.hpp.
+//Packed on the CPU by packEntityTransform and packColour, 56 bytes an entity.
+struct ModelPosition
+{
+    //Rows of the 3x4 affine transform, the translation is in w.
+    vec4 rows[3];
+    //RGBA8 unorm, red in the lowest byte.
+    uint colour;
+    //Uniform scale of the debug collider, its geometry is a unit shape.
+    float debugScale;
+};
+
+mat4 instanceMatrix(ModelPosition instance)
+{
+    return mat4(vec4(instance.rows[0].x, instance.rows[1].x, instance.rows[2].x, 0.0),
+                vec4(instance.rows[0].y, instance.rows[1].y, instance.rows[2].y, 0.0),
+                vec4(instance.rows[0].z, instance.rows[1].z, instance.rows[2].z, 0.0),
+                vec4(instance.rows[0].w, instance.rows[1].w, instance.rows[2].w, 1.0));
+}
+
+vec3 instanceTranslation(ModelPosition instance)
+{
+    return vec3(instance.rows[0].w, instance.rows[1].w, instance.rows[2].w);
+}
+
+vec4 instanceColour(ModelPosition instance)
+{
+    return unpackUnorm4x8(instance.colour);
+}
@@ -1,3 +1,4 @@
+#include "Foundation/JobScheduler.hpp"
 #include "Foundation/Memory.hpp"
 #include "Foundation/Time.hpp"
 
@@ -20,6 +21,10 @@ int main(int argc, char** argv)
     timeServiceInit();
 
     HeapAllocator* allocator = &MemoryService::instance()->systemAllocator;
+
+    //The scheduler is built on Jolt's job system, so Jolt's allocation hooks have to be registered before it starts.
+    JPH::RegisterDefaultAllocator();
+    JobScheduler::instance()->init(allocator);
     StackAllocator scratchAllocator = MemoryService::instance()->scratchAllocator;
 
     Window::instance()->init(1280, 800, "Void Engine");
@@ -73,6 +78,8 @@ int main(int argc, char** argv)
     inputHandler.shutdown();
     Window::instance()->shutdown();
 
+    JobScheduler::instance()->shutdown();
+
     MemoryService::instance()->shutdown();
 
     return 0;